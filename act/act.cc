@@ -51,6 +51,8 @@ struct command_line_defs {
 
 int Act::max_recurse_depth;
 int Act::max_loop_iterations;
+int Act::bulk_loops;
+int Act::compile_functions;
 int Act::emit_depend;
 char *Act::_getopt_string;
 
@@ -288,6 +290,12 @@ int Act::_process_act_arg (const char *argvp, int *tech_specified, char **conf)
   else if (strncmp (argvp, "-lev=", 5) == 0) {
     Log::UpdateLogLevel(argvp+5);
   }
+  else if (strncmp (argvp, "-prof=", 6) == 0) {
+    if (!argvp[6]) {
+      fatal_error ("-prof option needs a file name");
+    }
+    ActPass::setProfile (argvp+6);
+  }
   else {
     return 0;
   }
@@ -318,6 +326,8 @@ void Act::Init (int *iargc, char ***iargv)
 
   config_set_default_int ("act.max_recurse_depth", 1000);
   config_set_default_int ("act.max_loop_iterations", 1000);
+  config_set_default_int ("act.bulk_loops", 1);
+  config_set_default_int ("act.compile_functions", 1);
   
 #define WARNING_FLAG(x,y) \
   config_set_default_int ("act.warn." #x, y);
@@ -408,6 +418,8 @@ void Act::Init (int *iargc, char ***iargv)
   
   Act::max_recurse_depth = config_get_int ("act.max_recurse_depth");
   Act::max_loop_iterations = config_get_int ("act.max_loop_iterations");
+  Act::bulk_loops = config_get_int ("act.bulk_loops");
+  Act::compile_functions = config_get_int ("act.compile_functions");
   Act::cmdline_args = NULL;
   
   return;
@@ -559,6 +571,10 @@ Act::Act (const char *s)
 
   gns = ActNamespace::global;
   tf = new TypeFactory();
+
+  mangle_conn = phash_new (4);
+  mangle_type = phash_new (4);
+  pthread_mutex_init (&mangle_lock, NULL);
   
   if (!s) {
     return;
@@ -707,6 +723,11 @@ Act::Act (const char *s)
   _free_tr (&tr);
 }
 
+Act::~Act ()
+{
+  _mangle_cache_free ();
+}
+
 void Act::Merge (const char *s)
 {
   act_Token *a;
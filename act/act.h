@@ -31,6 +31,7 @@
 #include <common/config.h>
 #include <map>
 #include <unordered_set>
+#include <pthread.h>
 
 /**
  * @file act.h
@@ -90,6 +91,18 @@ class Act {
    */
   static int max_loop_iterations;
 
+  /**
+   * 1 if simple loops can be expanded as range
+   * instances/connections
+   */
+  static int bulk_loops;
+
+  /**
+   * 1 if parameter functions are compiled to bytecode before they
+   * are evaluated
+   */
+  static int compile_functions;
+
 #define WARNING_FLAG(x,y) \
   static int x ;
 #include "warn.def"
@@ -201,6 +214,24 @@ class Act {
    */
   void mfprintfproc (FILE *fp, UserDef *, int omit_ns = 0);
 
+  /**
+   * Cached mangled name of the canonical ID for a connection. The
+   * string is owned by the Act object. This must only be used once
+   * all connections have been made, and is thread-safe.
+   * @param c is the connection
+   * @return the mangled name
+   */
+  const char *mangledName (act_connection *c);
+
+  /**
+   * Cached mangled name for a user-defined type, identical to the
+   * string produced by msnprintfproc(). Thread-safe.
+   * @param omit_ns is 1 if you don't want to include the namespace in
+   * the string
+   * @return the mangled name
+   */
+  const char *mangledName (UserDef *u, int omit_ns = 0);
+
   /* 
      API functions
   */
@@ -269,6 +300,11 @@ private:
   int mangle_min_idx;     /* index of the min of , . { } */
   int mangle_mode;
 
+  struct pHashtable *mangle_conn;  /* cached mangled connection names */
+  struct pHashtable *mangle_type;  /* cached mangled type names */
+  pthread_mutex_t mangle_lock;
+  void _mangle_cache_free ();
+
   static Log *L;
 
   struct Hashtable *passes;	// any ActPass-es
@@ -305,6 +341,12 @@ protected:
   
   virtual void _actual_update (Process *p);
 
+  // profile frame for an overridden run() method, so that work done
+  // before/after ActPass::run() is attributed to this pass. Returns
+  // the argument to pass to _prof_end().
+  int _prof_begin ();
+  void _prof_end (int frame);
+
 public:
   ActPass (Act *_a, const char *name, int doroot = 0);
   // Create, initialize, and register pass
@@ -346,6 +388,15 @@ public:
 
   static void refreshAll (Act *a, Process *p = NULL);
 
+  /*
+   * Record per-pass and per-type run times in memory, and write them
+   * to the specified file at exit. A file name ending in ".folded"
+   * uses the folded-stack format for flame graphs; otherwise the
+   * output is JSON. Enabled by the -prof=<file> command-line option.
+   */
+  static void setProfile (const char *file);
+  static void printProfile (FILE *fp, int folded = 0);
+
 private:
   /* -- called before sub-tree -- */
   virtual void *pre_op (Process *p, int mode = 0);
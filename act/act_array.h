@@ -164,6 +164,8 @@ class Array {
   int size(); /**< returns total number of elements */
   int range_size(int d); /**< returns size of a particular dimension */
   void update_range (int d, int lo, int hi); /**< set range */
+  void update_range (int d, Expr *lo, Expr *hi); /**< set range of an
+						    unexpanded array */
   int isrange (int d) { return (r[d].u.ex.isrange == 1); }
 
   /* only for unexpanded ranges */
@@ -251,6 +253,7 @@ public:
   int typesize() { return base->size(); }
 
   char *string(int style = 0);
+  void sPrint (char *buf, int sz, int style = 0);
   Array *toArray();
 
   void Print (FILE *fp, int style = 0);
@@ -303,6 +306,7 @@ class AExpr {
   /**< expand out all parameters */
 
   ActId *toid ();
+  Expr *toexpr ();		/**< NULL if this is not a base expr */
 
   int isBase() { return t == EXPR ? 1 : 0; }
 
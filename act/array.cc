@@ -795,6 +795,21 @@ void Array::update_range (int d, int lo, int hi)
   range_sz = -1;
 }
 
+/*
+ * Update range of an unexpanded array; the result is a sub-range
+ * rather than a dereference.
+ */
+void Array::update_range (int d, Expr *lo, Expr *hi)
+{
+  Assert (!expanded, "Huh?");
+  Assert (0 <= d && d < dims, "Invalid dimension");
+  Assert (!isSparse(), "Only applicable to dense arrays");
+
+  r[d].u.ue.lo = lo;
+  r[d].u.ue.hi = hi;
+  deref = 0;
+}
+
 /*
  * @return number of elements in the array
  */
@@ -1878,6 +1893,14 @@ ActId *AExpr::toid ()
   return (ActId *)e->u.e.l;
 }
 
+Expr *AExpr::toexpr ()
+{
+  if (t != AExpr::EXPR) {
+    return NULL;
+  }
+  return (Expr *)l;
+}
+
 
 int AExprstep::isSimpleID ()
 {
@@ -1941,40 +1964,37 @@ Array *Array::unOffset (int idx)
 
 char *Arraystep::string(int style)
 {
-  char *s, *t;
-  int i;
+  char *s;
 
   MALLOC (s, char, base->dims*20);
+  sPrint (s, base->dims*20, style);
+  return s;
+}
 
-  t = s;
+void Arraystep::sPrint (char *buf, int sz, int style)
+{
+  int i, k;
 
+  k = 0;
   if (style) {
-    t[0] = '[';
-    t[1] = '\0';
-    t++;
-  }      
-  else {
-    t[0] = '\0';
+    k += snprintf (buf+k, sz-k, "[");
   }
-
-  for (i=0; i < base->dims; i++) {
+  for (i=0; i < base->dims && k < sz; i++) {
     if (style) {
       if (i != base->dims-1) {
-	sprintf (t, "%d,", deref[i]);
+	k += snprintf (buf+k, sz-k, "%d,", deref[i]);
       }
       else {
-	sprintf (t, "%d", deref[i]);
+	k += snprintf (buf+k, sz-k, "%d", deref[i]);
       }
     }
     else {
-      sprintf (t, "[%d]", deref[i]);
+      k += snprintf (buf+k, sz-k, "[%d]", deref[i]);
     }
-    t += strlen (t);
   }
-  if (style) {
-    sprintf (t, "]");
+  if (style && k < sz) {
+    snprintf (buf+k, sz-k, "]");
   }
-  return s;
 }
 
 
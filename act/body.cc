@@ -1050,6 +1050,373 @@ void act_syn_loop_teardown (ActNamespace *ns, Scope *s,
 }
 
 
+/*
+ * Bulk loop expansion.
+ *
+ * A loop body with only instances and connections, where the loop
+ * variable only appears as a unit-stride array index (i, i+c, c+i,
+ * i-c with c loop-invariant), is expanded with one range
+ * instance/connection per statement instead of re-expanding the body
+ * for each iteration:
+ *
+ *    (;i:lo..hi: bool x[i..i];)    =>  bool x[lo..hi];
+ *    (;i:lo..hi: x[i] = y[i+1];)   =>  x[lo..hi] = y[lo+1..hi+1];
+ *
+ * Everything else is expanded one iteration at a time.
+ */
+
+/* 1 if e does not depend on the loop variable; conservative */
+static int _loop_invariant (Expr *e, const char *var)
+{
+  ActId *id;
+  
+  if (!e) return 1;
+
+  switch (e->type) {
+  case E_INT:
+  case E_TRUE:
+  case E_FALSE:
+  case E_REAL:
+    return 1;
+
+  case E_VAR:
+    id = (ActId *)e->u.e.l;
+    if (strcmp (id->getName(), var) == 0) {
+      return 0;
+    }
+    while (id) {
+      if (id->arrayInfo()) {
+	return 0;
+      }
+      id = id->Rest();
+    }
+    return 1;
+
+  case E_PLUS:
+  case E_MINUS:
+  case E_MULT:
+  case E_DIV:
+  case E_MOD:
+  case E_LSL:
+  case E_LSR:
+  case E_ASR:
+  case E_AND:
+  case E_OR:
+  case E_XOR:
+    return _loop_invariant (e->u.e.l, var) && _loop_invariant (e->u.e.r, var);
+
+  case E_UMINUS:
+  case E_NOT:
+  case E_COMPLEMENT:
+    return _loop_invariant (e->u.e.l, var);
+
+  default:
+    return 0;
+  }
+}
+
+/* 1 if e is var + c, c loop-invariant */
+static int _loop_unit_index (Expr *e, const char *var)
+{
+  ActId *id;
+  
+  if (!e) return 0;
+
+  switch (e->type) {
+  case E_VAR:
+    id = (ActId *)e->u.e.l;
+    return (!id->Rest() && !id->arrayInfo() &&
+	    strcmp (id->getName(), var) == 0) ? 1 : 0;
+
+  case E_PLUS:
+    return (_loop_unit_index (e->u.e.l, var) &&
+	    _loop_invariant (e->u.e.r, var)) ||
+      (_loop_invariant (e->u.e.l, var) &&
+       _loop_unit_index (e->u.e.r, var));
+
+  case E_MINUS:
+    return _loop_unit_index (e->u.e.l, var) &&
+      _loop_invariant (e->u.e.r, var);
+
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Return the dimension of "a" indexed by the loop variable, or -1 if
+ * there isn't exactly one or if any other dimension depends on
+ * it. For instances (isinst=1), the dimension must be a range i..i
+ * rather than a dereference.
+ */
+static int _loop_array_dim (Array *a, const char *var, int isinst)
+{
+  int d = -1;
+  
+  if (!a || a->isExpanded() || a->isSparse()) {
+    return -1;
+  }
+  for (int i=0; i < a->nDims(); i++) {
+    if (_loop_invariant (a->lo (i), var) &&
+	_loop_invariant (a->hi (i), var)) {
+      continue;
+    }
+    if (d != -1) {
+      return -1;
+    }
+    if (isinst) {
+      if (!a->lo (i) || !_loop_unit_index (a->lo (i), var) ||
+	  !_loop_unit_index (a->hi (i), var)) {
+	return -1;
+      }
+    }
+    else {
+      if (a->lo (i) || !_loop_unit_index (a->hi (i), var)) {
+	return -1;
+      }
+    }
+    d = i;
+  }
+  return d;
+}
+
+/*
+ * Sub-ranges are only permitted in the last part of an identifier,
+ * so that is where the loop variable has to be.
+ */
+static ActId *_loop_id_tail (ActId *id, const char *var, int *d)
+{
+  Array *a;
+  
+  while (id->Rest()) {
+    a = id->arrayInfo();
+    if (a) {
+      if (a->isExpanded()) {
+	return NULL;
+      }
+      for (int i=0; i < a->nDims(); i++) {
+	if (!_loop_invariant (a->lo (i), var) ||
+	    !_loop_invariant (a->hi (i), var)) {
+	  return NULL;
+	}
+      }
+    }
+    id = id->Rest();
+  }
+  *d = _loop_array_dim (id->arrayInfo(), var, 0);
+  if (*d == -1) {
+    return NULL;
+  }
+  return id;
+}
+
+/* index value on the first iteration */
+static int _loop_first_index (ActNamespace *ns, Scope *s, Expr *e, int *v)
+{
+  e = expr_expand (e, ns, s);
+  if (!e || e->type != E_INT) {
+    return 0;
+  }
+  *v = e->u.v;
+  return 1;
+}
+
+struct act_bulk_stmt {
+  ActBody *b;
+  int d[2];			/* dimension indexed by the loop
+				   variable: instance or lhs, rhs */
+  int v[2];			/* index on the first iteration */
+  ActId *id[2];			/* lhs, rhs of a connection */
+};
+
+/*
+ * Expand iterations ilo..ihi of the loop body in bulk. Returns 0 if
+ * the body has to be expanded one iteration at a time, in which case
+ * nothing has been expanded.
+ */
+static int _loop_bulk_expand (ActNamespace *ns, Scope *s, const char *var,
+			      ValueIdx *vx, ActBody *b, int ilo, int ihi)
+{
+  A_DECL (struct act_bulk_stmt, st);
+  ActBody_Inst *bi;
+  ActBody_Conn *bc;
+  ActBody *bx;
+  int ok = 1;
+  int nconn = 0;
+  int n = ihi - ilo + 1;
+
+  if (!Act::bulk_loops || n < 2) {
+    return 0;
+  }
+
+  A_INIT (st);
+
+  /* instances first, then connections */
+  s->setPInt (vx->u.idx, ilo);
+  for (bx = b; ok && bx; bx = bx->Next()) {
+    A_NEW (st, struct act_bulk_stmt);
+    A_NEXT (st).b = bx;
+    A_NEXT (st).id[0] = NULL;
+    A_NEXT (st).id[1] = NULL;
+    
+    if ((bi = dynamic_cast<ActBody_Inst *>(bx))) {
+      InstType *it = bi->getType();
+      Array *a = it->arrayInfo();
+      int vh;
+
+      if (nconn > 0) {
+	ok = 0;
+	break;
+      }
+      for (int k=0; k < it->getNumParams(); k++) {
+	inst_param *ip = &it->allParams()[k];
+	if (ip->isatype) {
+	  if (ip->u.tt) {
+	    ok = 0;
+	  }
+	}
+	else if (ip->u.tp) {
+	  if (!ip->u.tp->toexpr() ||
+	      !_loop_invariant (ip->u.tp->toexpr(), var)) {
+	    ok = 0;
+	  }
+	}
+      }
+      A_NEXT (st).d[0] = _loop_array_dim (a, var, 1);
+      if (!ok || A_NEXT (st).d[0] == -1 ||
+	  !_loop_first_index (ns, s, a->lo (A_NEXT (st).d[0]),
+			      &A_NEXT (st).v[0]) ||
+	  !_loop_first_index (ns, s, a->hi (A_NEXT (st).d[0]), &vh) ||
+	  vh != A_NEXT (st).v[0]) {
+	ok = 0;
+	break;
+      }
+    }
+    else if ((bc = dynamic_cast<ActBody_Conn *>(bx))) {
+      ActId *tail;
+      Expr *e;
+
+      nconn++;
+      if (!bc->isBasic()) {
+	ok = 0;
+	break;
+      }
+      e = bc->getRHS()->toexpr();
+      if (!e || e->type != E_VAR) {
+	ok = 0;
+	break;
+      }
+      A_NEXT (st).id[0] = bc->getLHS();
+      A_NEXT (st).id[1] = (ActId *)e->u.e.l;
+
+      /* parameter assignments are order dependent, and so is a
+	 connection within one array */
+      InstType *ct = s->FullLookup (A_NEXT (st).id[0]->getName());
+      if (!ct || TypeFactory::isParamType (ct) ||
+	  strcmp (A_NEXT (st).id[0]->getName(),
+		  A_NEXT (st).id[1]->getName()) == 0) {
+	ok = 0;
+	break;
+      }
+      for (int k=0; ok && k < 2; k++) {
+	tail = _loop_id_tail (A_NEXT (st).id[k], var, &A_NEXT (st).d[k]);
+	if (!tail ||
+	    !_loop_first_index (ns, s,
+				tail->arrayInfo()->hi (A_NEXT (st).d[k]),
+				&A_NEXT (st).v[k])) {
+	  ok = 0;
+	}
+      }
+    }
+    else {
+      ok = 0;
+    }
+    A_INC (st);
+  }
+
+  /*
+   * Check for dependences between statements that would be visible
+   * when the iterations are re-ordered:
+   *   - a connection to an array created in the loop must use the
+   *     same index, so it only refers to elements that exist in the
+   *     same iteration;
+   *   - two connections must not share an array, since the order of
+   *     connections breaks ties for the canonical name.
+   * (A connection within a single array and parameter assignments
+   * were already rejected above.)
+   */
+  for (int i=0; ok && i < A_LEN (st); i++) {
+    if (!st[i].id[0]) continue;
+    for (int j=0; ok && j < A_LEN (st); j++) {
+      if (i == j) continue;
+      for (int k=0; ok && k < 2; k++) {
+	const char *nm = st[i].id[k]->getName();
+	if (!st[j].id[0]) {
+	  bi = dynamic_cast<ActBody_Inst *>(st[j].b);
+	  if (strcmp (nm, bi->getName()) == 0 &&
+	      (st[i].id[k]->Rest() || st[i].d[k] != st[j].d[0] ||
+	       st[i].v[k] != st[j].v[0])) {
+	    ok = 0;
+	  }
+	}
+	else if (strcmp (nm, st[j].id[0]->getName()) == 0 ||
+		 strcmp (nm, st[j].id[1]->getName()) == 0) {
+	  ok = 0;
+	}
+      }
+    }
+  }
+
+  if (!ok) {
+    A_FREE (st);
+    return 0;
+  }
+
+  for (int i=0; i < A_LEN (st); i++) {
+    if (!st[i].id[0]) {
+      /* range instance */
+      bi = dynamic_cast<ActBody_Inst *>(st[i].b);
+      InstType *it = new InstType (bi->getType(), 1);
+      Array *a = bi->getType()->arrayInfo()->Clone();
+      a->update_range (st[i].d[0], const_expr (st[i].v[0]),
+		       const_expr (st[i].v[0] + n - 1));
+      it->MkArray (a);
+
+      ActBody_Inst tmp (it, bi->getName());
+      tmp.Expand (ns, s);
+      delete it;
+    }
+    else {
+      /* range connection */
+      ActId *cid[2];
+      for (int k=0; k < 2; k++) {
+	ActId *tail;
+	cid[k] = st[i].id[k]->Clone ();
+	tail = cid[k];
+	while (tail->Rest()) {
+	  tail = tail->Rest();
+	}
+	tail->arrayInfo()->update_range (st[i].d[k],
+					 const_expr (st[i].v[k]),
+					 const_expr (st[i].v[k] + n - 1));
+      }
+      Expr *e;
+      NEW (e, Expr);
+      e->type = E_VAR;
+      e->u.e.l = (Expr *)cid[1];
+      e->u.e.r = NULL;
+      AExpr *ae = new AExpr (e);
+
+      ActBody_Conn tmp (cid[0], ae);
+      tmp.Expand (ns, s);
+      delete cid[0];
+      delete ae;
+    }
+  }
+  A_FREE (st);
+  return 1;
+}
+
 void ActBody_Loop::Expand (ActNamespace *ns, Scope *s)
 {
   int ilo, ihi;
@@ -1059,9 +1426,11 @@ void ActBody_Loop::Expand (ActNamespace *ns, Scope *s)
 
   act_syn_loop_setup (ns, s, id, lo, hi, &vx, &ilo, &ihi);
 
-  for (; ilo <= ihi; ilo++) {
-    s->setPInt (vx->u.idx, ilo);
-    b->Expandlist (ns, s);
+  if (!_loop_bulk_expand (ns, s, id, vx, b, ilo, ihi)) {
+    for (; ilo <= ihi; ilo++) {
+      s->setPInt (vx->u.idx, ilo);
+      b->Expandlist (ns, s);
+    }
   }
 
   act_syn_loop_teardown (ns, s, id, vx);
@@ -116,6 +116,10 @@ class ActBody_Conn : public ActBody {
   void Expand (ActNamespace *, Scope *);
 
   ActBody *Clone();
+
+  int isBasic () { return type == 0 ? 1 : 0; }
+  ActId *getLHS () { return type == 0 ? u.basic.lhs : NULL; }
+  AExpr *getRHS () { return type == 0 ? u.basic.rhs : NULL; }
   
  private:
   union {
@@ -1226,6 +1226,13 @@ void act_mk_connection (UserDef *ux, ActId *id1, act_connection *c1,
 #endif
 }
 
+/* replace an attribute value; BigInt-valued ints are not shared */
+static void _attr_set (Expr **e, Expr *x)
+{
+  expr_ex_free (*e);
+  *e = x;
+}
+
 void act_merge_attributes (act_attr_t **x, act_attr *a)
 {
   act_attr_t *t, *prev;
@@ -1255,10 +1262,10 @@ void act_merge_attributes (act_attr_t **x, act_attr *a)
 	  else if (z[i][2] == '+') {
 	    /* sum */
 	    if (t->e->type == E_REAL) {
-	      t->e->u.f += a->e->u.f;
+	      _attr_set (&t->e, const_expr_real (t->e->u.f + a->e->u.f));
 	    }
 	    else if (t->e->type == E_INT) {
-	      t->e->u.v += a->e->u.v;
+	      _attr_set (&t->e, const_expr (t->e->u.v + a->e->u.v));
 	    }
 	    else {
 	      act_error_ctxt (stderr);
@@ -1269,13 +1276,12 @@ void act_merge_attributes (act_attr_t **x, act_attr *a)
 	    /* max */
 	    if (t->e->type == E_REAL) {
 	      if (t->e->u.f < a->e->u.f) {
-		t->e->u.f = a->e->u.f;
+		_attr_set (&t->e, const_expr_real (a->e->u.f));
 	      }
 	    }
 	    else if (t->e->type == E_INT) {
 	      if (t->e->u.v < a->e->u.v) {
-		t->e->u.v = a->e->u.v;
-		t->e->u.v_extra = NULL;
+		_attr_set (&t->e, const_expr (a->e->u.v));
 	      }
 	    }
 	    else {
@@ -1287,13 +1293,12 @@ void act_merge_attributes (act_attr_t **x, act_attr *a)
 	    /* min */
 	    if (t->e->type == E_REAL) {
 	      if (t->e->u.f > a->e->u.f) {
-		t->e->u.f = a->e->u.f;
+		_attr_set (&t->e, const_expr_real (a->e->u.f));
 	      }
 	    }
 	    else if (t->e->type == E_INT) {
 	      if (t->e->u.v > a->e->u.v) {
-		t->e->u.v = a->e->u.v;
-		t->e->u.v_extra = NULL;
+		_attr_set (&t->e, const_expr (a->e->u.v));
 	      }
 	    }
 	    else {
@@ -1304,7 +1309,7 @@ void act_merge_attributes (act_attr_t **x, act_attr *a)
 	  else if (z[i][2] == '|') {
 	    /* OR */
 	    if (t->e->type == E_INT) {
-	      t->e->u.v |= a->e->u.v;
+	      _attr_set (&t->e, const_expr (t->e->u.v | a->e->u.v));
 	    }
 	    else {
 	      act_error_ctxt (stderr);
@@ -1314,8 +1319,7 @@ void act_merge_attributes (act_attr_t **x, act_attr *a)
 	  else if (z[i][2] == '&') {
 	    /* AND */
 	    if (t->e->type == E_INT) {
-	      t->e->u.v &= a->e->u.v;
-	      t->e->u.v_extra = NULL;
+	      _attr_set (&t->e, const_expr (t->e->u.v & a->e->u.v));
 	    }
 	    else {
 	      act_error_ctxt (stderr);
@@ -1324,7 +1328,8 @@ void act_merge_attributes (act_attr_t **x, act_attr *a)
 	  }
 	  else if (z[i][2] == 'h') {
 	    /* hierarchy: override! */
-	    t->e->u = a->e->u;
+	    _attr_set (&t->e, a->e);
+	    a->e = NULL;
 	  }
 	  else if (z[i][2] == 'H') {
 	    /* inv hierarchy: skip */
@@ -1352,7 +1357,7 @@ void act_merge_attributes (act_attr_t **x, act_attr *a)
 	}
 	t = a;
 	a = a->next;
-	FREE (t->e);
+	expr_ex_free (t->e);
 	FREE (t);
       }
     }
@@ -1481,10 +1486,13 @@ act_connection *act_connection::primary()
   }
   root = tmp;
 
-  /* flatten connection */
+  /* flatten connection; no stores once the path is compressed, so
+     concurrent calls on a compressed structure are read-only */
   while (c->up) {
     tmp = c->up;
-    c->up = root;
+    if (tmp != root) {
+      c->up = root;
+    }
     c = tmp;
   }
   return root;
@@ -33,7 +33,8 @@ struct err_ctxt {
   struct err_ctxt *next;
 };
 
-static struct err_ctxt *hd = NULL;
+/* per-thread, so that parallel passes can maintain their own context */
+static thread_local struct err_ctxt *hd = NULL;
 
 void act_error_push (const char *s, const char *file, int line)
 {
@@ -26,6 +26,8 @@
 #include <act/value.h>
 #include <act/lang.h>
 #include <common/int.h>
+#include <common/hash.h>
+#include <stdlib.h>
 #include <string.h>
 #include <string>
 
@@ -571,7 +573,10 @@ static int expr_args_equal (const Expr *a, const Expr *b)
 }
 
 /**
- *  Compare two expressions structurally for equality
+ *  Compare two expressions structurally for equality. Shared
+ *  constants from TypeFactory::NewExpr() are caught by the pointer
+ *  test; other nodes are not hash-consed, so they are compared by
+ *  walking both trees.
  *
  *  \param a First expression to be compared
  *  \param b Second expression to be compared
@@ -877,6 +882,158 @@ int expr_equal (const Expr *a, const Expr *b)
   return 0;
 }
 
+/*------------------------------------------------------------------------
+ *
+ *  Expression arena
+ *
+ *  _expr_expand() creates a node for every sub-expression it visits,
+ *  and most of them are immediately folded into (shared) constants.
+ *  Those working nodes are taken from a stack of fixed-size chunks
+ *  rather than the heap. expr_expand() copies whatever survives to
+ *  the heap and pops the arena back to where it started, so nested
+ *  calls are fine.
+ *
+ *  Chunks are aligned to their size, so the chunk holding a node is
+ *  found by masking its address; the set of chunk addresses tells the
+ *  free paths whether a node belongs to the arena.
+ *
+ *------------------------------------------------------------------------
+ */
+#define EXPR_ARENA_BYTES (1 << 17)
+#define EXPR_ARENA_CHUNK \
+  ((EXPR_ARENA_BYTES - sizeof (void *))/sizeof (Expr))
+
+struct expr_arena_chunk {
+  struct expr_arena_chunk *next;
+  Expr n[EXPR_ARENA_CHUNK];
+};
+
+static thread_local struct expr_arena_chunk *_arena_hd = NULL;
+static thread_local struct expr_arena_chunk *_arena_cur = NULL;
+static thread_local int _arena_pos = 0;
+static thread_local struct pHashtable *_arena_chunks = NULL;
+
+static struct expr_arena_chunk *_expr_arena_chunk_new (void)
+{
+  void *v;
+
+  if (posix_memalign (&v, EXPR_ARENA_BYTES,
+		      sizeof (struct expr_arena_chunk)) != 0) {
+    fatal_error ("expr_expand: could not allocate arena chunk");
+  }
+  if (!_arena_chunks) {
+    _arena_chunks = phash_new (4);
+  }
+  phash_add (_arena_chunks, v);
+  ((struct expr_arena_chunk *)v)->next = NULL;
+  return (struct expr_arena_chunk *)v;
+}
+
+static Expr *_expr_arena_alloc (void)
+{
+  if (!_arena_cur) {
+    if (!_arena_hd) {
+      _arena_hd = _expr_arena_chunk_new ();
+    }
+    _arena_cur = _arena_hd;
+    _arena_pos = 0;
+  }
+  if (_arena_pos == EXPR_ARENA_CHUNK) {
+    if (!_arena_cur->next) {
+      _arena_cur->next = _expr_arena_chunk_new ();
+    }
+    _arena_cur = _arena_cur->next;
+    _arena_pos = 0;
+  }
+  return &_arena_cur->n[_arena_pos++];
+}
+
+static int _expr_in_arena (const Expr *e)
+{
+  if (!_arena_chunks) {
+    return 0;
+  }
+  return phash_lookup (_arena_chunks, (void *)
+		       ((unsigned long)e & ~(unsigned long)(EXPR_ARENA_BYTES-1)))
+    ? 1 : 0;
+}
+
+/* free a working node that has been folded away */
+static void _expr_tmp_free (Expr *e)
+{
+  if (!e || _expr_in_arena (e) || TypeFactory::isSharedExpr (e)) {
+    return;
+  }
+  FREE (e);
+}
+
+/*
+ *  Copy all arena nodes reachable from e to the heap; returns the new
+ *  root.
+ */
+static Expr *_expr_promote (Expr *e)
+{
+  Expr *x, *f;
+
+  if (!e) return NULL;
+
+  if (_expr_in_arena (e)) {
+    NEW (x, Expr);
+    *x = *e;
+    e = x;
+  }
+
+  switch (e->type) {
+  case E_INT:
+  case E_REAL:
+  case E_TRUE:
+  case E_FALSE:
+  case E_VAR:
+  case E_PROBE:
+  case E_SELF:
+  case E_TYPE:
+  case E_ARRAY:
+  case E_SUBRANGE:
+    break;
+
+  case E_FUNCTION:
+    for (f = e->u.fn.r; f; f = f->u.e.r) {
+      x = _expr_promote (f->u.e.l);
+      if (x != f->u.e.l) {
+	f->u.e.l = x;
+      }
+    }
+    break;
+
+  case E_BITFIELD:
+    /* u.e.l is an id; u.e.r holds the bit range */
+    f = e->u.e.r;
+    if (f) {
+      x = _expr_promote (f->u.e.l);
+      if (x != f->u.e.l) {
+	f->u.e.l = x;
+      }
+      x = _expr_promote (f->u.e.r);
+      if (x != f->u.e.r) {
+	f->u.e.r = x;
+      }
+    }
+    break;
+
+  default:
+    x = _expr_promote (e->u.e.l);
+    if (x != e->u.e.l) {
+      e->u.e.l = x;
+    }
+    x = _expr_promote (e->u.e.r);
+    if (x != e->u.e.r) {
+      e->u.e.r = x;
+    }
+    break;
+  }
+  return e;
+}
+
 int _act_chp_is_synth_flag = 0;
 
 static void _eval_function (ActNamespace *ns, Scope *s, Expr *fn, Expr **ret,
@@ -935,7 +1092,7 @@ static void _eval_function (ActNamespace *ns, Scope *s, Expr *fn, Expr **ret,
       Assert (expr_is_a_const (args[i]), "Argument is not a constant?");
     }
     e = x->eval (ns, nargs, args);
-    FREE (*ret);
+    _expr_tmp_free (*ret);
     *ret = e;
     if (nargs > 0) {
       FREE (args);
@@ -990,7 +1147,7 @@ static Expr *_expr_expand (int *width, Expr *e,
   
   if (!e) return NULL;
 
-  NEW (ret, Expr);
+  ret = _expr_arena_alloc ();
   ret->type = e->type;
   ret->u.e.l = NULL;
   ret->u.e.r = NULL;
@@ -1105,7 +1262,7 @@ static Expr *_expr_expand (int *width, Expr *e,
       else {
 	if (count == 1) {
 	  Expr *tmp = ret->u.e.l;
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp;
 	}
       }
@@ -1136,8 +1293,8 @@ static Expr *_expr_expand (int *width, Expr *e,
 	    *l ^= (*r);
 	  }
 	  delete r;
-	  FREE (ret->u.e.r);
-	  FREE (ret->u.e.l);
+	  _expr_tmp_free (ret->u.e.r);
+	  _expr_tmp_free (ret->u.e.l);
 	  ret->type = E_INT;
 	  ret->u.v_extra = l;
 	  ret->u.v = l->getVal (0);
@@ -1162,7 +1319,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  ret->u.v_extra = NULL;
 
 	  tmp = TypeFactory::NewExpr (ret);
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp;
 	}
       }
@@ -1189,7 +1346,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	}
 
 	tmp = TypeFactory::NewExpr (ret);
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = tmp;
       }
       else {
@@ -1216,7 +1373,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	    (!ce->u.v_extra || ((BigInt *)ce->u.v_extra)->isZero())) {
 	  if (pc) {
 	    /* return 0 */
-	    FREE (ret);
+	    _expr_tmp_free (ret);
 	    ret = ce;
 	    if (ce->u.v_extra) {
 	      ((BigInt *)ce->u.v_extra)->setWidth (*width);
@@ -1225,13 +1382,13 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  }
 	}
 	else if (ce->type == E_TRUE) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = re;
 	}
 	else if (ret->u.e.l->type == E_FALSE) {
 	  if (pc) {
 	    /* return false */
-	    FREE (ret);
+	    _expr_tmp_free (ret);
 	    ret = ce;
 	    /* XXX: free re */
 	  }
@@ -1240,19 +1397,19 @@ static Expr *_expr_expand (int *width, Expr *e,
       else if (e->type == E_OR) {
 	if (ce->type == E_INT && ce->u.v == 0 &&
 	    (!ce->u.v_extra || ((BigInt *)ce->u.v_extra)->isZero())) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = re;
 	}
 	else if (ce->type == E_TRUE) {
 	  if (pc) {
 	    /* return true */
-	    FREE (ret);
+	    _expr_tmp_free (ret);
 	    ret = ce;
 	    /* XXX: free re */
 	  }
 	}
 	else if (ret->u.e.l->type == E_FALSE) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = re;
 	}
       }
@@ -1323,8 +1480,8 @@ static Expr *_expr_expand (int *width, Expr *e,
 	    (*l).toUnsigned ();
 	  }
 	  delete r;
-	  FREE (ret->u.e.r);
-	  FREE (ret->u.e.l);
+	  _expr_tmp_free (ret->u.e.r);
+	  _expr_tmp_free (ret->u.e.l);
 	  ret->type = E_INT;
 	  ret->u.v_extra = l;
 	  ret->u.v = l->getVal (0);
@@ -1366,7 +1523,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  ret->u.v_extra = NULL;
 
 	  tmp = TypeFactory::NewExpr (ret);
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp;
 	}
       }
@@ -1391,10 +1548,13 @@ static Expr *_expr_expand (int *width, Expr *e,
 	else if (e->type == E_DIV) {
 	  v = v / VAL(ret->u.e.r);
 	}
-	if (ret->u.e.l->type != E_INT) FREE (ret->u.e.l);
-	if (ret->u.e.r->type != E_INT) FREE (ret->u.e.r);
+	if (ret->u.e.l->type != E_INT) _expr_tmp_free (ret->u.e.l);
+	if (ret->u.e.r->type != E_INT) _expr_tmp_free (ret->u.e.r);
 	ret->type = E_REAL;
 	ret->u.f = v;
+	tmp = TypeFactory::NewExpr (ret);
+	_expr_tmp_free (ret);
+	ret = tmp;
       }
       else {
 	act_error_ctxt (stderr);
@@ -1417,12 +1577,12 @@ static Expr *_expr_expand (int *width, Expr *e,
 	re = ret->u.e.l;
       }
       if (e->type == E_PLUS && VAL(ce) == 0) {
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = re;
       }
       else if (e->type == E_MINUS && VAL(ce) == 0) {
 	if (ce == ret->u.e.r) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = re;
 	}
 	else {
@@ -1433,7 +1593,7 @@ static Expr *_expr_expand (int *width, Expr *e,
       }
       else if (e->type == E_MULT && VAL(ce) == 0) {
 	if (pc) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = ce;
 	  if (ce->type == E_INT && ce->u.v_extra) {
 	    ((BigInt *)ce->u.v_extra)->setWidth (*width);
@@ -1442,12 +1602,12 @@ static Expr *_expr_expand (int *width, Expr *e,
 	}
       }
       else if (e->type == E_MULT && VAL(ce) == 1) {
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = re;
       }
       else if (e->type == E_DIV && VAL(ce) == 0 && (ce == ret->u.e.l)) {
 	if (pc) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = ce;
 	  if (ce->type == E_INT && ce->u.v_extra) {
 	    ((BigInt *)ce->u.v_extra)->setWidth (*width);
@@ -1456,12 +1616,12 @@ static Expr *_expr_expand (int *width, Expr *e,
 	}
       }
       else if (e->type == E_DIV && VAL(ce) == 1 && (ce == ret->u.e.r)) {
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = re;
       }
       else if (e->type == E_MOD && VAL(ce) == 0 && (ce == ret->u.e.l)) {
 	if (pc) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = ce;
 	  if (ce->type == E_INT && ce->u.v_extra) {
 	    ((BigInt *)ce->u.v_extra)->setWidth (*width);
@@ -1508,8 +1668,8 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  }
 	  delete l;
 	  delete r;
-	  FREE (ret->u.e.l);
-	  FREE (ret->u.e.r);
+	  _expr_tmp_free (ret->u.e.l);
+	  _expr_tmp_free (ret->u.e.r);
 	  if (res) {
 	    ret->type = E_TRUE;
 	  }
@@ -1517,7 +1677,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	    ret->type = E_FALSE;
 	  }
 	  tmp = TypeFactory::NewExpr (ret);
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp;
 	}
 	else {
@@ -1552,7 +1712,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  }
 
 	  tmp = TypeFactory::NewExpr (ret);
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp;
 	}
       }
@@ -1578,8 +1738,8 @@ static Expr *_expr_expand (int *width, Expr *e,
 	else { /* NE */
 	  v = (v != ret->u.e.r->u.f ? 1 : 0);
 	}
-	FREE (ret->u.e.l);
-	FREE (ret->u.e.r);
+	_expr_tmp_free (ret->u.e.l);
+	_expr_tmp_free (ret->u.e.r);
 	if (v) {
 	  ret->type = E_TRUE;
 	}
@@ -1588,7 +1748,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	}
 
 	tmp = TypeFactory::NewExpr (ret);
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = tmp;
       }
       else {
@@ -1611,14 +1771,14 @@ static Expr *_expr_expand (int *width, Expr *e,
 	ret->type = E_FALSE;
 
 	tmp = TypeFactory::NewExpr (ret);
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = tmp;
       }
       else if (ret->u.e.l->type == E_FALSE) {
 	//FREE (ret->u.e.l);
 	ret->type = E_TRUE;
 	tmp = TypeFactory::NewExpr (ret);
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = tmp;
       }
       else {
@@ -1640,21 +1800,21 @@ static Expr *_expr_expand (int *width, Expr *e,
 	//FREE (ret->u.e.l);
 	ret->type = E_FALSE;
 	tmp = TypeFactory::NewExpr (ret);
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = tmp;
       }
       else if (ret->u.e.l->type == E_FALSE) {
 	//FREE (ret->u.e.l);
 	ret->type = E_TRUE;
 	tmp = TypeFactory::NewExpr (ret);
-	FREE (ret);
+	_expr_tmp_free (ret);
 	ret = tmp;
       }
       else if (ret->u.e.l->type == E_INT) {
 	if (ret->u.e.l->u.v_extra) {
 	  BigInt *l = (BigInt *)ret->u.e.l->u.v_extra;
 	  *l = ~(*l);
-	  FREE (ret->u.e.l);
+	  _expr_tmp_free (ret->u.e.l);
 	  ret->type = E_INT;
 	  ret->u.v_extra = l;
 	  ret->u.v = l->getVal (0);
@@ -1666,7 +1826,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  ret->u.v = ~v;
 	  ret->u.v_extra = NULL;
 	  tmp = TypeFactory::NewExpr (ret);
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp;
 	}
       }
@@ -1691,7 +1851,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  l->toSigned ();
 	  *l = -(*l);
 	  l->toUnsigned ();
-	  FREE (ret->u.e.l);
+	  _expr_tmp_free (ret->u.e.l);
 	  ret->type = E_INT;
 	  ret->u.v_extra = l;
 	  ret->u.v = l->getVal (0);
@@ -1703,15 +1863,18 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  ret->u.v = -v;
 	  ret->u.v_extra = NULL;
 	  tmp = TypeFactory::NewExpr (ret);
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp;
 	}
       }
       else if (ret->u.e.l->type == E_REAL) {
 	double f = ret->u.e.l->u.f;
-	FREE (ret->u.e.l);
+	_expr_tmp_free (ret->u.e.l);
 	ret->type = E_REAL;
 	ret->u.f = -f;
+	tmp = TypeFactory::NewExpr (ret);
+	_expr_tmp_free (ret);
+	ret = tmp;
       }
       else {
 	act_error_ctxt (stderr);
@@ -1737,8 +1900,8 @@ static Expr *_expr_expand (int *width, Expr *e,
 	    (tmp->u.e.l->type == E_FALSE && tmp->u.e.r->type == E_FALSE) ||
 	    (VAL(tmp->u.e.l) == VAL(tmp->u.e.r))) {
 	  /* XXX need to free ret->u.e.l */
-	  FREE (ret);
-	  FREE (tmp);
+	  _expr_tmp_free (ret);
+	  _expr_tmp_free (tmp);
 	  ret = ce;
 	  if (ce->type == E_INT && ce->u.v_extra) {
 	    ((BigInt *)ce->u.v_extra)->setWidth (*width);
@@ -1751,16 +1914,16 @@ static Expr *_expr_expand (int *width, Expr *e,
       if (expr_is_a_const (tmp->u.e.l) && expr_is_a_const (tmp->u.e.r)) {
 	//FREE (ret->u.e.l);
 	if (ret->u.e.l->type == E_TRUE) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp->u.e.l;
 	  expr_ex_free (tmp->u.e.r);
-	  FREE (tmp);
+	  _expr_tmp_free (tmp);
 	}
 	else if (ret->u.e.l->type == E_FALSE) {
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp->u.e.r;
 	  expr_ex_free (tmp->u.e.l);
-	  FREE (tmp);
+	  _expr_tmp_free (tmp);
 	}
 	else {
 	  act_error_ctxt (stderr);
@@ -1804,7 +1967,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	    expr_ex_free (te);
 	  }
 	  else {
-	    FREE (te);
+	    _expr_tmp_free (te);
 	  }
 	}
 	else {
@@ -1922,7 +2085,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 
 	if (ltmp) {
 	  *ltmp >>= lov;
-	  FREE (ret->u.e.l);
+	  _expr_tmp_free (ret->u.e.l);
 	  ltmp->setWidth (hiv-lov+1);
 	  ret->u.v_extra = ltmp;
 	  ret->u.v = ltmp->getVal (0);
@@ -1930,7 +2093,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	else {
 	  ret->u.v_extra = NULL;
 	  tmp = TypeFactory::NewExpr (ret);
-	  FREE (ret);
+	  _expr_tmp_free (ret);
 	  ret = tmp;
 	}
 	*width = (hiv - lov + 1);
@@ -1960,13 +2123,13 @@ static Expr *_expr_expand (int *width, Expr *e,
 	  if (ret->u.e.l->u.v) {
 	    ret->type = E_TRUE;
 	    tmp = TypeFactory::NewExpr (ret);
-	    FREE (ret);
+	    _expr_tmp_free (ret);
 	    ret = tmp;
 	  }
 	  else {
 	    ret->type = E_FALSE;
 	    tmp = TypeFactory::NewExpr (ret);
-	    FREE (ret);
+	    _expr_tmp_free (ret);
 	    ret = tmp;
 	  }
 	}
@@ -1976,7 +2139,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	    ret->u.v = 1;
             ret->u.v_extra = NULL;
 	    tmp = TypeFactory::NewExpr (ret);
-	    FREE (ret);
+	    _expr_tmp_free (ret);
 	    ret = tmp;
 	  }
 	  else {
@@ -1984,7 +2147,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 	    ret->u.v = 0;
             ret->u.v_extra = NULL;
 	    tmp = TypeFactory::NewExpr (ret);
-	    FREE (ret);
+	    _expr_tmp_free (ret);
 	    ret = tmp;
 	  }
 	}
@@ -2000,7 +2163,7 @@ static Expr *_expr_expand (int *width, Expr *e,
 
 	if (ret->u.e.l->u.v_extra) {
 	  l = (BigInt *)ret->u.e.l->u.v_extra;
-	  FREE (ret->u.e.l);
+	  _expr_tmp_free (ret->u.e.l);
 	  ret->type = E_INT;
 	  l->setWidth (_width);
 	  ret->u.v_extra = l;
@@ -2184,7 +2347,7 @@ static Expr *_expr_expand (int *width, Expr *e,
       if (te->type != E_VAR) {
 	delete xid;
       }
-      FREE (ret);
+      _expr_tmp_free (ret);
       ret = te;
     }
     break;
@@ -2210,7 +2373,7 @@ static Expr *_expr_expand (int *width, Expr *e,
     }
     else {
       tmp = TypeFactory::NewExpr (ret);
-      FREE (ret);
+      _expr_tmp_free (ret);
       ret = tmp;
     }
     break;
@@ -2218,6 +2381,9 @@ static Expr *_expr_expand (int *width, Expr *e,
   case E_REAL:
     LVAL_ERROR;
     ret->u.f = e->u.f;
+    tmp = TypeFactory::NewExpr (ret);
+    _expr_tmp_free (ret);
+    ret = tmp;
     *width = 64;
     break;
 
@@ -2226,7 +2392,7 @@ static Expr *_expr_expand (int *width, Expr *e,
     LVAL_ERROR;
 
     tmp = TypeFactory::NewExpr (ret);
-    FREE (ret);
+    _expr_tmp_free (ret);
     ret = tmp;
     *width = 1;
     break;
@@ -2242,7 +2408,7 @@ static Expr *_expr_expand (int *width, Expr *e,
     if (te->type != E_VAR) {
       delete xid;
     }
-    FREE (ret);
+    _expr_tmp_free (ret);
     ret = te;
     *width = 0;
     break;
@@ -2283,7 +2449,36 @@ static Expr *_expr_expand (int *width, Expr *e,
 Expr *expr_expand (Expr *e, ActNamespace *ns, Scope *s, unsigned int flags)
 {
   int w;
-  return _expr_expand (&w, e, ns, s, flags);
+  struct expr_arena_chunk *c;
+  int pos;
+  Expr *ret;
+
+  c = _arena_cur;
+  pos = _arena_pos;
+  ret = _expr_promote (_expr_expand (&w, e, ns, s, flags));
+  _arena_cur = c;
+  _arena_pos = pos;
+  return ret;
+}
+
+/*------------------------------------------------------------------------
+ *  Return arena chunks beyond the first one to the heap. Only has an
+ *  effect when no expansion is in progress.
+ *------------------------------------------------------------------------
+ */
+void expr_expand_release (void)
+{
+  struct expr_arena_chunk *c;
+
+  if (_arena_cur || !_arena_hd) {
+    return;
+  }
+  while (_arena_hd->next) {
+    c = _arena_hd->next;
+    _arena_hd->next = c->next;
+    phash_delete (_arena_chunks, c);
+    free (c);
+  }
 }
 
 /*------------------------------------------------------------------------
@@ -2350,7 +2545,12 @@ AExpr::~AExpr ()
   else {
     /* YYY: hmm... expression memory management */
     Expr *e = (Expr *)l;
-    if (e->type == E_SUBRANGE || e->type == E_TYPE || e->type == E_ARRAY || e->type == E_SELF || e->type == E_REAL) {
+    if (e->type == E_REAL) {
+      if (!TypeFactory::isSharedExpr (e)) {
+	FREE (e);
+      }
+    }
+    else if (e->type == E_SUBRANGE || e->type == E_TYPE || e->type == E_ARRAY || e->type == E_SELF) {
       FREE (e);
     }
     else if (e->type == E_VAR) {
@@ -2562,10 +2762,11 @@ static void efree_ex (Expr *e)
     break;
   }
   if (e->type == E_TRUE || e->type == E_FALSE ||
-      (e->type == E_INT && !e->u.v_extra)) {
+      (e->type == E_INT && !e->u.v_extra) ||
+      (e->type == E_REAL && TypeFactory::isSharedExpr (e))) {
     /* cached */
   }
-  else {
+  else if (!_expr_in_arena (e)) {
      FREE (e);
   }
   return;
@@ -0,0 +1,1028 @@
+/*************************************************************************
+ *
+ *  This file is part of the ACT library
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <string.h>
+#include <act/act.h>
+#include <act/types.h>
+#include <act/body.h>
+#include <common/misc.h>
+#include <common/hash.h>
+#include <common/array.h>
+
+/*------------------------------------------------------------------------
+ *
+ *  Compiled parameter functions
+ *
+ *  The chp body of a parameter function is compiled once into
+ *  register bytecode. Parameters, self, and local pint/pbool/preal
+ *  variables live in fixed registers; expression temporaries and
+ *  loop counters are allocated above them as a stack. Every operation
+ *  follows the constant-folding rules of expr_expand(), so the result
+ *  is the same as interpreting the body against the function scope.
+ *
+ *  Compilation fails (and the function is interpreted) for:
+ *  array and dotted variables, locals that are arrays or have an
+ *  initializer, replicated guards in selections and loops, loop
+ *  indices that shadow another name, templated calls, operators on
+ *  mixed types other than int/real + - * /, comparisons between
+ *  different types or of bools, and any other expression kind
+ *  (bitfields, concatenation, ...). At run-time, reading a variable
+ *  that has not been assigned abandons the compiled code and re-runs
+ *  the function with the interpreter, so that the error reporting
+ *  (or partial-evaluation result) is unchanged.
+ *
+ *------------------------------------------------------------------------
+ */
+
+union act_fval {
+  long i;			// pint, pbool
+  double f;			// preal
+};
+
+#define FT_INT  0
+#define FT_BOOL 1
+#define FT_REAL 2
+
+enum act_fop {
+  FOP_DONE,
+  FOP_CONST,			// dst := k
+  FOP_CHK,			// a must be assigned
+  FOP_UNSET,			// a is not assigned
+  FOP_SET,			// dst := a, assigned
+  FOP_TRUNC,			// dst := (int) a, assigned
+  FOP_INC,			// dst := dst + 1
+
+  FOP_ADD, FOP_SUB, FOP_MUL, FOP_DIV, FOP_MOD,
+  FOP_LSL, FOP_LSR, FOP_ASR,
+  FOP_AND, FOP_OR, FOP_XOR,
+  FOP_LT, FOP_GT, FOP_LE, FOP_GE, FOP_EQ, FOP_NE,
+  FOP_NOT, FOP_COMPL, FOP_NEG,
+
+  FOP_FADD, FOP_FSUB, FOP_FMUL, FOP_FDIV,
+  FOP_FLT, FOP_FGT, FOP_FLE, FOP_FGE, FOP_FEQ, FOP_FNE,
+  FOP_FNEG, FOP_I2F,
+
+  FOP_QUERY,			// dst := a ? b : c
+  FOP_CALL,			// dst := fn[a] (args[b .. b+c-1])
+
+  FOP_JMP,			// goto dst
+  FOP_JZ,			// if !a goto dst
+  FOP_JNZ,			// if a goto dst
+  FOP_LOOPCHK,			// a is the iteration count
+  FOP_NOGUARD			// all guards false
+};
+
+typedef struct {
+  unsigned char op;
+  int dst, a, b, c;
+  union act_fval k;
+} act_finsn_t;
+
+struct act_fprog {
+  A_DECL (act_finsn_t, code);
+  A_DECL (Function *, fn);	// called functions
+  A_DECL (int, args);		// argument registers for calls
+  A_DECL (unsigned char, argt);	// ... and their types
+  int nparams;
+  unsigned char *pt;		// parameter types
+  int self;			// register for self
+  unsigned char rett;		// type of self
+  int nregs;
+};
+
+/* registers kept on the stack during evaluation */
+#define ACT_FREGS 64
+
+
+/*-- compilation --*/
+
+struct act_fcomp {
+  struct act_fprog *p;
+  struct Hashtable *H;		// variable name -> register
+  A_DECL (unsigned char, ty);	// register types
+  int sp;			// next free register
+  int fail;
+};
+
+static int _ftype (InstType *it)
+{
+  if (!it || it->arrayInfo()) {
+    return -1;
+  }
+  if (TypeFactory::isPIntType (it)) {
+    return FT_INT;
+  }
+  if (TypeFactory::isPBoolType (it)) {
+    return FT_BOOL;
+  }
+  if (TypeFactory::isPRealType (it)) {
+    return FT_REAL;
+  }
+  return -1;
+}
+
+static int _fc_alloc (struct act_fcomp *fc, int ty)
+{
+  int r = fc->sp++;
+  if (r == A_LEN (fc->ty)) {
+    A_APPEND (fc->ty, unsigned char, ty);
+  }
+  else {
+    fc->ty[r] = ty;
+  }
+  if (fc->sp > fc->p->nregs) {
+    fc->p->nregs = fc->sp;
+  }
+  return r;
+}
+
+static int _fc_emit (struct act_fcomp *fc, int op, int dst,
+		     int a = 0, int b = 0, int c = 0)
+{
+  struct act_fprog *p = fc->p;
+  A_NEW (p->code, act_finsn_t);
+  A_NEXT (p->code).op = op;
+  A_NEXT (p->code).dst = dst;
+  A_NEXT (p->code).a = a;
+  A_NEXT (p->code).b = b;
+  A_NEXT (p->code).c = c;
+  A_NEXT (p->code).k.i = 0;
+  A_INC (p->code);
+  return A_LEN (p->code) - 1;
+}
+
+static int _fc_var (struct act_fcomp *fc, const char *name)
+{
+  hash_bucket_t *b = hash_lookup (fc->H, name);
+  if (!b) {
+    fc->fail = 1;
+    return 0;
+  }
+  return b->i;
+}
+
+static int _fc_id (struct act_fcomp *fc, ActId *id)
+{
+  if (id->Rest() || id->arrayInfo()) {
+    fc->fail = 1;
+    return 0;
+  }
+  return _fc_var (fc, id->getName());
+}
+
+static int _fc_expr (struct act_fcomp *fc, Expr *e, int *ty);
+
+static int _fc_binop (struct act_fcomp *fc, int op, int ty, int a, int b)
+{
+  int r = _fc_alloc (fc, ty);
+  _fc_emit (fc, op, r, a, b);
+  return r;
+}
+
+static int _fc_tofloat (struct act_fcomp *fc, int r, int ty)
+{
+  if (ty == FT_REAL) {
+    return r;
+  }
+  return _fc_binop (fc, FOP_I2F, FT_REAL, r, 0);
+}
+
+static int _fc_call (struct act_fcomp *fc, Expr *e, int *ty)
+{
+  Function *f = dynamic_cast<Function *>((UserDef *)e->u.fn.s);
+  struct act_fprog *p = fc->p;
+  Expr *w;
+  int n, base, r;
+
+  if (!f || (e->u.fn.r && e->u.fn.r->type == E_GT)) {
+    fc->fail = 1;
+    return 0;
+  }
+  *ty = _ftype (f->getRetType());
+  if (*ty < 0) {
+    fc->fail = 1;
+    return 0;
+  }
+
+  n = 0;
+  for (w = e->u.fn.r; w; w = w->u.e.r) {
+    n++;
+  }
+  if (n != f->getNumParams()) {
+    fc->fail = 1;
+    return 0;
+  }
+
+  /* arguments are evaluated first, in order */
+  int *regs = NULL;
+  unsigned char *types = NULL;
+  if (n > 0) {
+    MALLOC (regs, int, n);
+    MALLOC (types, unsigned char, n);
+  }
+  n = 0;
+  for (w = e->u.fn.r; w && !fc->fail; w = w->u.e.r) {
+    int aty;
+    regs[n] = _fc_expr (fc, w->u.e.l, &aty);
+    types[n] = aty;
+    if (!fc->fail && aty != _ftype (f->getPortType (-(n+1)))) {
+      fc->fail = 1;
+    }
+    n++;
+  }
+  r = 0;
+  if (!fc->fail) {
+    base = A_LEN (p->args);
+    for (int i=0; i < n; i++) {
+      A_APPEND (p->args, int, regs[i]);
+      A_APPEND (p->argt, unsigned char, types[i]);
+    }
+    A_APPEND (p->fn, Function *, f);
+    r = _fc_alloc (fc, *ty);
+    _fc_emit (fc, FOP_CALL, r, A_LEN (p->fn) - 1, base, n);
+  }
+  if (regs) {
+    FREE (regs);
+    FREE (types);
+  }
+  return r;
+}
+
+static int _fc_expr (struct act_fcomp *fc, Expr *e, int *ty)
+{
+  int l, r, lty, rty, op;
+
+  *ty = FT_INT;
+  if (fc->fail) return 0;
+
+  switch (e->type) {
+  case E_INT:
+    /* v_extra is dropped when parameters are expanded */
+    r = _fc_alloc (fc, FT_INT);
+    fc->p->code[_fc_emit (fc, FOP_CONST, r)].k.i = (long) e->u.v;
+    return r;
+
+  case E_REAL:
+    *ty = FT_REAL;
+    r = _fc_alloc (fc, FT_REAL);
+    fc->p->code[_fc_emit (fc, FOP_CONST, r)].k.f = e->u.f;
+    return r;
+
+  case E_TRUE:
+  case E_FALSE:
+    *ty = FT_BOOL;
+    r = _fc_alloc (fc, FT_BOOL);
+    fc->p->code[_fc_emit (fc, FOP_CONST, r)].k.i = (e->type == E_TRUE);
+    return r;
+
+  case E_VAR:
+  case E_SELF:
+    if (e->type == E_VAR) {
+      r = _fc_id (fc, (ActId *)e->u.e.l);
+    }
+    else {
+      r = _fc_var (fc, "self");
+    }
+    if (fc->fail) return 0;
+    *ty = fc->ty[r];
+    _fc_emit (fc, FOP_CHK, 0, r);
+    return r;
+
+  case E_AND:
+  case E_OR:
+  case E_XOR:
+    l = _fc_expr (fc, e->u.e.l, &lty);
+    r = _fc_expr (fc, e->u.e.r, &rty);
+    if (fc->fail) return 0;
+    if (lty != rty || lty == FT_REAL) {
+      fc->fail = 1;
+      return 0;
+    }
+    *ty = lty;
+    op = (e->type == E_AND ? FOP_AND : (e->type == E_OR ? FOP_OR : FOP_XOR));
+    return _fc_binop (fc, op, lty, l, r);
+
+  case E_PLUS:
+  case E_MINUS:
+  case E_MULT:
+  case E_DIV:
+  case E_MOD:
+  case E_LSL:
+  case E_LSR:
+  case E_ASR:
+    l = _fc_expr (fc, e->u.e.l, &lty);
+    r = _fc_expr (fc, e->u.e.r, &rty);
+    if (fc->fail) return 0;
+    if (lty == FT_INT && rty == FT_INT) {
+      switch (e->type) {
+      case E_PLUS:  op = FOP_ADD; break;
+      case E_MINUS: op = FOP_SUB; break;
+      case E_MULT:  op = FOP_MUL; break;
+      case E_DIV:   op = FOP_DIV; break;
+      case E_MOD:   op = FOP_MOD; break;
+      case E_LSL:   op = FOP_LSL; break;
+      case E_LSR:   op = FOP_LSR; break;
+      default:      op = FOP_ASR; break;
+      }
+      return _fc_binop (fc, op, FT_INT, l, r);
+    }
+    if (lty == FT_BOOL || rty == FT_BOOL ||
+	e->type == E_MOD || e->type == E_LSL ||
+	e->type == E_LSR || e->type == E_ASR) {
+      fc->fail = 1;
+      return 0;
+    }
+    /* int/real mix: computed in double precision */
+    *ty = FT_REAL;
+    l = _fc_tofloat (fc, l, lty);
+    r = _fc_tofloat (fc, r, rty);
+    switch (e->type) {
+    case E_PLUS:  op = FOP_FADD; break;
+    case E_MINUS: op = FOP_FSUB; break;
+    case E_MULT:  op = FOP_FMUL; break;
+    default:      op = FOP_FDIV; break;
+    }
+    return _fc_binop (fc, op, FT_REAL, l, r);
+
+  case E_LT:
+  case E_GT:
+  case E_LE:
+  case E_GE:
+  case E_EQ:
+  case E_NE:
+    l = _fc_expr (fc, e->u.e.l, &lty);
+    r = _fc_expr (fc, e->u.e.r, &rty);
+    if (fc->fail) return 0;
+    if (lty != rty || lty == FT_BOOL) {
+      fc->fail = 1;
+      return 0;
+    }
+    switch (e->type) {
+    case E_LT: op = FOP_LT; break;
+    case E_GT: op = FOP_GT; break;
+    case E_LE: op = FOP_LE; break;
+    case E_GE: op = FOP_GE; break;
+    case E_EQ: op = FOP_EQ; break;
+    default:   op = FOP_NE; break;
+    }
+    if (lty == FT_REAL) {
+      op += FOP_FLT - FOP_LT;
+    }
+    *ty = FT_BOOL;
+    return _fc_binop (fc, op, FT_BOOL, l, r);
+
+  case E_NOT:
+  case E_COMPLEMENT:
+  case E_UMINUS:
+    l = _fc_expr (fc, e->u.e.l, &lty);
+    if (fc->fail) return 0;
+    *ty = lty;
+    if (lty == FT_BOOL && e->type != E_UMINUS) {
+      op = FOP_NOT;
+    }
+    else if (lty == FT_INT && e->type == E_COMPLEMENT) {
+      op = FOP_COMPL;
+    }
+    else if (lty == FT_INT && e->type == E_UMINUS) {
+      op = FOP_NEG;
+    }
+    else if (lty == FT_REAL && e->type == E_UMINUS) {
+      op = FOP_FNEG;
+    }
+    else {
+      fc->fail = 1;
+      return 0;
+    }
+    return _fc_binop (fc, op, lty, l, 0);
+
+  case E_QUERY:
+    /* both alternatives are evaluated, as in expr_expand() */
+    {
+      int c, cty;
+      c = _fc_expr (fc, e->u.e.l, &cty);
+      l = _fc_expr (fc, e->u.e.r->u.e.l, &lty);
+      r = _fc_expr (fc, e->u.e.r->u.e.r, &rty);
+      if (fc->fail) return 0;
+      if (cty != FT_BOOL || lty != rty) {
+	fc->fail = 1;
+	return 0;
+      }
+      *ty = lty;
+      int d = _fc_alloc (fc, lty);
+      _fc_emit (fc, FOP_QUERY, d, c, l, r);
+      return d;
+    }
+
+  case E_FUNCTION:
+    return _fc_call (fc, e, ty);
+
+  default:
+    fc->fail = 1;
+    return 0;
+  }
+}
+
+/* compile a guard; returns -1 for an else/empty guard */
+static int _fc_guard (struct act_fcomp *fc, Expr *g)
+{
+  int r, ty;
+  if (!g) {
+    return -1;
+  }
+  r = _fc_expr (fc, g, &ty);
+  if (!fc->fail && ty != FT_BOOL) {
+    fc->fail = 1;
+  }
+  return r;
+}
+
+static void _fc_stmt (struct act_fcomp *fc, act_chp_lang_t *c)
+{
+  int sp, r, ty;
+
+  if (!c || fc->fail) return;
+
+  sp = fc->sp;
+  switch (c->type) {
+  case ACT_CHP_COMMA:
+  case ACT_CHP_SEMI:
+    for (listitem_t *li = list_first (c->u.semi_comma.cmd);
+	 li; li = list_next (li)) {
+      _fc_stmt (fc, (act_chp_lang_t *) list_value (li));
+    }
+    break;
+
+  case ACT_CHP_COMMALOOP:
+  case ACT_CHP_SEMILOOP:
+    {
+      /* the loop variable is a copy of a hidden counter, so that
+	 assignments to it in the body do not change the iteration */
+      int v, cnt, hi, one, top, jexit;
+
+      if (hash_lookup (fc->H, c->u.loop.id)) {
+	fc->fail = 1;
+	return;
+      }
+      v = _fc_alloc (fc, FT_INT);
+      hash_add (fc->H, c->u.loop.id)->i = v;
+      _fc_emit (fc, FOP_UNSET, 0, v);
+
+      r = _fc_expr (fc, c->u.loop.lo, &ty);
+      if (!fc->fail && ty != FT_INT) fc->fail = 1;
+      cnt = _fc_alloc (fc, FT_INT);
+      hi = _fc_alloc (fc, FT_INT);
+      if (c->u.loop.hi) {
+	_fc_emit (fc, FOP_TRUNC, cnt, r);
+	r = _fc_expr (fc, c->u.loop.hi, &ty);
+	if (!fc->fail && ty != FT_INT) fc->fail = 1;
+	_fc_emit (fc, FOP_TRUNC, hi, r);
+      }
+      else {
+	/* 0 .. lo-1 */
+	_fc_emit (fc, FOP_TRUNC, hi, r);
+	one = _fc_alloc (fc, FT_INT);
+	fc->p->code[_fc_emit (fc, FOP_CONST, one)].k.i = 1;
+	_fc_emit (fc, FOP_SUB, hi, hi, one);
+	_fc_emit (fc, FOP_CONST, cnt);
+      }
+
+      r = _fc_alloc (fc, FT_BOOL);
+      top = _fc_emit (fc, FOP_GT, r, cnt, hi);
+      jexit = _fc_emit (fc, FOP_JNZ, 0, r);
+      _fc_emit (fc, FOP_SET, v, cnt);
+      _fc_stmt (fc, c->u.loop.body);
+      _fc_emit (fc, FOP_INC, cnt);
+      _fc_emit (fc, FOP_JMP, top);
+      fc->p->code[jexit].dst = A_LEN (fc->p->code);
+
+      hash_delete (fc->H, c->u.loop.id);
+    }
+    break;
+
+  case ACT_CHP_SELECT:
+  case ACT_CHP_SELECT_NONDET:
+    {
+      A_DECL (int, jend);
+      A_INIT (jend);
+      for (act_chp_gc_t *gc = c->u.gc; gc && !fc->fail; gc = gc->next) {
+	int jz = -1;
+	if (gc->id) {
+	  fc->fail = 1;
+	  break;
+	}
+	r = _fc_guard (fc, gc->g);
+	if (r >= 0) {
+	  jz = _fc_emit (fc, FOP_JZ, 0, r);
+	}
+	fc->sp = sp;
+	_fc_stmt (fc, gc->s);
+	A_APPEND (jend, int, _fc_emit (fc, FOP_JMP, 0));
+	if (jz >= 0) {
+	  fc->p->code[jz].dst = A_LEN (fc->p->code);
+	}
+      }
+      _fc_emit (fc, FOP_NOGUARD, 0);
+      for (int i=0; i < A_LEN (jend); i++) {
+	fc->p->code[jend[i]].dst = A_LEN (fc->p->code);
+      }
+      A_FREE (jend);
+    }
+    break;
+
+  case ACT_CHP_LOOP:
+    {
+      int cnt, top, lsp;
+      cnt = _fc_alloc (fc, FT_INT);
+      _fc_emit (fc, FOP_CONST, cnt);
+      top = _fc_emit (fc, FOP_INC, cnt);
+      lsp = fc->sp;
+      for (act_chp_gc_t *gc = c->u.gc; gc && !fc->fail; gc = gc->next) {
+	int jz = -1;
+	if (gc->id) {
+	  fc->fail = 1;
+	  break;
+	}
+	r = _fc_guard (fc, gc->g);
+	if (r >= 0) {
+	  jz = _fc_emit (fc, FOP_JZ, 0, r);
+	}
+	fc->sp = lsp;
+	_fc_stmt (fc, gc->s);
+	_fc_emit (fc, FOP_LOOPCHK, 0, cnt);
+	_fc_emit (fc, FOP_JMP, top);
+	if (jz >= 0) {
+	  fc->p->code[jz].dst = A_LEN (fc->p->code);
+	}
+      }
+    }
+    break;
+
+  case ACT_CHP_DOLOOP:
+    {
+      int top = A_LEN (fc->p->code);
+      Assert (c->u.gc->next == NULL, "What?");
+      _fc_stmt (fc, c->u.gc->s);
+      r = _fc_guard (fc, c->u.gc->g);
+      if (r >= 0) {
+	_fc_emit (fc, FOP_JNZ, top, r);
+      }
+      else {
+	_fc_emit (fc, FOP_JMP, top);
+      }
+    }
+    break;
+
+  case ACT_CHP_SKIP:
+  case ACT_CHP_FUNC:
+    /* built-in functions are skipped */
+    break;
+
+  case ACT_CHP_ASSIGN:
+    {
+      int v = _fc_id (fc, c->u.assign.id);
+      r = _fc_expr (fc, c->u.assign.e, &ty);
+      if (fc->fail) break;
+      if (ty != fc->ty[v]) {
+	fc->fail = 1;
+	break;
+      }
+      _fc_emit (fc, FOP_SET, v, r);
+    }
+    break;
+
+  default:
+    fc->fail = 1;
+    break;
+  }
+  fc->sp = sp;
+}
+
+void Function::_free_prog ()
+{
+  A_FREE (prog->code);
+  A_FREE (prog->fn);
+  A_FREE (prog->args);
+  A_FREE (prog->argt);
+  if (prog->pt) {
+    FREE (prog->pt);
+  }
+  FREE (prog);
+  prog = NULL;
+}
+
+void Function::_compile ()
+{
+  struct act_fcomp fc;
+  struct act_fprog *p;
+  act_chp *c;
+  int ty;
+
+  prog_state = 2;
+
+  ty = _ftype (getRetType ());
+  if (ty < 0 || !b) {
+    return;
+  }
+
+  NEW (p, struct act_fprog);
+  A_INIT (p->code);
+  A_INIT (p->fn);
+  A_INIT (p->args);
+  A_INIT (p->argt);
+  p->nparams = getNumParams ();
+  p->pt = NULL;
+  p->rett = ty;
+  p->nregs = 0;
+  prog = p;
+
+  fc.p = p;
+  fc.H = hash_new (8);
+  A_INIT (fc.ty);
+  fc.sp = 0;
+  fc.fail = 0;
+
+  /* fixed registers: parameters, self, locals */
+  if (p->nparams > 0) {
+    MALLOC (p->pt, unsigned char, p->nparams);
+  }
+  for (int i=0; i < p->nparams; i++) {
+    const char *name = getPortName (-(i+1));
+    int pty = _ftype (getPortType (-(i+1)));
+    if (pty < 0 || hash_lookup (fc.H, name)) {
+      fc.fail = 1;
+      break;
+    }
+    p->pt[i] = pty;
+    hash_add (fc.H, name)->i = _fc_alloc (&fc, pty);
+  }
+  if (!fc.fail && !hash_lookup (fc.H, "self")) {
+    p->self = _fc_alloc (&fc, ty);
+    hash_add (fc.H, "self")->i = p->self;
+  }
+  else {
+    fc.fail = 1;
+  }
+
+  c = NULL;
+  for (ActBody *btmp = b; btmp && !fc.fail; btmp = btmp->Next()) {
+    ActBody_Lang *l;
+    ActBody_Inst *bi;
+    if ((l = dynamic_cast<ActBody_Lang *>(btmp))) {
+      if (l->gettype() != ActBody_Lang::LANG_CHP) {
+	fc.fail = 1;
+      }
+      c = (act_chp *)l->getlang();
+    }
+    else if ((bi = dynamic_cast<ActBody_Inst *>(btmp))) {
+      int lty = _ftype (bi->getType());
+      if (lty < 0 || hash_lookup (fc.H, bi->getName())) {
+	fc.fail = 1;
+      }
+      else {
+	hash_add (fc.H, bi->getName())->i = _fc_alloc (&fc, lty);
+      }
+    }
+    else {
+      fc.fail = 1;
+    }
+  }
+  if (!c) {
+    fc.fail = 1;
+  }
+  else {
+    _fc_stmt (&fc, c->c);
+    _fc_emit (&fc, FOP_DONE, 0);
+  }
+
+  hash_free (fc.H);
+  A_FREE (fc.ty);
+
+  if (fc.fail) {
+    _free_prog ();
+    return;
+  }
+  prog_state = 1;
+}
+
+
+/*-- evaluation --*/
+
+static int _expr_fval (Expr *e, int ty, union act_fval *v)
+{
+  switch (ty) {
+  case FT_INT:
+    if (e->type != E_INT) return 0;
+    v->i = (long) e->u.v;
+    break;
+  case FT_BOOL:
+    if (e->type != E_TRUE && e->type != E_FALSE) return 0;
+    v->i = (e->type == E_TRUE);
+    break;
+  case FT_REAL:
+    if (e->type != E_REAL) return 0;
+    v->f = e->u.f;
+    break;
+  default:
+    return 0;
+  }
+  return 1;
+}
+
+static Expr *_fval_expr (int ty, union act_fval *v)
+{
+  if (ty == FT_INT) {
+    return const_expr (v->i);
+  }
+  else if (ty == FT_BOOL) {
+    return const_expr_bool (v->i);
+  }
+  else {
+    return const_expr_real (v->f);
+  }
+}
+
+/*
+ * Run the compiled body. Returns 0 if a variable was used before it
+ * was assigned, in which case the caller falls back to _interp().
+ */
+int Function::_exec (ActNamespace *ns, union act_fval *args,
+		     union act_fval *ret)
+{
+  struct act_fprog *p = prog;
+  union act_fval rbuf[ACT_FREGS], *r;
+  unsigned char sbuf[ACT_FREGS], *set;
+  act_finsn_t *x;
+  int pc, ok;
+
+  if (p->nregs > ACT_FREGS) {
+    MALLOC (r, union act_fval, p->nregs);
+    MALLOC (set, unsigned char, p->nregs);
+  }
+  else {
+    r = rbuf;
+    set = sbuf;
+  }
+  memset (set, 0, p->nregs);
+  for (int i=0; i < p->nparams; i++) {
+    r[i] = args[i];
+    set[i] = 1;
+  }
+
+  pending = 1;
+  ok = 1;
+  pc = 0;
+  while (ok) {
+    x = &p->code[pc++];
+    switch (x->op) {
+    case FOP_DONE:
+      goto done;
+
+    case FOP_CONST:
+      r[x->dst] = x->k;
+      break;
+
+    case FOP_CHK:
+      if (!set[x->a]) {
+	ok = 0;
+      }
+      break;
+
+    case FOP_UNSET:
+      set[x->a] = 0;
+      break;
+
+    case FOP_SET:
+      r[x->dst] = r[x->a];
+      set[x->dst] = 1;
+      break;
+
+    case FOP_TRUNC:
+      r[x->dst].i = (int) r[x->a].i;
+      set[x->dst] = 1;
+      break;
+
+    case FOP_INC:
+      r[x->dst].i++;
+      break;
+
+#define IOP(o,expr) case o: r[x->dst].i = (expr); break
+#define A (r[x->a].i)
+#define B (r[x->b].i)
+#define UA ((unsigned long)A)
+#define UB ((unsigned long)B)
+
+    IOP (FOP_ADD, (long)(UA + UB));
+    IOP (FOP_SUB, (long)(UA - UB));
+    IOP (FOP_MUL, (long)(UA * UB));
+    IOP (FOP_LSL, A << UB);
+    IOP (FOP_LSR, (long)(UA >> UB));
+    IOP (FOP_ASR, A >> UB);
+    IOP (FOP_AND, A & B);
+    IOP (FOP_OR, A | B);
+    IOP (FOP_XOR, A ^ B);
+    IOP (FOP_LT, A < B);
+    IOP (FOP_GT, A > B);
+    IOP (FOP_LE, A <= B);
+    IOP (FOP_GE, A >= B);
+    IOP (FOP_EQ, A == B);
+    IOP (FOP_NE, A != B);
+    IOP (FOP_NOT, !A);
+    IOP (FOP_COMPL, ~A);
+    IOP (FOP_NEG, (long)(0UL - UA));
+
+    case FOP_DIV:
+    case FOP_MOD:
+      if (B == 0) {
+	act_error_ctxt (stderr);
+	fatal_error ("Function `%s': division by zero", getName());
+      }
+      r[x->dst].i = (x->op == FOP_DIV) ? A / B : A % B;
+      break;
+
+#define FA (r[x->a].f)
+#define FB (r[x->b].f)
+#define FOP(o,expr) case o: r[x->dst].f = (expr); break
+
+    FOP (FOP_FADD, FA + FB);
+    FOP (FOP_FSUB, FA - FB);
+    FOP (FOP_FMUL, FA * FB);
+    FOP (FOP_FDIV, FA / FB);
+    FOP (FOP_FNEG, -FA);
+    FOP (FOP_I2F, (double) UA);
+    IOP (FOP_FLT, FA < FB);
+    IOP (FOP_FGT, FA > FB);
+    IOP (FOP_FLE, FA <= FB);
+    IOP (FOP_FGE, FA >= FB);
+    IOP (FOP_FEQ, FA == FB);
+    IOP (FOP_FNE, FA != FB);
+
+#undef FOP
+#undef FA
+#undef FB
+#undef IOP
+#undef UA
+#undef UB
+#undef A
+#undef B
+
+    case FOP_QUERY:
+      r[x->dst] = r[x->a].i ? r[x->b] : r[x->c];
+      break;
+
+    case FOP_CALL:
+      {
+	Function *f = p->fn[x->a];
+	union act_fval abuf[8], *av;
+	if (x->c > 8) {
+	  MALLOC (av, union act_fval, x->c);
+	}
+	else {
+	  av = abuf;
+	}
+	for (int i=0; i < x->c; i++) {
+	  av[i] = r[p->args[x->b + i]];
+	}
+	if (f->pending) {
+	  fatal_error ("Sorry, recursive functions (`%s') not supported.",
+		       f->getName());
+	}
+	act_error_push (f->getName(), f->getFile(), f->getLine());
+	if (f->prog_state == 0) {
+	  f->_compile ();
+	}
+	if (f->prog_state != 1 || !f->_exec (ns, av, &r[x->dst])) {
+	  Expr **ea, *e;
+	  ea = NULL;
+	  if (x->c > 0) {
+	    MALLOC (ea, Expr *, x->c);
+	  }
+	  for (int i=0; i < x->c; i++) {
+	    ea[i] = _fval_expr (p->argt[x->b + i], &av[i]);
+	  }
+	  e = f->_interp (ns, x->c, ea);
+	  if (!_expr_fval (e, _ftype (f->getRetType()), &r[x->dst])) {
+	    fatal_error ("Function `%s' returned the wrong type?",
+			 f->getName());
+	  }
+	  if (ea) {
+	    FREE (ea);
+	  }
+	}
+	act_error_pop ();
+	if (av != abuf) {
+	  FREE (av);
+	}
+      }
+      break;
+
+    case FOP_JMP:
+      pc = x->dst;
+      break;
+
+    case FOP_JZ:
+      if (!r[x->a].i) {
+	pc = x->dst;
+      }
+      break;
+
+    case FOP_JNZ:
+      if (r[x->a].i) {
+	pc = x->dst;
+      }
+      break;
+
+    case FOP_LOOPCHK:
+      if (r[x->a].i > Act::max_loop_iterations) {
+	fatal_error ("# of loop iterations exceeded limit (%d)",
+		     Act::max_loop_iterations);
+      }
+      break;
+
+    case FOP_NOGUARD:
+      act_error_ctxt (stderr);
+      fatal_error ("In a function call: all guards are false!");
+      break;
+
+    default:
+      Assert (0, "Unknown function opcode");
+      break;
+    }
+  }
+
+done:
+  pending = 0;
+  if (ok && !set[p->self]) {
+    ok = 0;
+  }
+  if (ok) {
+    *ret = r[p->self];
+  }
+  if (r != rbuf) {
+    FREE (r);
+    FREE (set);
+  }
+  return ok;
+}
+
+
+Expr *Function::eval (ActNamespace *ns, int nargs, Expr **args)
+{
+  Assert (nargs == getNumParams(), "What?");
+
+  if (pending) {
+    fatal_error ("Sorry, recursive functions (`%s') not supported.",
+		 getName());
+  }
+
+  if (Act::compile_functions) {
+    if (prog_state == 0) {
+      _compile ();
+    }
+    if (prog_state == 1) {
+      union act_fval abuf[8], *av, ret;
+      int ok = 1;
+
+      if (nargs > 8) {
+	MALLOC (av, union act_fval, nargs);
+      }
+      else {
+	av = abuf;
+      }
+      for (int i=0; ok && i < nargs; i++) {
+	ok = _expr_fval (args[i], prog->pt[i], &av[i]);
+      }
+      if (ok) {
+	expanded = 1;
+	ok = _exec (ns, av, &ret);
+      }
+      if (av != abuf) {
+	FREE (av);
+      }
+      if (ok) {
+	return _fval_expr (prog->rett, &ret);
+      }
+    }
+  }
+  return _interp (ns, nargs, args);
+}
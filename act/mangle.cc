@@ -26,6 +26,7 @@
 #include <string.h>
 #include <act/act.h>
 #include <common/misc.h>
+#include <common/hash.h>
 
 /*
   Code for mangling/unmangling special characters to sanitize output
@@ -39,6 +40,19 @@ static unsigned char mangle_result[] =
 
 static int mangle_invidx[256];
 
+static void _mangle_flush_cache (struct pHashtable *H)
+{
+  phash_iter_t it;
+  phash_bucket_t *b;
+
+  if (!H) return;
+  phash_iter_init (H, &it);
+  while ((b = phash_iter_next (H, &it))) {
+    FREE (b->v);
+  }
+  phash_clear (H);
+}
+
 
 int Act::mangle_set_char (unsigned char c)
 {
@@ -76,6 +90,8 @@ void Act::mangle (char *str)
     inv_map[i] = -1;
     mangle_invidx[i] = -1;
   }
+  _mangle_flush_cache (mangle_conn);
+  _mangle_flush_cache (mangle_type);
 
   if (str == NULL || *str == '\0') {
     /* no mangling! */
@@ -92,13 +108,13 @@ void Act::mangle (char *str)
   mangle_invidx[(int)mangle_result[0]] = 0;
 
   for (i=0; (i+1) < max_len && str[i]; i++) {
-    if (mangle_characters[(unsigned)str[i]] >= 0) {
+    if (mangle_characters[(unsigned char)str[i]] >= 0) {
       fatal_error ("Cannot install mangle string `%s': dup char `%c'",
 		   str, str[i]);
     }
     mangle_invidx[(int)mangle_result[i+1]] = i+1;
-    mangle_characters[(unsigned)str[i]] = mangle_result[i+1];
-    inv_map[(int)mangle_result[i+1]] = (unsigned)str[i];
+    mangle_characters[(unsigned char)str[i]] = mangle_result[i+1];
+    inv_map[(int)mangle_result[i+1]] = (unsigned char)str[i];
 
 #if 0
     if (str[i] == '<') {
@@ -113,6 +129,17 @@ void Act::mangle (char *str)
     fatal_error ("Cannot install mangle string `%s'---too many characters",
 		 str);
   }
+
+  /* Mangling replaces each character with a two-character sequence
+     (the escape character followed by its code), and the escape
+     character itself is always mangled. So the mapping is invertible
+     as long as no two characters share a code; check that once here
+     rather than on every mangled string. */
+  for (i=0; i < 256; i++) {
+    if (mangle_characters[i] >= 0 && inv_map[mangle_characters[i]] != i) {
+      fatal_error ("Cannot install mangle string `%s': `%c' and `%c' have the same mangled form", str, i, inv_map[mangle_characters[i]]);
+    }
+  }
 #if 0  
   if (mangle_min_idx == -1) {
     mangle_min_idx = strlen (str);
@@ -137,7 +164,7 @@ int Act::mangle_string (const char *src, char *dst, int sz)
   }
 
   while (*src && sz > 0) {
-    if (mangle_characters[(unsigned)*src] >= 0) {
+    if (mangle_characters[(unsigned char)*src] >= 0) {
       //&&
       //((*src != '_') || inv_map[*(src+1)] == -1)) {
       /* modify _ mangling; special case.
@@ -150,7 +177,7 @@ int Act::mangle_string (const char *src, char *dst, int sz)
       *dst++ = mangle_result[0];
       sz--;
       if (sz == 0) return -1;
-      *dst++ = mangle_characters[(unsigned)*src];
+      *dst++ = mangle_characters[(unsigned char)*src];
       sz--;
     }
     else {
@@ -194,7 +221,7 @@ int Act::unmangle_string (const char *src, char *dst, int sz)
     //    if ((*src == mangle_result[0]) &&
     //	(mangle_invidx[*(src+1)] != -1)) {
       src++;
-      *dst++ = inv_map[(unsigned)*src];
+      *dst++ = inv_map[(unsigned char)*src];
 #if 0      
       if (inv_map[*src] == '<') {
 	mangle_mode++;
@@ -229,30 +256,15 @@ int Act::unmangle_string (const char *src, char *dst, int sz)
 void Act::mfprintf (FILE *fp, const char *s, ...)
 {
   va_list ap;
-  static char buf[10240];
-  static char buf2[20480];
-  static char chk[10240];
+  char buf[10240];
+  char buf2[20480];
 
   va_start (ap, s);
   vsnprintf (buf, 10240, s, ap);
   va_end (ap);
   
   Assert (mangle_string (buf, buf2, 20480) == 0, "Long name");
-  Assert (unmangle_string (buf2, chk, 10240) == 0, "Ick");
-  if (strcmp (chk, buf) != 0) {
-#if 1
-    /* XXX: This is a problem.
-       In particular, foo<8>
-       Will get mangled to foo_38_7
-       Mangling foo_38_7 will result in foo_38_7
-       So this is not a unique invertible mapping!
-    */
-    fprintf (stderr, "Mangled: %s; unmangled: %s\n", buf2, chk);
-    fatal_error ("Mangle/unmangle pair failure: [[ %s ]]\n", buf);
-#endif    
-  }
-  
-  fprintf (fp, "%s", buf2);
+  fputs (buf2, fp);
 }
 
 /*------------------------------------------------------------------------
@@ -267,23 +279,14 @@ void Act::mfprintf (FILE *fp, const char *s, ...)
 int Act::msnprintf (char *fp, int len, const char *s, ...)
 {
   va_list ap;
-  static char buf[10240];
-  static char buf2[20480];
-  static char chk[10240];
+  char buf[10240];
+  char buf2[20480];
 
   va_start (ap, s);
   vsnprintf (buf, 10240, s, ap);
   va_end (ap);
   
   Assert (mangle_string (buf, buf2, 20480) == 0, "Long name");
-  Assert (unmangle_string (buf2, chk, 10240) == 0, "Ick");
-  if (strcmp (chk, buf) != 0) {
-#if 1
-    fprintf (stderr, "Mangled: %s; unmangled: %s\n", buf2, chk);
-    fatal_error ("Mangle/unmangle pair failure: [[ %s ]]\n", buf);
-#endif
-  }
-  
   return snprintf (fp, len, "%s", buf2);
 }
 
@@ -301,30 +304,15 @@ int Act::msnprintf (char *fp, int len, const char *s, ...)
 void Act::ufprintf (FILE *fp, const char *s, ...)
 {
   va_list ap;
-  static char buf[10240];
-  static char buf2[10240];
-  static char chk[10240];
+  char buf[10240];
+  char buf2[10240];
 
   va_start (ap, s);
   vsnprintf (buf, 10240, s, ap);
   va_end (ap);
   
   Assert (unmangle_string (buf, buf2, 10240) == 0, "Long name");
-  Assert (mangle_string (buf2, chk, 10240) == 0, "Ick");
-  if (strcmp (chk, buf) != 0) {
-#if 0
-    /* XXX: This is a problem.
-       In particular, foo<8>
-       Will get mangled to foo_38_7
-       Mangling foo_38_7 will result in foo_38_7
-       So this is not a unique invertible mapping!
-    */
-    fprintf (stderr, "Mangled: %s; unmangled: %s\n", buf2, chk);
-    fatal_error ("Mangle/unmangle pair failure: [[ %s ]]\n", buf);
-#endif    
-  }
-  
-  fprintf (fp, "%s", buf2);
+  fputs (buf2, fp);
 }
 
 /*------------------------------------------------------------------------
@@ -339,23 +327,14 @@ void Act::ufprintf (FILE *fp, const char *s, ...)
 int Act::usnprintf (char *fp, int len, const char *s, ...)
 {
   va_list ap;
-  static char buf[10240];
-  static char buf2[10240];
-  static char chk[10240];
+  char buf[10240];
+  char buf2[10240];
 
   va_start (ap, s);
   vsnprintf (buf, 10240, s, ap);
   va_end (ap);
   
   Assert (unmangle_string (buf, buf2, 10240) == 0, "Long name");
-  Assert (mangle_string (buf2, chk, 10240) == 0, "Ick");
-  if (strcmp (chk, buf) != 0) {
-#if 0    
-    fprintf (stderr, "Mangled: %s; unmangled: %s\n", buf2, chk);
-    fatal_error ("Mangle/unmangle pair failure: [[ %s ]]\n", buf);
-#endif    
-  }
-  
   return snprintf (fp, len, "%s", buf2);
 }
 
@@ -416,27 +395,92 @@ void Act::msnprintfproc (char *fp, int len, UserDef *p, int omit_ns)
  */
 void Act::mfprintfproc (FILE *fp, UserDef *p, int omit_ns)
 {
-  int pos = 0;
+  fputs (mangledName (p, omit_ns), fp);
+}
 
-  /*--- process gp ---*/
-  if (!omit_ns) {
-    if (p->getns() && p->getns() != ActNamespace::Global()) {
-      char *s = p->getns()->Name();
-      mfprintf (fp, "%s::", s);
-      FREE (s);
-    }
+
+/* release the mangled name caches */
+void Act::_mangle_cache_free ()
+{
+  _mangle_flush_cache (mangle_conn);
+  _mangle_flush_cache (mangle_type);
+  phash_free (mangle_conn);
+  phash_free (mangle_type);
+  mangle_conn = NULL;
+  mangle_type = NULL;
+  pthread_mutex_destroy (&mangle_lock);
+}
+
+/*
+ * Look up a cached name; the mangled string is computed outside the
+ * lock, and the first string to be inserted wins.
+ */
+static const char *_mangle_cache_find (pthread_mutex_t *lock,
+				       struct pHashtable *H, void *key)
+{
+  phash_bucket_t *b;
+  const char *ret;
+
+  pthread_mutex_lock (lock);
+  b = phash_lookup (H, key);
+  ret = b ? (const char *) b->v : NULL;
+  pthread_mutex_unlock (lock);
+  return ret;
+}
+
+static const char *_mangle_cache_add (pthread_mutex_t *lock,
+				      struct pHashtable *H, void *key,
+				      const char *s)
+{
+  phash_bucket_t *b;
+  const char *ret;
+
+  pthread_mutex_lock (lock);
+  b = phash_lookup (H, key);
+  if (!b) {
+    b = phash_add (H, key);
+    b->v = Strdup (s);
   }
+  ret = (const char *) b->v;
+  pthread_mutex_unlock (lock);
+  return ret;
+}
 
-  const char *proc_name = p->getName ();
-  pos = strlen (proc_name);
-  if (pos > 2 && proc_name[pos-2] == '<' &&  proc_name[pos-1] == '>') {
-    pos = 0;
-    while (proc_name[pos] != '<') {
-      fputc (proc_name[pos], fp);
-      pos++;
-    }
+/*------------------------------------------------------------------------
+ *
+ *  Act::mangledName --
+ *
+ *   Cached mangled names for connections and user-defined types
+ *
+ *------------------------------------------------------------------------
+ */
+const char *Act::mangledName (act_connection *c)
+{
+  const char *ret;
+  char buf[10240];
+  char buf2[20480];
+
+  ret = _mangle_cache_find (&mangle_lock, mangle_conn, c);
+  if (ret) {
+    return ret;
   }
-  else {
-    mfprintf (fp, "%s", proc_name);
+  ActId *id = c->toid();
+  id->sPrint (buf, 10240);
+  delete id;
+  Assert (mangle_string (buf, buf2, 20480) == 0, "Long name");
+  return _mangle_cache_add (&mangle_lock, mangle_conn, c, buf2);
+}
+
+const char *Act::mangledName (UserDef *u, int omit_ns)
+{
+  const char *ret;
+  char buf[20480];
+  void *key = (void *)(((unsigned long)u) | (omit_ns ? 1 : 0));
+
+  ret = _mangle_cache_find (&mangle_lock, mangle_type, key);
+  if (ret) {
+    return ret;
   }
+  msnprintfproc (buf, 20480, u, omit_ns);
+  return _mangle_cache_add (&mangle_lock, mangle_type, key, buf);
 }
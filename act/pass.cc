@@ -23,7 +23,10 @@
 #include <act/iter.h>
 #include <act/tech.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include <dlfcn.h>
+#include <malloc.h>
 #include <common/config.h>
 
 class InternalDummyPass : public ActPass
@@ -126,14 +129,328 @@ const char *ActPass::getName ()
   return name;
 }
 
+/*------------------------------------------------------------------------
+ *
+ *  Pass profiling (-prof=<file>)
+ *
+ *  Every pass run and every local_op() call is a frame on a profile
+ *  stack. For each pass we record the number of runs, wall/self/CPU
+ *  time, the change in heap usage, and the number of local_op() calls;
+ *  local_op() calls are also broken down by type. The self time of
+ *  each distinct stack is kept as well, for flame graphs.
+ *
+ *  The profile stack is per thread; a pass run from a worker thread
+ *  starts a new stack. CPU time is that of the calling thread, so
+ *  concurrent passes are not charged for each other's work. The
+ *  tables are shared, and updated under a lock.
+ *
+ *------------------------------------------------------------------------
+ */
+struct act_prof_type {
+  long n;			/* # of local_op() calls */
+  double wall, cpu;		/* ms */
+};
+
+struct act_prof_pass {
+  long runs;
+  long local_ops;
+  double wall, self, cpu;	/* ms */
+  double heap;			/* bytes */
+  struct Hashtable *types;	/* type name -> act_prof_type */
+};
+
+struct act_prof_frame {
+  const char *name;
+  act_prof_pass *pp;		/* pass frame */
+  act_prof_type *pt;		/* local_op frame */
+  double wall, cpu, child;
+  double heap;
+};
+
+#define ACT_PROF_MAXDEPTH 128
+
+static char *_prof_file = NULL;
+static struct Hashtable *_prof_passes = NULL; /* name -> act_prof_pass */
+static struct Hashtable *_prof_stacks = NULL; /* folded stack -> us */
+static thread_local act_prof_frame _prof_stk[ACT_PROF_MAXDEPTH];
+static thread_local int _prof_depth = 0;
+static pthread_mutex_t _prof_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double _prof_time (clockid_t c)
+{
+  struct timespec ts;
+  clock_gettime (c, &ts);
+  return ts.tv_sec*1e3 + ts.tv_nsec*1e-6;
+}
+
+static double _prof_heap (void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 mi = mallinfo2 ();
+  return (double)mi.uordblks + (double)mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+static act_prof_pass *_prof_pass (const char *name)
+{
+  hash_bucket_t *b;
+  act_prof_pass *pp;
+
+  b = hash_lookup (_prof_passes, name);
+  if (b) {
+    return (act_prof_pass *) b->v;
+  }
+  b = hash_add (_prof_passes, name);
+  NEW (pp, act_prof_pass);
+  pp->runs = 0;
+  pp->local_ops = 0;
+  pp->wall = 0;
+  pp->self = 0;
+  pp->cpu = 0;
+  pp->heap = 0;
+  pp->types = hash_new (8);
+  b->v = pp;
+  return pp;
+}
+
+/*
+ *  Push a frame for a pass; nothing is pushed if the pass is already
+ *  on top of the stack, so that overridden run() methods that call
+ *  ActPass::run() are only counted once. Returns 1 if a frame was
+ *  pushed.
+ */
+static int _prof_push_pass (ActPass *ap)
+{
+  act_prof_frame *f;
+
+  if (_prof_depth > 0 && _prof_stk[_prof_depth-1].pt == NULL &&
+      _prof_stk[_prof_depth-1].name == ap->getName()) {
+    return 0;
+  }
+  if (_prof_depth == ACT_PROF_MAXDEPTH) {
+    return 0;
+  }
+  f = &_prof_stk[_prof_depth++];
+  f->name = ap->getName();
+  pthread_mutex_lock (&_prof_lock);
+  f->pp = _prof_pass (f->name);
+  pthread_mutex_unlock (&_prof_lock);
+  f->pt = NULL;
+  f->child = 0;
+  f->heap = _prof_heap ();
+  f->cpu = _prof_time (CLOCK_THREAD_CPUTIME_ID);
+  f->wall = _prof_time (CLOCK_MONOTONIC);
+  return 1;
+}
+
+static int _prof_push_type (UserDef *u)
+{
+  act_prof_frame *f;
+  act_prof_pass *pp;
+  hash_bucket_t *b;
+  const char *nm;
+
+  if (_prof_depth == 0 || _prof_depth == ACT_PROF_MAXDEPTH) {
+    return 0;
+  }
+  pp = _prof_stk[_prof_depth-1].pp;
+  nm = u ? u->getName() : "-toplevel-";
+  pthread_mutex_lock (&_prof_lock);
+  b = hash_lookup (pp->types, nm);
+  if (!b) {
+    act_prof_type *pt;
+    b = hash_add (pp->types, nm);
+    NEW (pt, act_prof_type);
+    pt->n = 0;
+    pt->wall = 0;
+    pt->cpu = 0;
+    b->v = pt;
+  }
+  pp->local_ops++;
+  pthread_mutex_unlock (&_prof_lock);
+
+  f = &_prof_stk[_prof_depth++];
+  f->name = b->key;
+  f->pp = pp;
+  f->pt = (act_prof_type *) b->v;
+  f->child = 0;
+  f->heap = 0;
+  f->cpu = _prof_time (CLOCK_THREAD_CPUTIME_ID);
+  f->wall = _prof_time (CLOCK_MONOTONIC);
+  return 1;
+}
+
+static void _prof_pop (void)
+{
+  act_prof_frame *f;
+  double wall, cpu, self;
+  hash_bucket_t *b;
+  char *buf;
+  int i, len;
+
+  Assert (_prof_depth > 0, "Profile stack underflow");
+  f = &_prof_stk[_prof_depth-1];
+  wall = _prof_time (CLOCK_MONOTONIC) - f->wall;
+  cpu = _prof_time (CLOCK_THREAD_CPUTIME_ID) - f->cpu;
+  self = wall - f->child;
+
+  pthread_mutex_lock (&_prof_lock);
+  if (f->pt) {
+    f->pt->n++;
+    f->pt->wall += wall;
+    f->pt->cpu += cpu;
+  }
+  else {
+    /* self time excludes local_op() calls and nested passes */
+    f->pp->runs++;
+    f->pp->wall += wall;
+    f->pp->self += self;
+    f->pp->cpu += cpu;
+    f->pp->heap += _prof_heap () - f->heap;
+  }
+
+  /* folded stack */
+  len = 1;
+  for (i=0; i < _prof_depth; i++) {
+    len += strlen (_prof_stk[i].name) + 1;
+  }
+  MALLOC (buf, char, len);
+  buf[0] = '\0';
+  for (i=0; i < _prof_depth; i++) {
+    if (i > 0) {
+      strcat (buf, ";");
+    }
+    strcat (buf, _prof_stk[i].name);
+  }
+  b = hash_lookup (_prof_stacks, buf);
+  if (!b) {
+    b = hash_add (_prof_stacks, buf);
+    b->f = 0;
+  }
+  b->f += self;
+  pthread_mutex_unlock (&_prof_lock);
+  FREE (buf);
+
+  _prof_depth--;
+  if (_prof_depth > 0) {
+    _prof_stk[_prof_depth-1].child += wall;
+  }
+}
+
+static void _prof_json_str (FILE *fp, const char *s)
+{
+  fputc ('"', fp);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc ('\\', fp);
+    }
+    fputc (*s, fp);
+  }
+  fputc ('"', fp);
+}
+
+void ActPass::printProfile (FILE *fp, int folded)
+{
+  hash_iter_t it, jt;
+  hash_bucket_t *b, *c;
+  int first, tfirst;
+
+  if (!_prof_passes) {
+    return;
+  }
+
+  if (folded) {
+    hash_iter_init (_prof_stacks, &it);
+    while ((b = hash_iter_next (_prof_stacks, &it))) {
+      if ((long)(b->f*1000) > 0) {
+	fprintf (fp, "%s %ld\n", b->key, (long)(b->f*1000));
+      }
+    }
+    return;
+  }
+
+  fprintf (fp, "{\n  \"passes\": [");
+  first = 1;
+  hash_iter_init (_prof_passes, &it);
+  while ((b = hash_iter_next (_prof_passes, &it))) {
+    act_prof_pass *pp = (act_prof_pass *) b->v;
+    fprintf (fp, "%s\n    { \"name\": ", first ? "" : ",");
+    first = 0;
+    _prof_json_str (fp, b->key);
+    fprintf (fp, ", \"runs\": %ld, \"wall_ms\": %.3f, \"self_ms\": %.3f, \"cpu_ms\": %.3f, \"heap_bytes\": %.0f, \"local_ops\": %ld,\n      \"types\": [",
+	     pp->runs, pp->wall, pp->self, pp->cpu, pp->heap, pp->local_ops);
+    tfirst = 1;
+    hash_iter_init (pp->types, &jt);
+    while ((c = hash_iter_next (pp->types, &jt))) {
+      act_prof_type *pt = (act_prof_type *) c->v;
+      fprintf (fp, "%s\n        { \"type\": ", tfirst ? "" : ",");
+      tfirst = 0;
+      _prof_json_str (fp, c->key);
+      fprintf (fp, ", \"local_ops\": %ld, \"wall_ms\": %.3f, \"cpu_ms\": %.3f }",
+	       pt->n, pt->wall, pt->cpu);
+    }
+    fprintf (fp, "%s]\n    }", tfirst ? "" : "\n      ");
+  }
+  fprintf (fp, "\n  ]\n}\n");
+}
+
+static void _prof_dump (void)
+{
+  FILE *fp;
+  int len;
+
+  while (_prof_depth > 0) {
+    _prof_pop ();
+  }
+  fp = fopen (_prof_file, "w");
+  if (!fp) {
+    warning ("Could not open pass profile `%s' for writing", _prof_file);
+    return;
+  }
+  len = strlen (_prof_file);
+  ActPass::printProfile (fp, (len > 7 && strcmp (_prof_file + len - 7, ".folded") == 0) ? 1 : 0);
+  fclose (fp);
+}
+
+int ActPass::_prof_begin ()
+{
+  return _prof_file ? _prof_push_pass (this) : 0;
+}
+
+void ActPass::_prof_end (int frame)
+{
+  if (frame) {
+    _prof_pop ();
+  }
+}
+
+void ActPass::setProfile (const char *file)
+{
+  if (!_prof_passes) {
+    _prof_passes = hash_new (8);
+    _prof_stacks = hash_new (32);
+    atexit (_prof_dump);
+  }
+  if (_prof_file) {
+    FREE (_prof_file);
+  }
+  _prof_file = Strdup (file);
+}
+
+
 /* defaults */
 int ActPass::run (Process *p)
 {
+  int prof = _prof_file ? _prof_push_pass (this) : 0;
+
   init();
 
   _root = p;
 
   if (!rundeps (p)) {
+    if (prof) _prof_pop ();
     return 0;
   }
 
@@ -154,14 +471,19 @@ int ActPass::run (Process *p)
 
   _finished = 2;
 
+  if (prof) _prof_pop ();
+
   return 1;
 }
 
 void ActPass::run_recursive (Process *p, int mode)
 {
+  int prof;
+
   if (!completed()) {
     return;
   }
+  prof = _prof_file ? _prof_push_pass (this) : 0;
 
   if (!visited_flag) {
     visited_flag = new std::unordered_set<UserDef *> ();
@@ -180,6 +502,8 @@ void ActPass::run_recursive (Process *p, int mode)
     delete visited_flag;
     visited_flag = NULL;
   }
+
+  if (prof) _prof_pop ();
 }
 
 int ActPass::init ()
@@ -301,6 +625,7 @@ void ActPass::recursive_op (UserDef *p, int mode)
   }
 
   if (mode >= 0) {
+    int prof = _prof_file ? _prof_push_type (p) : 0;
     if (TypeFactory::isProcessType (p) || (p == NULL)) {
       (*pmap)[p] = local_op (dynamic_cast<Process *>(p), mode);
     }
@@ -312,6 +637,7 @@ void ActPass::recursive_op (UserDef *p, int mode)
 	      "What?");
       (*pmap)[p] = local_op (dynamic_cast<Data *>(p), mode);
     }
+    if (prof) _prof_pop ();
   }
   else {
     void *v = (*pmap)[p];
@@ -486,22 +812,29 @@ struct Hashtable *ActDynamicPass::getConfig (void)
 
 int ActDynamicPass::run (Process *p)
 {
+  int prof = _prof_file ? _prof_push_pass (this) : 0;
   int ret = ActPass::run (p);
 
   if (_d._run) {
     (*_d._run)(this, p);
   }
+
+  if (prof) _prof_pop ();
   
   return ret;
 }
 
 void ActDynamicPass::run_recursive (Process *p, int mode)
 {
+  int prof = (_prof_file && completed()) ? _prof_push_pass (this) : 0;
+
   ActPass::run_recursive (p, mode);
  
   if (_d._recursive) {
     (*_d._recursive) (this, p, mode);
   }
+
+  if (prof) _prof_pop ();
 }
 
 int ActDynamicPass::runcmd (const char *name)
@@ -651,6 +984,8 @@ void *ActDynamicPass::getPtrParam (const char *name)
 
 void ActPass::_actual_update (Process *p)
 {
+  int prof = _prof_file ? _prof_push_pass (this) : 0;
+
   if (_root_dirty) {
     p = _root;
   }
@@ -675,6 +1010,8 @@ void ActPass::_actual_update (Process *p)
   act_error_pop ();
   
   visited_flag = NULL;
+
+  if (prof) _prof_pop ();
 }
 
 struct pass_edges {
@@ -21,6 +21,8 @@
  */
 #include <act/act.h>
 #include <act/types.h>
+#include <string.h>
+#include <pthread.h>
 #include <common/int.h>
 
 /**
@@ -43,6 +45,10 @@ struct cHashtable *TypeFactory::ptypehash = NULL;
 Expr *TypeFactory::expr_true = NULL;
 Expr *TypeFactory::expr_false = NULL;
 struct iHashtable *TypeFactory::expr_int = NULL;
+struct iHashtable *TypeFactory::expr_real = NULL;
+
+/* the shared constant tables are used by passes that run in parallel */
+static pthread_mutex_t expr_const_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 /*------------------------------------------------------------------------
@@ -135,6 +141,7 @@ void TypeFactory::Init ()
   TypeFactory::expr_false->type = E_FALSE;
   
   TypeFactory::expr_int = ihash_new (32);
+  TypeFactory::expr_real = ihash_new (8);
 }
 
 InstType *TypeFactory::NewBool (Type::direction dir)
@@ -845,11 +852,9 @@ Expr *TypeFactory::NewExpr (Expr *x)
       return t;
     }
     
+    pthread_mutex_lock (&expr_const_lock);
     b = ihash_lookup (TypeFactory::expr_int, x->u.v);
-    if (b) {
-      return (Expr *)b->v;
-    }
-    else {
+    if (!b) {
       Expr *t;
       b = ihash_add (TypeFactory::expr_int, x->u.v);
       NEW (t, Expr);
@@ -857,15 +862,66 @@ Expr *TypeFactory::NewExpr (Expr *x)
       t->u.v = x->u.v;
       t->u.v_extra = NULL;
       b->v = t;
-      return t;
     }
+    pthread_mutex_unlock (&expr_const_lock);
+    return (Expr *)b->v;
+  }
+  else if (x->type == E_REAL) {
+    ihash_bucket_t *b;
+    long key;
+
+    /* key on the bit pattern, so -0.0 and NaNs stay distinct */
+    Assert (sizeof (long) == sizeof (double), "Hmm");
+    memcpy (&key, &x->u.f, sizeof (double));
+    pthread_mutex_lock (&expr_const_lock);
+    b = ihash_lookup (TypeFactory::expr_real, key);
+    if (!b) {
+      Expr *t;
+      b = ihash_add (TypeFactory::expr_real, key);
+      NEW (t, Expr);
+      t->type = E_REAL;
+      t->u.f = x->u.f;
+      b->v = t;
+    }
+    pthread_mutex_unlock (&expr_const_lock);
+    return (Expr *)b->v;
   }
   else {
-    fatal_error ("TypeFactory::NewExpr() called without a constant int/bool expression!");
+    fatal_error ("TypeFactory::NewExpr() called without a constant int/bool/real expression!");
   }
   return NULL;
 }
 
+int TypeFactory::isSharedExpr (const Expr *x)
+{
+  ihash_bucket_t *b;
+  long key;
+
+  if (!x) return 0;
+
+  switch (x->type) {
+  case E_TRUE:
+    return x == TypeFactory::expr_true;
+  case E_FALSE:
+    return x == TypeFactory::expr_false;
+  case E_INT:
+    if (x->u.v_extra) return 0;
+    pthread_mutex_lock (&expr_const_lock);
+    b = ihash_lookup (TypeFactory::expr_int, x->u.v);
+    pthread_mutex_unlock (&expr_const_lock);
+    return b && b->v == x;
+  case E_REAL:
+    memcpy (&key, &x->u.f, sizeof (double));
+    pthread_mutex_lock (&expr_const_lock);
+    b = ihash_lookup (TypeFactory::expr_real, key);
+    pthread_mutex_unlock (&expr_const_lock);
+    return b && b->v == x;
+  default:
+    break;
+  }
+  return 0;
+}
+
 static int _ceil_log2 (int w)
 {
   int i;
@@ -365,6 +365,8 @@ Function::Function (UserDef *u) : UserDef (u)
   b = NULL;
   ret_type = NULL;
   is_simple_inline = 0;
+  prog = NULL;
+  prog_state = 0;
 }
 
 Function::~Function ()
@@ -372,6 +374,9 @@ Function::~Function ()
   if (b) {
     delete b;
   }
+  if (prog) {
+    _free_prog ();
+  }
 }
 
 
@@ -1009,6 +1014,7 @@ UserDef *UserDef::Expand (ActNamespace *ns, Scope *s,
   }
 
   ux->pending = 0;
+  expr_expand_release ();
   recursion_depth--;
   return ux;
 }
@@ -1791,7 +1797,12 @@ static void _run_chp (Scope *s, act_chp_lang_t *c)
   }
 }
 
-Expr *Function::eval (ActNamespace *ns, int nargs, Expr **args)
+/*
+ * Evaluate the function by running the chp body against the
+ * function scope. Function::eval() (fnexec.cc) uses this when the
+ * function could not be compiled.
+ */
+Expr *Function::_interp (ActNamespace *ns, int nargs, Expr **args)
 {
   Assert (nargs == getNumParams(), "What?");
   
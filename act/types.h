@@ -472,7 +472,14 @@ class Process : public UserDef {
  *  Looks like a process. The ActBody consists of a chp body,
  *  nothing else.
  *
+ *  Parameter functions are compiled on first use into register
+ *  bytecode (see fnexec.cc); anything the compiler does not handle is
+ *  evaluated by walking the chp body.
+ *
  */
+union act_fval;
+struct act_fprog;
+
 class Function : public UserDef {
  public:
   Function (UserDef *u);
@@ -497,6 +504,15 @@ class Function : public UserDef {
 
   void _chk_inline (Expr *e);
   void _chk_inline (struct act_chp_lang *c);
+
+  struct act_fprog *prog;	/* compiled body */
+  unsigned int prog_state:2;	/* 0 = not compiled yet, 1 = compiled,
+				   2 = not compilable */
+
+  Expr *_interp (ActNamespace *ns, int nargs, Expr **args);
+  void _compile ();
+  void _free_prog ();
+  int _exec (ActNamespace *ns, union act_fval *args, union act_fval *ret);
 };
 
 #define ACT_NUM_STD_METHODS 8
@@ -661,6 +677,7 @@ class TypeFactory {
   static Expr *expr_true;
   static Expr *expr_false;
   static struct iHashtable *expr_int;
+  static struct iHashtable *expr_real;
 
   /**
    * Hash table for integer types parameterized by bit-width and
@@ -782,10 +799,18 @@ class TypeFactory {
 
 
   /**
-   * Returns a unique pointer to a constant expression
+   * Returns a unique pointer to a constant expression. Only leaf
+   * constants (bool, int that fits in a word, real) are shared;
+   * expanded expressions with identifiers are not hash-consed.
    */
   static Expr *NewExpr (Expr *e);
 
+  /**
+   * \return 1 if the expression is a shared constant returned by
+   * NewExpr(), and so must not be free'd or modified
+   */
+  static int isSharedExpr (const Expr *e);
+
   static TypeFactory *Factory() { return tf; }
   
   /** 
@@ -1018,6 +1043,9 @@ Expr *expr_expand (Expr *e, ActNamespace *ns, Scope *s, unsigned int flag = 0x2)
 /* free an expanded expression */
 void expr_ex_free (Expr *);
 
+/* release memory held for temporary expressions during expansion */
+void expr_expand_release (void);
+
 /*-- more options for expanded expressions --*/
 
 #define E_TYPE  (E_END + 10)  /* the "l" field will point to an InstType */
@@ -152,11 +152,16 @@ Expr *const_expr_bool (int val)
 
 Expr *const_expr_real (double d)
 {
-  Expr *e;
+  Expr *e, *f;
+
   NEW (e, Expr);
   e->type = E_REAL;
   e->u.f = d;
-  return e;
+
+  f = TypeFactory::NewExpr (e);
+  FREE (e);
+
+  return f;
 }
 
 /**
@@ -452,12 +452,50 @@ static void seek_after_header (atrace *a, int offset)
 }
 
 
+/*
+  Helper function: # of steps, stop time, and dt for time/node order
+  files, computed from the file size. Needs the node table.
+*/
+static void read_header_steps (atrace *a)
+{
+  unsigned long n;
+  int offset = 4 * sizeof (int);
+
+  /* XXX: these formats cannot exceed 2GB */
+
+  n = a->fend - offset;
+
+  /* This is okay even if the file is truncated */
+  a->Nsteps = n / _space_for_nodes_upto (a, a->Nnodes);
+
+  /* get the stop-time from the file itself */
+  if (ATRACE_FMT (a->fmt) == ATRACE_TIME_ORDER) {
+    fseek (a->tr, offset +
+	   (a->Nsteps-1)*_space_for_nodes_upto (a, a->Nnodes), SEEK_SET);
+  }
+  else {
+    fseek (a->tr, offset +
+	   (a->Nsteps-1)*_space_for_one_entry (a->N[0]), SEEK_SET);
+  }
+  fread_float (a, &a->stop_time);
+  a->dt = a->stop_time/(a->Nsteps-1);
+
+  a->Nvsteps = a->Nsteps;
+  if (a->vdt > a->dt) {
+    a->Nvsteps = 1 + (int) ((a->stop_time)/a->vdt);
+  }
+  else {
+    a->vdt = a->dt;
+  }
+  fseek (a->tr, offset, SEEK_SET);
+  a->fpos = offset;
+}
+
 /*
   Helper function: Read atrace header
 */
 static void read_header (atrace *a)
 {
-  unsigned long n;
   int offset;
   int x;
 
@@ -515,31 +553,10 @@ static void read_header (atrace *a)
 
   if (ATRACE_FMT(a->fmt) == ATRACE_TIME_ORDER || 
       ATRACE_FMT(a->fmt) == ATRACE_NODE_ORDER) {
-    /* XXX: these formats cannot exceed 2GB */
-
-    n = a->fend - offset;
-
-    /* This is okay even if the file is truncated */
-    a->Nsteps = n / _space_for_nodes_upto (a, a->Nnodes);
-
-    /* get the stop-time from the file itself */
-    if (ATRACE_FMT (a->fmt) == ATRACE_TIME_ORDER) {
-      fseek (a->tr, 4 * sizeof (int) +
-	     (a->Nsteps-1)*_space_for_nodes_upto (a, a->Nnodes), SEEK_SET);
-    }
-    else {
-      fseek (a->tr, 4 * sizeof (int) +
-	     (a->Nsteps-1)*_space_for_one_entry (a->N[0]), SEEK_SET);
-    }
-    fread_float (a, &a->stop_time);
-    a->dt = a->stop_time/(a->Nsteps-1);
-
-    a->Nvsteps = a->Nsteps;
-    if (a->vdt > a->dt) {
-      a->Nvsteps = 1 + (int) ((a->stop_time)/a->vdt);
-    }
-    else {
-      a->vdt = a->dt;
+    /* needs the node types; atrace_open() calls this after reading
+       the names */
+    if (a->N) {
+      read_header_steps (a);
     }
   }
   else {
@@ -642,7 +659,6 @@ static void safe_fwrite_buf (atrace *a, void *x)
       (((a->bufpos*sizeof(int)) + a->fpos) == ATRACE_MAX_FILE_SIZE)) {
     Assert (a->fpos == ftell (a->tr), "Invariant violated");
     _write_out_buf (a);
-    a->bufpos = 0;
     
     if (!ATRACE_IS_STREAM (a)) {
       a->fpos += sizeof (int) * a->bufpos;
@@ -658,6 +674,7 @@ static void safe_fwrite_buf (atrace *a, void *x)
 	a->fpos = 0;
       }
     }
+    a->bufpos = 0;
   }
   a->buffer[a->bufpos++] = * ((int*) x);
 }
@@ -671,13 +688,43 @@ static void safe_fwrite_bufdone (atrace *a)
       Assert (a->fpos == ftell (a->tr), "Invariant violated");
     }
     _write_out_buf (a);
-    a->bufpos = 0;
     if (!ATRACE_IS_STREAM (a)) {
       a->fpos += sizeof (int) * a->bufpos;
     }
+    a->bufpos = 0;
   }
   fflush (a->tr);
 }
+
+/*
+  Write n ints in one go, bypassing the buffer. Only used for the
+  time/node order formats, which are never split across files.
+*/
+static void safe_fwrite_block (atrace *a, const void *x, int n)
+{
+  if (n < a->bufsz - a->bufpos) {
+    int i;
+    for (i=0; i < n; i++) {
+      safe_fwrite_buf (a, (int *)x + i);
+    }
+    return;
+  }
+  if (!a->used) {
+    a->used = 1;
+    a->fpos = ftell (a->tr);
+  }
+  if (a->bufpos > 0) {
+    _write_out_buf (a);
+    a->fpos += sizeof (int) * a->bufpos;
+    a->bufpos = 0;
+  }
+  while (fwrite (x, sizeof (int), n, a->tr) != n) {
+    fprintf (stderr, "fwrite failed, retrying..\n");
+    sleep (60);
+    fseek (a->tr, a->fpos, SEEK_SET);
+  }
+  a->fpos += sizeof (int) * n;
+}
   
 
 static void safe_fwrite_int_buf (atrace *a, int x)
@@ -1108,6 +1155,11 @@ atrace *atrace_open (const char *s)
   _atrace_open_helper_names (a, nfp);
   fclose (nfp);
 
+  if (ATRACE_FMT(a->fmt) == ATRACE_TIME_ORDER || 
+      ATRACE_FMT(a->fmt) == ATRACE_NODE_ORDER) {
+    read_header_steps (a);
+  }
+
   /* buffer isn't used for reading */
   a->curt = -1;
   a->rec_type = -2;
@@ -2407,6 +2459,39 @@ static void _sig_nodeorder_end (atrace *a)
 }
 
 
+/*
+  Node order output in blocks, as an alternative to recording one
+  change at a time.
+*/
+int atrace_nodeorder_begin (atrace *a)
+{
+  int i;
+
+  Assert (ATRACE_FMT (a->fmt) == ATRACE_NODE_ORDER, "Only for node order format");
+  Assert (!a->locked, "atrace_nodeorder_begin: values already written");
+  Assert (a->Nnodes > 1, "atrace_nodeorder_begin: no nodes");
+
+  emit_header_aux (a);
+  for (i=0; i < a->Nsteps; i++) {
+    safe_fwrite_float_buf (a, i*a->dt);
+  }
+  a->nprev = NULL;
+  return a->Nnodes;
+}
+
+void atrace_nodeorder_block (atrace *a, int idx, const float *v)
+{
+  Assert (ATRACE_FMT (a->fmt) == ATRACE_NODE_ORDER, "Only for node order format");
+  Assert (idx == (a->nprev ? a->nprev->idx : 0) + 1,
+	  "atrace_nodeorder_block: nodes must be written in index order");
+  Assert (a->N[idx]->type == 0, "atrace_nodeorder_block: analog nodes only");
+
+  safe_fwrite_block (a, v, a->Nsteps);
+  a->nprev = a->N[idx];
+  a->curtime = a->Nsteps;
+  a->nprev->vu.v = v[a->Nsteps-1];
+}
+
 /* signal change */
 void atrace_signal_change_cause (atrace *a, name_t *n, float t, float v, name_t *c)
 {
@@ -331,6 +331,13 @@ void  atrace_general_change_cause (atrace *, name_t *, float t, atrace_val_t *v,
 #define atrace_signal_change(a,n,t,v) atrace_signal_change_cause ((a), (n), (t), (v), ((a)->N ? (a)->N[0] : NULL))
 #define atrace_general_change(a,n,t,v) atrace_general_change_cause ((a), (n), (t), (v), ((a)->N ? (a)->N[0] : NULL))
 
+int atrace_nodeorder_begin (atrace *);
+void atrace_nodeorder_block (atrace *, int idx, const float *v);
+  /* node order format only: begin emits the header and the time
+     array and returns the # of nodes. Then call block with all Nsteps
+     values for each analog node 1 .. Nnodes-1 in index order (see
+     ATRACE_NODE_IDX), and close the trace as usual. */
+
 name_t *atrace_create_node (atrace *, const char *);
   /* create a node; if exists, return old value */
 void atrace_mk_digital (name_t *n);
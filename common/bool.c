@@ -32,7 +32,7 @@
 #define PMIN(a,b) ((PTR_TO_INT(a) < PTR_TO_INT(b)) ? a : b)
 #define PMAX(a,b) ((PTR_TO_INT(a) > PTR_TO_INT(b)) ? a : b)
 
-static bool_t *freelist = NULL;
+static __thread bool_t *freelist = NULL; /* per thread, for parallel users */
 #ifdef PROFILE
 static unsigned long nfreed = 0;
 static unsigned long nbools = 0;
@@ -0,0 +1,408 @@
+/*************************************************************************
+ *
+ *  Calendar queue
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include "calqueue.h"
+#include "misc.h"
+
+/*
+ * Some invariants for calendar queue q:
+ *
+ *   every element with key k is in bucket (k >> q->shift) % q->nbuckets
+ *
+ *   each bucket list is sorted by key; equal keys are in insertion
+ *   order
+ *
+ *   q->sz > 0 => (q->lastslot <= (MIN k :: k >> q->shift))
+ */
+
+#define CALQ_MIN_BUCKETS 16
+
+/* # of keys sampled to estimate the slot width on a resize */
+#define CALQ_SAMPLE 25
+
+#define SLOT(q,k)   ((k) >> (q)->shift)
+#define BUCKET(q,s) ((int)((s) & (heap_key_t)((q)->nbuckets-1)))
+
+static void _calq_resize (CalQueue *q, int nbuckets);
+
+CalQueue *calq_new (int sz)
+{
+  CalQueue *q;
+  int i;
+
+  NEW (q, CalQueue);
+
+  for (i=CALQ_MIN_BUCKETS; i < sz; i <<= 1)
+    ;
+  q->sz = 0;
+  q->nbuckets = i;
+  q->shift = 0;
+  q->resize = 1;
+  q->lastslot = 0;
+  q->freelist = NULL;
+  q->ops = 0;
+  q->cost = 0;
+  MALLOC (q->head, calq_item_t *, q->nbuckets);
+  MALLOC (q->tail, calq_item_t *, q->nbuckets);
+  for (i=0; i < q->nbuckets; i++) {
+    q->head[i] = NULL;
+    q->tail[i] = NULL;
+  }
+  return q;
+}
+
+void calq_free (CalQueue *q, void (*free_element)(void *))
+{
+  calq_item_t *it, *tmp;
+  int i;
+
+  for (i=0; i < q->nbuckets; i++) {
+    for (it = q->head[i]; it; it = tmp) {
+      tmp = it->next;
+      if (free_element) {
+	(*free_element) (it->value);
+      }
+      FREE (it);
+    }
+  }
+  for (it = q->freelist; it; it = tmp) {
+    tmp = it->next;
+    FREE (it);
+  }
+  FREE (q->head);
+  FREE (q->tail);
+  FREE (q);
+}
+
+/*
+ * Add an item to its bucket after all items with key <= its key. New
+ * events are usually later than existing ones, so scan from the tail.
+ */
+static void _calq_link (CalQueue *q, calq_item_t *it)
+{
+  calq_item_t *prev;
+  int b;
+
+  b = BUCKET (q, SLOT (q, it->key));
+
+  for (prev = q->tail[b]; prev && prev->key > it->key; prev = prev->prev) {
+    q->cost++;
+  }
+  it->prev = prev;
+  if (prev) {
+    it->next = prev->next;
+    prev->next = it;
+  }
+  else {
+    it->next = q->head[b];
+    q->head[b] = it;
+  }
+  if (it->next) {
+    it->next->prev = it;
+  }
+  else {
+    q->tail[b] = it;
+  }
+}
+
+static void _calq_unlink (CalQueue *q, calq_item_t *it)
+{
+  int b;
+
+  b = BUCKET (q, SLOT (q, it->key));
+
+  if (it->prev) {
+    it->prev->next = it->next;
+  }
+  else {
+    q->head[b] = it->next;
+  }
+  if (it->next) {
+    it->next->prev = it->prev;
+  }
+  else {
+    q->tail[b] = it->prev;
+  }
+}
+
+/*
+ * Re-compute the slot width if the queue has been doing too much work
+ * per operation since the last check.
+ */
+static void _calq_check_cost (CalQueue *q)
+{
+  q->ops++;
+  if (q->ops < q->nbuckets) return;
+  if (q->resize && q->cost > 4*q->ops) {
+    _calq_resize (q, q->nbuckets);
+  }
+  q->ops = 0;
+  q->cost = 0;
+}
+
+calq_item_t *calq_insert (CalQueue *q, heap_key_t key, void *value)
+{
+  calq_item_t *it;
+
+  if (q->freelist) {
+    it = q->freelist;
+    q->freelist = it->next;
+  }
+  else {
+    NEW (it, calq_item_t);
+  }
+  it->key = key;
+  it->value = value;
+
+  if (q->sz == 0 || SLOT (q, key) < q->lastslot) {
+    q->lastslot = SLOT (q, key);
+  }
+  _calq_link (q, it);
+  q->sz++;
+
+  if (q->resize && q->sz > 2*q->nbuckets) {
+    _calq_resize (q, 2*q->nbuckets);
+  }
+  else {
+    _calq_check_cost (q);
+  }
+  return it;
+}
+
+void calq_delete (CalQueue *q, calq_item_t *it)
+{
+  _calq_unlink (q, it);
+  it->value = NULL;
+  it->next = q->freelist;
+  q->freelist = it;
+  q->sz--;
+
+  if (q->resize && q->nbuckets > CALQ_MIN_BUCKETS &&
+      q->sz < q->nbuckets/2) {
+    _calq_resize (q, q->nbuckets/2);
+  }
+}
+
+/*
+ * Return the item with the smallest key, and update lastslot.
+ */
+static calq_item_t *_calq_find_min (CalQueue *q)
+{
+  calq_item_t *it, *min;
+  heap_key_t s;
+  int i;
+
+  if (q->sz == 0) return NULL;
+
+  /* walk the calendar, one slot at a time */
+  s = q->lastslot;
+  for (i=0; i < q->nbuckets; i++) {
+    it = q->head[BUCKET (q, s)];
+    if (it && SLOT (q, it->key) == s) {
+      q->lastslot = s;
+      q->cost += i;
+      return it;
+    }
+    s++;
+  }
+  q->cost += q->nbuckets;
+
+  /* nothing within one year; direct search over the bucket heads */
+  min = NULL;
+  for (i=0; i < q->nbuckets; i++) {
+    it = q->head[i];
+    if (it && (!min || it->key < min->key)) {
+      min = it;
+    }
+  }
+  Assert (min, "Calendar queue is corrupted!");
+  q->lastslot = SLOT (q, min->key);
+  return min;
+}
+
+void *calq_peek_min (CalQueue *q)
+{
+  calq_item_t *it = _calq_find_min (q);
+  if (!it) return NULL;
+  return it->value;
+}
+
+heap_key_t calq_peek_minkey (CalQueue *q)
+{
+  calq_item_t *it = _calq_find_min (q);
+  if (!it) return 0;
+  return it->key;
+}
+
+void *calq_remove_min_key (CalQueue *q, heap_key_t *keyp)
+{
+  calq_item_t *it;
+  void *v;
+
+  it = _calq_find_min (q);
+  if (!it) return NULL;
+
+  v = it->value;
+  *keyp = it->key;
+  calq_delete (q, it);
+  _calq_check_cost (q);
+  return v;
+}
+
+void *calq_remove_min (CalQueue *q)
+{
+  heap_key_t k;
+  return calq_remove_min_key (q, &k);
+}
+
+/*
+ * Rebuild the queue with the specified number of buckets, with the
+ * slot width estimated from the average separation of the smallest
+ * keys in the queue.
+ */
+static void _calq_resize (CalQueue *q, int nbuckets)
+{
+  calq_item_t *all, *it, *tmp, *last;
+  heap_key_t sample[CALQ_SAMPLE];
+  heap_key_t sep, avg, w;
+  int ns, i, j;
+
+  /* collect all items into one list, preserving FIFO order within a
+     bucket */
+  all = NULL;
+  last = NULL;
+  ns = 0;
+  for (i=0; i < q->nbuckets; i++) {
+    for (it = q->head[i]; it; it = it->next) {
+      /* keep the CALQ_SAMPLE smallest keys, sorted */
+      if (ns < CALQ_SAMPLE || it->key < sample[ns-1]) {
+	if (ns < CALQ_SAMPLE) ns++;
+	for (j=ns-1; j > 0 && sample[j-1] > it->key; j--) {
+	  sample[j] = sample[j-1];
+	}
+	sample[j] = it->key;
+      }
+    }
+    if (q->head[i]) {
+      if (last) {
+	last->next = q->head[i];
+      }
+      else {
+	all = q->head[i];
+      }
+      last = q->tail[i];
+    }
+  }
+
+  /* estimate the slot width: three times the average separation,
+     ignoring separations larger than twice the average */
+  if (ns > 1) {
+    avg = (sample[ns-1] - sample[0])/(ns-1);
+    sep = 0;
+    j = 0;
+    for (i=1; i < ns; i++) {
+      if (sample[i] - sample[i-1] <= 2*avg) {
+	sep += sample[i] - sample[i-1];
+	j++;
+      }
+    }
+    if (j > 0) {
+      avg = sep/j;
+    }
+    w = 3*avg;
+    for (q->shift = 0; q->shift < 63 &&
+	   ((heap_key_t)1 << q->shift) < w; q->shift++)
+      ;
+  }
+
+  if (nbuckets != q->nbuckets) {
+    q->nbuckets = nbuckets;
+    REALLOC (q->head, calq_item_t *, q->nbuckets);
+    REALLOC (q->tail, calq_item_t *, q->nbuckets);
+  }
+  for (i=0; i < q->nbuckets; i++) {
+    q->head[i] = NULL;
+    q->tail[i] = NULL;
+  }
+  if (ns > 0) {
+    q->lastslot = SLOT (q, sample[0]);
+  }
+  else {
+    q->lastslot = 0;
+  }
+
+  for (it = all; it; it = tmp) {
+    tmp = it->next;
+    _calq_link (q, it);
+  }
+  q->ops = 0;
+  q->cost = 0;
+}
+
+void calq_rebase (CalQueue *q, heap_key_t delta)
+{
+  calq_item_t *it;
+  int i;
+
+  for (i=0; i < q->nbuckets; i++) {
+    for (it = q->head[i]; it; it = it->next) {
+      Assert (it->key >= delta, "calq_rebase: delta too large");
+      it->key -= delta;
+    }
+  }
+  /* bucket assignment depends on the key, so rebuild */
+  _calq_resize (q, q->nbuckets);
+}
+
+int calq_apply (CalQueue *q, int (*fn)(void *, void *), void *cookie)
+{
+  calq_item_t *it;
+  int i;
+
+  for (i=0; i < q->nbuckets; i++) {
+    for (it = q->head[i]; it; it = it->next) {
+      if ((*fn) (cookie, it->value)) {
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+void calq_clear (CalQueue *q)
+{
+  int i;
+
+  for (i=0; i < q->nbuckets; i++) {
+    if (q->head[i]) {
+      q->tail[i]->next = q->freelist;
+      q->freelist = q->head[i];
+      q->head[i] = NULL;
+      q->tail[i] = NULL;
+    }
+  }
+  q->sz = 0;
+  q->lastslot = 0;
+  q->ops = 0;
+  q->cost = 0;
+}
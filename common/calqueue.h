@@ -0,0 +1,96 @@
+/*************************************************************************
+ *
+ *  Calendar queue
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#ifndef __CALQUEUE_H__
+#define __CALQUEUE_H__
+
+#include <stdio.h>
+#include <common/heap.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *  Calendar queue (R. Brown, CACM 1988): a priority queue keyed by
+ *  time with O(1) amortized insert and remove-min when the keys are
+ *  inserted in roughly "hold model" fashion.
+ *
+ *  Time is divided into slots of 2^shift units. Slot s maps to bucket
+ *  (s mod nbuckets); each bucket is a doubly-linked list kept sorted
+ *  by key, with FIFO order for equal keys. The number of buckets and
+ *  the slot width are re-computed whenever the queue grows or shrinks
+ *  by a factor of two.
+ *
+ *  Insert returns a handle that can be used to delete the element
+ *  from the queue in O(1) time. A handle is invalid once its element
+ *  has been removed from the queue.
+ */
+
+typedef struct calq_item {
+  heap_key_t key;
+  void *value;
+  struct calq_item *next, *prev;
+} calq_item_t;
+
+typedef struct {
+  int sz;			/* # of elements in the queue */
+  int nbuckets;			/* # of buckets, power of two */
+  int shift;			/* slot width is 2^shift */
+  int resize;			/* 1 if resizing is enabled */
+  calq_item_t **head, **tail;	/* bucket lists */
+  heap_key_t lastslot;		/* slot of the last element removed */
+  calq_item_t *freelist;	/* free list of items */
+  int ops, cost;		/* work done since the last width check */
+} CalQueue;
+
+CalQueue *calq_new (int sz);
+void calq_free (CalQueue *q, void (*free_element)(void *));
+
+calq_item_t *calq_insert (CalQueue *q, heap_key_t key, void *value);
+void calq_delete (CalQueue *q, calq_item_t *it);
+
+void *calq_remove_min (CalQueue *q);
+void *calq_remove_min_key (CalQueue *q, heap_key_t *keyp);
+void *calq_peek_min (CalQueue *q);
+heap_key_t calq_peek_minkey (CalQueue *q);
+
+/* subtract delta from every key in the queue; delta must be no
+   larger than the smallest key */
+void calq_rebase (CalQueue *q, heap_key_t delta);
+
+/* apply fn to every element (in no particular order); stops early and
+   returns 1 if fn returns non-zero, returns 0 otherwise */
+int calq_apply (CalQueue *q, int (*fn)(void *cookie, void *value),
+		void *cookie);
+
+/* remove all elements, without changing the bucket structure */
+void calq_clear (CalQueue *q);
+
+#define calq_size(q) ((q)->sz)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CALQUEUE_H__ */
@@ -34,6 +34,55 @@ struct process_record {
 process_t *current_process = NULL;
 static process_t *terminated_process = NULL;
 
+#ifdef CONTEXT_FAST_SWITCH
+/*
+ * context_swap (void **save_sp, void *new_sp)
+ *
+ *   Push the callee-saved registers and the MXCSR and x87 control
+ *   words (also callee-saved in the x86-64 ABI), save the stack
+ *   pointer in *save_sp, switch to new_sp, and restore the state
+ *   saved there. The "ret" resumes the other context.
+ */
+void context_swap (void **save_sp, void *new_sp);
+
+#ifdef __APPLE__
+#define CONTEXT_SYM(x) "_" #x
+#else
+#define CONTEXT_SYM(x) #x
+#endif
+
+__asm__ (
+  ".text\n"
+  ".globl " CONTEXT_SYM(context_swap) "\n"
+  ".p2align 4\n"
+  CONTEXT_SYM(context_swap) ":\n"
+  "\tpushq %rbp\n"
+  "\tpushq %rbx\n"
+  "\tpushq %r12\n"
+  "\tpushq %r13\n"
+  "\tpushq %r14\n"
+  "\tpushq %r15\n"
+  "\tsubq $8, %rsp\n"
+  "\tstmxcsr (%rsp)\n"
+  "\tfnstcw 4(%rsp)\n"
+  "\tmovq %rsp, (%rdi)\n"
+  "\tmovq %rsi, %rsp\n"
+  "\tldmxcsr (%rsp)\n"
+  "\tfldcw 4(%rsp)\n"
+  "\taddq $8, %rsp\n"
+  "\tpopq %r15\n"
+  "\tpopq %r14\n"
+  "\tpopq %r13\n"
+  "\tpopq %r12\n"
+  "\tpopq %rbx\n"
+  "\tpopq %rbp\n"
+  "\tret\n"
+);
+
+/* the main thread's context is never resumed, but it is saved */
+static void *main_sp;
+#endif
+
 #ifdef FAIR
 
 static struct itimerval mt;	/* the timer for the main thread */
@@ -216,10 +265,17 @@ void context_disable (void)
  */
 void context_switch (process_t *p)
 {
+#ifdef CONTEXT_FAST_SWITCH
+  process_t *from = current_process;
+
+  current_process = p;
+  context_swap (from ? &from->c.sp : &main_sp, p->c.sp);
+#else
   if (!current_process || !_setjmp (current_process->c.buf)) {
     current_process = p;
     _longjmp (p->c.buf,1);
   }
+#endif
   if (terminated_process) {
     context_destroy (terminated_process);
     terminated_process = NULL;
@@ -357,7 +413,9 @@ void context_init (process_t *p, void (*f)(void))
   stack = p->c.stack;
   n = p->c.sz;
 
+#ifndef CONTEXT_FAST_SWITCH
   _setjmp (p->c.buf);
+#endif
 
 #if 0
   printf ("%llx context_init, %llx stack\n", (unsigned long long)context_init, 
@@ -375,7 +433,39 @@ void context_init (process_t *p, void (*f)(void))
   p->c.interrupted = 0;
 #endif
 
-#if defined(__sparc__) && !defined(__svr4__)
+#if defined(CONTEXT_FAST_SWITCH)
+
+#define INIT_SP(p) (unsigned long long)((char*)(p)->c.stack + (p)->c.sz)
+#define CURR_SP(p) (p)->c.sp
+
+  /*
+   * Initial stack, from the (16-byte aligned) top:
+   *    0             : fake return address for context_stub
+   *    context_stub  : popped by the "ret" in context_swap
+   *    6 x 0         : callee-saved registers
+   *    mxcsr, x87 cw : control words, inherited from the creator
+   * so that on entry to context_stub, %rsp is 8 mod 16 as required
+   * by the ABI.
+   */
+  {
+    unsigned long long *sp;
+    unsigned int mxcsr;
+    unsigned short fpucw;
+
+    __asm__ __volatile__ ("stmxcsr %0" : "=m" (mxcsr));
+    __asm__ __volatile__ ("fnstcw %0" : "=m" (fpucw));
+
+    sp = (unsigned long long *)(((unsigned long long)stack + n) & ~0xfULL);
+    *--sp = 0;
+    *--sp = (unsigned long long)context_stub;
+    for (i=0; i < 6; i++) {
+      *--sp = 0;
+    }
+    *--sp = (unsigned long long)mxcsr | ((unsigned long long)fpucw << 32);
+    p->c.sp = sp;
+  }
+
+#elif defined(__sparc__) && !defined(__svr4__)
 
 #define INIT_SP(p) (int)((double*)(p)->c.stack + (p)->c.sz/sizeof(double)-11)
 #define CURR_SP(p) (p)->c.buf[2]
@@ -38,6 +38,16 @@
 #define LARGE_STACK_SIZE (0x1000 * 16)
 #endif
 
+/*
+ * On x86-64, use a hand-written context switch that only saves the
+ * callee-saved registers and the stack pointer, instead of
+ * _setjmp/_longjmp with libc pointer mangling. Define
+ * CONTEXT_NO_FAST_SWITCH to use the setjmp-based version.
+ */
+#if defined(__x86_64__) && !defined(CONTEXT_NO_FAST_SWITCH)
+#define CONTEXT_FAST_SWITCH
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -68,6 +78,10 @@ typedef struct process_record process_t;
  */
 typedef struct {
   jmp_buf buf;			/* state  */
+#ifdef CONTEXT_FAST_SWITCH
+  void *sp;			/* saved stack pointer; the registers
+				   are saved on the stack */
+#endif
   char *stack;			/* stack  */
   int sz;			/* stack size */
   void (*start) ();		/* entry point */
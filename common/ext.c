@@ -22,14 +22,19 @@
  **************************************************************************
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <pwd.h>
 #include <ctype.h>
 #include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "ext.h"
 #include "lex.h"
 #include "config.h"
 #include "hash.h"
 #include "misc.h"
+#include "workpool.h"
 
 #define MAXLINE 1024
 
@@ -38,6 +43,9 @@ static char **device_names = NULL;
 
 static int path_first_time = 1;
 
+static int ext_threads = 1;	/* # of threads used by ext_read() */
+static int ext_cache = 0;	/* 1 if binary .extb caches are used */
+
 static
 struct pathlist {
   char *path;
@@ -186,59 +194,101 @@ void read_dotmagic (char *file)
 }
 
 
-static
-FILE *mag_path_open (const char *name, FILE **dumpfile)
+/*------------------------------------------------------------------------
+ *
+ *  Return the expanded path name of the extract file for "name", or
+ *  NULL if it is not on the search path. The caller frees the result.
+ *
+ *------------------------------------------------------------------------
+ */
+static void _ext_path_init (void)
 {
   struct pathlist *p;
-  char *file, *try;
-  FILE *fp;
+  char *s;
 
-  if (dumpfile) {
-    *dumpfile = NULL;
+  if (!path_first_time) {
+    return;
   }
-  if (path_first_time) {
-    addpath(Strdup("\".\""), 0);
-    read_dotmagic (Strdup("~cad/lib/magic/sys/.magicrc"));
-    read_dotmagic (Strdup("~/.magicrc"));
-    read_dotmagic (Strdup(".magicrc"));
+  addpath(Strdup("\".\""), 0);
+  read_dotmagic (Strdup("~cad/lib/magic/sys/.magicrc"));
+  read_dotmagic (Strdup("~/.magicrc"));
+  read_dotmagic (Strdup(".magicrc"));
+
+  /* expand ~ once, so that lookups don't need getpwnam() */
+  for (p = hd; p; p = p->next) {
+    MALLOC (s, char, strlen (p->path) + 2);
+    strcpy (s, p->path);
+    strcat (s, "/");
+    FREE (p->path);
+    p->path = expand (s);
+    FREE (s);
+    p->path[strlen (p->path)-1] = '\0';
   }
   path_first_time = 0;
+}
+
+char *ext_find_file (const char *name)
+{
+  struct pathlist *p;
+  char *try;
+  FILE *fp;
+
+  _ext_path_init ();
   p = hd;
 
   while (p) {
-    MALLOC (file, char, strlen (p->path)+strlen(name)+6);
-    strcpy (file, p->path);
-    strcat (file, "/");
-    strcat (file, name);
-    try = expand (file);
-    FREE (file);
+    MALLOC (try, char, strlen (p->path)+strlen(name)+6);
+    strcpy (try, p->path);
+    strcat (try, "/");
+    strcat (try, name);
 
     fp = fopen (try, "r");
     if (fp) {
-      if (dumpfile) {
-	sprintf (try + strlen (try) - 3, "hxt");
-	*dumpfile = fopen (try, "r");
-      }
-      FREE (try);
-      return fp; 
+      fclose (fp);
+      return try;
     }
     strcat (try, ".ext");
     fp = fopen (try, "r");
     if (fp) {
-      if (dumpfile) {
-	sprintf (try + strlen(try)-3, "hxt");
-	*dumpfile = fopen (try, "r");
-      }
-      FREE (try);
-      return fp;
+      fclose (fp);
+      return try;
     }
     FREE (try);
     p = p->next;
   }
-  fatal_error ("Could not find cell %s", name);
   return NULL;
 }
 
+/*
+ *  Open the extract file for a cell; if dumpfile is non-NULL, the
+ *  summary file is opened as well. If path is non-NULL, it is set to
+ *  the path of the extract file (freed by the caller).
+ */
+static
+FILE *mag_path_open (const char *name, FILE **dumpfile, char **path)
+{
+  char *try;
+  FILE *fp;
+
+  if (dumpfile) {
+    *dumpfile = NULL;
+  }
+  try = ext_find_file (name);
+  if (!try) {
+    fatal_error ("Could not find cell %s", name);
+  }
+  fp = fopen (try, "r");
+  if (path) {
+    *path = Strdup (try);
+  }
+  if (fp && dumpfile) {
+    sprintf (try + strlen (try) - 3, "hxt");
+    *dumpfile = fopen (try, "r");
+  }
+  FREE (try);
+  return fp;
+}
+
 
 /*
  *
@@ -333,6 +383,50 @@ char *getint (char *s, int *i)
  *
  *------------------------------------------------------------------------
  */
+/*
+ *  Node names are allocated from blocks rather than with one malloc
+ *  per name, since a flat extract file can have millions of them.
+ *  Like the rest of the parsed data, they are never freed.
+ */
+#define EXT_STRBLOCK_MAX 65536
+
+struct ext_strings {
+  char *cur;			/* next free byte in the current block */
+  int left;			/* bytes left in the current block */
+  int blk;			/* size of the last block */
+};
+
+static char *_ext_stralloc (struct ext_strings *S, int len)
+{
+  char *r;
+
+  if (len > S->left) {
+    if (len > EXT_STRBLOCK_MAX/4) {
+      MALLOC (r, char, len);
+      return r;
+    }
+    /* blocks grow, so small cells don't waste much space */
+    S->blk = S->blk ? S->blk*2 : 1024;
+    if (S->blk > EXT_STRBLOCK_MAX) {
+      S->blk = EXT_STRBLOCK_MAX;
+    }
+    MALLOC (S->cur, char, S->blk);
+    S->left = S->blk;
+  }
+  r = S->cur;
+  S->cur += len;
+  S->left -= len;
+  return r;
+}
+
+static char *_ext_strdup (struct ext_strings *S, const char *s)
+{
+  int len = strlen (s) + 1;
+  char *r = _ext_stralloc (S, len);
+  memcpy (r, s, len);
+  return r;
+}
+
 static
 void addcap (struct ext_file *ext, char *a, char *b, double cap, int type)
 {
@@ -396,7 +490,8 @@ void addattr (struct ext_file *ext, char *n, char *attr)
  *------------------------------------------------------------------------
  */
 static
-void expand_aliases (char *a, char *b, struct ext_file *ext, double cap)
+void expand_aliases (char *a, char *b, struct ext_file *ext, double cap,
+		     struct ext_strings *names)
 {
   char *s, *t;
   struct ext_alias *alias;
@@ -416,12 +511,12 @@ void expand_aliases (char *a, char *b, struct ext_file *ext, double cap)
   while (*t && *t != '[') t++;
   if (!*s || !*t) {
     MALLOC (alias, struct ext_alias, 1);
-    alias->n1 = Strdup(a);
-    alias->n2 = Strdup(b);
+    alias->n1 = _ext_strdup (names, a);
+    alias->n2 = _ext_strdup (names, b);
     alias->next = ext->aliases;
     ext->aliases = alias;
     if (cap != 0) 
-      addcap (ext,Strdup(alias->n1), Strdup(alias->n2), cap, CAP_CORRECT);
+      addcap (ext, alias->n1, alias->n2, cap, CAP_CORRECT);
   }
   else {
     sta = s+1;
@@ -455,13 +550,12 @@ void expand_aliases (char *a, char *b, struct ext_file *ext, double cap)
       *(sta-1) = '[';
       *(stb-1) = '[';
       MALLOC (alias, struct ext_alias, 1);
-      alias->n1 = Strdup(a);
-      alias->n2 = Strdup(b);
+      alias->n1 = _ext_strdup (names, a);
+      alias->n2 = _ext_strdup (names, b);
       alias->next = ext->aliases;
       ext->aliases = alias;
       if (cap != 0) 
-	addcap (ext,
-		Strdup(alias->n1), Strdup(alias->n2), cap, CAP_CORRECT);
+	addcap (ext, alias->n1, alias->n2, cap, CAP_CORRECT);
       FREE (a);
       FREE (b);
       return;
@@ -514,8 +608,7 @@ void expand_aliases (char *a, char *b, struct ext_file *ext, double cap)
 	alias->next = ext->aliases;
 	ext->aliases = alias;
 	if (cap != 0) 
-	  addcap (ext,
-		  Strdup(alias->n1), Strdup(alias->n2), cap, CAP_CORRECT);
+	  addcap (ext, alias->n1, alias->n2, cap, CAP_CORRECT);
       }
     else {
       for (i=0; i < xrange; i++)
@@ -528,8 +621,7 @@ void expand_aliases (char *a, char *b, struct ext_file *ext, double cap)
 	  alias->next = ext->aliases;
 	  ext->aliases = alias;
 	  if (cap != 0) 
-	    addcap (ext,
-		    Strdup(alias->n1), Strdup(alias->n2), cap,CAP_CORRECT);
+	    addcap (ext, alias->n1, alias->n2, cap, CAP_CORRECT);
 	}
     }
   }
@@ -563,7 +655,7 @@ void _check_ext_timestamp (FILE *fp, unsigned long tm)
       while (*s && *s != ' ') s++;
       *s = '\0';
       strcat (buf, ".ext");
-      subcell = mag_path_open (buf+4, &sdump);
+      subcell = mag_path_open (buf+4, &sdump, NULL);
       strcpy (cell, buf+4);
       if (sdump) fclose (sdump);
       if (!fgets (buf, MAXLINE, subcell) || 
@@ -589,7 +681,7 @@ ext_validate_timestamp (const char *file)
 
   fp = fopen (file, "r");
   if (!fp) {
-    fp = mag_path_open (file, NULL);
+    fp = mag_path_open (file, NULL, NULL);
   }
   if (!fp) {
     fatal_error ("File `%s' not found", file);
@@ -604,15 +696,429 @@ ext_validate_timestamp (const char *file)
 
 /*------------------------------------------------------------------------
  *
- *  Parse .ext file hierarchically
+ *  Binary cache of a parsed .ext file, saved as <cell>.extb next to
+ *  the .ext file. The cache is only used if the timestamp, size,
+ *  modification time and content hash of the .ext file as well as
+ *  the device names match the ones recorded in the cache; otherwise
+ *  the .ext file is parsed and the cache is re-written.
  *
  *------------------------------------------------------------------------
  */
-struct ext_file *ext_read (const char *name)
+#define EXT_CACHE_MAGIC   0x42545845	/* "EXTB" */
+#define EXT_CACHE_VERSION 2
+
+struct ext_cache_hdr {
+  unsigned int magic, version;
+  unsigned long timestamp;	/* .ext timestamp */
+  long long size;		/* .ext file size */
+  long long mtime;		/* .ext modification time, seconds */
+  long mtime_ns;		/*   ... and nanoseconds */
+  unsigned int sum;		/* hash of the .ext contents */
+  int ndev;			/* # of device types, -1 if default */
+  unsigned int devhash;		/* hash of the device names */
+};
+
+struct ext_rbuf {
+  FILE *fp;
+  int err;
+};
+
+static char *_ext_cache_name (const char *path)
+{
+  char *s;
+  int len = strlen (path);
+
+  MALLOC (s, char, len + 6);
+  strcpy (s, path);
+  if (len > 4 && strcmp (s + len - 4, ".ext") == 0) {
+    strcat (s, "b");
+  }
+  else {
+    strcat (s, ".extb");
+  }
+  return s;
+}
+
+/*
+ *  Hash of the contents of the .ext file; 0 if it can't be read.
+ */
+static unsigned int _ext_file_hash (const char *path)
+{
+  unsigned char buf[65536];
+  unsigned int sum = 0;
+  FILE *fp;
+  size_t n;
+  int cont = 0;
+
+  fp = fopen (path, "rb");
+  if (!fp) {
+    return 0;
+  }
+  while ((n = fread (buf, 1, sizeof (buf), fp)) > 0) {
+    sum = hash_function_continue (1 << 30, buf, n, sum, cont);
+    cont = 1;
+  }
+  fclose (fp);
+  return sum;
+}
+
+static void _ext_cache_hdr (struct ext_cache_hdr *h, unsigned long tm,
+			    const char *path, struct stat *st)
+{
+  int i;
+  
+  memset (h, 0, sizeof (*h));
+  h->magic = EXT_CACHE_MAGIC;
+  h->version = EXT_CACHE_VERSION;
+  h->timestamp = tm;
+  h->size = st->st_size;
+  h->mtime = st->st_mtime;
+#if defined(__APPLE__)
+  h->mtime_ns = st->st_mtimespec.tv_nsec;
+#else
+  h->mtime_ns = st->st_mtim.tv_nsec;
+#endif
+  h->sum = _ext_file_hash (path);
+  h->ndev = device_names ? num_devices : -1;
+  h->devhash = 0;
+  for (i=0; device_names && i < num_devices; i++) {
+    h->devhash = hash_function_continue (1 << 30,
+					 (const unsigned char *)device_names[i],
+					 strlen (device_names[i]) + 1,
+					 h->devhash, i > 0);
+  }
+}
+
+static void _ext_wint (FILE *fp, int x)
+{
+  fwrite (&x, sizeof (int), 1, fp);
+}
+
+static void _ext_wdbl (FILE *fp, double x)
+{
+  fwrite (&x, sizeof (double), 1, fp);
+}
+
+static void _ext_wstr (FILE *fp, const char *s)
+{
+  if (!s) {
+    _ext_wint (fp, -1);
+  }
+  else {
+    int len = strlen (s);
+    _ext_wint (fp, len);
+    fwrite (s, 1, len, fp);
+  }
+}
+
+static void _ext_read (struct ext_rbuf *r, void *x, int sz)
+{
+  if (r->err || fread (x, sz, 1, r->fp) != 1) {
+    r->err = 1;
+    memset (x, 0, sz);
+  }
+}
+
+static int _ext_rint (struct ext_rbuf *r)
+{
+  int x;
+  _ext_read (r, &x, sizeof (int));
+  return x;
+}
+
+static double _ext_rdbl (struct ext_rbuf *r)
+{
+  double x;
+  _ext_read (r, &x, sizeof (double));
+  return x;
+}
+
+static char *_ext_rstr (struct ext_rbuf *r)
+{
+  char *s;
+  int len = _ext_rint (r);
+
+  if (len < 0 || r->err) {
+    return NULL;
+  }
+  MALLOC (s, char, len + 1);
+  s[len] = '\0';
+  if (len > 0) {
+    _ext_read (r, s, len);
+  }
+  return s;
+}
+
+static char *_ext_rname (struct ext_rbuf *r, struct ext_strings *S)
+{
+  char *s;
+  int len = _ext_rint (r);
+
+  if (len < 0 || r->err) {
+    return NULL;
+  }
+  s = _ext_stralloc (S, len + 1);
+  s[len] = '\0';
+  if (len > 0) {
+    _ext_read (r, s, len);
+  }
+  return s;
+}
+
+static int _ext_count (void *l, int off)
+{
+  int n = 0;
+  while (l) {
+    n++;
+    l = *(void **)((char *)l + off);
+  }
+  return n;
+}
+#define EXT_COUNT(l,type) _ext_count ((l), offsetof (type, next))
+
+static void _ext_cache_save (const char *cache, const char *path,
+			     struct ext_file *ext)
+{
+  struct ext_cache_hdr h;
+  struct stat st;
+  struct ext_fets *f;
+  struct ext_list *sc;
+  struct ext_alias *a;
+  struct ext_cap *c;
+  struct ext_attr *at;
+  struct ext_ap *ap;
+  char *tmp;
+  FILE *fp;
+  int i, nd;
+
+  if (stat (path, &st) != 0) {
+    return;
+  }
+  MALLOC (tmp, char, strlen (cache) + 32);
+  sprintf (tmp, "%s.%d.tmp", cache, (int) getpid ());
+  fp = fopen (tmp, "wb");
+  if (!fp) {
+    /* no write permission; just don't cache */
+    FREE (tmp);
+    return;
+  }
+  _ext_cache_hdr (&h, ext->timestamp, path, &st);
+  fwrite (&h, sizeof (h), 1, fp);
+
+  nd = device_names ? num_devices : 2;
+
+  _ext_wint (fp, EXT_COUNT (ext->fet, struct ext_fets));
+  for (f = ext->fet; f; f = f->next) {
+    _ext_wint (fp, f->type);
+    _ext_wint (fp, f->isweak);
+    _ext_wdbl (fp, f->length);
+    _ext_wdbl (fp, f->width);
+    _ext_wstr (fp, f->g);
+    _ext_wstr (fp, f->t1);
+    _ext_wstr (fp, f->t2);
+    _ext_wstr (fp, f->sub);
+  }
+  _ext_wint (fp, EXT_COUNT (ext->subcells, struct ext_list));
+  for (sc = ext->subcells; sc; sc = sc->next) {
+    _ext_wstr (fp, sc->file);
+    _ext_wstr (fp, sc->id);
+    _ext_wdbl (fp, sc->mult);
+    _ext_wint (fp, sc->xlo);
+    _ext_wint (fp, sc->xhi);
+    _ext_wint (fp, sc->ylo);
+    _ext_wint (fp, sc->yhi);
+  }
+  _ext_wint (fp, EXT_COUNT (ext->aliases, struct ext_alias));
+  for (a = ext->aliases; a; a = a->next) {
+    _ext_wstr (fp, a->n1);
+    _ext_wstr (fp, a->n2);
+  }
+  _ext_wint (fp, EXT_COUNT (ext->cap, struct ext_cap));
+  for (c = ext->cap; c; c = c->next) {
+    _ext_wint (fp, c->type);
+    _ext_wdbl (fp, c->cap);
+    _ext_wstr (fp, c->n1);
+    _ext_wstr (fp, c->n2);
+  }
+  _ext_wint (fp, EXT_COUNT (ext->attr, struct ext_attr));
+  for (at = ext->attr; at; at = at->next) {
+    _ext_wstr (fp, at->n);
+    _ext_wint (fp, (int) at->attr);
+  }
+  _ext_wint (fp, EXT_COUNT (ext->ap, struct ext_ap));
+  for (ap = ext->ap; ap; ap = ap->next) {
+    _ext_wstr (fp, ap->node);
+    _ext_wint (fp, ap->area ? 1 : 0);
+    if (ap->area) {
+      for (i=0; i < nd; i++) {
+	_ext_wdbl (fp, ap->area[i]);
+	_ext_wdbl (fp, ap->perim[i]);
+      }
+    }
+  }
+  if (ferror (fp) | fclose (fp)) {
+    unlink (tmp);
+  }
+  else if (rename (tmp, cache) != 0) {
+    unlink (tmp);
+  }
+  FREE (tmp);
+}
+
+/*
+ *  Fill in ext from the cache, if it is valid for the .ext file fp.
+ *  Returns 1 on success, 0 if the .ext file has to be parsed.
+ */
+static int _ext_cache_load (const char *cache, const char *path, FILE *fp,
+			    struct ext_file *ext, struct ext_strings *names)
+{
+  struct ext_cache_hdr h, fh;
+  struct stat st;
+  struct ext_rbuf r;
+  FILE *cfp;
+  int i, j, n, nd;
+
+  if (fstat (fileno (fp), &st) != 0) {
+    return 0;
+  }
+  cfp = fopen (cache, "rb");
+  if (!cfp) {
+    return 0;
+  }
+  _ext_cache_hdr (&h, ext->timestamp, path, &st);
+  if (fread (&fh, sizeof (fh), 1, cfp) != 1 ||
+      memcmp (&h, &fh, sizeof (h)) != 0) {
+    fclose (cfp);
+    return 0;
+  }
+
+  r.fp = cfp;
+  r.err = 0;
+  nd = device_names ? num_devices : 2;
+
+  /* lists are rebuilt in the same order as they were saved */
+  {
+    struct ext_fets **f = &ext->fet;
+    n = _ext_rint (&r);
+    for (i=0; i < n && !r.err; i++) {
+      MALLOC (*f, struct ext_fets, 1);
+      (*f)->type = _ext_rint (&r);
+      (*f)->isweak = _ext_rint (&r);
+      (*f)->length = _ext_rdbl (&r);
+      (*f)->width = _ext_rdbl (&r);
+      (*f)->g = _ext_rname (&r, names);
+      (*f)->t1 = _ext_rname (&r, names);
+      (*f)->t2 = _ext_rname (&r, names);
+      (*f)->sub = _ext_rname (&r, names);
+      f = &(*f)->next;
+    }
+    *f = NULL;
+  }
+  {
+    struct ext_list **sc = &ext->subcells;
+    n = _ext_rint (&r);
+    for (i=0; i < n && !r.err; i++) {
+      MALLOC (*sc, struct ext_list, 1);
+      (*sc)->file = _ext_rstr (&r);
+      (*sc)->id = _ext_rstr (&r);
+      (*sc)->mult = _ext_rdbl (&r);
+      (*sc)->xlo = _ext_rint (&r);
+      (*sc)->xhi = _ext_rint (&r);
+      (*sc)->ylo = _ext_rint (&r);
+      (*sc)->yhi = _ext_rint (&r);
+      (*sc)->ext = NULL;
+      sc = &(*sc)->next;
+    }
+    *sc = NULL;
+  }
+  {
+    struct ext_alias **a = &ext->aliases;
+    n = _ext_rint (&r);
+    for (i=0; i < n && !r.err; i++) {
+      MALLOC (*a, struct ext_alias, 1);
+      (*a)->n1 = _ext_rname (&r, names);
+      (*a)->n2 = _ext_rname (&r, names);
+      a = &(*a)->next;
+    }
+    *a = NULL;
+  }
+  {
+    struct ext_cap **c = &ext->cap;
+    n = _ext_rint (&r);
+    for (i=0; i < n && !r.err; i++) {
+      MALLOC (*c, struct ext_cap, 1);
+      (*c)->type = _ext_rint (&r);
+      (*c)->cap = _ext_rdbl (&r);
+      (*c)->n1 = _ext_rname (&r, names);
+      (*c)->n2 = _ext_rname (&r, names);
+      c = &(*c)->next;
+    }
+    *c = NULL;
+  }
+  {
+    struct ext_attr **at = &ext->attr;
+    n = _ext_rint (&r);
+    for (i=0; i < n && !r.err; i++) {
+      MALLOC (*at, struct ext_attr, 1);
+      (*at)->n = _ext_rstr (&r);
+      (*at)->attr = (unsigned int) _ext_rint (&r);
+      at = &(*at)->next;
+    }
+    *at = NULL;
+  }
+  {
+    struct ext_ap **ap = &ext->ap;
+    n = _ext_rint (&r);
+    for (i=0; i < n && !r.err; i++) {
+      MALLOC (*ap, struct ext_ap, 1);
+      (*ap)->node = _ext_rname (&r, names);
+      (*ap)->area = NULL;
+      (*ap)->perim = NULL;
+      if (_ext_rint (&r)) {
+	MALLOC ((*ap)->area, double, nd);
+	MALLOC ((*ap)->perim, double, nd);
+	for (j=0; j < nd; j++) {
+	  (*ap)->area[j] = _ext_rdbl (&r);
+	  (*ap)->perim[j] = _ext_rdbl (&r);
+	}
+      }
+      ap = &(*ap)->next;
+    }
+    *ap = NULL;
+  }
+  if (!r.err && fgetc (cfp) != EOF) {
+    r.err = 1;
+  }
+  fclose (cfp);
+
+  if (r.err) {
+    /* corrupted cache; start over (and leak the partial lists) */
+    warning ("ignoring corrupted cache file `%s'", cache);
+    ext->fet = NULL;
+    ext->subcells = NULL;
+    ext->aliases = NULL;
+    ext->cap = NULL;
+    ext->attr = NULL;
+    ext->ap = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+
+/*------------------------------------------------------------------------
+ *
+ *  Parse a single .ext file; subcells are linked up by ext_read().
+ *  This only uses local state, so several files can be parsed in
+ *  parallel.
+ *
+ *------------------------------------------------------------------------
+ */
+static struct ext_file *_ext_read_one (const char *name, int top)
 {
   FILE *fp, *dump;
-  static char buf[MAXLINE];
-  static char tok1[MAXLINE], tok2[MAXLINE];
+  char buf[MAXLINE];
+  char tok1[MAXLINE], tok2[MAXLINE];
   struct ext_file *ext = NULL;
   LEX_T *l;
   struct ext_fets *fet;
@@ -624,39 +1130,24 @@ struct ext_file *ext_read (const char *name)
   double cscale, rscale;
   double lscale;
   double x;
-  static int depth = 0;
-  static struct Hashtable *ehash;
-  hash_bucket_t *eb;
+  char *path, *cache;
+  struct ext_strings names;
 
   dump = NULL;
   fp = NULL;
-  if (depth == 0) {
-    ehash = hash_new (2);
+  path = NULL;
+  if (top) {
     fp = fopen (name, "r");
-
-    if (!device_names) {
-      config_read ("extract.conf");
-      if (config_exists ("net.ext_devs")) {
-	num_devices = config_get_table_size ("net.ext_devs");
-	device_names = config_get_table_string ("net.ext_devs");
-      }
+    if (fp) {
+      path = Strdup (name);
     }
   }
-
-  eb = hash_lookup (ehash, name);
-  if (eb) {
-    return (struct ext_file *)eb->v;
-  }
-  eb = hash_add (ehash, name);
-  
   if (!fp) {
-    fp = mag_path_open (name, &dump);
+    fp = mag_path_open (name, &dump, &path);
   }
   if (!fp) {
     fatal_error ("Could not find extract file for `%s'", name);
   }
-  depth++;
-
 
   l = lex_string ("boo");
   l_comma = lex_addtoken (l, ",");
@@ -670,7 +1161,6 @@ struct ext_file *ext_read (const char *name)
   ext->cap = NULL;
   ext->attr = NULL;
   ext->ap = NULL;
-  eb->v = ext;
 
   buf[MAXLINE-1] = '\n';
 
@@ -685,12 +1175,7 @@ struct ext_file *ext_read (const char *name)
     fclose (fp);
     if (dump) fclose (dump);
     lex_free (l);
-    depth--;
-
-    if (depth == 0) {
-      hash_free (ehash);
-      ehash = NULL;
-    }
+    FREE (path);
     return ext;
   }
 
@@ -744,11 +1229,7 @@ struct ext_file *ext_read (const char *name)
 	}
       }
       lex_free (l);
-      depth--;
-      if (depth == 0) {
-	hash_free (ehash);
-	ehash = NULL;
-      }
+      FREE (path);
       return ext;
     }
     else {
@@ -758,6 +1239,20 @@ struct ext_file *ext_read (const char *name)
   }
   /* dump file is closed */
 readext:
+  names.cur = NULL;
+  names.left = 0;
+  names.blk = 0;
+  cache = NULL;
+  if (ext_cache) {
+    cache = _ext_cache_name (path);
+    if (_ext_cache_load (cache, path, fp, ext, &names)) {
+      fclose (fp);
+      lex_free (l);
+      FREE (cache);
+      FREE (path);
+      return ext;
+    }
+  }
   cscale = 1;
   rscale = 1;
   lscale = 1e-8;		/* 1 centimicron */
@@ -837,7 +1332,7 @@ readext:
       }
       subcell->next = ext->subcells;
       ext->subcells = subcell;
-      subcell->ext = ext_read (subcell->file);
+      subcell->ext = NULL;
     }
     else if (lex_have_keyw (l, "device")) {
       if (lex_have_keyw (l, "mosfet")) {
@@ -875,10 +1370,10 @@ readext:
 	dim2 = lex_mustbe_number (l)*lscale;
 
 	/* substrate */
-	fet->sub = Strdup (lex_mustbe_string_id (l, name, line));
+	fet->sub = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
 
 	/* gate */
-	fet->g = Strdup(lex_mustbe_string_id (l, name, line));
+	fet->g = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
 
 	gperim = lex_mustbe_number (l)*lscale; /* convert to SI units */
 	fet->isweak = 0;
@@ -892,7 +1387,7 @@ readext:
 	  } while (lex_have (l,l_comma));
 
 	/* t1 */
-	fet->t1 = Strdup(lex_mustbe_string_id (l, name, line));
+	fet->t1 = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
 	t1perim = lex_mustbe_number (l)*lscale; /* convert to SI units */
 	if (strcmp (lex_tokenstring (l), "0") == 0)
 	  lex_getsym (l);
@@ -904,7 +1399,7 @@ readext:
 	if (!fet->t2) {
 	  fatal_error ("fet in layout does not have enough terminals; t=%s; gate=%s", fet->t1, fet->g);
 	}
-	fet->t2 = Strdup(fet->t2);
+	fet->t2 = _ext_strdup (&names, fet->t2);
 	t2perim = lex_mustbe_number (l)*lscale; /* convert to SI unitS
 						   */
 
@@ -946,10 +1441,10 @@ readext:
       lex_mustbe_number (l); lex_mustbe_number (l); lex_mustbe_number (l);
 
       /* substrate */
-      fet->sub = Strdup (lex_mustbe_string_id (l, name, line));
+      fet->sub = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
 
       /* gate */
-      fet->g = Strdup(lex_mustbe_string_id (l, name, line));
+      fet->g = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
 
       gperim = lex_mustbe_number (l)*lscale; /* convert to SI units */
       fet->isweak = 0;
@@ -963,7 +1458,7 @@ readext:
 	} while (lex_have (l,l_comma));
 
       /* t1 */
-      fet->t1 = Strdup(lex_mustbe_string_id (l, name, line));
+      fet->t1 = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
       t1perim = lex_mustbe_number (l)*lscale; /* convert to SI units */
       if (strcmp (lex_tokenstring (l), "0") == 0)
 	lex_getsym (l);
@@ -975,7 +1470,7 @@ readext:
       if (!fet->t2) {
 	fatal_error ("fet in layout does not have enough terminals; t=%s; gate=%s", fet->t1, fet->g);
       }
-      fet->t2 = Strdup(fet->t2);
+      fet->t2 = _ext_strdup (&names, fet->t2);
       t2perim = lex_mustbe_number (l)*lscale; /* convert to SI unitS */
 
       fet->width = (t1perim + t2perim)/2;
@@ -988,7 +1483,7 @@ readext:
     else if (lex_have_keyw (l, "equiv")) {
       s = Strdup(lex_mustbe_string_id (l, name, line));
       t = Strdup(lex_mustbe_string_id (l, name, line));
-      expand_aliases (s, t, ext, 0);
+      expand_aliases (s, t, ext, 0, &names);
     }
     else if (lex_have_keyw (l, "merge")) {
       s = Strdup(lex_mustbe_string_id (l, name, line));
@@ -997,7 +1492,7 @@ readext:
 	x = cscale*lex_mustbe_number (l);
       else
 	x = 0;
-      expand_aliases (s, t, ext, x);
+      expand_aliases (s, t, ext, x, &names);
     }
     else if (lex_have_keyw (l, "node") || lex_have_keyw (l, "substrate")) {
       struct ext_ap *ap;
@@ -1009,10 +1504,10 @@ readext:
       lex_mustbe_number (l); /* y */
       lex_mustbe_string_contiguous_id (l); /* type */
 
-      addcap (ext, Strdup (s), NULL, x, CAP_GND);
+      addcap (ext, _ext_strdup (&names, s), NULL, x, CAP_GND);
 
       if (!lex_eof (l)) {
-	ap = add_ap_empty (ext, Strdup (s));
+	ap = add_ap_empty (ext, _ext_strdup (&names, s));
 	if (device_names) {
 	  int j;
 	  MALLOC (ap->area, double, num_devices);
@@ -1032,17 +1527,17 @@ readext:
 	  ap->perim[1] = lex_mustbe_number (l)*lscale;
 	}
       }
-      expand_aliases (s, Strdup(s), ext, 0);
+      expand_aliases (s, Strdup(s), ext, 0, &names);
     }
     else if (lex_have_keyw (l, "cap")) {
-      s = Strdup (lex_mustbe_string_id (l, name, line));
-      t = Strdup (lex_mustbe_string_id (l, name, line));
+      s = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
+      t = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
       x = lex_mustbe_number (l)*cscale;
       addcap (ext, s, t, x, CAP_INTERNODE);
     }
     else if (lex_have_keyw (l, "subcap")) {
       /* figure out what to do */
-      s = Strdup (lex_mustbe_string_id (l, name, line));
+      s = _ext_strdup (&names, lex_mustbe_string_id (l, name, line));
       x = lex_mustbe_number (l)*cscale;
       addcap (ext, s, NULL, x, CAP_SUBSTRATE);
     }
@@ -1063,10 +1558,128 @@ readext:
   }
   fclose (fp);
   lex_free (l);
-  depth--;
-  if (depth == 0) {
-    hash_free (ehash);
-    ehash = NULL;
+  if (cache) {
+    _ext_cache_save (cache, path, ext);
+    FREE (cache);
   }
+  FREE (path);
   return ext;
 }
+
+struct ext_read_batch {
+  char **names;
+  struct ext_file **ext;
+};
+
+static void _ext_read_job (void *cookie, int job, int tid)
+{
+  struct ext_read_batch *rb = (struct ext_read_batch *) cookie;
+  rb->ext[job] = _ext_read_one (rb->names[job], 0);
+}
+
+/*------------------------------------------------------------------------
+ *
+ *  ext_read --
+ *
+ *     Read a hierarchical extract file. The hierarchy is read one level
+ *     at a time; all the new cells used at a level are parsed in
+ *     parallel, and every distinct cell is only parsed once.
+ *
+ *------------------------------------------------------------------------
+ */
+struct ext_file *ext_read (const char *name)
+{
+  struct Hashtable *H;
+  hash_bucket_t *b;
+  struct ext_file *top, *e;
+  struct ext_list *sc;
+  struct ext_read_batch rb;
+  struct ext_file **level;
+  int nlevel, maxlevel;
+  char **names;
+  int n, maxnames;
+  int i;
+
+  if (!device_names) {
+    config_read ("extract.conf");
+    if (config_exists ("net.ext_devs")) {
+      num_devices = config_get_table_size ("net.ext_devs");
+      device_names = config_get_table_string ("net.ext_devs");
+    }
+  }
+  _ext_path_init ();
+
+  H = hash_new (8);
+  top = _ext_read_one (name, 1);
+  b = hash_add (H, name);
+  b->v = top;
+
+  maxlevel = 1;
+  MALLOC (level, struct ext_file *, maxlevel);
+  level[0] = top;
+  nlevel = 1;
+  maxnames = 0;
+  names = NULL;
+
+  while (nlevel > 0) {
+    /* new cells used by this level */
+    n = 0;
+    for (i=0; i < nlevel; i++) {
+      for (sc = level[i]->subcells; sc; sc = sc->next) {
+	if (hash_lookup (H, sc->file)) continue;
+	b = hash_add (H, sc->file);
+	b->v = NULL;
+	if (n == maxnames) {
+	  maxnames = 2*maxnames + 8;
+	  REALLOC (names, char *, maxnames);
+	}
+	names[n++] = b->key;
+      }
+    }
+    if (n == 0) break;
+
+    rb.names = names;
+    MALLOC (rb.ext, struct ext_file *, n);
+    workpool_run (ext_threads, n, _ext_read_job, &rb);
+
+    if (n > maxlevel) {
+      maxlevel = n;
+      REALLOC (level, struct ext_file *, maxlevel);
+    }
+    for (i=0; i < n; i++) {
+      hash_lookup (H, names[i])->v = rb.ext[i];
+      level[i] = rb.ext[i];
+    }
+    nlevel = n;
+    FREE (rb.ext);
+  }
+  if (names) {
+    FREE (names);
+  }
+  FREE (level);
+
+  /* link subcells; common subcells share the same ext_file */
+  for (i=0; i < H->size; i++) {
+    for (b = H->head[i]; b; b = b->next) {
+      e = (struct ext_file *) b->v;
+      for (sc = e->subcells; sc; sc = sc->next) {
+	sc->ext = (struct ext_file *) hash_lookup (H, sc->file)->v;
+      }
+    }
+  }
+  hash_free (H);
+  return top;
+}
+
+void ext_set_threads (int n)
+{
+  if (n <= 0) {
+    n = workpool_ncpus ();
+  }
+  ext_threads = n;
+}
+
+void ext_set_cache (int on)
+{
+  ext_cache = on ? 1 : 0;
+}
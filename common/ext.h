@@ -123,6 +123,15 @@ struct ext_file {
 extern struct ext_file *ext_read (const char *name);
 extern void ext_validate_timestamp (const char *name);
 
+/* # of threads used to parse extract files (0 = # of cpus) */
+extern void ext_set_threads (int n);
+
+/* 1 to cache parsed extract files in binary <cell>.extb files */
+extern void ext_set_cache (int on);
+
+/* path to the extract file for a cell on the search path, or NULL */
+extern char *ext_find_file (const char *name);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,7 +21,249 @@
  */
 #include "int.h"
 
-#define UNIT_SZ 
+/*------------------------------------------------------------------------
+ *
+ *   Multi-word kernels. These operate on arrays of units, least
+ *   significant unit first. The element-wise loops are written so
+ *   that the compiler can vectorize them.
+ *
+ *------------------------------------------------------------------------
+ */
+#if defined(BIGINT_TEST)
+typedef unsigned short BIGINT_DUNIT;
+#define BIGINT_HAVE_DUNIT
+#elif defined(__SIZEOF_INT128__)
+typedef unsigned __int128 BIGINT_DUNIT;
+#define BIGINT_HAVE_DUNIT
+#endif
+
+/* r = a + b + cin, where b has nb units and is extended with bext;
+   returns the carry out */
+static inline int _bi_add (UNIT_TYPE *r, const UNIT_TYPE *a,
+			   const UNIT_TYPE *b, int n, int nb,
+			   UNIT_TYPE bext, int cin)
+{
+  UNIT_TYPE c = cin;
+  int m = (n < nb) ? n : nb;
+  int i;
+  for (i=0; i < m; i++) {
+    UNIT_TYPE s = a[i] + b[i];
+    UNIT_TYPE c1 = (s < b[i]);
+    r[i] = s + c;
+    c = c1 | (r[i] < c);
+  }
+  for (; i < n; i++) {
+    UNIT_TYPE s = a[i] + bext;
+    UNIT_TYPE c1 = (s < bext);
+    r[i] = s + c;
+    c = c1 | (r[i] < c);
+  }
+  return c;
+}
+
+/* r = a - b, where b has nb units and is extended with bext */
+static inline void _bi_sub (UNIT_TYPE *r, const UNIT_TYPE *a,
+			    const UNIT_TYPE *b, int n, int nb,
+			    UNIT_TYPE bext)
+{
+  UNIT_TYPE bw = 0;
+  int m = (n < nb) ? n : nb;
+  int i;
+  for (i=0; i < m; i++) {
+    UNIT_TYPE d = a[i] - b[i];
+    UNIT_TYPE b1 = (a[i] < b[i]);
+    r[i] = d - bw;
+    bw = b1 | (d < bw);
+  }
+  for (; i < n; i++) {
+    UNIT_TYPE d = a[i] - bext;
+    UNIT_TYPE b1 = (a[i] < bext);
+    r[i] = d - bw;
+    bw = b1 | (d < bw);
+  }
+}
+
+/* two's complement negation in place; returns 1 if the value was
+   zero */
+static inline int _bi_neg (UNIT_TYPE *r, int n)
+{
+  int i;
+  for (i=0; i < n; i++) {
+    r[i] = ~r[i];
+  }
+  for (i=0; i < n; i++) {
+    r[i]++;
+    if (r[i] != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static inline int _bi_iszero (const UNIT_TYPE *a, int n)
+{
+  UNIT_TYPE x = 0;
+  for (int i=0; i < n; i++) {
+    x |= a[i];
+  }
+  return x == 0;
+}
+
+/* full product a*b, truncated to nr units */
+static void _bi_mul (UNIT_TYPE *r, int nr, const UNIT_TYPE *a, int na,
+		     const UNIT_TYPE *b, int nb)
+{
+  for (int i=0; i < nr; i++) {
+    r[i] = 0;
+  }
+  for (int i=0; i < na && i < nr; i++) {
+    UNIT_TYPE c = 0;
+    int j, k;
+    if (a[i] == 0) continue;
+    for (j=0; j < nb && i+j < nr; j++) {
+#ifdef BIGINT_HAVE_DUNIT
+      BIGINT_DUNIT t = (BIGINT_DUNIT)a[i]*b[j] + r[i+j] + c;
+      r[i+j] = (UNIT_TYPE)t;
+      c = (UNIT_TYPE)(t >> BIGINT_BITS_ONE);
+#else
+      /* split into half units */
+      const int h = BIGINT_BITS_ONE/2;
+      const UNIT_TYPE m = (((UNIT_TYPE)1) << h) - 1;
+      UNIT_TYPE al = a[i] & m, ah = a[i] >> h;
+      UNIT_TYPE bl = b[j] & m, bh = b[j] >> h;
+      UNIT_TYPE ll = al*bl, lh = al*bh, hl = ah*bl, hh = ah*bh;
+      UNIT_TYPE mid = (ll >> h) + (lh & m) + (hl & m);
+      UNIT_TYPE lo = (ll & m) | (mid << h);
+      UNIT_TYPE hi = hh + (lh >> h) + (hl >> h) + (mid >> h);
+      lo += r[i+j];
+      hi += (lo < r[i+j]);
+      lo += c;
+      hi += (lo < c);
+      r[i+j] = lo;
+      c = hi;
+#endif
+    }
+    for (k=i+j; c != 0 && k < nr; k++) {
+      r[k] += c;
+      c = (r[k] < c);
+    }
+  }
+}
+
+/* shift left in place by s units and b bits (b < BIGINT_BITS_ONE) */
+static inline void _bi_shl (UNIT_TYPE *r, int n, int s, int b)
+{
+  int i;
+  if (s >= n) {
+    for (i=0; i < n; i++) {
+      r[i] = 0;
+    }
+    return;
+  }
+  if (b == 0) {
+    for (i=n-1; i >= s; i--) {
+      r[i] = r[i-s];
+    }
+  }
+  else {
+    for (i=n-1; i > s; i--) {
+      r[i] = (r[i-s] << b) | (r[i-s-1] >> (BIGINT_BITS_ONE-b));
+    }
+    r[s] = r[0] << b;
+  }
+  for (i=0; i < s; i++) {
+    r[i] = 0;
+  }
+}
+
+/* shift right in place by s units and b bits, filling with f */
+static inline void _bi_shr (UNIT_TYPE *r, int n, int s, int b,
+			    UNIT_TYPE f)
+{
+  int i;
+  if (b == 0) {
+    for (i=0; i+s < n; i++) {
+      r[i] = r[i+s];
+    }
+  }
+  else {
+    for (i=0; i+s+1 < n; i++) {
+      r[i] = (r[i+s] >> b) | (r[i+s+1] << (BIGINT_BITS_ONE-b));
+    }
+    r[i] = (r[i+s] >> b) | (f << (BIGINT_BITS_ONE-b));
+    i++;
+  }
+  for (; i < n; i++) {
+    r[i] = f;
+  }
+}
+
+/* compare a and b, both with n units: -1, 0, 1 */
+static inline int _bi_cmp (const UNIT_TYPE *a, const UNIT_TYPE *b, int n)
+{
+  for (int i=n-1; i >= 0; i--) {
+    if (a[i] != b[i]) {
+      return (a[i] < b[i]) ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+/* unsigned q = y/x, r = y%x. q and r have ny units. x must be
+   non-zero. */
+static void _bi_divmod (UNIT_TYPE *q, UNIT_TYPE *r,
+			const UNIT_TYPE *y, int ny,
+			const UNIT_TYPE *x, int nx)
+{
+  int i;
+  while (nx > 1 && x[nx-1] == 0) {
+    nx--;
+  }
+  for (i=0; i < ny; i++) {
+    q[i] = 0;
+    r[i] = 0;
+  }
+#ifdef BIGINT_HAVE_DUNIT
+  if (nx == 1) {
+    BIGINT_DUNIT rem = 0;
+    for (i=ny-1; i >= 0; i--) {
+      BIGINT_DUNIT t = (rem << BIGINT_BITS_ONE) | y[i];
+      q[i] = (UNIT_TYPE)(t / x[0]);
+      rem = t % x[0];
+    }
+    r[0] = (UNIT_TYPE)rem;
+    return;
+  }
+#endif
+  /* shift-subtract on a remainder with one extra unit */
+  UNIT_TYPE buf[BIGINT_INLINE+1], *rr;
+  int nr = nx + 1;
+  if (nr > BIGINT_INLINE+1) {
+    MALLOC (rr, UNIT_TYPE, nr);
+  }
+  else {
+    rr = buf;
+  }
+  for (i=0; i < nr; i++) {
+    rr[i] = 0;
+  }
+  for (int k=ny*BIGINT_BITS_ONE-1; k >= 0; k--) {
+    UNIT_TYPE bit = (y[k/BIGINT_BITS_ONE] >> (k % BIGINT_BITS_ONE)) & 1;
+    _bi_shl (rr, nr, 0, 1);
+    rr[0] |= bit;
+    if (rr[nx] != 0 || _bi_cmp (rr, x, nx) >= 0) {
+      _bi_sub (rr, rr, x, nr, nx, 0);
+      q[k/BIGINT_BITS_ONE] |= ((UNIT_TYPE)1) << (k % BIGINT_BITS_ONE);
+    }
+  }
+  for (i=0; i < nx && i < ny; i++) {
+    r[i] = rr[i];
+  }
+  if (rr != buf) {
+    FREE (rr);
+  }
+}
+
 
 /*------------------------------------------------------------------------
  *
@@ -38,32 +280,31 @@ BigInt::BigInt(int w, int s, int d)
     w = w - BIGINT_BITS_ONE;
   } while (w > 0);
   Assert (len > 0, "What?");
-  if (len >= 2) {
+  if (len > BIGINT_INLINE) {
     MALLOC (u.v, UNIT_TYPE, len);
-    for (int i=0; i < len; i++) {
-      u.v[i] = 0;
-    }
-  } else {
-    u.value = 0;
+  }
+  UNIT_TYPE *v = getV();
+  for (int i=0; i < len; i++) {
+    v[i] = 0;
   }
   isdynamic = d;
   issigned = s;
 }
 
 /*-- copy constructor --*/
-BigInt::BigInt (BigInt &b)
+BigInt::BigInt (const BigInt &b)
 {
   isdynamic = b.isdynamic;
   issigned = b.issigned;
   len = b.len;
   width = b.width;
-  if (len >= 2) {
-    MALLOC (u.v, UNIT_TYPE, b.len);
+  if (len > BIGINT_INLINE) {
+    MALLOC (u.v, UNIT_TYPE, len);
     for (int i=0; i < len; i++) {
       u.v[i] = b.u.v[i];
     }
   } else {
-    u.value = b.u.value;
+    u = b.u;
   }
 }
 
@@ -73,16 +314,12 @@ BigInt::BigInt (BigInt &&b)
   isdynamic = b.isdynamic;
   issigned = b.issigned;
   len = b.len;
-  if (len >= 2) {
-    u.v = b.u.v;
-  } else {
-    u.value = b.u.value;
-  }
   width = b.width;
-  if (len >= 2) {
+  u = b.u;
+  if (len > BIGINT_INLINE) {
     b.u.v = NULL;
   } else {
-    b.u.value = 0;
+    b.u.w[0] = 0;
   }
   b.len = 0;
 }
@@ -91,20 +328,24 @@ BigInt::BigInt (BigInt &&b)
 BigInt& BigInt::operator=(const BigInt &b)
 {
   if (&b == this) { return *this; }
-  if (len >= 2) {
+  if (len > BIGINT_INLINE && (b.len <= BIGINT_INLINE || b.len != len)) {
     FREE (u.v);
+    len = 0;
   }
   isdynamic = b.isdynamic;
   issigned = b.issigned;
-  len = b.len;
   width = b.width;
-  if (len >= 2) {
-    MALLOC (u.v, UNIT_TYPE, len);
+  if (b.len > BIGINT_INLINE) {
+    if (len != b.len) {
+      MALLOC (u.v, UNIT_TYPE, b.len);
+    }
+    len = b.len;
     for (int i=0; i < len; i++) {
       u.v[i] = b.u.v[i];
     }
   } else {
-    u.value = b.u.value;
+    len = b.len;
+    u = b.u;
   }
   return *this;
 }
@@ -112,18 +353,14 @@ BigInt& BigInt::operator=(const BigInt &b)
 BigInt& BigInt::operator=(BigInt &&b)
 {
   if (&b == this) { return *this; }
-  if (len >= 2) {
+  if (len > BIGINT_INLINE) {
     FREE (u.v);
   }
   isdynamic = b.isdynamic;
   issigned = b.issigned;
   len = b.len;
   width = b.width;
-  if (len >= 2) {
-    u.v = b.u.v;
-  } else {
-    u.value = b.u.value;
-  }
+  u = b.u;
 
   b.u.v = NULL;
   b.len = 0;
@@ -133,20 +370,20 @@ BigInt& BigInt::operator=(BigInt &&b)
 
 BigInt& BigInt::operator=(const UNIT_TYPE &b)
 {
-  if (len >= 2) {
+  if (len > BIGINT_INLINE) {
     FREE (u.v);
   }
   isdynamic = 0;
   issigned = 0;
   len = 1;
   width = 8*sizeof(UNIT_TYPE);
-  u.value = b;
+  u.w[0] = b;
   return *this;
 }
 
 BigInt& BigInt::operator=(const std::string &b)
 {
-  if (len >= 2) {
+  if (len > BIGINT_INLINE) {
     FREE(u.v);
   }
 
@@ -161,14 +398,11 @@ BigInt& BigInt::operator=(const std::string &b)
 
   if ((4*(b.size()-2)) % BIGINT_BITS_ONE == 0) {
     len = 4*(b.size()-2)/BIGINT_BITS_ONE;
-    if (len >= 2) {
-      MALLOC(u.v, UNIT_TYPE, len);
-    }
   } else {
     len = 1 + 4*(b.size()-2)/BIGINT_BITS_ONE;
-    if (len >= 2) {
-      MALLOC(u.v, UNIT_TYPE, len);
-    }
+  }
+  if (len > BIGINT_INLINE) {
+    MALLOC(u.v, UNIT_TYPE, len);
   }
 
   std::string hex_test = b.substr(0,2);
@@ -253,16 +487,13 @@ void BigInt::expandSpace (int amt)
     signExtend();
   }
 
+  int ol = len;
   _adjlen (x);
-  if (x > 1) {
-    for (; len < x; len++) {
-      u.v[len] = 0;
-      if (sa) {
-        u.v[len] = ~u.v[len];
-      }
+  if (sa) {
+    UNIT_TYPE *v = getV();
+    for (int i=ol; i < x; i++) {
+      v[i] = ~((UNIT_TYPE)0);
     }
-  } else {
-    len = x;
   }
 }
 
@@ -275,7 +506,6 @@ void BigInt::squeezeSpace (int amt)
     x = (width - amt + BIGINT_BITS_ONE-1)/BIGINT_BITS_ONE;
     if (x < len) {
       _adjlen (x);
-      len = x;
     }
   }
   width = width - amt;
@@ -284,11 +514,7 @@ void BigInt::squeezeSpace (int amt)
   UNIT_TYPE res = 0;
   res = ~res;
   res = res >> tmp;
-  if (len >= 2) {
-    u.v[len-1] = u.v[len-1] & res;
-  } else {
-    u.value = u.value & res;
-  }
+  getV()[len-1] &= res;
 
   int sa = 0;
   sa = isSigned() && isNegative();
@@ -306,53 +532,13 @@ void BigInt::squeezeSpace (int amt)
  */
 BigInt BigInt::operator-() const
 {
-  int i;
   BigInt b;
-  int c = 1;
-  int sa = isSigned() && isNegative();
 
   b = (*this);
-  
-  if (len >= 2) {
-    for (int i=0; i < len; i++) {
-      b.u.v[i] = ~b.u.v[i];
-    }
-  } else {
-    b.u.value = ~b.u.value;
-  }
 
-  for (int i = 0; c == 1 && (i<len); i++) {
-    if (len >= 2) {
-      b.u.v[i] = b.u.v[i] + c;
-      if (b.u.v[i] == 0) {
-        c = 1;
-      } else {
-        c = 0;
-        break;
-      }
-    } else {
-      b.u.value = b.u.value + c;
-      if (b.u.value == 0) {
-        c = 1;
-      } else {
-        c = 0;
-        break;
-      }
-    }
-  }
-  if (c && isDynamic()) {
+  if (_bi_neg (b.getV(), len) && isDynamic()) {
+    /* zero: the carry out widens a dynamic value */
     b.expandSpace (1);
-    if (b.len >= 2) {
-      b.u.v[len-1] = 0;
-      if (sa) {
-        b.u.v[len-1] = ~b.u.v[len-1];
-      }
-    } else {
-      b.u.value = 0;
-      if (sa) {
-        b.u.value = ~b.u.value;
-      }
-    }
     b.width++;
   }
   return b;
@@ -722,62 +908,29 @@ void BigInt::_add (const BigInt &b, int cin)
   }
 
   int i;
-  int c, nc;
+  int nc;
   int sa, sb;
 
   sa = isSigned() & isNegative();
   sb = b.isSigned() & b.isNegative();
 
-  BigInt b_ext;
-
-  if (len < b.len) {
-    if (isDynamic()) {
-      _adjlen (b.len);
-      for (i=len; i < b.len; i++) {
-        u.v[i] = 0;
-        if (sa) {
-          u.v[i] = ~u.v[i];
-        }
-      }
-      len = b.len;
-      width = b.width;
-    }
-  } else if (b.len < len) {
-    b_ext._adjlen (len-b.len);
-    b_ext.len = len - b.len;
-    for (i=b.len; i < len; i++) {
-      b_ext._setVal (i-b.len, 0);
-      if (sb == 1) {
-        b_ext._setVal (i-b.len, ~b_ext.getVal (i-b.len));
+  if (len < b.len && isDynamic()) {
+    int ol = len;
+    _adjlen (b.len);
+    if (sa) {
+      for (i=ol; i < len; i++) {
+        _setVal (i, ~((UNIT_TYPE)0));
       }
     }
-    b_ext.width = width - b.len*BIGINT_BITS_ONE;
+    width = b.width;
   }
 
-  c = 0;
-  nc = cin;
-  for (i = 0; i < len; i++) {
-    UNIT_TYPE value;
-    c = nc;
-    if (i < b.len) {
-      value = b.getVal (i);
-    } else {
-      value = b_ext.getVal (i-b.len);
-    }
-    _setVal (i, getVal (i) + value);
-    if (getVal (i) <  value) {
-      nc = 1;
-    } else {
-      nc = 0;
-    }
-    _setVal (i, getVal (i) + c);
-    if (getVal (i) == 0 && c != 0) {
-      nc = 1;
-    }
-  }
+  UNIT_TYPE *v = getV();
+  nc = _bi_add (v, v, b.getV(), len, b.len,
+		sb ? ~((UNIT_TYPE)0) : 0, cin);
 
   int dif;
-  UNIT_TYPE x, nx;
+  UNIT_TYPE nx;
   if (width == len * BIGINT_BITS_ONE) {
     dif = 0;
   } else {
@@ -791,7 +944,6 @@ void BigInt::_add (const BigInt &b, int cin)
   
   if (isDynamic()) {
     if (nc) {
-      UNIT_TYPE one = 1;
       expandSpace(1);
       width++;
       sa = isSigned() && isNegative();
@@ -835,66 +987,25 @@ BigInt &BigInt::operator-=(const BigInt &b)
     return *this;
   }
 
-  BigInt nb;
-
   int i;
-  int c, nc;
   int sa, sb;
 
   sa = isSigned() && isNegative();
   sb = b.isSigned() && b.isNegative();
 
-  BigInt b_ext;
-  if (len < b.len) {
-    if (isDynamic()) {
-      _adjlen (b.len);
-      for (i=len; i < b.len; i++) {
-        u.v[i] = 0;
-        if (sa) {
-          u.v[i] = ~u.v[i];
-        }
-      }
-      if (sa) {  signExtend(); }
-      width = b.width;
-      len = b.len;
-    }
-  } else if (b.len < len) {
-    b_ext._adjlen (len-b.len);
-    b_ext.len = len - b.len;
-    for (i=b.len; i < len; i++) {
-      b_ext._setVal (i-b.len, 0);
-      if (sb == 1) {
-        b_ext._setVal (i-b.len, ~b_ext.getVal (i-b.len));
+  if (len < b.len && isDynamic()) {
+    int ol = len;
+    _adjlen (b.len);
+    if (sa) {
+      for (i=ol; i < len; i++) {
+        _setVal (i, ~((UNIT_TYPE)0));
       }
     }
-    if (sb) {  b_ext.signExtend(); }
-    b_ext.width = width - b.len*BIGINT_BITS_ONE;
+    width = b.width;
   }
 
-  nb = (-b);
-  b_ext = (~b_ext);
-  
-  c = 0;
-  nc = 0;
-  for (i = 0; i < len; i++) {
-    UNIT_TYPE value;
-    c = nc;
-    if (i < nb.len) {
-      value = nb.getVal (i);
-    } else {
-      value = b_ext.getVal (i-nb.len);
-    }
-    _setVal (i, getVal (i) + value);
-    if (getVal (i) < value) {
-      nc = 1;
-    } else {
-      nc = 0;
-    }
-    _setVal (i, getVal (i) + c);
-    if (getVal (i) == 0 && c != 0) {
-      nc = 1;
-    }
-  }
+  UNIT_TYPE *v = getV();
+  _bi_sub (v, v, b.getV(), len, b.len, sb ? ~((UNIT_TYPE)0) : 0);
 
   if (isSigned()) {
     signExtend();
@@ -906,12 +1017,13 @@ BigInt &BigInt::operator-=(const BigInt &b)
 }
 
 
-BigInt BigInt::operator*(BigInt &b)
+BigInt BigInt::operator*(const BigInt &b) const
 {
-
   if (isSigned() != b.isSigned()) {
-    issigned = 0;
-    b.issigned = 0;
+    BigInt ta(*this), tb(b);
+    ta.toUnsigned();
+    tb.toUnsigned();
+    return ta * tb;
   }
 
   BigInt tmp(*this);
@@ -927,144 +1039,28 @@ BigInt BigInt::operator*(BigInt &b)
     return tmp;
   }
 
-  if (isOne() == 1) {
-    for (auto i = 0; i < b.len; i++) {
-      tmp._setVal (i, b.getVal (i));
-    }
-    if (b.isSigned() && b.isNegative()) {
-      UNIT_TYPE mask = 0;
-      mask = ~mask;
-      for (auto i = b.len; i < tmp.len; i++) {
-        tmp._setVal (i, mask);
-      }
-    }
-    return tmp;
-  } else if (b.isOne() == 1) {
-    for (auto i = 0; i < len; i++) {
-      tmp._setVal (i, getVal (i));
-    }
-    if (isSigned() && isNegative()) {
-      UNIT_TYPE mask = 0;
-      mask = ~mask;
-      for (auto i = len; i < tmp.len; i++) {
-        tmp._setVal (i, mask);
-      }
-    }
-    return tmp;
-  }
-
+  /* multiply magnitudes, then fix the sign */
   int sa = 0;
+  BigInt x, y;
+  const UNIT_TYPE *xv = b.getV();
+  const UNIT_TYPE *yv = getV();
 
-  BigInt x(b);
   if (b.isSigned() && b.isNegative()) {
     sa = sa ^ 0x1;
-    x = (-x);
+    x = b;
+    _bi_neg (x.getV(), x.len);
+    xv = x.getV();
   }
-
-  BigInt y(*this);
   if (isSigned() && isNegative()) {
     sa = sa ^ 0x1;
-    y = (-y);
+    y = *this;
+    _bi_neg (y.getV(), y.len);
+    yv = y.getV();
   }
 
-  int k;
-  int l;
-  UNIT_TYPE carry = 0;
-
-  UNIT_TYPE mid = 0;
+  _bi_mul (tmp.getV(), tmp.len, yv, len, xv, b.len);
 
-  UNIT_TYPE par_prod1, par_prod2, par_prod3, par_prod4;
-  UNIT_TYPE a1, a2;
-  UNIT_TYPE b1, b2;
-
-  UNIT_TYPE um; //upper half mask
-  UNIT_TYPE lm; //lower half mask
-
-  um = 0;
-  um = ~um;
-  um = um >> (BIGINT_BITS_ONE/2);
-  lm = ~um;
-
-  for (auto i = 0; i < len; i++) {
-    for (auto j = 0; j < x.len; j++) {
-      k = i + j;
-
-      a1 = y.getVal (i) & um;
-      b1 = x.getVal (j) & um;
-      a2 = y.getVal (i) >> (BIGINT_BITS_ONE/2); 
-      b2 = x.getVal (j) >> (BIGINT_BITS_ONE/2);
-
-      par_prod1 = a1 * b1;
-
-      carry = (UNIT_TYPE)(par_prod1 + tmp.getVal (k)) < par_prod1;
-
-      tmp._setVal (k, tmp.getVal (k) + par_prod1);
-
-      l = k+1;
-      while (carry == 1) {
-        tmp._setVal (l, tmp.getVal (l) + carry);
-        if (tmp.getVal (l) == 0) {
-          carry = 1;
-          l++;
-        } else {
-          carry = 0;
-          break;
-        }
-      }
-
-      par_prod3 = a2 * b2;
-
-      carry = (UNIT_TYPE)(par_prod3 + tmp.getVal (k+1)) < par_prod3;
-
-      l = k+2;
-      while (carry == 1) {
-        tmp._setVal (l, tmp.getVal (l) + carry);
-        if (tmp.getVal (l) == 0) {
-          carry = 1;
-          l++;
-        } else {
-          carry = 0;
-          break;
-        }
-      }
-
-      tmp._setVal (k+1, tmp.getVal (k+1) + par_prod3);
-
-      mid = (tmp.getVal (k) >> BIGINT_BITS_ONE/2) | (tmp.getVal (k+1) << BIGINT_BITS_ONE/2);
-
-      par_prod2 = a2 * b1;
-      par_prod3 = a1 * b2;
-
-      carry = (UNIT_TYPE)(par_prod2 + par_prod3) < par_prod2;
-
-      par_prod2 = par_prod2 + par_prod3;
-
-      carry += (UNIT_TYPE)(mid + par_prod2) < mid;
-
-      mid = mid + par_prod2;
-
-      tmp._setVal (k,  (tmp.getVal (k) & um) | ((mid & um) << BIGINT_BITS_ONE/2));
-      tmp._setVal (k+1, (tmp.getVal (k+1) & lm) | ((mid & lm) >> BIGINT_BITS_ONE/2));
-
-      if (carry > 0) {
-        carry = carry << (BIGINT_BITS_ONE/2);
-        
-        l = k + 1;
-        while (carry > 0) {
-          if ((UNIT_TYPE)(tmp.getVal (l) + carry) < tmp.getVal (l)) {
-            tmp._setVal (l, tmp.getVal (l) + carry);
-            carry = 1;
-            l++;
-          } else {
-            tmp._setVal (l, tmp.getVal (l) + carry);
-            carry = 0;
-          }
-        }
-      }
-    }
-  }
-
-  if(sa) {
+  if (sa) {
     tmp = (-tmp);
     tmp.toSigned();
   }
@@ -1072,11 +1068,14 @@ BigInt BigInt::operator*(BigInt &b)
   return tmp;
 }
 
-void BigInt::_div(BigInt &b, int func)
+void BigInt::_div(const BigInt &b, int func)
 {
   if (isSigned() != b.isSigned()) {
-    issigned = 0;
-    b.issigned = 0;
+    BigInt tb(b);
+    toUnsigned();
+    tb.toUnsigned();
+    _div (tb, func);
+    return;
   }
 
   if (b.isZero()) {
@@ -1107,21 +1106,18 @@ void BigInt::_div(BigInt &b, int func)
     }
   }
 
+  /* divide magnitudes; the result is negated if the signs differ */
   int sa = 0;
-  BigInt x;
+  BigInt x(b);
   if (b.isSigned() && b.isNegative()) {
-    x = (-b);
+    _bi_neg (x.getV(), x.len);
     sa = sa ^ 0x1;
-  } else {
-    x = b;
   }
 
-  BigInt y;
+  BigInt y(*this);
   if (isSigned() && isNegative()) {
-    y = (-(*this));
+    _bi_neg (y.getV(), y.len);
     sa = sa ^ 0x1;
-  } else {
-    y = *this;
   }
 
   if (width <= BIGINT_BITS_ONE && b.width <= BIGINT_BITS_ONE) {
@@ -1133,91 +1129,37 @@ void BigInt::_div(BigInt &b, int func)
     if (sa) {
       y = (-y);
     }
-    *this = y;
+    *this = std::move (y);
     return;
   }
 
   x.toUnsigned();
   y.toUnsigned();
 
-  BigInt tmp_q(*this);
-  BigInt tmp_r(*this);
-  for (int i = 0; i < len; i++) {
-    tmp_q._setVal (i, 0);
-    tmp_r._setVal (i, 0);
-  }
-  tmp_q.toUnsigned();
-  tmp_q.toStatic();
-
-  tmp_r.toUnsigned();
-  tmp_r.toStatic();
-
-  BigInt one;
-  one.toStatic();
-  one.toUnsigned();
-  UNIT_TYPE l_one = 1;
-  one = l_one;
-
-  unsigned int word_num = len-1;
-  unsigned int res = width % BIGINT_BITS_ONE;
-  unsigned int shift = (res == 0) ? (BIGINT_BITS_ONE -1) : (res -1);
-  
-  for (auto k = width; k > 0; k--) {
-    tmp_q <<= 1;
-    tmp_r <<= 1;
-
-    if (((y.getVal (word_num) >> shift) & 0x1) == 1) {
-      tmp_r += one;
-    }
-    if (tmp_r >= x) {
-      tmp_r -= x;
-      tmp_q += one;
-    }
-
-    if (shift == 0) {
-      word_num--;
-      shift = BIGINT_BITS_ONE -1;
-    } else {
-      shift--;
-    }
-  }
+  BigInt q(y), r(y);
+  _bi_divmod (q.getV(), r.getV(), y.getV(), y.len, x.getV(), x.len);
 
+  BigInt &res = (func == 0) ? q : r;
+  res.toStatic();
   if (sa) {
-    if (func == 0) {
-      tmp_q = (-tmp_q);
-      tmp_q.toSigned();
-    } else {
-      tmp_r = (-tmp_r);
-      tmp_r.toSigned();
-    } 
-  }
-
-  if (isDynamic() == 0) {
-    if (func == 0) {
-      tmp_q.adjlen(len);
-    } else {
-      tmp_r.adjlen(len);
-    }
+    _bi_neg (res.getV(), res.len);
+    res.toSigned();
   }
-
-  if (func == 0) {
-    *this = tmp_q;
-  } else {
-    *this = tmp_r;
-  }
-
+  *this = std::move (res);
 }
 
-BigInt BigInt::operator/(BigInt &b)
+BigInt BigInt::operator/(const BigInt &b) const
 {
-  _div(b, 0);
-  return *this;
+  BigInt tmp(*this);
+  tmp._div(b, 0);
+  return tmp;
 }
 
-BigInt BigInt::operator%(BigInt &b)
+BigInt BigInt::operator%(const BigInt &b) const
 {
-  _div(b, 1);
-  return *this;
+  BigInt tmp(*this);
+  tmp._div(b, 1);
+  return tmp;
 }
 
 /*------------------------------------------------------------------------
@@ -1228,9 +1170,13 @@ BigInt BigInt::operator%(BigInt &b)
  */
 unsigned int BigInt::nBit(unsigned long n)
 {
-  unsigned int num = n/BIGINT_BITS_ONE;
+  unsigned long num = n/BIGINT_BITS_ONE;
   unsigned int shift = n%BIGINT_BITS_ONE;
 
+  if (num >= (unsigned long)len) {
+    return isNegative();
+  }
+
   unsigned int res = (getVal (num) >> shift) & 0x1;
 
   return res;
@@ -1246,25 +1192,13 @@ unsigned int BigInt::nBit(unsigned long n)
  */
 int BigInt::isZero () const
 {
-  if (len >= 2) {
-    for (auto i = 0; i < len; i++) {
-      if (u.v[i] != 0) return 0;
-    }
-  } else {
-    if (u.value != 0) return 0;
-  }
-  return 1;
+  return _bi_iszero (getV(), len);
 }
 
 int BigInt::isOne () const
 {
   if (getVal (0) == 1) {
-    for (auto i = 1; i < len; i++) {
-      if (getVal (i) != 0) {
-        return 0;
-      }
-    }
-    return 1;
+    return _bi_iszero (getV()+1, len-1);
   } else {
     return 0;
   }
@@ -1272,17 +1206,7 @@ int BigInt::isOne () const
 
 int BigInt::isOneInt() const
 {
-  if (len >= 2) {
-    for (auto i = 1; i < len; i++) {
-      if (u.v[i] != 0) {
-        return 0;
-      }
-    }
-    //squeezeSpace((len-1) * BIGINT_BITS_ONE);
-    return 1;
-  } else {
-    return 1;
-  }
+  return _bi_iszero (getV()+1, len-1);
 }
 /*------------------------------------------------------------------------
  *
@@ -1303,14 +1227,18 @@ BigInt &BigInt::operator&=(const BigInt &b)
 
   int mil = std::min(len, b.len); //min length
   int mal = std::max(len, b.len); //max length
-  adjlen(mal);
-  len = mal;
-  for (int i = 0; i < mal; i++) {
-    if (i < mil) {
-      setVal (i, getVal (i) & b.getVal (i));
-    } else {
-      setVal (i, 0);
-    }
+  _adjlen(mal);
+
+  UNIT_TYPE *v = getV();
+  const UNIT_TYPE *bv = b.getV();
+  for (int i = 0; i < mil; i++) {
+    v[i] &= bv[i];
+  }
+  for (int i = mil; i < mal; i++) {
+    v[i] = 0;
+  }
+  if (isSigned()) {
+    signExtend ();
   }
 
   return (*this);
@@ -1329,16 +1257,18 @@ BigInt &BigInt::operator|=(const BigInt &b)
 
   int mil = std::min(len, b.len); //min length
   int mal = std::max(len, b.len); //max length
-  adjlen(mal);
-  len = mal;
-  for (int i = 0; i < mal; i++) {
-    if (i < mil) {
-      setVal (i, getVal (i) | b.getVal (i));
-    } else {
-      if (i < b.len) {
-	setVal (i, b.getVal (i));
-      }
-    }
+  _adjlen(mal);
+
+  UNIT_TYPE *v = getV();
+  const UNIT_TYPE *bv = b.getV();
+  for (int i = 0; i < mil; i++) {
+    v[i] |= bv[i];
+  }
+  for (int i = mil; i < b.len; i++) {
+    v[i] = bv[i];
+  }
+  if (isSigned()) {
+    signExtend ();
   }
 
   return (*this);
@@ -1357,16 +1287,18 @@ BigInt &BigInt::operator^=(const BigInt &b)
 
   int mil = std::min(len, b.len); //min length
   int mal = std::max(len, b.len); //max length
-  adjlen(mal);
-  len = mal;
-  for (int i = 0; i < mal; i++) {
-    if (i < mil) {
-      setVal (i, getVal (i) ^ b.getVal (i));
-    } else {
-      if (i < b.len) {
-	setVal (i, b.getVal (i));
-      }
-    }
+  _adjlen(mal);
+
+  UNIT_TYPE *v = getV();
+  const UNIT_TYPE *bv = b.getV();
+  for (int i = 0; i < mil; i++) {
+    v[i] ^= bv[i];
+  }
+  for (int i = mil; i < b.len; i++) {
+    v[i] = bv[i];
+  }
+  if (isSigned()) {
+    signExtend ();
   }
 
   return (*this);
@@ -1374,12 +1306,16 @@ BigInt &BigInt::operator^=(const BigInt &b)
 
 BigInt &BigInt::operator~()
 {
+  UNIT_TYPE *v = getV();
   for (int i=0; i < len; i++) {
-    setVal (i, ~getVal (i));
+    v[i] = ~v[i];
   }
   if (!isSigned()) {
     zeroClear ();
   }
+  else {
+    signExtend ();
+  }
 
   return (*this);
 }
@@ -1396,24 +1332,10 @@ BigInt &BigInt::operator<<=(UNIT_TYPE x)
     width += x;
   }
 
-  int stride = x / BIGINT_BITS_ONE;
+  UNIT_TYPE stride = x / BIGINT_BITS_ONE;
   x = x % BIGINT_BITS_ONE;
 
-  UNIT_TYPE mask = 0;
-  mask = ~mask << x;
-  for (int i = len-1; i >= 0; i--) {
-    if (i + stride < len) {
-      if (i > 0 && (x != 0)) {
-	_setVal (i+stride, (getVal (i) << x) | (getVal (i-1) >> (BIGINT_BITS_ONE-x)));
-      }
-      else {
-	_setVal(i+stride, getVal(i) << x);
-      }
-    }
-  }
-  for (int i=0; i < stride; i++) {
-    _setVal (i, 0);
-  }
+  _bi_shl (getV(), len, (stride > (UNIT_TYPE)len) ? len : stride, x);
 
   return (*this);
 }
@@ -1427,7 +1349,6 @@ BigInt &BigInt::operator>>=(UNIT_TYPE x)
   if (x >= width) {
     if (isDynamic()) {
       _adjlen (1);
-      len = 1;
       width = 1;
       _setVal (0, 0);
       if (sa) {
@@ -1450,37 +1371,12 @@ BigInt &BigInt::operator>>=(UNIT_TYPE x)
   }
 
   int stride = x / BIGINT_BITS_ONE;
-  UNIT_TYPE mask = 0;
-
   x = x % BIGINT_BITS_ONE;
 
-  mask = ~mask;
-  mask = mask >> (BIGINT_BITS_ONE-x);
-
-  for (auto i = 0; i < len-stride; i++) {
-    _setVal (i, getVal (i+stride) >> x);
-    if ((i + stride + 1)  < len) {
-      if (x != 0) {
-        _setVal (i, getVal (i) | (getVal (i+stride+1) & mask) << (BIGINT_BITS_ONE - x));
-      }
-    } 
-  }
-
-  UNIT_TYPE y = 0;
-  if (sa) {
-    y = ~y;
-  }
-  for (auto i = len-stride; i < len; i++) {
-    _setVal (i, y);
-  }
-  if (x != 0) {
-    y = y << (BIGINT_BITS_ONE - x);
-  }
-  _setVal (len-stride-1, getVal (len-stride-1) | y);
+  _bi_shr (getV(), len, stride, x, sa ? ~((UNIT_TYPE)0) : 0);
 
   if (isDynamic() && stride > 0) {
     _adjlen (len-stride);
-    len -= stride;
   }
 
   return (*this);
@@ -59,16 +59,21 @@
   Result inherits issigned value from A.
   7. Comparing signed and unsigned numbers promotes both to unsigned.
   8. Left shift extends dynamic numbers.
+  9. Numbers with up to BIGINT_INLINE units are stored in the object
+  itself, so arithmetic on them does not allocate memory.
 */
 
 #define BIGINT_BITS_ONE (8*sizeof (UNIT_TYPE))
 
+/* # of units stored without a heap allocation (256 bits) */
+#define BIGINT_INLINE 4
+
 class BigInt {
 public:
   BigInt () {
     len = 1;
     width = 1;
-    u.value = 0;
+    u.w[0] = 0;
     isdynamic = 0;
     issigned = 0;
   }
@@ -76,12 +81,12 @@ public:
   BigInt (int w, int s, int d); 
 
   ~BigInt () {
-    if (len >= 2) {
+    if (len > BIGINT_INLINE) {
       FREE (u.v);
     }
   }
 
-  BigInt (BigInt &);    // copy constructor
+  BigInt (const BigInt &);    // copy constructor
   BigInt (BigInt &&);   // move constructor
 
   BigInt& operator=(const BigInt &);            // copy assignment
@@ -107,9 +112,9 @@ public:
   BigInt &operator+=(const BigInt &);  
   BigInt &operator-=(const BigInt &);  
   BigInt operator-() const;           
-  BigInt operator*(BigInt &);   
-  BigInt operator/(BigInt &);   
-  BigInt operator%(BigInt &);   
+  BigInt operator*(const BigInt &) const;
+  BigInt operator/(const BigInt &) const;
+  BigInt operator%(const BigInt &) const;
 
   BigInt &operator&=(const BigInt &);  
   BigInt &operator|=(const BigInt &);  
@@ -143,7 +148,7 @@ public:
   void bitPrint (FILE *fp) const;
   void decPrint (FILE *fp, int w = 0) const;
 
-  UNIT_TYPE getVal(int n) const { if (len >= 2) return u.v[n]; else return u.value; }
+  UNIT_TYPE getVal(int n) const { return getV()[n]; }
   void setVal (int n, UNIT_TYPE nv) {
     if (n > len) {
       expandSpace(sizeof(UNIT_TYPE));
@@ -166,42 +171,53 @@ private:
   
   union {
     UNIT_TYPE *v; // actual bits; 2's complement
-    UNIT_TYPE value;  // used when len <= 1 to avoid allocation
+    UNIT_TYPE w[BIGINT_INLINE];  // used when len <= BIGINT_INLINE
   } u;
   // rep. The number is sign-extended to the maximum width of the rep
 
   int isOneInt() const;
 
   inline void _setVal (int n, UNIT_TYPE nv) {
-    if (len >= 2) {
-      u.v[n] = nv;
-    }
-    else {
-      u.value = nv;
-    }
+    getV()[n] = nv;
   }
 
+  /* change the # of units to newlen, keeping the low units; new
+     units are zero */
   inline void _adjlen (int newlen) {
     if (len == newlen) return;
-    if (len <= 1) {
-      if (newlen >= 2) {
-        UNIT_TYPE oval = u.value;
-        MALLOC (u.v, UNIT_TYPE, newlen);
-        u.v[0] = oval;
+    if (len <= BIGINT_INLINE) {
+      if (newlen > BIGINT_INLINE) {
+        UNIT_TYPE *x;
+        MALLOC (x, UNIT_TYPE, newlen);
+        for (int i=0; i < newlen; i++) {
+          x[i] = (i < len) ? u.w[i] : 0;
+        }
+        u.v = x;
+      }
+      else {
+        for (int i=len; i < newlen; i++) {
+          u.w[i] = 0;
+        }
       }
     } else {
-      if (newlen >= 2) {
+      if (newlen > BIGINT_INLINE) {
         REALLOC (u.v, UNIT_TYPE, newlen);
+        for (int i=len; i < newlen; i++) {
+          u.v[i] = 0;
+        }
       } else {
-        UNIT_TYPE oval = u.v[0];
-        FREE (u.v);
-        u.value = oval;
+        UNIT_TYPE *x = u.v;
+        for (int i=0; i < newlen; i++) {
+          u.w[i] = x[i];
+        }
+        FREE (x);
       }
     }
+    len = newlen;
   }
 
   void _add (const BigInt &b, int cin);
-  void _div (BigInt &b, int func);  //0 - div, 1 - rem
+  void _div (const BigInt &b, int func);  //0 - div, 1 - rem
 
   void signExtend ();
 
@@ -213,7 +229,8 @@ private:
 
   void cutZero(); //helper function to zero MSB zeros
 
-  UNIT_TYPE* getV() { if (len >= 2) return u.v; else return &u.value; };
+  UNIT_TYPE *getV() { return (len > BIGINT_INLINE) ? u.v : u.w; }
+  const UNIT_TYPE *getV() const { return (len > BIGINT_INLINE) ? u.v : u.w; }
 };
 
 
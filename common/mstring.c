@@ -23,6 +23,7 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include "mstring.h"
 #include "misc.h"
 
@@ -34,6 +35,9 @@ struct strHashtable {
 
 static struct strHashtable *sH = NULL;
 
+/* the table is shared by all threads */
+static pthread_mutex_t sH_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*-- note this is copied from hash.c --*/
 
 static int T[] =
@@ -188,6 +192,7 @@ mstring_t *string_create (const char *s)
   int i;
   mstring_t *b;
 
+  pthread_mutex_lock (&sH_lock);
   string_init ();
 
   if (sH->n > (sH->size << 2)) {
@@ -215,19 +220,24 @@ mstring_t *string_create (const char *s)
   }
 
   /*check_table (sH);*/
+  pthread_mutex_unlock (&sH_lock);
 
   return b;
 }
 		       
 mstring_t *string_dup (mstring_t *s)
 {
+  pthread_mutex_lock (&sH_lock);
   s->ref++;
+  pthread_mutex_unlock (&sH_lock);
   return s;
 }
 
 void string_free (mstring_t *s)
 {
+  pthread_mutex_lock (&sH_lock);
   s->ref--;
+  pthread_mutex_unlock (&sH_lock);
   /* if s->ref == 0... */
 }
 
@@ -19,30 +19,86 @@
  *
  **************************************************************************
  */
+#include <string.h>
+#include <pthread.h>
 #include "simdes.h"
 #include "int.h"
+#include "config.h"
+#include "array.h"
 
 /* globals for sim object */
 int SimDES::initialized_sim = 0;
 
 int SimDES::_interrupt = 0;
 
-/* globals for events */
-Heap *SimDES::all = NULL;
-unsigned long SimDES::tm_offset[SIM_TIME_SIZE];
-unsigned long SimDES::curtime = 0;
-Event *Event::ev_queue = NULL;
-SimDES *SimDES::curobj = NULL;
+/* globals for events; the queue and time are per thread so that
+   each logical process has its own copy */
+thread_local Heap *SimDES::all = NULL;
+thread_local CalQueue *SimDES::calq = NULL;
+int SimDES::evq_type = SIM_EVQ_HEAP;
+thread_local unsigned long SimDES::tm_offset[SIM_TIME_SIZE];
+thread_local unsigned long SimDES::curtime = 0;
+thread_local Event *Event::ev_queue = NULL;
+thread_local Event *Event::ev_removed = NULL;
+thread_local SimDES *SimDES::curobj = NULL;
+
+/* parallel execution */
+int SimDES::_nlp = 1;
+unsigned long SimDES::_lookahead = 1;
+thread_local struct sim_lp *SimDES::_lpcur = NULL;
+
+struct sim_lp_ev {
+  heap_key_t tm;
+  Event *ev;
+};
+
+struct sim_lp_buf {
+  A_DECL (struct sim_lp_ev, ev);
+};
+
+struct sim_lp {
+  int id;
+  pthread_t th;
+
+  struct sim_lp_buf in;		// events handed to/from the main thread
+  struct sim_lp_buf *out;	// out[i] : events sent to LP i during
+				// the current window
+  unsigned long curtime;	// time at the start/end of the run
+
+  heap_key_t next;		// earliest pending event, and
+  int has_next;			// whether there is one (published at
+				// the barrier)
+  int halt;			// published stop request
+
+  int stop;			// Step() returned 0
+  Event *bp;			// event that hit a breakpoint, taken
+				// out of the queue
+  heap_key_t bptm;		// ...and its time
+
+  Event *freelist;		// event free list at thread exit
+};
+
+struct sim_barrier {
+  pthread_mutex_t lock;
+  pthread_cond_t cv;
+  int n, count;
+  unsigned long gen;
+};
+
+static struct sim_lp *_lps = NULL;
+static struct sim_barrier _lp_barrier;
+static unsigned long _lp_tm_offset[SIM_TIME_SIZE];
 
 /* create and destroy */
 SimDES::SimDES ()
 {
   break_point = 0;
   flags = 0;
+  _lp = 0;
 
-  if (!all) {
+  if (!all && !calq) {
     /* first time I'm here */
-    all = heap_new (32);
+    _evq_init ();
   }
 
   if (!initialized_sim) {
@@ -61,12 +117,185 @@ void SimDES::Init()
   SimDES::curtime = 0;
   initialized_sim = 1;
 
-  for (int i=0; i < all->sz; i++) {
-    Event *ev = (Event *) all->value[i];
+  if (!all && !calq) {
+    _evq_init ();
+  }
+
+  Event *ev;
+  heap_key_t tm;
+  while ((ev = _evq_remove_min (&tm))) {
     delete ev;
-    all->value[i] = NULL;
   }
-  all->sz = 0;
+  _evq_reap ();
+}
+
+/*
+ * Event queue management
+ */
+void SimDES::_evq_init ()
+{
+  if (config_exists ("sim.des.event_queue")) {
+    const char *s = config_get_string ("sim.des.event_queue");
+    if (strcmp (s, "heap") == 0) {
+      evq_type = SIM_EVQ_HEAP;
+    }
+    else if (strcmp (s, "calendar") == 0) {
+      evq_type = SIM_EVQ_CALENDAR;
+    }
+    else {
+      warning ("sim.des.event_queue: unknown queue `%s'; using heap", s);
+      evq_type = SIM_EVQ_HEAP;
+    }
+  }
+  if (config_exists ("sim.des.threads")) {
+    int lookahead = 1;
+    if (config_exists ("sim.des.lookahead")) {
+      lookahead = config_get_int ("sim.des.lookahead");
+    }
+    setParallel (config_get_int ("sim.des.threads"), lookahead);
+  }
+  _evq_alloc ();
+}
+
+/* allocate the event queue for the current thread */
+void SimDES::_evq_alloc ()
+{
+  if (evq_type == SIM_EVQ_CALENDAR) {
+    calq = calq_new (32);
+  }
+  else {
+    all = heap_new (32);
+  }
+}
+
+void SimDES::setEventQueue (int type)
+{
+  Heap *oall;
+  CalQueue *ocalq;
+  Event *ev;
+  heap_key_t tm;
+
+  Assert (type == SIM_EVQ_HEAP || type == SIM_EVQ_CALENDAR,
+	  "Unknown event queue type");
+
+  if (!all && !calq) {
+    /* nothing allocated yet */
+    evq_type = type;
+    _evq_alloc ();
+    return;
+  }
+  if (type == evq_type) {
+    return;
+  }
+
+  /* move all pending events to the new queue */
+  oall = all;
+  ocalq = calq;
+  all = NULL;
+  calq = NULL;
+  evq_type = type;
+  if (type == SIM_EVQ_CALENDAR) {
+    calq = calq_new (oall ? heap_size (oall) : 32);
+    while ((ev = (Event *) heap_remove_min_key (oall, &tm))) {
+      if (!ev->kill) {
+	_evq_insert (tm, ev);
+      }
+      else {
+	delete ev;
+      }
+    }
+    heap_free (oall, NULL);
+  }
+  else {
+    all = heap_new (ocalq ? calq_size (ocalq) : 32);
+    while ((ev = (Event *) calq_remove_min_key (ocalq, &tm))) {
+      ev->qh = NULL;
+      _evq_insert (tm, ev);
+    }
+    calq_free (ocalq, NULL);
+  }
+}
+
+void SimDES::_evq_insert (heap_key_t tm, Event *ev)
+{
+  if (calq) {
+    ev->qh = calq_insert (calq, tm, ev);
+  }
+  else {
+    ev->qh = NULL;
+    heap_insert (all, tm, ev);
+  }
+}
+
+/* free events taken out of the queue by Event::Remove() */
+void SimDES::_evq_reap ()
+{
+  Event *ev;
+  while (Event::ev_removed) {
+    ev = Event::ev_removed;
+    Event::ev_removed = (Event *) ev->cause;
+    delete ev;
+  }
+}
+
+Event *SimDES::_evq_remove_min (heap_key_t *tm)
+{
+  Event *ev;
+  if (Event::ev_removed) {
+    _evq_reap ();
+  }
+  if (calq) {
+    ev = (Event *) calq_remove_min_key (calq, tm);
+    if (ev) {
+      ev->qh = NULL;
+    }
+  }
+  else {
+    ev = (Event *) heap_remove_min_key (all, tm);
+  }
+  return ev;
+}
+
+Event *SimDES::_evq_peek_min ()
+{
+  if (calq) {
+    return (Event *) calq_peek_min (calq);
+  }
+  else {
+    return (Event *) heap_peek_min (all);
+  }
+}
+
+heap_key_t SimDES::_evq_peek_minkey ()
+{
+  if (calq) {
+    return calq_peek_minkey (calq);
+  }
+  else {
+    return heap_peek_minkey (all);
+  }
+}
+
+int SimDES::_evq_size ()
+{
+  if (calq) {
+    return calq_size (calq);
+  }
+  else {
+    return heap_size (all);
+  }
+}
+
+void SimDES::_evq_rebase (heap_key_t tm)
+{
+  if (calq) {
+    calq_rebase (calq, tm);
+  }
+  else {
+    for (int i=0; i < all->sz; i++) {
+      all->key[i] -= tm;
+    }
+  }
 }
 
 /*
@@ -80,6 +309,34 @@ SimDES::~SimDES ()
  */
 Event::Event (SimDES *s, int event_type, int delay, void *_cause)
 {
+  obj = s;
+  cause = _cause;
+  ev_type = event_type;
+  kill = 0;
+  qh = NULL;
+
+  if (SimDES::_lpcur && s->_lp != SimDES::_lpcur->id) {
+    /* event for a different logical process: send it at the end of
+       the current window */
+    struct sim_lp_buf *b;
+    if ((unsigned long)delay < SimDES::_lookahead) {
+      fatal_error ("Event between logical processes %d and %d has delay %d, less than the lookahead %lu",
+		   SimDES::_lpcur->id, s->_lp, delay, SimDES::_lookahead);
+    }
+    if (s->_lp >= SimDES::_nlp) {
+      fatal_error ("Object assigned to logical process %d, but there are only %d", s->_lp, SimDES::_nlp);
+    }
+    if (((unsigned long)~0UL - SimDES::curtime) < (unsigned)delay) {
+      fatal_error ("Time overflow during parallel simulation");
+    }
+    b = &SimDES::_lpcur->out[s->_lp];
+    A_NEW (b->ev, struct sim_lp_ev);
+    A_NEXT (b->ev).tm = SimDES::curtime + delay;
+    A_NEXT (b->ev).ev = this;
+    A_INC (b->ev);
+    return;
+  }
+
   /* check to see if the delay would cause "curtime" to roll over */
   while (((unsigned long)~0UL - SimDES::curtime) < (unsigned)delay) {
     /* let's walk through the heap to see if I can change the current
@@ -87,7 +344,12 @@ Event::Event (SimDES *s, int event_type, int delay, void *_cause)
     int i;
     unsigned long tm;
 
-    tm = heap_peek_minkey (SimDES::all);
+    if (SimDES::_lpcur) {
+      /* logical processes share a time base */
+      fatal_error ("Time overflow during parallel simulation");
+    }
+
+    tm = SimDES::_evq_peek_minkey ();
     /* the earliest time of all pending events is now tm */
 
     if (tm == 0) {
@@ -107,21 +369,31 @@ Event::Event (SimDES *s, int event_type, int delay, void *_cause)
       }
     }
     SimDES::tm_offset[0] = SimDES::tm_offset[0] + tm;
-      
-    for (i=0; i < SimDES::all->sz; i++) {
-      SimDES::all->key[i] -= tm;
-    }
+
+    SimDES::_evq_rebase (tm);
   }
 
-  obj = s;
-  cause = _cause;
-  ev_type = event_type;
-  kill = 0;
-  heap_insert (SimDES::all, SimDES::curtime + delay, this);
+  SimDES::_evq_insert (SimDES::curtime + delay, this);
 }
 
 Event::~Event () { } 
 
+void Event::Remove ()
+{
+  if (kill) {
+    return;
+  }
+  kill = 1;
+  if (qh) {
+    /* pending in the calendar queue: take it out right away; it is
+       freed on the next dequeue, like a killed event in the heap */
+    calq_delete (SimDES::calq, qh);
+    qh = NULL;
+    cause = Event::ev_removed;
+    Event::ev_removed = this;
+  }
+}
+
 /*
  * Return the low order bits of the current simulation time
  */
@@ -159,16 +431,22 @@ BigInt SimDES::CurTime()
  * static method, run the entire simulation
  *
  *  Returns NULL if no more events, otherwise returns the event that
- *  caused the simulation to stop due to a break point.
+ *  caused the simulation to stop due to a break point. The event has
+ *  been taken out of the event queue, and is owned by the caller (in
+ *  parallel mode as well).
  */
 Event *SimDES::Run ()
 {
   Event *ev;
   unsigned long tm;
-  unsigned long long tm2;
+  heap_key_t tm2;
+
+  if (_nlp > 1) {
+    return RunParallel ();
+  }
   
   /* process all events in global time order */
-  while ((ev = (Event *)heap_remove_min_key (all, &tm2))) {
+  while ((ev = _evq_remove_min (&tm2))) {
     tm = tm2;
     /* current time needs to advance */
     curtime = tm;
@@ -201,17 +479,17 @@ Event *SimDES::Advance (long n)
 {
   Event *ev;
   unsigned long tm;
-  unsigned long long tm2;
+  heap_key_t tm2;
 
   /* process all events in global time order */
-  while (n && (ev = (Event *)heap_remove_min_key (all, &tm2))) {
+  while (n && (ev = _evq_remove_min (&tm2))) {
     tm = tm2;
     curtime = tm;
     /* current time needs to advance */
     if (!ev->kill) {
       if (IS_A_BREAKPOINT(ev)) {
 	/* put the event back */
-	heap_insert (all, tm, ev);
+	_evq_insert (tm, ev);
 	break;
       }
       curobj = ev->obj;
@@ -240,14 +518,15 @@ Event *SimDES::AdvanceTime (long delay)
 {
   Event *ev;
   unsigned long tm;
+  heap_key_t tm2;
 
   /* process all events in global time order */
   do {
-    if (heap_peek_min (all) == NULL) {
+    if (_evq_peek_min () == NULL) {
       /* nothing in the heap */
       return NULL;
     }
-    tm = heap_peek_minkey (all);
+    tm = _evq_peek_minkey ();
     
     if (delay < (tm - curtime)) {
       /* I'm out of time, return */
@@ -257,13 +536,13 @@ Event *SimDES::AdvanceTime (long delay)
       delay = delay - (tm - curtime);
     }
 
-    ev = (Event *) heap_remove_min (all);
+    ev = _evq_remove_min (&tm2);
 
     /* current time needs to advance */
     curtime = tm;
     if (!ev->kill) {
       if (IS_A_BREAKPOINT(ev)) {
-	heap_insert (all, tm, ev);
+	_evq_insert (tm, ev);
 	break;
       }
       curobj = ev->obj;
@@ -284,6 +563,276 @@ void SimDES::Pause (int delay)
 }
 
 
+/*
+ * Parallel execution
+ */
+void SimDES::setLP (int lp)
+{
+  Assert (lp >= 0, "Negative logical process id?");
+  _lp = lp;
+}
+
+void SimDES::setParallel (int nlp, unsigned long lookahead)
+{
+  if (nlp < 1) {
+    nlp = 1;
+  }
+  if (nlp > 1 && lookahead < 1) {
+    fatal_error ("SimDES::setParallel(): lookahead must be at least 1");
+  }
+  _nlp = nlp;
+  _lookahead = lookahead;
+}
+
+static void _barrier_init (struct sim_barrier *b, int n)
+{
+  pthread_mutex_init (&b->lock, NULL);
+  pthread_cond_init (&b->cv, NULL);
+  b->n = n;
+  b->count = 0;
+  b->gen = 0;
+}
+
+static void _barrier_wait (struct sim_barrier *b)
+{
+  unsigned long gen;
+
+  pthread_mutex_lock (&b->lock);
+  gen = b->gen;
+  b->count++;
+  if (b->count == b->n) {
+    b->count = 0;
+    b->gen++;
+    pthread_cond_broadcast (&b->cv);
+  }
+  else {
+    while (gen == b->gen) {
+      pthread_cond_wait (&b->cv, &b->lock);
+    }
+  }
+  pthread_mutex_unlock (&b->lock);
+}
+
+static void _barrier_free (struct sim_barrier *b)
+{
+  pthread_mutex_destroy (&b->lock);
+  pthread_cond_destroy (&b->cv);
+}
+
+/*
+ * Execute all events for the current LP with time < wend
+ */
+void SimDES::_lp_window (struct sim_lp *lp, heap_key_t wend)
+{
+  Event *ev;
+  heap_key_t tm;
+
+  while ((ev = _evq_peek_min ()) && _evq_peek_minkey () < wend) {
+    ev = _evq_remove_min (&tm);
+    curtime = tm;
+    if (!ev->kill) {
+      if (IS_A_BREAKPOINT (ev)) {
+	/* as in Run(), the event is handed to the caller */
+	lp->bp = ev;
+	lp->bptm = tm;
+	return;
+      }
+      curobj = ev->obj;
+      if (!ev->obj->Step (ev)) {
+	delete ev;
+	lp->stop = 1;
+	return;
+      }
+    }
+    delete ev;
+  }
+}
+
+void *SimDES::_lp_thread (void *arg)
+{
+  struct sim_lp *lp = (struct sim_lp *) arg;
+  heap_key_t tm, wend;
+  Event *ev;
+  int i, found;
+
+  _lpcur = lp;
+  all = NULL;
+  calq = NULL;
+  _evq_alloc ();
+  curtime = lp->curtime;
+  for (i=0; i < SIM_TIME_SIZE; i++) {
+    tm_offset[i] = _lp_tm_offset[i];
+  }
+  for (i=0; i < A_LEN (lp->in.ev); i++) {
+    _evq_insert (lp->in.ev[i].tm, lp->in.ev[i].ev);
+  }
+  A_LEN_RAW (lp->in.ev) = 0;
+
+  while (1) {
+    /* all LPs are done with the previous window */
+    _barrier_wait (&_lp_barrier);
+
+    /* receive events in a fixed order */
+    for (i=0; i < _nlp; i++) {
+      struct sim_lp_buf *b = &_lps[i].out[lp->id];
+      for (int j=0; j < A_LEN (b->ev); j++) {
+	_evq_insert (b->ev[j].tm, b->ev[j].ev);
+      }
+      A_LEN_RAW (b->ev) = 0;
+    }
+
+    /* publish local state */
+    if (_evq_peek_min ()) {
+      lp->has_next = 1;
+      lp->next = _evq_peek_minkey ();
+    }
+    else {
+      lp->has_next = 0;
+    }
+    lp->halt = (lp->stop || lp->bp || (lp->id == 0 && _interrupt));
+
+    _barrier_wait (&_lp_barrier);
+
+    /* every LP makes the same decision from the published state */
+    found = 0;
+    wend = 0;
+    for (i=0; i < _nlp; i++) {
+      if (_lps[i].halt) {
+	break;
+      }
+      if (_lps[i].has_next && (!found || _lps[i].next < wend)) {
+	found = 1;
+	wend = _lps[i].next;
+      }
+    }
+    if (i != _nlp || !found) {
+      break;
+    }
+    if (wend + _lookahead < wend) {
+      wend = ~(heap_key_t)0;
+    }
+    else {
+      wend = wend + _lookahead;
+    }
+    _lp_window (lp, wend);
+  }
+
+  /* hand the remaining events back to the main thread */
+  while ((ev = _evq_remove_min (&tm))) {
+    A_NEW (lp->in.ev, struct sim_lp_ev);
+    A_NEXT (lp->in.ev).tm = tm;
+    A_NEXT (lp->in.ev).ev = ev;
+    A_INC (lp->in.ev);
+  }
+  _evq_reap ();
+  lp->curtime = curtime;
+  if (calq) {
+    calq_free (calq, NULL);
+    calq = NULL;
+  }
+  if (all) {
+    heap_free (all, NULL);
+    all = NULL;
+  }
+  lp->freelist = Event::ev_queue;
+  Event::ev_queue = NULL;
+  _lpcur = NULL;
+  return NULL;
+}
+
+/*
+ * static method, run the simulation using multiple logical processes
+ */
+Event *SimDES::RunParallel ()
+{
+  Event *ev, *ret;
+  heap_key_t tm;
+  int i, j, lp;
+
+  MALLOC (_lps, struct sim_lp, _nlp);
+  for (i=0; i < _nlp; i++) {
+    _lps[i].id = i;
+    A_INIT (_lps[i].in.ev);
+    MALLOC (_lps[i].out, struct sim_lp_buf, _nlp);
+    for (j=0; j < _nlp; j++) {
+      A_INIT (_lps[i].out[j].ev);
+    }
+    _lps[i].curtime = curtime;
+    _lps[i].has_next = 0;
+    _lps[i].halt = 0;
+    _lps[i].stop = 0;
+    _lps[i].bp = NULL;
+    _lps[i].freelist = NULL;
+  }
+  for (i=0; i < SIM_TIME_SIZE; i++) {
+    _lp_tm_offset[i] = tm_offset[i];
+  }
+
+  /* distribute pending events */
+  while ((ev = _evq_remove_min (&tm))) {
+    if (ev->kill) {
+      delete ev;
+      continue;
+    }
+    lp = ev->obj->_lp;
+    if (lp >= _nlp) {
+      fatal_error ("Object assigned to logical process %d, but there are only %d", lp, _nlp);
+    }
+    A_NEW (_lps[lp].in.ev, struct sim_lp_ev);
+    A_NEXT (_lps[lp].in.ev).tm = tm;
+    A_NEXT (_lps[lp].in.ev).ev = ev;
+    A_INC (_lps[lp].in.ev);
+  }
+
+  _barrier_init (&_lp_barrier, _nlp);
+  for (i=0; i < _nlp; i++) {
+    if (pthread_create (&_lps[i].th, NULL, _lp_thread, &_lps[i]) != 0) {
+      fatal_error ("Could not create thread for logical process %d", i);
+    }
+  }
+  for (i=0; i < _nlp; i++) {
+    pthread_join (_lps[i].th, NULL);
+  }
+  _barrier_free (&_lp_barrier);
+
+  /* collect the remaining events and per-thread state */
+  ret = NULL;
+  for (i=0; i < _nlp; i++) {
+    for (j=0; j < A_LEN (_lps[i].in.ev); j++) {
+      _evq_insert (_lps[i].in.ev[j].tm, _lps[i].in.ev[j].ev);
+    }
+    if (_lps[i].curtime > curtime) {
+      curtime = _lps[i].curtime;
+    }
+    if (_lps[i].bp) {
+      if (!ret) {
+	ret = _lps[i].bp;
+      }
+      else {
+	/* only one event is returned; the others stay pending */
+	_evq_insert (_lps[i].bptm, _lps[i].bp);
+      }
+    }
+    if (_lps[i].freelist) {
+      Event *e;
+      for (e = _lps[i].freelist; e->cause; e = (Event *)e->cause)
+	;
+      e->cause = Event::ev_queue;
+      Event::ev_queue = _lps[i].freelist;
+    }
+    A_FREE (_lps[i].in.ev);
+    for (j=0; j < _nlp; j++) {
+      A_FREE (_lps[i].out[j].ev);
+    }
+    FREE (_lps[i].out);
+  }
+  FREE (_lps);
+  _lps = NULL;
+
+  return ret;
+}
+
+
 /*
  * Conditions
  */
@@ -488,7 +1037,7 @@ int WaitForOne::Notify (int ev_type, int slot) { return Notify (ev_type); }
 
 bool SimDES::hasPendingEvent (void)
 {
-  if (heap_size (all) > 0) {
+  if ((all || calq) && _evq_size () > 0) {
     return true;
   }
   else {
@@ -497,8 +1046,26 @@ bool SimDES::hasPendingEvent (void)
 }
 
 
+struct _sim_match_fn {
+  bool (*fn) (Event *);
+};
+
+static int _match_event (void *cookie, void *v)
+{
+  struct _sim_match_fn *m = (struct _sim_match_fn *) cookie;
+  return (*m->fn) ((Event *)v) ? 1 : 0;
+}
+
 bool SimDES::matchPendingEvent (bool (*matchfn) (Event *))
 {
+  if (calq) {
+    struct _sim_match_fn m;
+    m.fn = matchfn;
+    return calq_apply (calq, _match_event, &m) ? true : false;
+  }
+  if (!all) {
+    return false;
+  }
   for (int i=0; i < heap_size (all); i++) {
     if ((*matchfn)((Event *)all->value[i])) {
       return true;
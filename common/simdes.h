@@ -52,12 +52,14 @@
 #include <stdio.h>
 #include <common/misc.h>
 #include <common/heap.h>
+#include <common/calqueue.h>
 #include <common/list.h>
 #include <common/bitset.h>
 #include <common/sim.h>
 #include <common/int.h>
 
 class SimDES;
+struct sim_lp;
 
 /*
  * Events: used to make forward progress in the simulation
@@ -93,8 +95,15 @@ public:
   /*
    * Used to make the simulator drop an event without executing
    * it. Used to revoke a pending event.
+   *
+   * The event is owned by the simulator, and is freed by it in
+   * both queue implementations: the caller must not use or delete
+   * the event after this call. With the heap, the event is marked
+   * and discarded when it reaches the head of the queue. With the
+   * calendar queue, it is taken out of the queue right away and
+   * freed the next time an event is taken from the queue.
    */
-  void Remove () { kill = 1; }
+  void Remove ();
 
   void *operator new (size_t sz);
   void operator delete (void *v);
@@ -113,10 +122,16 @@ private:
   SimDES *obj;		    // information about the event (see above)
 
   void *cause;			// information about event causality
+
+  calq_item_t *qh;		// calendar queue handle, NULL if the
+				// event is not in the calendar queue
   
 
-  /* allocated event queue */
-  static Event *ev_queue;
+  /* allocated event queue (one per thread) */
+  static thread_local Event *ev_queue;
+
+  /* removed events waiting to be freed (one per thread) */
+  static thread_local Event *ev_removed;
   friend class SimDES;
 };
 
@@ -126,6 +141,55 @@ private:
 
 #define SIM_TIME_SIZE 2
 
+/*
+ * Event queue implementations
+ *
+ *   SIM_EVQ_HEAP: binary heap; revoked events stay in the heap until
+ *   they are popped.
+ *
+ *   SIM_EVQ_CALENDAR: calendar queue, O(1) amortized insert and
+ *   remove for hold-model style workloads, and revoked events are
+ *   deleted from the queue.
+ *
+ * The default can be set with the configuration string
+ * "sim.des.event_queue" ("heap" or "calendar"), read when the first
+ * SimDES object is created.
+ */
+#define SIM_EVQ_HEAP      0
+#define SIM_EVQ_CALENDAR  1
+
+/*
+ * Parallel execution
+ *
+ *   Each SimDES object belongs to a logical process (LP), 0 by
+ *   default. When the simulation is configured with more than one
+ *   LP, Run() executes each LP on its own OS thread with its own event
+ *   queue, current time, and event free list. The LPs advance in
+ *   lock-step through time windows of size "lookahead": all events
+ *   in [T, T+lookahead) are executed in parallel, where T is the
+ *   earliest pending event across all LPs.
+ *
+ *   This is conservative synchronization, and it requires that:
+ *     - any event scheduled for an object in a different LP has a
+ *       delay of at least the lookahead;
+ *     - Condition objects, Event::Remove(), and any other shared
+ *       state are only used within a single LP.
+ *
+ *   Events sent between LPs are delivered at the end of the window
+ *   in (source LP, creation order), so a parallel run is
+ *   deterministic. When Run() returns, all pending events are moved
+ *   back to the main thread, so Advance() and AdvanceTime() can be
+ *   used as before. A stop request from Step() or interrupt() takes
+ *   effect at the end of the current window. If more than one LP hits
+ *   a breakpoint in the same window, the event from the lowest
+ *   numbered LP is returned (taken out of the queue, as in a serial
+ *   run) and the others are left pending.
+ *
+ *   The number of LPs and lookahead can also be set with the
+ *   configuration parameters "sim.des.threads" and
+ *   "sim.des.lookahead".
+ */
+
 class SimDES {
  public:
   SimDES ();		    // Inherit from this class. The
@@ -144,6 +208,9 @@ class SimDES {
 				// delay---after executing this
 				// function return immediately.
 
+  void setLP (int lp);		// assign object to a logical process
+  int getLP () { return _lp; }
+
   virtual const char *Name() { return "-anon-"; } // name for object
 
   /* set and clear break-points on the object */
@@ -183,6 +250,16 @@ class SimDES {
   static void interrupt () { _interrupt = 1; }
   static void resume () { _interrupt = 0; }
 
+  /*-- event queue selection --*/
+  static void setEventQueue (int type); // SIM_EVQ_HEAP/SIM_EVQ_CALENDAR;
+					// pending events are moved to
+					// the new queue
+  static int getEventQueue () { return evq_type; }
+
+  /*-- parallel execution --*/
+  static void setParallel (int nlp, unsigned long lookahead);
+  static int getNumLP () { return _nlp; }
+
 protected:
   unsigned int break_point:2;	// set a breakpoint on this object
   unsigned int bp_ev_type:6;    // event type for breakpoint, if
@@ -190,7 +267,9 @@ protected:
   unsigned int flags:8;		// available flags
 
 private:
-  static SimDES *curobj;	// current object being stepped
+  int _lp;			// logical process for this object
+
+  static thread_local SimDES *curobj; // current object being stepped
 
   /*-- object management --*/
   static int initialized_sim;   // global check
@@ -205,13 +284,35 @@ private:
     heap and modify all times in the heap, and update tm_offset.
   */
 
-  static unsigned long tm_offset[SIM_TIME_SIZE];
+  static thread_local unsigned long tm_offset[SIM_TIME_SIZE];
   /* if heap times get large, this will get used as the
      offset into the current time
   */
 
-  static unsigned long curtime;	// current time
-  static Heap *all;		// all events
+  static thread_local unsigned long curtime; // current time
+  static thread_local Heap *all;	// all events (SIM_EVQ_HEAP)
+  static thread_local CalQueue *calq; // all events (SIM_EVQ_CALENDAR)
+  static int evq_type;		// event queue in use
+
+  /*-- parallel execution --*/
+  static int _nlp;		// # of logical processes
+  static unsigned long _lookahead; // minimum cross-LP event delay
+  static thread_local struct sim_lp *_lpcur; // LP run by this thread,
+					      // NULL in serial mode
+
+  static Event *RunParallel ();
+  static void *_lp_thread (void *);
+  static void _lp_window (struct sim_lp *lp, heap_key_t wend);
+
+  static void _evq_init ();
+  static void _evq_alloc ();
+  static void _evq_insert (heap_key_t tm, Event *ev);
+  static Event *_evq_remove_min (heap_key_t *tm);
+  static Event *_evq_peek_min ();
+  static heap_key_t _evq_peek_minkey ();
+  static int _evq_size ();
+  static void _evq_rebase (heap_key_t tm);
+  static void _evq_reap ();
 
   friend class Event;
 };
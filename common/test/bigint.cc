@@ -0,0 +1,167 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <common/int.h>
+#include <common/mytime.h>
+
+/*
+ *  Micro-benchmark for BigInt.
+ *
+ *  Each operator is applied to a pool of random operands of the
+ *  specified width, and the average time per operation is reported.
+ *  Widths up to BIGINT_INLINE units use the in-object storage, so the
+ *  results show the cost of arithmetic with and without allocation.
+ */
+
+#define POOL 64
+
+static unsigned long nextrand (void)
+{
+  return ((unsigned long)random() << 42) ^ ((unsigned long)random() << 21)
+    ^ random();
+}
+
+static void randval (BigInt &b, int w, int sgn)
+{
+  b = BigInt (w, sgn, 0);
+  for (unsigned int i=0; i < b.getLen(); i++) {
+    b.setVal (i, nextrand ());
+  }
+  if (sgn) {
+    b.toSigned ();
+  }
+  else {
+    b.toUnsigned ();
+  }
+}
+
+enum bench_op {
+  OP_ADD, OP_SUB, OP_NEG, OP_MUL, OP_DIV, OP_MOD,
+  OP_AND, OP_OR, OP_XOR, OP_NOT, OP_SHL, OP_SHR, OP_LT, OP_EQ,
+  OP_NUM
+};
+
+static const char *opname[] = {
+  "+", "-", "neg", "*", "/", "%",
+  "&", "|", "^", "~", "<<", ">>", "<", "=="
+};
+
+static unsigned long run_op (int op, BigInt *a, BigInt *b, long n)
+{
+  unsigned long chk = 0;
+
+  for (long k=0; k < n; k++) {
+    BigInt &x = a[k % POOL];
+    BigInt &y = b[(k*7+3) % POOL];
+    switch (op) {
+    case OP_ADD: { BigInt r(x); r += y; chk += r.getVal (0); } break;
+    case OP_SUB: { BigInt r(x); r -= y; chk += r.getVal (0); } break;
+    case OP_NEG: { BigInt r = -x; chk += r.getVal (0); } break;
+    /* the operand is copied first: older versions of *, / and %
+       modified their left operand, and the pool must stay intact
+       for the timings to be comparable */
+    case OP_MUL: { BigInt t(x); BigInt r = t * y; chk += r.getVal (0); } break;
+    case OP_DIV: { BigInt t(x); BigInt r = t / y; chk += r.getVal (0); } break;
+    case OP_MOD: { BigInt t(x); BigInt r = t % y; chk += r.getVal (0); } break;
+    case OP_AND: { BigInt r(x); r &= y; chk += r.getVal (0); } break;
+    case OP_OR:  { BigInt r(x); r |= y; chk += r.getVal (0); } break;
+    case OP_XOR: { BigInt r(x); r ^= y; chk += r.getVal (0); } break;
+    case OP_NOT: { BigInt r(x); ~r; chk += r.getVal (0); } break;
+    case OP_SHL: { BigInt r(x); r <<= (k % x.getWidth()); chk += r.getVal (0); } break;
+    case OP_SHR: { BigInt r(x); r >>= (k % x.getWidth()); chk += r.getVal (0); } break;
+    case OP_LT:  chk += (x < y); break;
+    case OP_EQ:  chk += (x == y); break;
+    }
+  }
+  return chk;
+}
+
+static void usage (char *s)
+{
+  fprintf (stderr, "Usage: %s [-n ops] [-s] [-w width]\n", s);
+  fprintf (stderr, "  -n : number of operations per measurement (default: 1000000)\n");
+  fprintf (stderr, "  -s : use signed operands\n");
+  fprintf (stderr, "  -w : only measure the specified width (default: 8, 64, 128, 256, 1024)\n");
+  exit (1);
+}
+
+int main (int argc, char **argv)
+{
+  int ch;
+  long n = 1000000;
+  int sgn = 0;
+  int widths[] = { 8, 64, 128, 256, 1024 };
+  int nw = sizeof (widths)/sizeof (widths[0]);
+  unsigned long chk = 0;
+
+  while ((ch = getopt (argc, argv, "n:sw:")) != -1) {
+    switch (ch) {
+    case 'n':
+      n = atol (optarg);
+      break;
+    case 's':
+      sgn = 1;
+      break;
+    case 'w':
+      widths[0] = atoi (optarg);
+      nw = 1;
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+  if (optind != argc || n <= 0 || widths[0] <= 0) {
+    usage (argv[0]);
+  }
+
+  srandom (1);
+  for (int i=0; i < nw; i++) {
+    BigInt a[POOL], b[POOL];
+    int w = widths[i];
+
+    for (int j=0; j < POOL; j++) {
+      randval (a[j], w, sgn);
+      /* divisors of about half the width */
+      randval (b[j], w, sgn);
+      if (w > 1) {
+	b[j] >>= (w/2);
+      }
+      if (b[j].isZero()) {
+	b[j].setVal (0, 1);
+      }
+    }
+    for (int op=0; op < OP_NUM; op++) {
+      double tm;
+      realtime_msec ();
+      chk += run_op (op, a, b, n);
+      tm = realtime_msec ();
+      printf ("width=%d op=%s signed=%d ops=%ld time_ms=%.1f ns_per_op=%.1f\n",
+	      w, opname[op], sgn, n, tm, tm*1e6/n);
+    }
+  }
+  printf ("checksum=%lx\n", chk);
+  return 0;
+}
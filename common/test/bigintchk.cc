@@ -0,0 +1,392 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <common/int.h>
+
+/*
+ *  Correctness checks for BigInt.
+ *
+ *  Random operands of up to 128 bits are checked against native
+ *  128-bit arithmetic, followed by hand-picked cases for the corners
+ *  of the word kernels: sign extension across units in subtraction,
+ *  shifts by a unit or more, bits past the width, carries in
+ *  multiplication, and mixed signed/unsigned operands.
+ *
+ *  Exits with status 1 if any check fails.
+ */
+
+typedef unsigned __int128 u128;
+
+static int nfail = 0;
+static int ncheck = 0;
+
+static unsigned long nextrand (void)
+{
+  return ((unsigned long)random() << 42) ^ ((unsigned long)random() << 21)
+    ^ random();
+}
+
+/* reduce x to w bits, sign extending if s is set */
+static u128 fix (u128 x, int w, int s)
+{
+  if (w < 128) {
+    x &= (((u128)1) << w) - 1;
+    if (s && ((x >> (w-1)) & 1)) {
+      x |= ~((((u128)1) << w) - 1);
+    }
+  }
+  return x;
+}
+
+static BigInt mk (int w, int s, u128 x)
+{
+  BigInt b(w, s, 0);
+
+  x = fix (x, w, s);
+  b.setVal (0, (unsigned long)x);
+  if (b.getLen() > 1) {
+    b.setVal (1, (unsigned long)(x >> 64));
+  }
+  if (s) {
+    b.toSigned ();
+  }
+  else {
+    b.toUnsigned ();
+  }
+  return b;
+}
+
+static void report (const char *msg, const BigInt &r, u128 x)
+{
+  fprintf (stderr, "FAIL: %s: got ", msg);
+  r.hPrint (stderr);
+  fprintf (stderr, " expected %016lx_%016lx\n",
+	   (unsigned long)(x >> 64), (unsigned long)x);
+  nfail++;
+}
+
+/* the low two units of r must be x (one unit if r is that short) */
+static void check (const char *msg, const BigInt &r, u128 x)
+{
+  ncheck++;
+  if (r.getVal (0) != (unsigned long)x ||
+      (r.getLen() > 1 && r.getVal (1) != (unsigned long)(x >> 64))) {
+    report (msg, r, x);
+  }
+}
+
+/* as check(), but only the low w bits of r are significant */
+static void check_w (const char *msg, const BigInt &r, int w, int s, u128 x)
+{
+  u128 v = r.getVal (0);
+
+  if (r.getLen() > 1) {
+    v |= ((u128)r.getVal (1)) << 64;
+  }
+  ncheck++;
+  if (fix (v, w, s) != fix (x, w, s)) {
+    report (msg, r, x);
+  }
+}
+
+static void check_int (const char *msg, long got, long x)
+{
+  ncheck++;
+  if (got != x) {
+    fprintf (stderr, "FAIL: %s: got %ld expected %ld\n", msg, got, x);
+    nfail++;
+  }
+}
+
+static void check_units (const char *msg, const BigInt &r, int n,
+			 const unsigned long *x)
+{
+  ncheck++;
+  if ((int)r.getLen() != n) {
+    fprintf (stderr, "FAIL: %s: %d units, expected %d\n", msg,
+	     (int)r.getLen(), n);
+    nfail++;
+    return;
+  }
+  for (int i=0; i < n; i++) {
+    if (r.getVal (i) != x[i]) {
+      report (msg, r, x[0]);
+      return;
+    }
+  }
+}
+
+/*
+ *  Random operands of width w, checked against 128-bit arithmetic.
+ *  Unary minus and << on a static value leave the bits above the
+ *  width as they are, so only the low w bits of those are compared.
+ */
+static void random_ops (int w, int s, int n)
+{
+  char buf[64];
+
+  for (int k=0; k < n; k++) {
+    u128 xa = fix (((u128)nextrand() << 64) | nextrand(), w, s);
+    u128 xb = fix (((u128)nextrand() << 64) | nextrand(), w, s);
+    if (k & 1) {
+      /* short divisors exercise the single-unit path */
+      xb = fix (xb >> (w/2 + 1), w, s);
+    }
+    BigInt a = mk (w, s, xa);
+    BigInt b = mk (w, s, xb);
+
+    snprintf (buf, 64, "w=%d s=%d +", w, s);
+    { BigInt r(a); r += b; check (buf, r, fix (xa + xb, w, s)); }
+    snprintf (buf, 64, "w=%d s=%d -", w, s);
+    { BigInt r(a); r -= b; check (buf, r, fix (xa - xb, w, s)); }
+    snprintf (buf, 64, "w=%d s=%d neg", w, s);
+    { BigInt r = -a; check_w (buf, r, w, s, -xa); }
+    snprintf (buf, 64, "w=%d s=%d &", w, s);
+    { BigInt r(a); r &= b; check (buf, r, xa & xb); }
+    snprintf (buf, 64, "w=%d s=%d |", w, s);
+    { BigInt r(a); r |= b; check (buf, r, xa | xb); }
+    snprintf (buf, 64, "w=%d s=%d ^", w, s);
+    { BigInt r(a); r ^= b; check (buf, r, xa ^ xb); }
+    snprintf (buf, 64, "w=%d s=%d ~", w, s);
+    { BigInt r(a); ~r; check (buf, r, fix (~xa, w, s)); }
+
+    /* product: exact, so the low 128 bits match native arithmetic */
+    snprintf (buf, 64, "w=%d s=%d *", w, s);
+    { BigInt r = a * b;
+      check (buf, r, fix (xa * xb, 2*w > 128 ? 128 : 2*w, s));
+      check_int (buf, r.getWidth(), 2*w); }
+
+    if (!s && xb != 0) {
+      snprintf (buf, 64, "w=%d /", w);
+      { BigInt r = a / b; check (buf, r, xa / xb); }
+      snprintf (buf, 64, "w=%d %%", w);
+      { BigInt r = a % b; check (buf, r, xa % xb); }
+      snprintf (buf, 64, "w=%d / keeps lhs", w);
+      check (buf, a, xa);
+    }
+
+    int sh = random() % (w + 8);
+    snprintf (buf, 64, "w=%d s=%d <<%d", w, s, sh);
+    { BigInt r(a); r <<= sh;
+      check_w (buf, r, w, s, sh >= 128 ? 0 : xa << sh); }
+    snprintf (buf, 64, "w=%d s=%d >>%d", w, s, sh);
+    { BigInt r(a); r >>= sh;
+      u128 x;
+      if (sh >= w) {
+	x = (s && ((xa >> (w-1)) & 1)) ? ~(u128)0 : 0;
+      }
+      else if (s) {
+	x = fix ((u128)((__int128)xa >> sh), w, s);
+      }
+      else {
+	x = xa >> sh;
+      }
+      check (buf, r, x); }
+
+    snprintf (buf, 64, "w=%d s=%d <", w, s);
+    check_int (buf, (a < b),
+	       s ? ((__int128)xa < (__int128)xb) : (xa < xb));
+    snprintf (buf, 64, "w=%d s=%d ==", w, s);
+    check_int (buf, (a == b), (xa == xb));
+    check_int (buf, (a == a), 1);
+  }
+}
+
+static void sub_signext (void)
+{
+  /* borrow out of a short signed value fills the unit */
+  { BigInt a = mk (8, 1, 3), b = mk (8, 1, 5);
+    a -= b;
+    check ("s8: 3-5", a, fix (-2, 8, 1));
+    check_int ("s8: 3-5 negative", a.isNegative(), 1); }
+
+  /* ... and is cleared for an unsigned one */
+  { BigInt a = mk (8, 0, 3), b = mk (8, 0, 5);
+    a -= b;
+    check ("u8: 3-5", a, 0xfe); }
+
+  /* the borrow crosses into the upper unit */
+  { BigInt a = mk (100, 1, 1), b = mk (100, 1, 2);
+    a -= b;
+    check ("s100: 1-2", a, ~(u128)0); }
+
+  /* a negative one-unit subtrahend is sign extended over two units */
+  { BigInt a = mk (70, 1, 0), b = mk (8, 1, -1);
+    a -= b;
+    check ("s70: 0-(-1)", a, 1); }
+  { BigInt a = mk (70, 1, ((u128)1) << 64), b = mk (8, 1, 1);
+    a -= b;
+    check ("s70: 2^64-1", a, (((u128)1) << 64) - 1); }
+}
+
+static void shift_big (void)
+{
+  u128 one = 1;
+
+  { BigInt a = mk (128, 0, 1); a <<= 64; check ("u128: 1<<64", a, one << 64); }
+  { BigInt a = mk (128, 0, 3); a <<= 100; check ("u128: 3<<100", a, 3*(one << 100)); }
+  { BigInt a = mk (128, 0, 1); a <<= 128; check ("u128: 1<<128", a, 0); }
+  { BigInt a = mk (128, 0, 1); a <<= 200; check ("u128: 1<<200", a, 0); }
+  { BigInt a = mk (128, 0, one << 127); a >>= 64;
+    check ("u128: 2^127>>64", a, one << 63); }
+  { BigInt a = mk (128, 0, one << 127); a >>= 127; check ("u128: 2^127>>127", a, 1); }
+  { BigInt a = mk (128, 1, one << 127); a >>= 70;
+    check ("s128: -2^127>>70", a, ~((one << 57) - 1)); }
+  { BigInt a = mk (100, 1, -5); a >>= 100; check ("s100: -5>>100", a, ~(u128)0); }
+  { BigInt a = mk (100, 0, 5); a >>= 300; check ("u100: 5>>300", a, 0); }
+
+  /* a dynamic value grows by the shift amount */
+  { BigInt a = mk (8, 0, 0x81);
+    a.toDynamic ();
+    a <<= 70;
+    check ("dyn u8: 0x81<<70", a, ((u128)0x81) << 70);
+    check_int ("dyn u8: 0x81<<70 width", a.getWidth(), 78);
+    a >>= 70;
+    check ("dyn u8: >>70", a, 0x81);
+    check_int ("dyn u8: >>70 width", a.getWidth(), 8); }
+}
+
+static void nbit_past_width (void)
+{
+  { BigInt a = mk (8, 0, 0xff);
+    check_int ("u8 nBit(7)", a.nBit (7), 1);
+    check_int ("u8 nBit(8)", a.nBit (8), 0);
+    check_int ("u8 nBit(64)", a.nBit (64), 0);
+    check_int ("u8 nBit(1000)", a.nBit (1000), 0); }
+  { BigInt a = mk (8, 1, -1);
+    check_int ("s8 nBit(8)", a.nBit (8), 1);
+    check_int ("s8 nBit(64)", a.nBit (64), 1);
+    check_int ("s8 nBit(1000)", a.nBit (1000), 1); }
+  { BigInt a = mk (70, 1, 1);
+    check_int ("s70 nBit(0)", a.nBit (0), 1);
+    check_int ("s70 nBit(69)", a.nBit (69), 0);
+    check_int ("s70 nBit(500)", a.nBit (500), 0); }
+}
+
+static void mul_carry (void)
+{
+  /* (2^64-1)^2 carries into the upper unit */
+  { BigInt a = mk (64, 0, ~0UL), b = mk (64, 0, ~0UL);
+    BigInt r = a * b;
+    const unsigned long x[] = { 1, ~0UL - 1 };
+    check_units ("u64: (2^64-1)^2", r, 2, x);
+    check_int ("u64: (2^64-1)^2 width", r.getWidth(), 128); }
+
+  /* (2^128-1)(2^64-1) ripples a carry through all three units */
+  { BigInt a = mk (128, 0, ~(u128)0), b = mk (64, 0, ~0UL);
+    BigInt r = a * b;
+    const unsigned long x[] = { 1, ~0UL, ~0UL - 1 };
+    check_units ("u128*u64: carry", r, 3, x); }
+
+  /* (2^256-1)^2 = 2^512 - 2^257 + 1 */
+  { BigInt a(256, 0, 0);
+    for (int i=0; i < 4; i++) {
+      a.setVal (i, ~0UL);
+    }
+    BigInt b(a);
+    BigInt r = a * b;
+    const unsigned long x[] = { 1, 0, 0, 0, ~0UL - 1, ~0UL, ~0UL, ~0UL };
+    check_units ("u256: (2^256-1)^2", r, 8, x); }
+
+  /* signed */
+  { BigInt a = mk (8, 1, -3), b = mk (8, 1, 5);
+    BigInt r = a * b;
+    check ("s8: -3*5", r, fix (-15, 16, 1));
+    check_int ("s8: -3*5 signed", r.isSigned(), 1); }
+  { BigInt a = mk (64, 1, -1), b = mk (64, 1, -1);
+    BigInt r = a * b;
+    check ("s64: -1*-1", r, 1); }
+}
+
+static void mixed_sign (void)
+{
+  /* signed operands are treated as unsigned when mixed */
+  { BigInt a = mk (8, 1, -1), b = mk (8, 0, 1);
+    a += b;
+    check ("s8+u8: -1+1", a, 0);
+    check_int ("s8+u8: unsigned", a.isSigned(), 0); }
+  { BigInt a = mk (8, 1, -1), b = mk (8, 0, 1);
+    a -= b;
+    check ("s8-u8: -1-1", a, 0xfe);
+    check_int ("s8-u8: unsigned", a.isSigned(), 0); }
+  { BigInt a = mk (8, 1, -1), b = mk (8, 0, 2);
+    BigInt r = a * b;
+    check ("s8*u8: 0xff*2", r, 0x1fe);
+    check_int ("s8*u8: unsigned", r.isSigned(), 0); }
+  { BigInt a = mk (8, 1, -1), b = mk (8, 0, 1);
+    check_int ("s8<u8: 0xff<1", (a < b), 0);
+    check_int ("u8<s8: 1<0xff", (b < a), 1); }
+  { BigInt a = mk (8, 1, -1), b = mk (8, 0, 0xff);
+    check_int ("s8==u8: 0xff", (a == b), 1); }
+  { BigInt a = mk (16, 1, -16), b = mk (8, 0, 5);
+    BigInt r = a / b;
+    check ("s16/u8: 0xfff0/5", r, 0xfff0/5);
+    check_int ("s16/u8: unsigned", r.isSigned(), 0); }
+  { BigInt a = mk (8, 1, -1), b = mk (8, 0, 0x0f);
+    a &= b;
+    check ("s8&u8", a, 0x0f); }
+}
+
+static void usage (char *s)
+{
+  fprintf (stderr, "Usage: %s [-n iterations]\n", s);
+  exit (1);
+}
+
+int main (int argc, char **argv)
+{
+  int ch;
+  int n = 2000;
+  int widths[] = { 1, 2, 7, 8, 31, 32, 33, 63, 64, 65, 100, 127, 128 };
+
+  while ((ch = getopt (argc, argv, "n:")) != -1) {
+    switch (ch) {
+    case 'n':
+      n = atoi (optarg);
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+  if (optind != argc || n < 0) {
+    usage (argv[0]);
+  }
+
+  srandom (1);
+  for (unsigned int i=0; i < sizeof (widths)/sizeof (widths[0]); i++) {
+    random_ops (widths[i], 0, n);
+    if (widths[i] > 1) {
+      random_ops (widths[i], 1, n);
+    }
+  }
+  sub_signext ();
+  shift_big ();
+  nbit_past_width ();
+  mul_carry ();
+  mixed_sign ();
+
+  printf ("%d checks, %d failed\n", ncheck, nfail);
+  return nfail ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <common/simdes.h>
+#include <common/mytime.h>
+
+/*
+ *  Hold-model benchmark for SimDES.
+ *
+ *  Each object repeatedly schedules its next event with an
+ *  exponentially distributed delay. In addition, each step arms a
+ *  timeout that is revoked by the object's next step with the
+ *  specified probability, which is how co-simulation models use
+ *  timeouts. Optionally, a step also sends a message to a random
+ *  object, which exercises cross-LP events in parallel mode.
+ *
+ *  All state is per object, so the same run can be executed with any
+ *  number of logical processes.
+ */
+
+#define EV_HOLD    1
+#define EV_TIMEOUT 2
+#define EV_MSG     3
+
+static int hold_mean;		/* mean hold time */
+static int timeout_mult;	/* timeout delay = mult * hold_mean */
+static int revoke_pct;		/* % of timeouts that are revoked */
+static int msg_pct;		/* % of steps that send a message */
+static unsigned long lookahead;	/* minimum message delay */
+
+class HoldObj;
+static HoldObj **objs;
+static int nobjs;
+
+class HoldObj : public SimDES {
+public:
+  HoldObj (int id, long events) {
+    timeout = NULL;
+    rnd_state = 88172645463325252ULL + 1000003ULL*id;
+    nevents = events;
+    nrevoked = 0;
+    nfired = 0;
+    nmsgs = 0;
+    new Event (this, EV_HOLD, rnd_delay (hold_mean));
+  }
+
+  int Step (Event *ev) {
+    if (ev->getType() == EV_TIMEOUT) {
+      if (ev == timeout) {
+	timeout = NULL;
+      }
+      nfired++;
+      return 1;
+    }
+    if (ev->getType() == EV_MSG) {
+      nmsgs++;
+      return 1;
+    }
+
+    if (nevents-- <= 0) {
+      /* done: let the simulation drain */
+      return 1;
+    }
+    if (timeout && (int)(rnd () % 100) < revoke_pct) {
+      timeout->Remove ();
+      timeout = NULL;
+      nrevoked++;
+    }
+    if (revoke_pct > 0 && !timeout) {
+      timeout = new Event (this, EV_TIMEOUT, timeout_mult*hold_mean);
+    }
+    if (msg_pct > 0 && (int)(rnd () % 100) < msg_pct) {
+      new Event (objs[rnd () % nobjs], EV_MSG,
+		 lookahead + rnd_delay (hold_mean));
+    }
+    new Event (this, EV_HOLD, rnd_delay (hold_mean));
+    return 1;
+  }
+
+  long nrevoked;		/* # of timeouts revoked */
+  long nfired;			/* # of timeouts that fired */
+  long nmsgs;			/* # of messages received */
+
+private:
+  unsigned long rnd () {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+  }
+
+  int rnd_delay (int mean) {
+    double u = (rnd () % 1000000 + 1)/1000001.0;
+    return 1 + (int)(-log (u) * mean);
+  }
+
+  Event *timeout;
+  unsigned long long rnd_state;
+  long nevents;			/* # of hold events left to execute */
+};
+
+static void usage (char *s)
+{
+  fprintf (stderr, "Usage: %s [-q heap|calendar] [-n objs] [-e events] [-m mean] [-t mult] [-r pct] [-x pct] [-p threads] [-l lookahead]\n", s);
+  fprintf (stderr, "  -q : event queue (default: heap)\n");
+  fprintf (stderr, "  -n : number of simulation objects (default: 10000)\n");
+  fprintf (stderr, "  -e : number of hold events to execute (default: 10000000)\n");
+  fprintf (stderr, "  -m : mean hold time (default: 100)\n");
+  fprintf (stderr, "  -t : timeout delay as a multiple of the mean (default: 10)\n");
+  fprintf (stderr, "  -r : percentage of timeouts revoked (default: 0)\n");
+  fprintf (stderr, "  -x : percentage of steps that message a random object (default: 0)\n");
+  fprintf (stderr, "  -p : number of logical processes/threads (default: 1)\n");
+  fprintf (stderr, "  -l : lookahead for messages (default: mean hold time)\n");
+  exit (1);
+}
+
+int main (int argc, char **argv)
+{
+  int ch;
+  long total = 10000000;
+  int qtype = SIM_EVQ_HEAP;
+  int nthreads = 1;
+  long nrevoked, nfired, nmsgs;
+  double tm;
+  struct rusage ru;
+
+  nobjs = 10000;
+  hold_mean = 100;
+  timeout_mult = 10;
+  revoke_pct = 0;
+  msg_pct = 0;
+  lookahead = 0;
+
+  while ((ch = getopt (argc, argv, "q:n:e:m:t:r:x:p:l:")) != -1) {
+    switch (ch) {
+    case 'q':
+      if (strcmp (optarg, "heap") == 0) {
+	qtype = SIM_EVQ_HEAP;
+      }
+      else if (strcmp (optarg, "calendar") == 0) {
+	qtype = SIM_EVQ_CALENDAR;
+      }
+      else {
+	usage (argv[0]);
+      }
+      break;
+    case 'n':
+      nobjs = atoi (optarg);
+      break;
+    case 'e':
+      total = atol (optarg);
+      break;
+    case 'm':
+      hold_mean = atoi (optarg);
+      break;
+    case 't':
+      timeout_mult = atoi (optarg);
+      break;
+    case 'r':
+      revoke_pct = atoi (optarg);
+      break;
+    case 'x':
+      msg_pct = atoi (optarg);
+      break;
+    case 'p':
+      nthreads = atoi (optarg);
+      break;
+    case 'l':
+      lookahead = atol (optarg);
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+  if (optind != argc || nobjs < 1 || total < 1 || hold_mean < 1
+      || nthreads < 1) {
+    usage (argv[0]);
+  }
+  if (lookahead == 0) {
+    lookahead = hold_mean;
+  }
+
+  SimDES::setEventQueue (qtype);
+  SimDES::setParallel (nthreads, lookahead);
+  MALLOC (objs, HoldObj *, nobjs);
+  for (int i=0; i < nobjs; i++) {
+    objs[i] = new HoldObj (i, total/nobjs + (i < total % nobjs ? 1 : 0));
+    objs[i]->setLP ((long)i*nthreads/nobjs);
+  }
+
+  realtime_msec ();
+  SimDES::Run ();
+  tm = realtime_msec ();
+
+  nrevoked = 0;
+  nfired = 0;
+  nmsgs = 0;
+  for (int i=0; i < nobjs; i++) {
+    nrevoked += objs[i]->nrevoked;
+    nfired += objs[i]->nfired;
+    nmsgs += objs[i]->nmsgs;
+  }
+
+  getrusage (RUSAGE_SELF, &ru);
+  printf ("queue=%s threads=%d objs=%d events=%ld revoked=%ld fired=%ld msgs=%ld time_ms=%.1f events_per_sec=%.0f maxrss_kb=%ld\n",
+	  qtype == SIM_EVQ_HEAP ? "heap" : "calendar", nthreads, nobjs,
+	  total, nrevoked, nfired, nmsgs, tm,
+	  tm > 0 ? total/(tm/1000.0) : 0.0, ru.ru_maxrss);
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <common/thread.h>
+
+/*
+ *  User-level thread benchmark: creates a number of threads, and has
+ *  each of them yield a fixed number of times. Reports the context
+ *  switch rate and the memory used per thread.
+ */
+
+static int nthreads = 1000000;
+static int nrounds = 10;
+static int stksz = 0;
+static int guard = 0;
+
+static double create_ms;
+static double run_ms;
+static int started = 0;
+
+static void worker (void)
+{
+  int i;
+
+  if (!started) {
+    started = 1;
+    create_ms = realtime_msec ();
+  }
+  for (i=0; i < nrounds; i++) {
+    thread_idle ();
+  }
+}
+
+static void done (void)
+{
+  struct rusage ru;
+  double nsw;
+
+  run_ms = realtime_msec ();
+  getrusage (RUSAGE_SELF, &ru);
+  nsw = (double)nthreads*(nrounds+1);
+  printf ("threads=%d stack=%d guard=%d create_ms=%.1f run_ms=%.1f switches=%.0f switches_per_sec=%.0f maxrss_kb=%ld kb_per_thread=%.2f\n",
+	  nthreads, stksz ? stksz : DEFAULT_STACK_SIZE, guard, create_ms,
+	  run_ms, nsw, run_ms > 0 ? nsw/(run_ms/1000.0) : 0.0,
+	  ru.ru_maxrss, (double)ru.ru_maxrss/nthreads);
+}
+
+static void usage (char *s)
+{
+  fprintf (stderr, "Usage: %s [-n threads] [-r rounds] [-s stack] [-g]\n", s);
+  fprintf (stderr, "  -n : number of threads (default: 1000000)\n");
+  fprintf (stderr, "  -r : number of yields per thread (default: 10)\n");
+  fprintf (stderr, "  -s : stack size in bytes (default: %d)\n", DEFAULT_STACK_SIZE);
+  fprintf (stderr, "  -g : use stack guard pages\n");
+  exit (1);
+}
+
+int main (int argc, char **argv)
+{
+  int ch, i;
+
+  while ((ch = getopt (argc, argv, "n:r:s:g")) != -1) {
+    switch (ch) {
+    case 'n':
+      nthreads = atoi (optarg);
+      break;
+    case 'r':
+      nrounds = atoi (optarg);
+      break;
+    case 's':
+      stksz = atoi (optarg);
+      break;
+    case 'g':
+      guard = 1;
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+  if (optind != argc || nthreads < 1 || nrounds < 0) {
+    usage (argv[0]);
+  }
+
+  thread_stack_config (stksz, guard);
+  context_unfair ();
+
+  realtime_msec ();
+  for (i=0; i < nthreads; i++) {
+    thread_new (worker, 0);
+  }
+  simulate (done);
+  return 0;
+}
@@ -25,8 +25,19 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "thread.h"
 #include "qops.h"
+#include "array.h"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
 
 #define DEBUG_MODE
 
@@ -44,6 +55,15 @@ void (*thread_cleanup)(void) = NULL;
 
 static Time_t inconsistent_timer = 0;
 
+/* thread stacks */
+#define STACK_SLAB 64		/* # of default-size stacks per mmap */
+
+static int stack_default_sz = DEFAULT_STACK_SIZE;
+static int stack_guard = 1;
+static int stack_page_sz = 0;
+static int stack_configured = 0;
+L_A_DECL (char *, stack_freeq);	/* free default-size stacks */
+
 lthread_t *timerQh = NULL;
 lthread_t *timerQt = NULL;
 
@@ -93,6 +113,108 @@ void thread_pause (int delay)
   context_switch (context_select ());
 }
 
+/*------------------------------------------------------------------------
+ *
+ *  Stack allocation
+ *
+ *------------------------------------------------------------------------
+ */
+static int stack_round (int sz)
+{
+  if (stack_page_sz == 0) {
+    stack_page_sz = getpagesize ();
+  }
+  return ((sz + stack_page_sz - 1)/stack_page_sz)*stack_page_sz;
+}
+
+void thread_stack_config (int sz, int guard)
+{
+  if (stack_configured) {
+    printf ("thread_stack_config: threads already exist; ignored\n");
+    return;
+  }
+  if (sz <= 0) {
+    sz = DEFAULT_STACK_SIZE;
+  }
+  stack_default_sz = stack_round (sz);
+  stack_guard = guard ? 1 : 0;
+}
+
+static char *stack_map (size_t len)
+{
+  void *v;
+
+  v = mmap (NULL, len, PROT_READ|PROT_WRITE,
+	    MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (v == MAP_FAILED) {
+    printf ("Thread stack allocation failed, size=%lu\n", (unsigned long)len);
+    exit (1);
+  }
+  return (char *)v;
+}
+
+/* make the lowest page of a stack inaccessible */
+static void stack_guard_page (char *stk, size_t guard, char *map, size_t len)
+{
+  if (mprotect (stk, guard, PROT_NONE) != 0) {
+    munmap (map, len);
+    printf ("Thread stack guard page setup failed\n");
+    exit (1);
+  }
+}
+
+/*
+ * Returns the lowest usable address of a stack of size sz (a multiple
+ * of the page size).
+ */
+static char *stack_alloc (int sz)
+{
+  int guard = stack_guard ? stack_page_sz : 0;
+  char *base;
+  int i;
+
+  stack_configured = 1;
+
+  if (sz != stack_default_sz) {
+    base = stack_map (sz + guard);
+    if (guard) {
+      stack_guard_page (base, guard, base, sz + guard);
+    }
+    return base + guard;
+  }
+
+  if (A_LEN (stack_freeq) == 0) {
+    /* allocate a slab of stacks; push them in reverse order so that
+       they are handed out in address order */
+    base = stack_map ((size_t)STACK_SLAB*(sz + guard));
+    for (i=STACK_SLAB-1; i >= 0; i--) {
+      char *stk = base + (size_t)i*(sz + guard);
+      if (guard) {
+	stack_guard_page (stk, guard, base, (size_t)STACK_SLAB*(sz + guard));
+      }
+      A_NEW (stack_freeq, char *);
+      A_NEXT (stack_freeq) = stk + guard;
+      A_INC (stack_freeq);
+    }
+  }
+  A_LEN_RAW (stack_freeq)--;
+  return stack_freeq[A_LEN (stack_freeq)];
+}
+
+static void stack_free (char *stk, int sz)
+{
+  int guard = stack_guard ? stack_page_sz : 0;
+
+  if (sz == stack_default_sz) {
+    A_NEW (stack_freeq, char *);
+    A_NEXT (stack_freeq) = stk;
+    A_INC (stack_freeq);
+  }
+  else {
+    munmap (stk - guard, sz + guard);
+  }
+}
+
 /*------------------------------------------------------------------------
  *
  * Interface to context library
@@ -156,12 +278,9 @@ void context_destroy (lthread_t *t)
   if (t->name) free ((void *)t->name);
   if (t->file) free ((void *)t->file);
 #endif /* DEBUG_MODE */
-  if (t->c.sz == DEFAULT_STACK_SIZE) {
-    t->next = thread_freeq;
-    thread_freeq = t;
-  }
-  else
-    free (t);
+  stack_free (t->c.stack, t->c.sz);
+  t->next = thread_freeq;
+  thread_freeq = t;
 }
 
 
@@ -236,22 +355,21 @@ _thread_new (void (*f)(void), int stksz, const char *name, int ready,
     }
   }
   if (stksz == 0 || stksz == DEFAULT_STACK_SIZE) {
-    stksz = DEFAULT_STACK_SIZE;
-    if (thread_freeq) {
-      t = thread_freeq;
-      thread_freeq = thread_freeq->next;
-    }
-    else
-      t = (lthread_t*)malloc(sizeof(lthread_t));
+    stksz = stack_default_sz;
+  }
+  stksz = stack_round (stksz);
+  if (thread_freeq) {
+    t = thread_freeq;
+    thread_freeq = thread_freeq->next;
   }
   else
-    t = (lthread_t*)malloc(sizeof(lthread_t)-DEFAULT_STACK_SIZE+stksz);
+    t = (lthread_t*)malloc(sizeof(lthread_t));
   if (!t) {
-    printf ("Thread allocation failed, stack size=%d\n",stksz);
+    printf ("Thread allocation failed\n");
     exit (1);
   }
   t->sz = stksz;
-  t->c.stack = (char*) t->s;
+  t->c.stack = stack_alloc (stksz);
   t->c.sz = stksz;
   t->tid = tid++;
   t->line = line;
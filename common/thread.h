@@ -45,14 +45,26 @@ struct process_record {
   int color;			/* odd/even queue setup */
   int in_readyq;		/* 1 if in the readyq */
   struct process_record *next;
-  double s[(DEFAULT_STACK_SIZE+sizeof(double)-1)/sizeof(double)]; 
-         /* stack; this crazy construct is to make the "s" field aligned
-	    properly on a sparc
-         */
 };
 
 typedef struct process_record lthread_t;
 
+/*
+ * Thread stacks are allocated with mmap(), so memory is only
+ * committed for the pages a thread actually touches. Stacks of the
+ * default size are carved out of larger slabs and recycled.
+ *
+ * If guard pages are enabled, an inaccessible page sits below each
+ * stack so that an overflow faults instead of silently corrupting
+ * memory. Each guard page costs a separate kernel mapping, so very
+ * large numbers of threads (more than vm.max_map_count/2 on Linux)
+ * require guard pages to be turned off.
+ */
+void thread_stack_config (int default_sz, int guard);
+  /* default stack size (0 = DEFAULT_STACK_SIZE), and guard pages
+     (default: on). Must be called before the first thread is created.
+  */
+
 lthread_t *_thread_new (void (*f)(void), int stksz, const char *name, int
 		       ready, char *file, int line);
 
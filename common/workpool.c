@@ -0,0 +1,114 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <unistd.h>
+#include <pthread.h>
+#include "workpool.h"
+#include "misc.h"
+
+struct workpool {
+  pthread_mutex_t lock;
+  int next;			/* next job to hand out */
+  int njobs;
+  void (*fn)(void *, int, int);
+  void *cookie;
+};
+
+struct workpool_thread {
+  struct workpool *w;
+  int tid;
+  pthread_t th;
+};
+
+static void *_workpool_thread (void *arg)
+{
+  struct workpool_thread *t = (struct workpool_thread *) arg;
+  struct workpool *w = t->w;
+  int job;
+
+  while (1) {
+    pthread_mutex_lock (&w->lock);
+    job = w->next;
+    if (job < w->njobs) {
+      w->next++;
+    }
+    pthread_mutex_unlock (&w->lock);
+    if (job >= w->njobs) break;
+    (*w->fn) (w->cookie, job, t->tid);
+  }
+  return NULL;
+}
+
+void workpool_run (int nthreads, int njobs,
+		   void (*fn)(void *, int, int), void *cookie)
+{
+  struct workpool w;
+  struct workpool_thread *t;
+  int i;
+
+  if (njobs <= 0) return;
+  if (nthreads > njobs) {
+    nthreads = njobs;
+  }
+  if (nthreads <= 1) {
+    for (i=0; i < njobs; i++) {
+      (*fn) (cookie, i, 0);
+    }
+    return;
+  }
+
+  pthread_mutex_init (&w.lock, NULL);
+  w.next = 0;
+  w.njobs = njobs;
+  w.fn = fn;
+  w.cookie = cookie;
+
+  MALLOC (t, struct workpool_thread, nthreads);
+  for (i=0; i < nthreads; i++) {
+    t[i].w = &w;
+    t[i].tid = i;
+  }
+  /* the calling thread is worker 0 */
+  for (i=1; i < nthreads; i++) {
+    if (pthread_create (&t[i].th, NULL, _workpool_thread, &t[i]) != 0) {
+      fatal_error ("workpool_run: could not create thread");
+    }
+  }
+  _workpool_thread (&t[0]);
+  for (i=1; i < nthreads; i++) {
+    pthread_join (t[i].th, NULL);
+  }
+  FREE (t);
+  pthread_mutex_destroy (&w.lock);
+}
+
+int workpool_ncpus (void)
+{
+  long n;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  n = sysconf (_SC_NPROCESSORS_ONLN);
+#else
+  n = 1;
+#endif
+  if (n < 1) n = 1;
+  return n;
+}
@@ -0,0 +1,55 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#ifndef __WORKPOOL_H__
+#define __WORKPOOL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *  Minimal parallel-for over a set of independent jobs.
+ *
+ *  workpool_run() calls fn(cookie, job, tid) once for every job in
+ *  [0, njobs), using up to nthreads threads; tid in [0, nthreads) is
+ *  the index of the calling thread, and can be used to select
+ *  per-thread scratch state. Jobs are handed out in increasing order,
+ *  but may complete in any order. The call returns when all jobs are
+ *  done. With nthreads <= 1, the jobs are run in order in the calling
+ *  thread.
+ *
+ *  Any code that uses this must link with -lpthread.
+ */
+void workpool_run (int nthreads, int njobs,
+		   void (*fn)(void *cookie, int job, int tid), void *cookie);
+
+/*
+ *  Number of threads to use when the user asks for "all" (0): the
+ *  number of online processors.
+ */
+int workpool_ncpus (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WORKPOOL_H__ */
@@ -31,6 +31,7 @@
 #include <act/passes/booleanize.h>
 #include <act/passes/netlist.h>
 #include <common/config.h>
+#include <common/workpool.h>
 
 struct act_varinfo {
   int nup, ndn;			// # of times in up and down guards
@@ -73,9 +74,50 @@ struct act_prsinfo {
       /* The # of these will be nout + any internal labels */
 
   int *match_perm;		// used to report match!
-  
+
+  int *canon;			/* canonical form, see _canonicalize() */
+  int canon_len;
+  unsigned long canon_hash;	/* hash of the canonical form */
+};
+
+/* cell table statistics; see _collect_job() for the per-thread part */
+static __thread struct {
+  unsigned long gates;		/* # of gates canonicalized */
+  unsigned long orders;		/* # of variable orders serialized */
+  unsigned long limit;		/* # of gates with too many ties */
+  unsigned long probes;		/* # of hash table entries examined */
+  unsigned long rejects;	/* # rejected using the canonical form */
+  unsigned long compares;	/* # of expression tree comparisons */
+  unsigned long matches;	/* # of successful matches */
+} cell_stats;
+
+/*
+  Gate extraction state. This is per thread, so that gates from
+  different processes can be extracted in parallel.
+*/
+static __thread struct idmap current_idmap;
+static __thread int _leak_flag;
+
+/* gates found in a process, to be instantiated in order */
+#define CELL_GATE_PRS   0	/* pull-up/pull-down pair */
+#define CELL_GATE_GROUP 1	/* rules grouped by shared labels */
+#define CELL_GATE_PASS  2	/* pass gate */
+
+struct cell_gate {
+  int type;
+  struct act_prsinfo *pi;
+  struct idmap imap;		/* current_idmap for pi */
+  act_prs_lang_t *prs;		/* pass gate */
+};
+
+struct cell_gates {
+  A_DECL (struct cell_gate, g);
+  unsigned long gates, orders, limit; /* canonicalization stats */
 };
 
+/* non-NULL if gates are being recorded rather than instantiated */
+static __thread struct cell_gates *_defer;
+
 
 static void _add_new_outslot (struct act_prsinfo *pi)
 {
@@ -105,28 +147,9 @@ static act_prs_expr_t *_convert_prsexpr_to_act (act_prs_expr_t *e,
 static int cell_hashfn (int sz, void *key)
 {
   struct act_prsinfo *ckey = (struct act_prsinfo *)key;
-  unsigned int h;
-  int i;
 
-  h = hash_function_continue (sz, (unsigned char *)&ckey->nvars,
-			      sizeof (int), 0, 0);
-  h = hash_function_continue (sz, (unsigned char *)&ckey->nout,
-			      sizeof (int), h, 1);
-  h = hash_function_continue (sz, (unsigned char *)&ckey->nat,
-			      sizeof (int), h, 1);
-  h = hash_function_continue (sz, (unsigned char *)&ckey->tval,
-			      sizeof (int), h, 1);
-
-  for (i=0; i < A_LEN (ckey->attrib); i++) {
-    h = hash_function_continue (sz, (unsigned char *)&ckey->attrib[i].nup,
-				sizeof (int), h, 1);
-    h = hash_function_continue (sz, (unsigned char *)&ckey->attrib[i].ndn,
-				sizeof (int), h, 1);
-    h = hash_function_continue (sz, (unsigned char *)&ckey->attrib[i].tree,
-				sizeof (char), h, 1);
-  }
-  
-  return h;
+  return hash_function_continue (sz, (unsigned char *)&ckey->canon_hash,
+				 sizeof (unsigned long), 0, 0);
 }
 
 static Expr *_id_to_expr (ActId *id)
@@ -479,8 +502,18 @@ static int cell_matchfn (void *key1, void *key2)
   k1 = (struct act_prsinfo *)key1;
   k2 = (struct act_prsinfo *)key2;
 
+  cell_stats.probes++;
+  if (k1->canon_hash != k2->canon_hash ||
+      k1->canon_len != k2->canon_len ||
+      memcmp (k1->canon, k2->canon, sizeof (int)*k1->canon_len) != 0) {
+    cell_stats.rejects++;
+    return 0;
+  }
   if (!basic_match (k1, k2)) return 0;
-  return match_prsinfo (k1, k2, 1);
+  cell_stats.compares++;
+  if (!match_prsinfo (k1, k2, 1)) return 0;
+  cell_stats.matches++;
+  return 1;
 }
 
 static void *cell_dupfn (void *key)
@@ -501,7 +534,318 @@ static void cell_freefn (void *key)
 }
 
 
-L_A_DECL (act_prs_lang_t *, pendingprs);
+/*
+ *  Canonical form of a gate.
+ *
+ *  The attribute sort in _gen_prs_attributes() only partially orders
+ *  the variables; variables with identical attributes are left in
+ *  their original order, so two isomorphic gates need not end up with
+ *  the same attr_map. We break these ties by picking the order whose
+ *  serialization is lexicographically smallest. Isomorphic gates then
+ *  have identical serializations, so the hash of the serialization
+ *  identifies the cell, and a candidate with a different
+ *  serialization is rejected without comparing expression trees.
+ *
+ *  Non-constant sizes are not serialized; match_prsinfo() still
+ *  checks those.
+ */
+#define CANON_NULL   -1
+#define CANON_TRUE   -2
+#define CANON_FALSE  -3
+#define CANON_VAR    -4
+#define CANON_LABEL  -5
+#define CANON_AND    -6
+#define CANON_OR     -7
+#define CANON_INT    -8
+#define CANON_EXPR   -9
+
+#define CANON_MAXPERM 5040	/* max # of tie-breaking orders tried */
+
+struct canon_buf {
+  A_DECL (int, v);
+};
+
+static int _canon_cmp (int *a, int alen, int *b, int blen)
+{
+  int i;
+  for (i=0; i < alen && i < blen; i++) {
+    if (a[i] < b[i]) return -1;
+    if (a[i] > b[i]) return 1;
+  }
+  if (alen < blen) return -1;
+  if (alen > blen) return 1;
+  return 0;
+}
+
+static void _canon_size (struct canon_buf *b, Expr *e)
+{
+  if (!e) {
+    A_APPEND (b->v, int, CANON_NULL);
+  }
+  else if (e->type == E_INT) {
+    A_APPEND (b->v, int, CANON_INT);
+    A_APPEND (b->v, int, (int)e->u.v);
+  }
+  else {
+    A_APPEND (b->v, int, CANON_EXPR);
+  }
+}
+
+/*
+  Serialize expression; pos[] maps a variable to its position in the
+  order being tried. Negations are pushed down to the leaves, the same
+  way _equal_expr() compares expressions.
+*/
+static void _canon_expr (struct canon_buf *b, act_prs_expr_t *e,
+			 int *pos, int parity)
+{
+  int mid, start, *tmp;
+  
+  if (!e) {
+    A_APPEND (b->v, int, CANON_NULL);
+    return;
+  }
+  while (e->type == ACT_PRS_EXPR_NOT) {
+    parity = 1 - parity;
+    e = e->u.e.l;
+  }
+  switch (e->type) {
+  case ACT_PRS_EXPR_TRUE:
+  case ACT_PRS_EXPR_FALSE:
+    if ((e->type == ACT_PRS_EXPR_TRUE ? 1 : 0) ^ parity) {
+      A_APPEND (b->v, int, CANON_TRUE);
+    }
+    else {
+      A_APPEND (b->v, int, CANON_FALSE);
+    }
+    break;
+
+  case ACT_PRS_EXPR_LABEL:
+    A_APPEND (b->v, int, CANON_LABEL);
+    A_APPEND (b->v, int, 2*pos[(unsigned long)e->u.l.label] + parity);
+    break;
+
+  case ACT_PRS_EXPR_VAR:
+    A_APPEND (b->v, int, CANON_VAR);
+    A_APPEND (b->v, int, 2*pos[(unsigned long)e->u.v.id] + parity);
+    if (e->u.v.sz) {
+      A_APPEND (b->v, int, e->u.v.sz->flavor);
+      _canon_size (b, e->u.v.sz->w);
+      _canon_size (b, e->u.v.sz->l);
+      _canon_size (b, e->u.v.sz->folds);
+    }
+    else {
+      A_APPEND (b->v, int, CANON_NULL);
+    }
+    break;
+
+  case ACT_PRS_EXPR_AND:
+  case ACT_PRS_EXPR_OR:
+    if ((e->type == ACT_PRS_EXPR_AND) == (parity == 0)) {
+      A_APPEND (b->v, int, CANON_AND);
+      _canon_expr (b, e->u.e.l, pos, parity);
+      _canon_expr (b, e->u.e.r, pos, parity);
+      if (e->u.e.pchg) {
+	A_APPEND (b->v, int, e->u.e.pchg_type);
+	_canon_expr (b, e->u.e.pchg, pos, 0);
+      }
+      else {
+	A_APPEND (b->v, int, CANON_NULL);
+      }
+    }
+    else {
+      /* or is commutative: the smaller operand goes first */
+      A_APPEND (b->v, int, CANON_OR);
+      start = A_LEN (b->v);
+      _canon_expr (b, e->u.e.l, pos, parity);
+      mid = A_LEN (b->v);
+      _canon_expr (b, e->u.e.r, pos, parity);
+      if (_canon_cmp (b->v + mid, A_LEN (b->v) - mid,
+		      b->v + start, mid - start) < 0) {
+	MALLOC (tmp, int, mid - start);
+	memcpy (tmp, b->v + start, sizeof (int)*(mid - start));
+	memmove (b->v + start, b->v + mid, sizeof (int)*(A_LEN (b->v) - mid));
+	memcpy (b->v + A_LEN (b->v) - (mid - start), tmp,
+		sizeof (int)*(mid - start));
+	FREE (tmp);
+      }
+    }
+    break;
+
+  case ACT_PRS_EXPR_ANDLOOP:
+  case ACT_PRS_EXPR_ORLOOP:
+    fatal_error ("loops in expanded prs?");
+    break;
+
+  default:
+    fatal_error ("What?");
+    break;
+  }
+}
+
+/* serialize the rules of the gate, with variables in order map[] */
+static void _canon_rules (struct canon_buf *b, struct act_prsinfo *pi,
+			  int *map, int *pos)
+{
+  int i;
+
+  A_LEN_RAW (b->v) = 0;
+  for (i=0; i < pi->nvars; i++) {
+    pos[map[i]] = i;
+  }
+  for (i=0; i < pi->nvars; i++) {
+    if (map[i] < A_LEN (pi->up)) {
+      A_APPEND (b->v, int, i);
+      _canon_expr (b, pi->up[map[i]], pos, 0);
+      _canon_expr (b, pi->dn[map[i]], pos, 0);
+    }
+  }
+}
+
+static int _var_kind (struct act_prsinfo *pi, int v)
+{
+  if (v < pi->nout) return 0;
+  if (v < pi->nout + pi->nat) return 1;
+  return 2;
+}
+
+/*
+  vars[] holds the variable attributes sorted with cmp_fn_varinfo;
+  pi->attr_map[] is the corresponding map to variable indices. This
+  refines attr_map[] to the canonical order, and computes the
+  canonical form of the gate.
+*/
+static void _canonicalize (struct act_prsinfo *pi, struct act_varinfo **vars)
+{
+  struct canon_buf b, best;
+  int i, j, k, nruns;
+  int *runs, **aux, *cur, *pos;
+  unsigned long total;
+
+  cell_stats.gates++;
+  
+  /* 
+     Partition the order into runs of variables that are
+     indistinguishable by their attributes; outputs, labels, and
+     inputs are never exchanged, so they are split within a run.
+  */
+  MALLOC (cur, int, pi->nvars);
+  MALLOC (pos, int, pi->nvars);
+  MALLOC (runs, int, 2*pi->nvars);
+  nruns = 0;
+  total = 1;
+  for (i=0; i < pi->nvars; i = j) {
+    for (j=i+1; j < pi->nvars && cmp_fn_varinfo (vars[i], vars[j]) == 0; j++)
+      ;
+    int n = i;
+    for (k=0; k < 3; k++) {
+      int s = n;
+      for (int l=i; l < j; l++) {
+	if (_var_kind (pi, pi->attr_map[l]) == k) {
+	  cur[n++] = pi->attr_map[l];
+	}
+      }
+      if (n - s > 1) {
+	runs[2*nruns] = s;
+	runs[2*nruns+1] = n - s;
+	nruns++;
+	for (int l=2; l <= n - s && total <= CANON_MAXPERM; l++) {
+	  total *= l;
+	}
+      }
+    }
+  }
+  for (i=0; i < pi->nvars; i++) {
+    pi->attr_map[i] = cur[i];
+  }
+
+  A_INIT (b.v);
+  A_INIT (best.v);
+  _canon_rules (&best, pi, pi->attr_map, pos);
+  cell_stats.orders++;
+
+  if (nruns > 0 && total > CANON_MAXPERM) {
+    /* too many ties; use the partial order as-is */
+    cell_stats.limit++;
+  }
+  else if (nruns > 0) {
+    /* try all orders within each run, odometer-style */
+    MALLOC (aux, int *, nruns);
+    for (i=0; i < nruns; i++) {
+      MALLOC (aux[i], int, runs[2*i+1]+1);
+      aux[i][0] = -1;
+      mypermutation (cur + runs[2*i], aux[i], runs[2*i+1]);
+    }
+    while (1) {
+      for (i=0; i < nruns; i++) {
+	if (mypermutation (cur + runs[2*i], aux[i], runs[2*i+1])) {
+	  break;
+	}
+	mypermutation (cur + runs[2*i], aux[i], runs[2*i+1]);
+      }
+      if (i == nruns) break;
+      
+      _canon_rules (&b, pi, cur, pos);
+      cell_stats.orders++;
+      if (_canon_cmp (b.v, A_LEN (b.v), best.v, A_LEN (best.v)) < 0) {
+	struct canon_buf t = best;
+	best = b;
+	b = t;
+	for (j=0; j < pi->nvars; j++) {
+	  pi->attr_map[j] = cur[j];
+	}
+      }
+    }
+    for (i=0; i < nruns; i++) {
+      FREE (aux[i]);
+    }
+    FREE (aux);
+  }
+  A_FREE (b.v);
+
+  /* 
+     The canonical form: gate parameters and variable attributes,
+     followed by the rules.
+  */
+  A_INIT (b.v);
+  A_APPEND (b.v, int, pi->nvars);
+  A_APPEND (b.v, int, pi->nout);
+  A_APPEND (b.v, int, pi->nat);
+  A_APPEND (b.v, int, pi->tval);
+  A_APPEND (b.v, int, pi->leak_adjust);
+  for (i=0; i < pi->nvars; i++) {
+    A_APPEND (b.v, int, vars[i]->nup);
+    A_APPEND (b.v, int, vars[i]->ndn);
+    A_APPEND (b.v, int, vars[i]->tree);
+    for (k=0; k < vars[i]->nup + vars[i]->ndn; k++) {
+      A_APPEND (b.v, int, vars[i]->depths[k]);
+    }
+  }
+  for (i=0; i < A_LEN (best.v); i++) {
+    A_APPEND (b.v, int, best.v[i]);
+  }
+  A_FREE (best.v);
+
+  pi->canon = b.v;
+  pi->canon_len = A_LEN (b.v);
+
+  /* FNV-1a */
+  pi->canon_hash = 14695981039346656037UL;
+  for (i=0; i < pi->canon_len; i++) {
+    pi->canon_hash ^= (unsigned int)pi->canon[i];
+    pi->canon_hash *= 1099511628211UL;
+  }
+
+  FREE (runs);
+  FREE (pos);
+  FREE (cur);
+}
+
+
+/* rules waiting for the rest of their gate (per thread) */
+static __thread unsigned int pendingprs_num;
+static __thread unsigned int pendingprs_max;
+static __thread act_prs_lang_t **pendingprs;
 
 
 static int _uses_a_label (act_prs_expr_t *e)
@@ -637,8 +981,6 @@ static void _mark_at_used2 (act_prs_expr_t *e, bitset_t *b,
 
 void ActCellPass::flush_pending (Scope *sc)
 {
-  int pending_count = 0;
-
   if (A_LEN (pendingprs) == 0) {
     A_FREE (pendingprs);
     A_INIT (pendingprs);
@@ -702,7 +1044,6 @@ void ActCellPass::flush_pending (Scope *sc)
   
   for (int i=0; i < A_LEN (pendingprs); i++) {
     struct act_prsinfo *pi;
-    chash_bucket_t *b;
 
     if (at_len > 0 && (grouped[i] == 2)) {
       /* skip, since it has been grouped already */
@@ -803,49 +1144,8 @@ void ActCellPass::flush_pending (Scope *sc)
     _dump_prsinfo (pi);
 #endif    
 
-    if (cell_table) {
-      b = chash_lookup (cell_table, pi);
-      if (b) {
-	pi = (struct act_prsinfo *)b->v;
-      }
-      else {
-#if 0
-	_dump_prsinfo (pi);
-#endif
-	add_new_cell (pi);
-	b = chash_add (cell_table, pi);
-	b->v = pi;
-      }
-
-      char buf[100];
-      do {
-	snprintf (buf, 100, "cpx%d", pending_count++);
-      } while (sc->Lookup (buf));
-
-      Assert (sc->isExpanded(), "Hmm");
-
-      InstType *it = new InstType (sc, pi->cell, 0);
-      it = it->Expand (NULL, sc);
-
-      Assert (it->isExpanded(), "Hmm");
-    
-      Assert (sc->Add (buf, it), "What?");
-      /*--- now make connections --*/
-    
-      ActBody_Conn *ac;
-
-      //printf (" --- [%s] \n", p->getName());
-      ac = _build_connections (buf, pi);
-      //ac->Print (stdout);
-      //ac->Next()->Print (stdout);
-      //printf (" --- \n");
+    _add_gate (sc, CELL_GATE_GROUP, pi, NULL);
 
-      int oval = Act::double_expand;
-      Act::double_expand = 0;
-      ac->Expandlist (NULL, sc);
-      Act::double_expand = oval;
-      //printf ("---\n");
-    }
     A_FREE (groupprs);
     A_INIT (groupprs);
   }
@@ -1571,6 +1871,9 @@ struct act_prsinfo *ActCellPass::_gen_prs_attributes (act_prs_lang_t *prs, int n
   ret->nattr = NULL;
   ret->at_perm = NULL;
   ret->leak_adjust = _leak_flag;
+  ret->canon = NULL;
+  ret->canon_len = 0;
+  ret->canon_hash = 0;
 
   A_INIT (ret->attrib);
   A_INIT (ret->up);
@@ -1801,6 +2104,7 @@ struct act_prsinfo *ActCellPass::_gen_prs_attributes (act_prs_lang_t *prs, int n
 #if 0
   printf("\n");
 #endif  
+  _canonicalize (ret, _core_array);
   FREE (_core_array);
 
   struct act_varinfo *tmp;
@@ -2171,7 +2475,6 @@ void ActCellPass::_collect_one_prs (Scope *sc, act_prs_lang_t *prs)
   int i;
   struct act_prsinfo *pi;
   act_prs_lang_t newprs, newprs2;
-  chash_bucket_t *b;
   
   // add this prs to the list, if it is paired then we can find a gate
   Assert (prs->type == ACT_PRS_RULE, "Hmm.");
@@ -2248,6 +2551,18 @@ void ActCellPass::_collect_one_prs (Scope *sc, act_prs_lang_t *prs)
     
   }
   pi = _gen_prs_attributes (&newprs);
+  _add_gate (sc, CELL_GATE_PRS, pi, NULL);
+}
+
+/*
+  Create an instance of the cell for a gate extracted from the current
+  process. _instance_prs() is used for pull-up/pull-down pairs, and
+  _instance_group() for gates built from rules with shared labels.
+*/
+void ActCellPass::_instance_prs (Scope *sc, struct act_prsinfo *pi)
+{
+  chash_bucket_t *b;
+
   if (cell_table) {
     b = chash_lookup (cell_table, pi);
     if (b) {
@@ -2300,6 +2615,103 @@ void ActCellPass::_collect_one_prs (Scope *sc, act_prs_lang_t *prs)
   }
 }
 
+void ActCellPass::_instance_group (Scope *sc, struct act_prsinfo *pi)
+{
+  chash_bucket_t *b;
+
+  if (cell_table) {
+    b = chash_lookup (cell_table, pi);
+    if (b) {
+      pi = (struct act_prsinfo *)b->v;
+    }
+    else {
+#if 0
+      _dump_prsinfo (pi);
+#endif
+      add_new_cell (pi);
+      b = chash_add (cell_table, pi);
+      b->v = pi;
+    }
+
+    char buf[100];
+    do {
+      snprintf (buf, 100, "cpx%d", group_inst_count++);
+    } while (sc->Lookup (buf));
+
+    Assert (sc->isExpanded(), "Hmm");
+
+    InstType *it = new InstType (sc, pi->cell, 0);
+    it = it->Expand (NULL, sc);
+
+    Assert (it->isExpanded(), "Hmm");
+
+    Assert (sc->Add (buf, it), "What?");
+    /*--- now make connections --*/
+
+    ActBody_Conn *ac;
+
+    //printf (" --- [%s] \n", p->getName());
+    ac = _build_connections (buf, pi);
+    //ac->Print (stdout);
+    //ac->Next()->Print (stdout);
+    //printf (" --- \n");
+
+    int oval = Act::double_expand;
+    Act::double_expand = 0;
+    ac->Expandlist (NULL, sc);
+    Act::double_expand = oval;
+    //printf ("---\n");
+  }
+}
+
+/*
+  Called for each gate, in the order the gates are found in the
+  process. When gates are being extracted in parallel (see
+  _parallel_collect()), the gate is recorded so that it can be
+  instantiated later from local_op(); otherwise it is instantiated
+  right away.
+*/
+void ActCellPass::_add_gate (Scope *sc, int type, struct act_prsinfo *pi,
+			     act_prs_lang_t *prs)
+{
+  if (_defer) {
+    struct cell_gate *g;
+
+    A_NEW (_defer->g, struct cell_gate);
+    g = &A_NEXT (_defer->g);
+    g->type = type;
+    g->pi = pi;
+    g->prs = prs;
+    if (type == CELL_GATE_PASS) {
+      A_INIT (g->imap.ids);
+      g->imap.nout = 0;
+      g->imap.nat = 0;
+    }
+    else {
+      /* the record now owns the id map */
+      g->imap = current_idmap;
+      A_INIT (current_idmap.ids);
+    }
+    A_INC (_defer->g);
+    return;
+  }
+
+  switch (type) {
+  case CELL_GATE_PRS:
+    _instance_prs (sc, pi);
+    break;
+  case CELL_GATE_GROUP:
+    _instance_group (sc, pi);
+    break;
+  case CELL_GATE_PASS:
+    _collect_one_passgate (sc, prs);
+    break;
+  default:
+    fatal_error ("What?");
+    break;
+  }
+}
+
 void ActCellPass::_collect_one_passgate (Scope *sc, act_prs_lang_t *prs)
 {
   int i;
@@ -2453,7 +2865,7 @@ void ActCellPass::collect_gates (Scope *sc, act_prs_lang_t **pprs)
       if (prev) {
 	prev->next = prs->next;
       }
-      _collect_one_passgate (sc, prs);
+      _add_gate (sc, CELL_GATE_PASS, NULL, prs);
 #else
       /* preserve pass gates */
       if (!prev) {
@@ -2509,6 +2921,41 @@ void ActCellPass::collect_gates (Scope *sc, act_prs_lang_t **pprs)
   add_cells: -1 if not to be added, otherwise starting id of newcells 
 */
 void ActCellPass::prs_to_cells (Process *p)
+{
+  Scope *sc;
+  phash_bucket_t *b;
+
+  sc = p ? p->CurScope() : ActNamespace::Global()->CurScope();
+  proc_inst_count = 0;
+  group_inst_count = 0;
+
+  if (_pregates && (b = phash_lookup (_pregates, p)) && b->v) {
+    /* gates were already extracted; instantiate them in order */
+    struct cell_gates *cg = (struct cell_gates *) b->v;
+    for (int i=0; i < A_LEN (cg->g); i++) {
+      if (cg->g[i].type != CELL_GATE_PASS) {
+	A_FREE (current_idmap.ids);
+	current_idmap = cg->g[i].imap;
+      }
+      _add_gate (sc, cg->g[i].type, cg->g[i].pi, cg->g[i].prs);
+    }
+    cell_stats.gates += cg->gates;
+    cell_stats.orders += cg->orders;
+    cell_stats.limit += cg->limit;
+    A_FREE (cg->g);
+    FREE (cg);
+    b->v = NULL;
+    return;
+  }
+  _collect_prs (p);
+}
+
+/*
+  Extract all the gates from the production rules of p, and
+  instantiate (or record, see _add_gate()) the corresponding cells.
+  The rules are removed from the process.
+*/
+void ActCellPass::_collect_prs (Process *p)
 {
   Scope *sc;
   act_languages *lang;
@@ -2521,7 +2968,6 @@ void ActCellPass::prs_to_cells (Process *p)
     }
   }
 
-  proc_inst_count = 0;
   A_INIT (pendingprs);
 
   lang = (p ? p->getlang() : ActNamespace::Global()->getlang());
@@ -2830,15 +3276,149 @@ void ActCellPass::free_local (void *v)
   return;
 }
 
+/*
+ * Post-order list of the process types reachable from p, in the same
+ * order as the pass traversal.
+ */
+static void _collect_procs (UserDef *p, struct pHashtable *H, list_t *l)
+{
+  ActInstiter i(p ? p->CurScope() : ActNamespace::Global()->CurScope());
+
+  if (phash_lookup (H, p)) {
+    return;
+  }
+  phash_add (H, p);
+
+  for (i = i.begin(); i != i.end(); i++) {
+    ValueIdx *vx = *i;
+    if (TypeFactory::isProcessType (vx->t)) {
+      Process *x = dynamic_cast<Process *> (vx->t->BaseType());
+      if (x->isExpanded()) {
+	_collect_procs (x, H, l);
+      }
+    }
+  }
+  list_append (l, p);
+}
+
+struct cell_collect_info {
+  ActCellPass *cp;
+  Process **procs;
+  struct cell_gates **cg;
+};
+
+void ActCellPass::_collect_job (void *cookie, int job, int tid)
+{
+  struct cell_collect_info *ci = (struct cell_collect_info *) cookie;
+  struct cell_gates *cg;
+  unsigned long gates, orders, limit;
+
+  NEW (cg, struct cell_gates);
+  A_INIT (cg->g);
+  gates = cell_stats.gates;
+  orders = cell_stats.orders;
+  limit = cell_stats.limit;
+
+  _defer = cg;
+  ci->cp->_collect_prs (ci->procs[job]);
+  _defer = NULL;
+
+  cg->gates = cell_stats.gates - gates;
+  cg->orders = cell_stats.orders - orders;
+  cg->limit = cell_stats.limit - limit;
+  ci->cg[job] = cg;
+}
+
+/*
+ * Extracting and canonicalizing the gates of a process only touches
+ * that process, so this is done for all processes in parallel. Only
+ * the cell table lookups and the instances are left for local_op(),
+ * which handles the processes in the same order as the serial pass
+ * so the cell numbering is unchanged.
+ */
+void ActCellPass::_parallel_collect (Process *p)
+{
+  struct pHashtable *H;
+  list_t *l;
+  listitem_t *li;
+  phash_bucket_t *b;
+  struct cell_collect_info ci;
+  int n, k;
+
+  H = phash_new (32);
+  l = list_new ();
+  _collect_procs (p, H, l);
+  phash_free (H);
+
+  n = list_length (l);
+  ci.cp = this;
+  MALLOC (ci.procs, Process *, n);
+  MALLOC (ci.cg, struct cell_gates *, n);
+  k = 0;
+  for (li = list_first (l); li; li = list_next (li)) {
+    ci.procs[k++] = (Process *) list_value (li);
+  }
+  list_free (l);
+
+  workpool_run (_nthreads, n, _collect_job, &ci);
+
+  _pregates = phash_new (32);
+  for (k=0; k < n; k++) {
+    b = phash_add (_pregates, ci.procs[k]);
+    b->v = ci.cg[k];
+  }
+  FREE (ci.procs);
+  FREE (ci.cg);
+}
+
+void ActCellPass::setThreads (int n)
+{
+  if (n == 0) {
+    n = workpool_ncpus ();
+  }
+  if (n < 1) {
+    n = 1;
+  }
+  _nthreads = n;
+}
+
 int ActCellPass::run (Process *p)
 {
-  int ret = ActPass::run (p);
+  int ret;
+  int prof = _prof_begin ();
+
+  if (_nthreads > 1 && !completed()) {
+    if (!rundeps (p)) {
+      _prof_end (prof);
+      return 0;
+    }
+    _parallel_collect (p);
+  }
+  ret = ActPass::run (p);
+  if (_pregates) {
+    phash_iter_t it;
+    phash_bucket_t *b;
+    phash_iter_init (_pregates, &it);
+    while ((b = phash_iter_next (_pregates, &it))) {
+      struct cell_gates *cg = (struct cell_gates *) b->v;
+      if (cg) {
+	for (int i=0; i < A_LEN (cg->g); i++) {
+	  A_FREE (cg->g[i].imap.ids);
+	}
+	A_FREE (cg->g);
+	FREE (cg);
+      }
+    }
+    phash_free (_pregates);
+    _pregates = NULL;
+  }
 
   /* 
      We've changed the netlist: all passes need to be re-computed!
   */
   ActPass::refreshAll (a, p);
 
+  _prof_end (prof);
   return ret;
 }
 
@@ -2856,11 +3436,48 @@ void ActCellPass::Print (FILE *fp)
 }
 
 
+void ActCellPass::printStats (FILE *fp)
+{
+  int i, len, used, maxlen;
+  chash_bucket_t *b;
+
+  fprintf (fp, "prs2cells: %lu gates canonicalized, %lu orders tried, %lu with too many ties\n",
+	   cell_stats.gates, cell_stats.orders, cell_stats.limit);
+  fprintf (fp, "prs2cells: %lu probes, %lu rejected by canonical form, %lu compared, %lu matched\n",
+	   cell_stats.probes, cell_stats.rejects, cell_stats.compares,
+	   cell_stats.matches);
+  if (!cell_table) {
+    return;
+  }
+  used = 0;
+  maxlen = 0;
+  for (i=0; i < cell_table->size; i++) {
+    len = 0;
+    for (b = cell_table->head[i]; b; b = b->next) {
+      len++;
+    }
+    if (len > 0) {
+      used++;
+    }
+    if (len > maxlen) {
+      maxlen = len;
+    }
+  }
+  fprintf (fp, "prs2cells: %d cells in %d/%d buckets, max bucket %d, avg %.2f\n",
+	   cell_table->n, used, cell_table->size, maxlen,
+	   used > 0 ? (double)cell_table->n/used : 0.0);
+}
+
+
 ActCellPass::ActCellPass (Act *a) : ActPass (a, "prs2cells")
 {
+  memset (&cell_stats, 0, sizeof (cell_stats));
   cell_table = NULL;
   cell_ns = NULL;
   proc_inst_count = 0;
+  group_inst_count = 0;
+  _nthreads = 1;
+  _pregates = NULL;
   cell_count = 0;
   disableUpdate ();
 
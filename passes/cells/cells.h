@@ -33,6 +33,7 @@
 #include <common/array.h>
 
 struct act_prsinfo;
+struct cell_gates;
 
 struct idmap {
   A_DECL (ActId *, ids);
@@ -50,7 +51,13 @@ public:
 
   void Print (FILE *fp);
 
+  /* cell table statistics */
+  void printStats (FILE *fp);
+
   int numCellMax () { return cell_count-1; }
+
+  /* number of threads used to extract gates; 0 = all cpus */
+  void setThreads (int n);
   Process *getCell(int i);
 
 private:
@@ -61,9 +68,10 @@ private:
   struct cHashtable *cell_table;
   ActNamespace *cell_ns;
   int proc_inst_count;
+  int group_inst_count;
   int cell_count;
-  struct idmap current_idmap;
-  int _leak_flag;
+  int _nthreads;
+  struct pHashtable *_pregates;	// process -> struct cell_gates
 
   /*-- private functions --*/
   void add_new_cell (struct act_prsinfo *pi);
@@ -78,9 +86,16 @@ private:
 				    act_prs_lang_t *gate);
   
   void _collect_one_prs (Scope *sc, act_prs_lang_t *prs);
+  void _add_gate (Scope *sc, int type, struct act_prsinfo *pi,
+		  act_prs_lang_t *prs);
+  void _instance_prs (Scope *sc, struct act_prsinfo *pi);
+  void _instance_group (Scope *sc, struct act_prsinfo *pi);
   void _collect_one_passgate (Scope *sc, act_prs_lang_t *prs);
   void collect_gates (Scope *sc, act_prs_lang_t **pprs);
   void prs_to_cells (Process *p);
+  void _collect_prs (Process *p);
+  void _parallel_collect (Process *p);
+  static void _collect_job (void *cookie, int job, int tid);
   int _collect_cells (ActNamespace *cells);
   void flush_pending (Scope *sc);
 };
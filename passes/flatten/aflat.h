@@ -26,6 +26,45 @@
 
 #include <act/act.h>
 
+/*
+ * The current hierarchical path during flattening. The path is kept
+ * in printed form, so pushing/popping a component only appends to or
+ * truncates a buffer that is reused for the entire pass.
+ */
+class ActApplyPath {
+ public:
+  ActApplyPath ();
+  ~ActApplyPath ();
+
+  void pushNamespace (const char *ns); ///< append "ns::"
+  void push (const char *name, Arraystep *idx = NULL); ///< append ".name[idx]"
+  void pop ();			///< undo the last push
+
+  void append (const char *s);	///< append a component
+  void append (ActId *id);	///< append a component
+  void appendIndex (Arraystep *idx); ///< append "[idx]"
+  void appendRaw (const char *s); ///< append s with no separator
+  void copy (ActApplyPath *p);	///< replace with p's path
+
+  int length () { return len; }
+  void truncate (int l) { len = l; buf[len] = '\0'; }
+  void clear () { truncate (0); A_LEN_RAW (marks) = 0; }
+
+  const char *string () { return buf; }
+  void Print (FILE *fp) { fputs (buf, fp); }
+  void sPrint (char *s, int sz) { snprintf (s, sz, "%s", buf); }
+
+ private:
+  char *buf;
+  int len, max;
+  A_DECL (int, marks);		///< lengths before each push
+
+  void _sep ();
+  void _reserve (int n);
+};
+
+struct act_apply_task;
+
 class ActApplyPass : public ActPass {
  public:
   ActApplyPass (Act *a);
@@ -39,10 +78,26 @@ class ActApplyPass : public ActPass {
   void setInstFn (void (*f) (void *, ActId *, UserDef *));
   void setConnPairFn (void (*f) (void *, ActId *, ActId *));
 
+  /* same as above, but the instance/connection names are provided as
+     paths that are only valid during the callback; this avoids
+     constructing ActIds for every instance and connection */
+  void setInstPathFn (void (*f) (void *, ActApplyPath *, UserDef *));
+  void setConnPathFn (void (*f) (void *, ActApplyPath *, ActApplyPath *));
+
   void setProcFn (void (*f) (void *, Process *));
   void setChannelFn (void (*f) (void *, Channel *));
   void setDataFn (void (*f) (void *, Data *));
 
+  /* Flatten independent subtrees of the instance hierarchy in
+     parallel (only for the path callbacks). Callbacks must be
+     thread-safe, and must write their output to out(): each subtree
+     is written to its own buffer, and the buffers are copied to fp
+     in the original traversal order. */
+  void setThreads (int n, FILE *fp = stdout);
+
+  /* where callbacks should write their output */
+  FILE *out () { return _out ? _out : _output; }
+
   void printns (FILE *fp);
 
  private:
@@ -60,6 +115,8 @@ class ActApplyPass : public ActPass {
   
   void (*apply_user_fn) (void *, ActId *, UserDef *);
   void (*apply_conn_fn) (void *, ActId *, ActId *);
+  void (*apply_user_path_fn) (void *, ActApplyPath *, UserDef *);
+  void (*apply_conn_path_fn) (void *, ActApplyPath *, ActApplyPath *);
   void *cookie;
   
   list_t *prefixes;
@@ -67,16 +124,45 @@ class ActApplyPass : public ActPass {
   list_t *suffixes;
   list_t *suffix_array;
 
+  int need_ids;			/* 1 if the ActId callbacks are used */
+
+  /* walk state; per thread in parallel mode */
+  static thread_local ActApplyPath *path; /* current instance path */
+  static thread_local ActApplyPath *suffix_path; /* current suffix */
+  static thread_local ActApplyPath *conn_path[2]; /* scratch for connections */
+  static thread_local FILE *_out; /* output for the current subtree */
+
+  int nthreads;
+  FILE *_output;
+
+  /* parallel mode: the hierarchy down to some depth is turned into a
+     list of tasks in traversal order */
+  A_DECL (struct act_apply_task, tasks);
+  int tasks_written;		/* # of tasks copied to the output */
+
+  static void _task_job (void *cookie, int job, int tid);
+  void _add_task (int type, UserDef *ux, ValueIdx *vx);
+  void _run_task (int k);
+  void _run_parallel (Process *p);
+
   /*-- private functions --*/
   void push_namespace_name (const char *);
+  void pop_namespace_name ();
   
-  void push_name (const char *, Array *arr = NULL);
+  void push_name (const char *, Arraystep *idx = NULL);
   void pop_name ();
     
-  void push_name_suffix (const char *, Array *arr = NULL);
+  void push_name_suffix (const char *, Arraystep *idx = NULL);
   void pop_name_suffix ();
 
+  void _path_start (ActApplyPath *p, ActNamespace *g, int isglobal);
+  void _walk_begin ();
+  void _walk_end ();
+  void _suffix_begin ();
+  void _suffix_end ();
+
   void _flat_connections_bool (ValueIdx *vx);
+  void _path_connections_bool (ValueIdx *vx);
   
   void _flat_single_connection (ActId *one, Array *oa,
 				ActId *two, Array *ta,
@@ -84,14 +170,24 @@ class ActApplyPass : public ActPass {
 				ActNamespace *isoneglobal,
 				ActNamespace *istwoglobal);
 
+  void _path_single_connection (ActId *one, Array *oa,
+				ActId *two, Array *ta,
+				const char *nm, Arraystep *na,
+				ActNamespace *isoneglobal,
+				ActNamespace *istwoglobal);
+
   void _flat_rec_bool_conns (ActId *one, ActId *two, UserDef *ux,
 			     Array *oa, Array *ta,
 			     ActNamespace *isoneglobal,
 			     ActNamespace *istwoglobal);
   
   void _any_global_conns (act_connection *c);
-  void _flat_scope (Scope *);
-  void _flat_ns (ActNamespace *);
+  void _apply_user (UserDef *ux);
+  void _flat_inst (UserDef *ux);
+  void _flat_vx (ValueIdx *vx, int plan);
+  void _flat_vx_conns (ValueIdx *vx);
+  void _flat_scope (Scope *, int plan = -1);
+  void _flat_ns (ActNamespace *, int plan = -1);
 
 };
 
@@ -23,12 +23,150 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include "aflat.h"
 #include <common/config.h>
+#include <common/workpool.h>
 #include <act/iter.h>
 
+/*-- current path --*/
+
+ActApplyPath::ActApplyPath ()
+{
+  max = 256;
+  MALLOC (buf, char, max);
+  len = 0;
+  buf[0] = '\0';
+  A_INIT (marks);
+}
+
+ActApplyPath::~ActApplyPath ()
+{
+  FREE (buf);
+  A_FREE (marks);
+}
+
+void ActApplyPath::_reserve (int n)
+{
+  if (len + n + 1 > max) {
+    while (len + n + 1 > max) {
+      max *= 2;
+    }
+    REALLOC (buf, char, max);
+  }
+}
+
+void ActApplyPath::_sep ()
+{
+  /* no separator at the start, or after a namespace */
+  if (len > 0 && buf[len-1] != ':') {
+    appendRaw (".");
+  }
+}
+
+void ActApplyPath::appendRaw (const char *s)
+{
+  int l = strlen (s);
+  _reserve (l);
+  memcpy (buf + len, s, l + 1);
+  len += l;
+}
+
+void ActApplyPath::append (const char *s)
+{
+  _sep ();
+  appendRaw (s);
+}
+
+void ActApplyPath::append (ActId *id)
+{
+  char tmp[10240];
+  id->sPrint (tmp, 10240);
+  append (tmp);
+}
+
+void ActApplyPath::appendIndex (Arraystep *idx)
+{
+  char tmp[1024];
+  idx->sPrint (tmp, 1024);
+  appendRaw (tmp);
+}
+
+void ActApplyPath::copy (ActApplyPath *p)
+{
+  clear ();
+  appendRaw (p->buf);
+}
+
+void ActApplyPath::pushNamespace (const char *ns)
+{
+  A_NEW (marks, int);
+  A_NEXT (marks) = len;
+  A_INC (marks);
+  appendRaw (ns);
+  appendRaw ("::");
+}
+
+void ActApplyPath::push (const char *name, Arraystep *idx)
+{
+  A_NEW (marks, int);
+  A_NEXT (marks) = len;
+  A_INC (marks);
+  append (name);
+  if (idx) {
+    appendIndex (idx);
+  }
+}
+
+void ActApplyPath::pop ()
+{
+  Assert (A_LEN (marks) > 0, "ActApplyPath::pop() on empty path");
+  A_LEN_RAW (marks)--;
+  truncate (marks[A_LEN (marks)]);
+}
+
+/* print id without the array on its last component */
+static void _path_append_base (ActApplyPath *p, ActId *id)
+{
+  ActId *tl = id;
+  Array *a;
+
+  while (tl->Rest()) {
+    tl = tl->Rest();
+  }
+  a = tl->arrayInfo();
+  tl->setArray (NULL);
+  p->append (id);
+  tl->setArray (a);
+}
+
+
 /*-- a pass to walk through all connection pairs --*/
 
+thread_local ActApplyPath *ActApplyPass::path = NULL;
+thread_local ActApplyPath *ActApplyPass::suffix_path = NULL;
+thread_local ActApplyPath *ActApplyPass::conn_path[2] = { NULL, NULL };
+thread_local FILE *ActApplyPass::_out = NULL;
+
+/* parallel mode tasks */
+enum {
+  APPLY_TASK_INST,		/* instance callback + subtree */
+  APPLY_TASK_USER,		/* instance callback only */
+  APPLY_TASK_CONNS		/* connections for an instance */
+};
+
+struct act_apply_task {
+  int type;
+  char *path;			/* path when the task was created */
+  UserDef *ux;
+  ValueIdx *vx;
+  int done;			/* 1 when the task has finished */
+  char *buf;			/* output of the task */
+  size_t sz;
+};
+
+static pthread_mutex_t task_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 void ActApplyPass::printns (FILE *fp)
 {
@@ -50,27 +188,66 @@ void ActApplyPass::push_namespace_name (const char *s)
   sprintf (n, "%s::", s);
   list_append (prefixes, n);
   list_append (prefix_array, NULL);
+  path->pushNamespace (s);
+}
+
+void ActApplyPass::pop_namespace_name ()
+{
+  char *s = (char *) list_delete_tail (prefixes);
+  FREE (s);
+  list_delete_tail (prefix_array);
+  path->pop ();
+}
+
+/* the ActId lists are only needed for the ActId callbacks */
+
+void ActApplyPass::push_name (const char *s, Arraystep *idx)
+{
+  if (need_ids) {
+    list_append (prefixes, s);
+    list_append (prefix_array, idx ? idx->toArray() : NULL);
+  }
+  path->push (s, idx);
+}
+
+void ActApplyPass::push_name_suffix (const char *s, Arraystep *idx)
+{
+  if (need_ids) {
+    list_append (suffixes, s);
+    list_append (suffix_array, idx ? idx->toArray() : NULL);
+  }
+  suffix_path->push (s, idx);
 }
 
-void ActApplyPass::push_name (const char *s, Array *t)
+/* the suffix lists are only needed for the ActId callbacks */
+void ActApplyPass::_suffix_begin ()
 {
-  list_append (prefixes, s);
-  list_append (prefix_array, t);
+  if (need_ids) {
+    suffixes = list_new ();
+    suffix_array = list_new ();
+  }
 }
 
-void ActApplyPass::push_name_suffix (const char *s, Array *t)
+void ActApplyPass::_suffix_end ()
 {
-  list_append (suffixes, s);
-  list_append (suffix_array, t);
+  if (need_ids) {
+    list_free (suffixes);
+    list_free (suffix_array);
+    suffixes = NULL;
+    suffix_array = NULL;
+  }
 }
 
 void ActApplyPass::pop_name_suffix ()
 {
-  list_delete_tail (suffixes);
-  Array *a = (Array *) list_delete_tail (suffix_array);
-  if (a) {
-    delete a;
+  if (need_ids) {
+    list_delete_tail (suffixes);
+    Array *a = (Array *) list_delete_tail (suffix_array);
+    if (a) {
+      delete a;
+    }
   }
+  suffix_path->pop ();
 }
 
 static ActId *suffix_to_id (list_t *suffixes, list_t *suffix_array)
@@ -107,14 +284,14 @@ static ActId *suffix_to_id (list_t *suffixes, list_t *suffix_array)
 
 void ActApplyPass::pop_name ()
 {
-  char *s = (char *) list_delete_tail (prefixes);
-  if (s[strlen(s)-1] == ':') {
-    FREE (s);
-  }
-  Array *a = (Array *) list_delete_tail (prefix_array);
-  if (a) {
-    delete a;
+  if (need_ids) {
+    list_delete_tail (prefixes);
+    Array *a = (Array *) list_delete_tail (prefix_array);
+    if (a) {
+      delete a;
+    }
   }
+  path->pop ();
 }
 
 static ActId *tailid (ActId *id)
@@ -470,6 +647,14 @@ void ActApplyPass::_flat_single_connection (ActId *one, Array *oa,
   ActId *suf1, *suf2;
   Array *na_arr;
 
+  if (apply_conn_path_fn) {
+    _path_single_connection (one, oa, two, ta, nm, na,
+			     isoneglobal, istwoglobal);
+  }
+  if (!apply_conn_fn) {
+    return;
+  }
+
   if (na) {
     na_arr = na->toArray();
   }
@@ -609,6 +794,189 @@ void ActApplyPass::_flat_single_connection (ActId *one, Array *oa,
 }
 
 
+/*
+ * Set p to the start of a connection name: the current prefix for
+ * local names, and the namespace g for globals.
+ */
+void ActApplyPass::_path_start (ActApplyPath *p, ActNamespace *g,
+				int isglobal)
+{
+  if (isglobal) {
+    p->clear ();
+  }
+  else {
+    p->copy (path);
+  }
+  if (g && g != ActNamespace::Global()) {
+    char *buf = g->Name (true);
+    p->append (buf);
+    FREE (buf);
+  }
+}
+
+/* finish a connection name: array index, suffix, and final name */
+static void _path_finish (ActApplyPath *p, int base, Arraystep *idx,
+			  ActApplyPath *suffix, const char *nm, Arraystep *na)
+{
+  p->truncate (base);
+  if (idx) {
+    p->appendIndex (idx);
+  }
+  if (nm) {
+    if (suffix->length() > 0) {
+      p->append (suffix->string());
+    }
+    p->append (nm);
+    if (na) {
+      p->appendIndex (na);
+    }
+  }
+}
+
+/* path version of _flat_single_connection() */
+void ActApplyPass::_path_single_connection (ActId *one, Array *oa,
+					    ActId *two, Array *ta,
+					    const char *nm, Arraystep *na,
+					    ActNamespace *isoneglobal,
+					    ActNamespace *istwoglobal)
+{
+  ActApplyPath *p1 = conn_path[0];
+  ActApplyPath *p2 = conn_path[1];
+  int base1, base2;
+
+  _path_start (p1, isoneglobal, isoneglobal ? 1 : 0);
+  _path_start (p2, istwoglobal, istwoglobal ? 1 : 0);
+
+  if (oa && ta) {
+    Arraystep *s1, *s2;
+
+    _path_append_base (p1, one);
+    _path_append_base (p2, two);
+    base1 = p1->length();
+    base2 = p2->length();
+
+    s1 = oa->stepper();
+    s2 = ta->stepper();
+    while (!s1->isend()) {
+      _path_finish (p1, base1, s1, suffix_path, nm, na);
+      _path_finish (p2, base2, s2, suffix_path, nm, na);
+      (*apply_conn_path_fn) (cookie, p1, p2);
+      s1->step();
+      s2->step();
+    }
+    delete s1;
+    delete s2;
+  }
+  else {
+    p1->append (one);
+    p2->append (two);
+    _path_finish (p1, p1->length(), NULL, suffix_path, nm, na);
+    _path_finish (p2, p2->length(), NULL, suffix_path, nm, na);
+    (*apply_conn_path_fn) (cookie, p1, p2);
+  }
+}
+
+
+/* path version of _flat_connections_bool() */
+void ActApplyPass::_path_connections_bool (ValueIdx *vx)
+{
+  act_connection *c = vx->connection();
+  ActConniter iter(c);
+  act_connection *tmp;
+  ActApplyPath *p1 = conn_path[0];
+  ActApplyPath *p2 = conn_path[1];
+  ActId *id;
+  int is_global, base1, base2;
+
+  is_global = c->isglobal();
+
+  _path_start (p1, c->getvx()->global, is_global);
+  id = c->toid();
+  if (vx->t->arrayInfo()) {
+    _path_append_base (p1, id);
+  }
+  else {
+    p1->append (id);
+  }
+  delete id;
+  base1 = p1->length();
+
+  for (iter = iter.begin(); iter != iter.end(); iter++) {
+    tmp = *iter;
+
+    /* don't print connections to yourself */
+    if (tmp == c) continue;
+    if (tmp->isglobal() != is_global) continue;
+
+    _path_start (p2, tmp->getvx()->global, is_global);
+    id = tmp->toid();
+
+    if (vx->t->arrayInfo()) {
+      Arraystep *s1 = vx->t->arrayInfo()->stepper();
+      Arraystep *s2;
+
+      /* tmp might have a different array index, so it needs its own stepper */
+      if (tmp->vx) {
+	Assert (tmp->vx->t->arrayInfo(), "huh?");
+	s2 = tmp->vx->t->arrayInfo()->stepper();
+      }
+      else {
+	Assert (tmp->parent->vx && tmp->parent->vx->t->arrayInfo(), "What?");
+	s2 = tmp->parent->vx->t->arrayInfo()->stepper();
+      }
+      _path_append_base (p2, id);
+      base2 = p2->length();
+
+      while (!s1->isend()) {
+	Assert (!s2->isend(), "What?");
+	_path_finish (p1, base1, s1, NULL, NULL, NULL);
+	_path_finish (p2, base2, s2, NULL, NULL, NULL);
+	(*apply_conn_path_fn) (cookie, p1, p2);
+	s1->step();
+	s2->step();
+      }
+      Assert (s2->isend(), "Hmm...");
+      delete s1;
+      delete s2;
+      p1->truncate (base1);
+    }
+    else {
+      p2->append (id);
+      (*apply_conn_path_fn) (cookie, p1, p2);
+    }
+    delete id;
+  }
+
+  /* subconnections in case of an array */
+  if (c && vx->t->arrayInfo() && c->hasSubconnections()) {
+    for (int i=0; i < c->numSubconnections(); i++) {
+      act_connection *d = c->a[i];
+      if (!d) continue;
+      if (!d->isPrimary()) continue;
+
+      ActConniter iter2(d);
+
+      _path_start (p1, NULL, is_global);
+      id = d->toid();
+      p1->append (id);
+      delete id;
+
+      for (iter2 = iter2.begin(); iter2 != iter2.end(); iter2++) {
+	tmp = *iter2;
+	if (tmp == d) continue;
+	if (tmp->isglobal() != is_global) continue;
+
+	_path_start (p2, NULL, is_global);
+	id = tmp->toid();
+	p2->append (id);
+	delete id;
+	(*apply_conn_path_fn) (cookie, p1, p2);
+      }
+    }
+  }
+}
+
+
 void ActApplyPass::_flat_rec_bool_conns (ActId *one, ActId *two, UserDef *ux,
 					 Array *oa, Array *ta,
 					 ActNamespace *isoneglobal,
@@ -633,11 +1001,12 @@ void ActApplyPass::_flat_rec_bool_conns (ActId *one, ActId *two, UserDef *ux,
       if (vx->t->arrayInfo()) {
 	Arraystep *p = vx->t->arrayInfo()->stepper ();
 	while (!p->isend()) {
-	  push_name_suffix (vx->getName (), p->toArray());
+	  push_name_suffix (vx->getName (), p);
 	  _flat_rec_bool_conns (one, two, rux, oa, ta, isoneglobal, istwoglobal);
 	  pop_name_suffix ();
 	  p->step();
 	}
+	delete p;
       }
       else {
 	push_name_suffix (vx->getName());
@@ -654,6 +1023,7 @@ void ActApplyPass::_flat_rec_bool_conns (ActId *one, ActId *two, UserDef *ux,
 				   isoneglobal, istwoglobal);
 	  p->step();
 	}
+	delete p;
       }
       else {
 	_flat_single_connection (one, oa, two, ta, vx->getName(), NULL,
@@ -691,17 +1061,13 @@ void ActApplyPass::_any_global_conns (act_connection *c)
 	two = c->toid();
 
 	if (TypeFactory::isUserType (xit)) {
-	  suffixes = list_new ();
-	  suffix_array = list_new ();
+	  _suffix_begin ();
 
 	  _flat_rec_bool_conns (one, two, rux,
 				 it->arrayInfo(), xit->arrayInfo(),
 				root->getvx()->global, NULL);
 
-	  list_free (suffixes);
-	  list_free (suffix_array);
-	  suffixes = NULL;
-	  suffix_array = NULL;
+	  _suffix_end ();
 	}
 	else if (TypeFactory::isBoolType (xit)) {
 	  _flat_single_connection (one, it->arrayInfo(),
@@ -725,234 +1091,271 @@ void ActApplyPass::_any_global_conns (act_connection *c)
 }
 
 
-void ActApplyPass::_flat_scope (Scope *s)
+void ActApplyPass::_apply_user (UserDef *ux)
 {
-  ActInstiter inst(s);
+  if (apply_user_fn) {
+    ActId *proc_inst = prefix_to_id (prefixes, prefix_array, NULL);
+    (*apply_user_fn) (cookie, proc_inst, ux);
+    nullify_arrays (proc_inst);
+    delete proc_inst;
+  }
+  if (apply_user_path_fn) {
+    (*apply_user_path_fn) (cookie, path, ux);
+  }
+}
 
-  for (inst = inst.begin(); inst != inst.end(); inst++) {
-    ValueIdx *vx;
-    UserDef *ux;
-    InstType *it;
-    int count;
+void ActApplyPass::_flat_inst (UserDef *ux)
+{
+  _apply_user (ux);
+  _flat_scope (ux->CurScope());
+}
 
-    vx = *inst;
-    if (TypeFactory::isParamType (vx->t)) continue;
+/*
+ * Process an instance in the current scope: the subtrees for all its
+ * elements, followed by its connections.
+ *
+ * plan >= 0 is used to split the hierarchy into tasks: instead of
+ * processing them, subtrees "plan" levels down and connections are
+ * added to the task list in traversal order.
+ */
+void ActApplyPass::_flat_vx (ValueIdx *vx, int plan)
+{
+  InstType *it;
+  UserDef *ux;
 
-    if (!vx->isPrimary()) {
-      if (vx->connection()->isglobal()) continue;
-      
-      /* Check if this or any of its sub-objects is connected to a
-	 global signal. If so, just emit that connection and nothing
-	 else. 
-      */
-      if (apply_conn_fn) {
-	_any_global_conns (vx->connection());
-      }
-      continue;
-    }
+  it = vx->t;
+  ux = dynamic_cast<UserDef *>(it->BaseType());
 
-    it = vx->t;
-    ux = dynamic_cast<UserDef *>(it->BaseType());
-    
-    if (ux) {
-      /* set scope here */
-      Arraystep *step;
+  if (vx->isPrimary() && ux) {
+    /* set scope here */
+    Arraystep *step;
 
-      if (it->arrayInfo()) {
-	step = it->arrayInfo()->stepper();
-      }
-      else {
-	step = NULL;
-      }
+    if (it->arrayInfo()) {
+      step = it->arrayInfo()->stepper();
+    }
+    else {
+      step = NULL;
+    }
 
-      do {
-	if (!step || (!step->isend() && vx->isPrimary (step->index()))) {
-	  if (step) {
-	    push_name (vx->getName(), step->toArray());
-	  }
-	  else {
-	    push_name (vx->getName());
-	  }
+    do {
+      if (!step || (!step->isend() && vx->isPrimary (step->index()))) {
+	push_name (vx->getName(), step);
 
-	  /*-- process me --*/
-	  if (apply_user_fn) {
-	    ActId *proc_inst = prefix_to_id (prefixes, prefix_array, NULL);
-	    (*apply_user_fn) (cookie, proc_inst, ux);
-	    nullify_arrays (proc_inst);
-	    delete proc_inst;
-	  }
-	  _flat_scope (ux->CurScope());
-	  pop_name ();
+	/*-- process me --*/
+	if (plan < 0) {
+	  _flat_inst (ux);
 	}
-	if (step) {
-	  step->step();
+	else if (plan == 0) {
+	  _add_task (APPLY_TASK_INST, ux, NULL);
+	}
+	else {
+	  _add_task (APPLY_TASK_USER, ux, NULL);
+	  _flat_scope (ux->CurScope(), plan-1);
 	}
-      } while (step && !step->isend());
+	pop_name ();
+      }
       if (step) {
-	delete step;
+	step->step();
       }
+    } while (step && !step->isend());
+    if (step) {
+      delete step;
+    }
+  }
+
+  if (plan < 0) {
+    _flat_vx_conns (vx);
+  }
+  else {
+    _add_task (APPLY_TASK_CONNS, NULL, vx);
+  }
+}
+
+void ActApplyPass::_flat_vx_conns (ValueIdx *vx)
+{
+  InstType *it = vx->t;
+
+  if (!vx->isPrimary()) {
+    if (vx->connection()->isglobal()) return;
+      
+    /* Check if this or any of its sub-objects is connected to a
+       global signal. If so, just emit that connection and nothing
+       else. 
+    */
+    if (apply_conn_fn || apply_conn_path_fn) {
+      _any_global_conns (vx->connection());
     }
+    return;
+  }
 
-    if (!apply_conn_fn) continue;
+  if (!apply_conn_fn && !apply_conn_path_fn) return;
 
-    /* not the special case of global to non-global connection; vx
-       is the primary ValueIdx */
-    if (vx->hasConnection()) {
-      int is_global_conn;
+  /* not the special case of global to non-global connection; vx
+     is the primary ValueIdx */
+  if (vx->hasConnection()) {
+    int is_global_conn;
 
-      if (vx->connection()->isglobal()) {
-	/* only emit connections when the other vx is a global */
-	is_global_conn = 1;
-      }
-      else {
-	/* only emit local connections */
-	is_global_conn = 0;
-      }
+    if (vx->connection()->isglobal()) {
+      /* only emit connections when the other vx is a global */
+      is_global_conn = 1;
+    }
+    else {
+      /* only emit local connections */
+      is_global_conn = 0;
+    }
       
-      /* ok, now we get to look at this more closely */
-      if (TypeFactory::isUserType (it)) {
-	/* user-defined---now expand recursively */
-	UserDef *rux = dynamic_cast<UserDef *>(it->BaseType());
-	act_connection *c;
-	c = vx->connection();
-	if (c->hasDirectconnections()) {
-	  /* ok, we have other user-defined things directly connected,
-	     take care of this */
-	  ActId *one, *two;
-	  ActConniter ci(c);
-	  int ig;
-
-	  one = c->toid();
-	  for (ci = ci.begin(); ci != ci.end(); ci++) {
-	    if (*ci == c) continue; // don't print connections to yourself
-
-	    ig = (*ci)->isglobal();
-	    if (!(!ig || ig == is_global_conn)) continue; // only print global
-	    // to global or
-	    // non-global to non-global
+    /* ok, now we get to look at this more closely */
+    if (TypeFactory::isUserType (it)) {
+      /* user-defined---now expand recursively */
+      UserDef *rux = dynamic_cast<UserDef *>(it->BaseType());
+      act_connection *c;
+      c = vx->connection();
+      if (c->hasDirectconnections()) {
+	/* ok, we have other user-defined things directly connected,
+	   take care of this */
+	ActId *one, *two;
+	ActConniter ci(c);
+	int ig;
+
+	one = c->toid();
+	for (ci = ci.begin(); ci != ci.end(); ci++) {
+	  if (*ci == c) continue; // don't print connections to yourself
+
+	  ig = (*ci)->isglobal();
+	  if (!(!ig || ig == is_global_conn)) continue; // only print global
+	  // to global or
+	  // non-global to non-global
 	      
-	    two = (*ci)->toid();
-	    suffixes = list_new ();
-	    suffix_array = list_new ();
-	    _flat_rec_bool_conns (one, two, rux, it->arrayInfo(),
-				  ((*ci)->vx ?
-				   (*ci)->vx->t->arrayInfo() : NULL),
-				  c->getvx()->global,
-				  (*ci)->getvx()->global);
-
-	    list_free (suffixes);
-	    list_free (suffix_array);
-	    suffixes = NULL;
-	    suffix_array = NULL;
-	    delete two;
-	  }
-	  delete one;
+	  two = (*ci)->toid();
+	  _suffix_begin ();
+	  _flat_rec_bool_conns (one, two, rux, it->arrayInfo(),
+				((*ci)->vx ?
+				 (*ci)->vx->t->arrayInfo() : NULL),
+				c->getvx()->global,
+				(*ci)->getvx()->global);
+
+	  _suffix_end ();
+	  delete two;
 	}
-	if (c->hasSubconnections()) {
-	  /* we have connections to components of this as well, check! */
-	  list_t *sublist = list_new ();
-	  list_append (sublist, c);
-
-	  while ((c = (act_connection *)list_delete_tail (sublist))) {
-	    Assert (c->hasSubconnections(), "Invariant fail");
-
-	    for (int i=0; i < c->numSubconnections(); i++) {
-	      if (c->hasDirectconnections (i)) {
-		if (c->isPrimary (i)) {
-		  int type;
-		  InstType *xit;
-		  ActId *one, *two;
-		  ActConniter ci(c->a[i]);
-		  int ig;
-
-
-		  type = c->a[i]->getctype();
-		  it = c->a[i]->getvx()->t;
+	delete one;
+      }
+      if (c->hasSubconnections()) {
+	/* we have connections to components of this as well, check! */
+	list_t *sublist = list_new ();
+	list_append (sublist, c);
+
+	while ((c = (act_connection *)list_delete_tail (sublist))) {
+	  Assert (c->hasSubconnections(), "Invariant fail");
+
+	  for (int i=0; i < c->numSubconnections(); i++) {
+	    if (c->hasDirectconnections (i)) {
+	      if (c->isPrimary (i)) {
+		int type;
+		InstType *xit;
+		ActId *one, *two;
+		ActConniter ci(c->a[i]);
+		int ig;
+
+
+		type = c->a[i]->getctype();
+		it = c->a[i]->getvx()->t;
 		
-		  UserDef *rux = dynamic_cast<UserDef *> (it->BaseType());
+		UserDef *rux = dynamic_cast<UserDef *> (it->BaseType());
 
-		  /* now find the type */
-		  if (type == 0 || type == 1) {
-		    xit = it;
-		  }
-		  else {
-		    Assert (rux, "what?");
-		    xit = rux->getPortType (i);
-		  }
+		/* now find the type */
+		if (type == 0 || type == 1) {
+		  xit = it;
+		}
+		else {
+		  Assert (rux, "what?");
+		  xit = rux->getPortType (i);
+		}
 
-		  one = c->a[i]->toid();
-		  for (ci = ci.begin(); ci != ci.end(); ci++) {
-		    int type2;
-		    if (*ci == c->a[i]) continue;
+		one = c->a[i]->toid();
+		for (ci = ci.begin(); ci != ci.end(); ci++) {
+		  int type2;
+		  if (*ci == c->a[i]) continue;
 
-		    ig = (*ci)->isglobal();
-		    if (!(!ig || ig == is_global_conn)) continue;
+		  ig = (*ci)->isglobal();
+		  if (!(!ig || ig == is_global_conn)) continue;
 		  
-		    two = (*ci)->toid();
-		    type2 = (*ci)->getctype();
-
-		    ActNamespace *g1, *g2;
-		    g1 = c->a[i]->getvx()->global;
-		    g2 = (*ci)->getvx()->global;
-
-		    if (TypeFactory::isUserType (xit)) {
-		      suffixes = list_new ();
-		      suffix_array = list_new ();
-		      if (type == 1 || type2 == 1) {
-			_flat_rec_bool_conns (one, two, rux, NULL, NULL,
-					      g1, g2);
-		      }
-		      else {
-			_flat_rec_bool_conns (one, two, rux, xit->arrayInfo(),
-					      (*ci)->getvx()->t->arrayInfo(),
-					      g1, g2);
-		      }
-		      list_free (suffixes);
-		      list_free (suffix_array);
-		      suffixes = NULL;
-		      suffix_array = NULL;
+		  two = (*ci)->toid();
+		  type2 = (*ci)->getctype();
+
+		  ActNamespace *g1, *g2;
+		  g1 = c->a[i]->getvx()->global;
+		  g2 = (*ci)->getvx()->global;
+
+		  if (TypeFactory::isUserType (xit)) {
+		    _suffix_begin ();
+		    if (type == 1 || type2 == 1) {
+		      _flat_rec_bool_conns (one, two, rux, NULL, NULL,
+					    g1, g2);
 		    }
-		    else if (TypeFactory::isBoolType (xit)) {
-		      if (type == 1 || type2 == 1) {
-			_flat_single_connection (one, NULL,
-						 two, NULL,
-						 NULL, NULL, g1, g2);
-		      }
-		      else {
-			_flat_single_connection (one, xit->arrayInfo(),
-						 two,
-						 (*ci)->getvx()->t->arrayInfo(),
-						 NULL, NULL, g1, g2);
-		      }
+		    else {
+		      _flat_rec_bool_conns (one, two, rux, xit->arrayInfo(),
+					    (*ci)->getvx()->t->arrayInfo(),
+					    g1, g2);
 		    }
-		    delete two;
+		    _suffix_end ();
 		  }
-		  delete one;
-		}
-		else {
-		  if (apply_conn_fn && !c->a[i]->isglobal()) {
-		    _any_global_conns (c->a[i]);
+		  else if (TypeFactory::isBoolType (xit)) {
+		    if (type == 1 || type2 == 1) {
+		      _flat_single_connection (one, NULL,
+					       two, NULL,
+					       NULL, NULL, g1, g2);
+		    }
+		    else {
+		      _flat_single_connection (one, xit->arrayInfo(),
+					       two,
+					       (*ci)->getvx()->t->arrayInfo(),
+					       NULL, NULL, g1, g2);
+		    }
 		  }
+		  delete two;
 		}
+		delete one;
 	      }
-	      if (c->a[i] && c->a[i]->hasSubconnections ()) {
-		list_append (sublist, c->a[i]);
+	      else {
+		if ((apply_conn_fn || apply_conn_path_fn) &&
+	    !c->a[i]->isglobal()) {
+		  _any_global_conns (c->a[i]);
+		}
 	      }
 	    }
+	    if (c->a[i] && c->a[i]->hasSubconnections ()) {
+	      list_append (sublist, c->a[i]);
+	    }
 	  }
-	  list_free (sublist);
 	}
+	list_free (sublist);
       }
-      else if (TypeFactory::isBoolType (it)) {
-	/* print connections! */
+    }
+    else if (TypeFactory::isBoolType (it)) {
+      /* print connections! */
+      if (apply_conn_fn) {
 	_flat_connections_bool (vx);
       }
+      if (apply_conn_path_fn) {
+	_path_connections_bool (vx);
+      }
     }
   }
 }
 
+void ActApplyPass::_flat_scope (Scope *s, int plan)
+{
+  ActInstiter inst(s);
+
+  for (inst = inst.begin(); inst != inst.end(); inst++) {
+    ValueIdx *vx = *inst;
+    if (TypeFactory::isParamType (vx->t)) continue;
+    _flat_vx (vx, plan);
+  }
+}
 
-void ActApplyPass::_flat_ns (ActNamespace *ns)
+
+void ActApplyPass::_flat_ns (ActNamespace *ns, int plan)
 {
   /* sub-namespaces */
   ActNamespaceiter iter(ns);
@@ -961,12 +1364,12 @@ void ActApplyPass::_flat_ns (ActNamespace *ns)
     ActNamespace *t = *iter;
 
     push_namespace_name (t->getName());
-    _flat_ns (t);
-    pop_name ();
+    _flat_ns (t, plan);
+    pop_namespace_name ();
   }
 
   /* connections! */
-  _flat_scope (ns->CurScope());
+  _flat_scope (ns->CurScope(), plan);
 }
 
 
@@ -981,16 +1384,45 @@ ActApplyPass::ActApplyPass (Act *a) : ActPass (a, "apply")
   apply_per_channel_fn = NULL;
   apply_per_data_fn = NULL;
 
+  apply_user_path_fn = NULL;
+  apply_conn_path_fn = NULL;
+
   prefixes = NULL;
   prefix_array = NULL;
   suffixes = NULL;
   suffix_array = NULL;
+
+  need_ids = 0;
+  nthreads = 1;
+  _output = stdout;
+  A_INIT (tasks);
+  tasks_written = 0;
 }
 
 
 ActApplyPass::~ActApplyPass()
 {
+  A_FREE (tasks);
+}
 
+void ActApplyPass::_walk_begin ()
+{
+  path = new ActApplyPath ();
+  suffix_path = new ActApplyPath ();
+  conn_path[0] = new ActApplyPath ();
+  conn_path[1] = new ActApplyPath ();
+}
+
+void ActApplyPass::_walk_end ()
+{
+  delete path;
+  delete suffix_path;
+  delete conn_path[0];
+  delete conn_path[1];
+  path = NULL;
+  suffix_path = NULL;
+  conn_path[0] = NULL;
+  conn_path[1] = NULL;
 }
 
 
@@ -1026,6 +1458,26 @@ void ActApplyPass::setConnPairFn (void (*f) (void *, ActId *, ActId *))
   apply_conn_fn = f;
 }
 
+void ActApplyPass::setInstPathFn (void (*f) (void *, ActApplyPath *, UserDef *))
+{
+  apply_user_path_fn = f;
+}
+
+void ActApplyPass::setConnPathFn (void (*f) (void *, ActApplyPath *,
+					     ActApplyPath *))
+{
+  apply_conn_path_fn = f;
+}
+
+void ActApplyPass::setThreads (int n, FILE *fp)
+{
+  if (n == 0) {
+    n = workpool_ncpus ();
+  }
+  nthreads = n;
+  _output = fp;
+}
+
 void ActApplyPass::setProcFn (void (*f) (void *, Process *))
 {
   apply_per_proc_fn = f;
@@ -1043,6 +1495,8 @@ void ActApplyPass::setDataFn (void (*f) (void *, Data *))
 
 int ActApplyPass::run (Process *p)
 {
+  int prof = _prof_begin ();
+
   init ();
 
   if (!completed()) {
@@ -1053,23 +1507,195 @@ int ActApplyPass::run (Process *p)
     fatal_error ("ActApplyPass: must be called after expansion!");
   }
 
-  if (!apply_conn_fn && !apply_user_fn) {
+  need_ids = (apply_conn_fn || apply_user_fn) ? 1 : 0;
+
+  if (!apply_conn_fn && !apply_user_fn &&
+      !apply_conn_path_fn && !apply_user_path_fn) {
     /*-- do nothing --*/
   }
+  else if (nthreads > 1 && !need_ids) {
+    _run_parallel (p);
+  }
   else {
+    _walk_begin ();
     if (!p) {
       _flat_ns (a->Global ());
     }
     else {
       _flat_scope (p->CurScope ());
     }
+    _walk_end ();
   }
   
   _finished = 2;
+  _prof_end (prof);
   return 1;
 }
 
 
+void ActApplyPass::_add_task (int type, UserDef *ux, ValueIdx *vx)
+{
+  A_NEW (tasks, struct act_apply_task);
+  A_NEXT (tasks).type = type;
+  A_NEXT (tasks).path = Strdup (path->string());
+  A_NEXT (tasks).ux = ux;
+  A_NEXT (tasks).vx = vx;
+  A_NEXT (tasks).done = 0;
+  A_NEXT (tasks).buf = NULL;
+  A_NEXT (tasks).sz = 0;
+  A_INC (tasks);
+}
+
+void ActApplyPass::_task_job (void *cookie, int job, int tid)
+{
+  ((ActApplyPass *)cookie)->_run_task (job);
+}
+
+void ActApplyPass::_run_task (int k)
+{
+  struct act_apply_task *t = &tasks[k];
+
+  _walk_begin ();
+  path->appendRaw (t->path);
+  _out = open_memstream (&t->buf, &t->sz);
+  if (!_out) {
+    fatal_error ("ActApplyPass: could not create output buffer");
+  }
+
+  switch (t->type) {
+  case APPLY_TASK_INST:
+    _flat_inst (t->ux);
+    break;
+  case APPLY_TASK_USER:
+    _apply_user (t->ux);
+    break;
+  case APPLY_TASK_CONNS:
+    _flat_vx_conns (t->vx);
+    break;
+  }
+
+  fclose (_out);
+  _out = NULL;
+  _walk_end ();
+
+  /* copy out every finished task that has no unfinished predecessor */
+  pthread_mutex_lock (&task_lock);
+  t->done = 1;
+  while (tasks_written < A_LEN (tasks) && tasks[tasks_written].done) {
+    t = &tasks[tasks_written];
+    fwrite (t->buf, 1, t->sz, _output);
+    free (t->buf);
+    t->buf = NULL;
+    tasks_written++;
+  }
+  pthread_mutex_unlock (&task_lock);
+}
+
+/*
+ * act_connection::primary() compresses paths as a side effect. Do this
+ * for every connection before the tasks start, so that the calls made
+ * by the tasks only read the connection structure.
+ */
+static void _compress_conn (act_connection *c)
+{
+  if (!c) {
+    return;
+  }
+  c->primary ();
+  if (c->hasSubconnections()) {
+    for (int i=0; i < c->numTotSubconnections(); i++) {
+      _compress_conn (c->a[i]);
+    }
+  }
+}
+
+static void _compress_scope (Scope *sc, struct pHashtable *H)
+{
+  ActInstiter i(sc);
+
+  for (i = i.begin(); i != i.end(); i++) {
+    ValueIdx *vx = *i;
+    if (vx->hasConnection()) {
+      _compress_conn (vx->connection());
+    }
+    UserDef *ux = dynamic_cast<UserDef *> (vx->t->BaseType());
+    if (ux && ux->isExpanded() && !phash_lookup (H, ux)) {
+      phash_add (H, ux);
+      _compress_scope (ux->CurScope(), H);
+    }
+  }
+}
+
+static void _compress_ns (ActNamespace *ns, struct pHashtable *H)
+{
+  ActNamespaceiter iter(ns);
+
+  for (iter = iter.begin(); iter != iter.end(); iter++) {
+    _compress_ns (*iter, H);
+  }
+  _compress_scope (ns->CurScope(), H);
+}
+
+/*
+ * Parallel mode: the top of the hierarchy is split into tasks, going
+ * one level deeper at a time until there are enough subtrees to keep
+ * all the threads busy. The tasks are then run by the work pool.
+ */
+#define APPLY_TASKS_PER_THREAD 8
+#define APPLY_MAX_PLAN_DEPTH   16
+
+void ActApplyPass::_run_parallel (Process *p)
+{
+  int depth, ninst;
+
+  _walk_begin ();
+  for (depth = 0; ; depth++) {
+    for (int i=0; i < A_LEN (tasks); i++) {
+      FREE (tasks[i].path);
+    }
+    A_LEN_RAW (tasks) = 0;
+
+    if (!p) {
+      _flat_ns (a->Global (), depth);
+    }
+    else {
+      _flat_scope (p->CurScope (), depth);
+    }
+
+    ninst = 0;
+    for (int i=0; i < A_LEN (tasks); i++) {
+      if (tasks[i].type == APPLY_TASK_INST) {
+	ninst++;
+      }
+    }
+    if (ninst == 0 || ninst >= APPLY_TASKS_PER_THREAD*nthreads ||
+	depth == APPLY_MAX_PLAN_DEPTH) {
+      break;
+    }
+  }
+  _walk_end ();
+
+  struct pHashtable *H = phash_new (32);
+  if (!p) {
+    _compress_ns (a->Global (), H);
+  }
+  else {
+    _compress_scope (p->CurScope (), H);
+  }
+  phash_free (H);
+
+  fflush (_output);
+  tasks_written = 0;
+  workpool_run (nthreads, A_LEN (tasks), _task_job, this);
+  Assert (tasks_written == A_LEN (tasks), "ActApplyPass: missing output");
+
+  for (int i=0; i < A_LEN (tasks); i++) {
+    FREE (tasks[i].path);
+  }
+  A_LEN_RAW (tasks) = 0;
+}
+
+
 void *ActApplyPass::local_op (Process *p, int mode)
 {
   if (mode == 1) {
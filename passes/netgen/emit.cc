@@ -24,6 +24,7 @@
 #include <map>
 #include <string.h>
 #include "netlist.h"
+#include <common/workpool.h>
 #include <common/config.h>
 #include <act/iter.h>
 
@@ -45,9 +46,8 @@ static void print_number (FILE *fp, double x)
   }
 }
 
-netlist_t *ActNetlistPass::emitNetlist (Process *p)
+netlist_t *ActNetlistPass::emitNetlist (Process *p, FILE *fp)
 {
-  FILE *fp = _outfp;
   netlist_t *n = getNL (p);
 
   if (!n) {
@@ -90,11 +90,7 @@ netlist_t *ActNetlistPass::emitNetlist (Process *p)
       a->mfprintfproc (fp, p);
       for (int k=0; k < A_LEN (n->bN->ports); k++) {
 	if (n->bN->ports[k].omit) continue;
-	ActId *id = n->bN->ports[k].c->toid();
-	char buf[10240];
-	id->sPrint (buf, 10240);
-	a->mfprintf (fp, " %s", buf);
-	delete id;
+	fprintf (fp, " %s", a->mangledName (n->bN->ports[k].c));
 	out = 1;
       }
 
@@ -114,12 +110,8 @@ netlist_t *ActNetlistPass::emitNetlist (Process *p)
     fprintf (fp, "*.PININFO");
     for (int k=0; k < A_LEN (n->bN->ports); k++) {
       if (n->bN->ports[k].omit) continue;
-      ActId *id = n->bN->ports[k].c->toid();
-      char buf[10240];
-      id->sPrint (buf, 10240);
-      a->mfprintf (fp, " %s", buf);
-      fprintf (fp, ":%c", n->bN->ports[k].input ? 'I' : 'O');
-      delete id;
+      fprintf (fp, " %s:%c", a->mangledName (n->bN->ports[k].c),
+	       n->bN->ports[k].input ? 'I' : 'O');
     }
     if (n->weak_supply_vdd > 0) {
       fprintf (fp, " #%d:I", n->nid_wvdd);
@@ -180,15 +172,11 @@ netlist_t *ActNetlistPass::emitNetlist (Process *p)
   for (x = n->hd; x; x = x->next) {
     if (!x->v) continue;
     if (!x->v->v->output) continue;
-    ActId *id = x->v->v->id->toid();
-    char buf[10240];
-    id->sPrint (buf, 10240);
-    delete id;
     if (!out) {
       fprintf (fp, "*\n* --- node flags ---\n*\n");
       out = 1;
     }
-    a->mfprintf (fp, "* %s ", buf);
+    fprintf (fp, "* %s ", a->mangledName (x->v->v->id));
     if (x->v->stateholding) {
       fprintf (fp, "(state-holding): pup_reff=%g; pdn_reff=%g\n",
 	       x->reff[EDGE_PFET], x->reff[EDGE_NFET]);
@@ -489,16 +477,10 @@ netlist_t *ActNetlistPass::emitNetlist (Process *p)
 	    FREE (str);
 	  }
 	  for (int i=0; i < A_LEN (sub->bN->ports); i++) {
-	    ActId *id;
-	    char buf[10240];
 	    if (sub->bN->ports[i].omit) continue;
 
 	    Assert (iport < A_LEN (n->bN->instports), "Hmm");
-	    id = n->bN->instports[iport]->toid();
-	    fprintf (fp, " ");
-	    id->sPrint (buf, 10240);
-	    a->mfprintf (fp, "%s", buf);
-	    delete id;
+	    fprintf (fp, " %s", a->mangledName (n->bN->instports[iport]));
 	    iport++;
 	  }
 
@@ -548,7 +530,81 @@ void ActNetlistPass::Print (FILE *fp, Process *p)
     fatal_error ("ActNetlistPass::Print() called before pass is run!");
   }
   
+  if (_nthreads > 1) {
+    _parallel_emit (fp, p);
+    return;
+  }
   _outfp = fp;
   run_recursive (p, 1);
   _outfp = NULL;
 }
+
+struct netgen_emit_info {
+  ActNetlistPass *np;
+  Process **procs;
+  char **buf;			// emitted text for each process
+  size_t *sz;
+};
+
+void ActNetlistPass::_emit_job (void *cookie, int job, int tid)
+{
+  struct netgen_emit_info *ei = (struct netgen_emit_info *) cookie;
+  FILE *fp;
+
+  fp = open_memstream (&ei->buf[job], &ei->sz[job]);
+  if (!fp) {
+    fatal_error ("open_memstream() failed");
+  }
+  ei->np->_emitNetlist (ei->procs[job], fp);
+  fclose (fp);
+}
+
+/*
+ * Each process is emitted into its own memory buffer, and the buffers
+ * are written out in the order used by run_recursive(). Processes are
+ * handled in batches to bound the amount of buffered text.
+ */
+void ActNetlistPass::_parallel_emit (FILE *fp, Process *p)
+{
+  struct pHashtable *H;
+  list_t *l;
+  listitem_t *li;
+  struct netgen_emit_info ei;
+  int n, k, batch;
+
+  H = phash_new (32);
+  l = list_new ();
+  _collect_procs (p, H, l);
+  phash_free (H);
+
+  n = list_length (l);
+  MALLOC (ei.procs, Process *, n);
+  MALLOC (ei.buf, char *, n);
+  MALLOC (ei.sz, size_t, n);
+  k = 0;
+  for (li = list_first (l); li; li = list_next (li)) {
+    ei.procs[k++] = (Process *) list_value (li);
+  }
+  list_free (l);
+
+  ei.np = this;
+  batch = 16*_nthreads;
+  for (int start=0; start < n; start += batch) {
+    int m = n - start;
+    if (m > batch) {
+      m = batch;
+    }
+    struct netgen_emit_info bi = ei;
+    bi.procs += start;
+    bi.buf += start;
+    bi.sz += start;
+    workpool_run (_nthreads, m, _emit_job, &bi);
+    for (k=0; k < m; k++) {
+      fwrite (bi.buf[k], 1, bi.sz[k], fp);
+      free (bi.buf[k]);
+    }
+  }
+  FREE (ei.procs);
+  FREE (ei.buf);
+  FREE (ei.sz);
+}
@@ -24,11 +24,16 @@
 #include <map>
 #include <math.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "netlist.h"
 #include <common/hash.h>
 #include <common/qops.h>
 #include <common/bitset.h>
 #include <common/config.h>
+#include <common/workpool.h>
 #include <act/iter.h>
 #include <act/passes/sizing.h>
 
@@ -1445,6 +1450,10 @@ void ActNetlistPass::sprint_node (char *buf, int sz, netlist_t *N, node_t *n)
 void ActNetlistPass::emit_node (netlist_t *N, FILE *fp, node_t *n, int mangle)
 {
   char buf[10240];
+  if (mangle && n->v) {
+    fputs (ActNetlistPass::current_act->mangledName (n->v->v->id), fp);
+    return;
+  }
   sprint_node (buf, 10240, N, n);
   if (mangle) {
     ActNetlistPass::current_act->mfprintf (fp, "%s", buf);
@@ -2219,8 +2228,7 @@ netlist_t *ActNetlistPass::genNetlist (Process *p)
   for (i = i.begin(); i != i.end(); i++) {
     ValueIdx *vx = *i;
     int cnt = 1;
-    netlist_t *tn = (netlist_t *)
-      getMap (dynamic_cast<Process *>(vx->t->BaseType()));
+    netlist_t *tn = _subNL (dynamic_cast<Process *>(vx->t->BaseType()));
     Assert (tn, "What?");
 
     /* count the # of shared weak drivers so far, and track the
@@ -2289,14 +2297,462 @@ netlist_t *ActNetlistPass::genNetlist (Process *p)
 void *ActNetlistPass::local_op (Process *p, int mode)
 {
   if (mode == 0) {
-    return genNetlist (p);
+    if (_pregen) {
+      phash_bucket_t *b = phash_lookup (_pregen, p);
+      if (b) {
+	return b->v;
+      }
+    }
+    return _genNetlist (p);
   }
   else if (mode == 1) {
-    return emitNetlist (p);
+    return _emitNetlist (p, _outfp);
   }
   return NULL;
 }
 
+netlist_t *ActNetlistPass::_subNL (Process *p)
+{
+  if (_pregen) {
+    phash_bucket_t *b = phash_lookup (_pregen, p);
+    if (b) {
+      return (netlist_t *) b->v;
+    }
+  }
+  return (netlist_t *) getMap (p);
+}
+
+/*
+ * Post-order list of the process types reachable from p, in the same
+ * order as the pass traversal.
+ */
+void ActNetlistPass::_collect_procs (UserDef *p, struct pHashtable *H,
+				     list_t *l)
+{
+  ActInstiter i(p ? p->CurScope() : ActNamespace::Global()->CurScope());
+
+  if (phash_lookup (H, p)) {
+    return;
+  }
+  phash_add (H, p);
+
+  for (i = i.begin(); i != i.end(); i++) {
+    ValueIdx *vx = *i;
+    if (TypeFactory::isProcessType (vx->t)) {
+      Process *x = dynamic_cast<Process *> (vx->t->BaseType());
+      if (x->isExpanded()) {
+	_collect_procs (x, H, l);
+      }
+    }
+  }
+  list_append (l, p);
+}
+
+struct netgen_gen_info {
+  ActNetlistPass *np;
+  Process **procs;		// processes at the current level
+  netlist_t **nl;		// generated netlists
+};
+
+void ActNetlistPass::_gen_job (void *cookie, int job, int tid)
+{
+  struct netgen_gen_info *gi = (struct netgen_gen_info *) cookie;
+  Process *p = gi->procs[job];
+
+  /* the error context is per-thread; report the type being generated */
+  if (p) {
+    act_error_push (p->getName(), p->getFile(), p->getLine());
+  }
+  else {
+    act_error_push ("-toplevel-", NULL, 0);
+  }
+  gi->nl[job] = gi->np->_genNetlist (p);
+  act_error_pop ();
+}
+
+/*
+ * Generate netlists for all the processes used by p. A process only
+ * depends on the netlists of the processes it instantiates, so the
+ * processes are grouped by their height in the instance hierarchy,
+ * and each group is generated in parallel. The netlists are recorded
+ * in _pregen, and picked up by local_op() when the pass is run.
+ */
+void ActNetlistPass::_parallel_gen (Process *p)
+{
+  struct pHashtable *H;
+  list_t *l;
+  listitem_t *li;
+  phash_bucket_t *b;
+  int n, maxh, k;
+  Process **procs;
+  int *height;
+  struct netgen_gen_info gi;
+
+  H = phash_new (32);
+  l = list_new ();
+  _collect_procs (p, H, l);
+  phash_free (H);
+
+  n = list_length (l);
+  MALLOC (procs, Process *, n);
+  MALLOC (height, int, n);
+  MALLOC (gi.procs, Process *, n);
+  MALLOC (gi.nl, netlist_t *, n);
+
+  /* post-order, so the children have been assigned a height */
+  H = phash_new (32);
+  k = 0;
+  maxh = 0;
+  for (li = list_first (l); li; li = list_next (li)) {
+    Process *x = (Process *) list_value (li);
+    ActUniqProcInstiter i(x ? x->CurScope() :
+			  ActNamespace::Global()->CurScope());
+    int h = 0;
+    for (i = i.begin(); i != i.end(); i++) {
+      ValueIdx *vx = *i;
+      b = phash_lookup (H, vx->t->BaseType());
+      if (b && b->i + 1 > h) {
+	h = b->i + 1;
+      }
+    }
+    b = phash_add (H, x);
+    b->i = h;
+    if (h > maxh) {
+      maxh = h;
+    }
+    procs[k] = x;
+    height[k] = h;
+    k++;
+  }
+  phash_free (H);
+  list_free (l);
+
+  _pregen = phash_new (32);
+  gi.np = this;
+  for (int h=0; h <= maxh; h++) {
+    int m = 0;
+    for (k=0; k < n; k++) {
+      if (height[k] == h) {
+	gi.procs[m++] = procs[k];
+      }
+    }
+    workpool_run (_nthreads, m, _gen_job, &gi);
+    /* only modified between levels */
+    for (k=0; k < m; k++) {
+      b = phash_add (_pregen, gi.procs[k]);
+      b->v = gi.nl[k];
+    }
+  }
+  FREE (gi.procs);
+  FREE (gi.nl);
+  FREE (procs);
+  FREE (height);
+}
+
+/*------------------------------------------------------------------------
+ *
+ *  Incremental mode
+ *
+ *  Each process type gets a 64-bit key computed from:
+ *    - the printed expanded process (ports, instances, connections,
+ *      and all the language bodies, including prs and sizing)
+ *    - the netlist configuration (net.*, lefdef.*, act.mangle*)
+ *    - the keys of all the types it instantiates
+ *  and its emitted text is saved in <dir>/<key>.sp. The first line of
+ *  the file records the weak supply information needed by the parent
+ *  netlists, so a cached type never has to be regenerated.
+ *
+ *------------------------------------------------------------------------
+ */
+struct netgen_cache {
+  unsigned long long key;
+  int hit;			// 1 if the cache file is valid
+  int weak_vdd, weak_gnd;	// weak supply info
+  int vdd_len, gnd_len;
+};
+
+#define NETGEN_CACHE_MAGIC "* act-prs2net-cache"
+
+static unsigned long long _fnv_hash (unsigned long long h,
+				     const char *s, size_t len)
+{
+  for (size_t i=0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+#define FNV_INIT 14695981039346656037ULL
+
+/* order-independent hash of the relevant part of the configuration */
+static unsigned long long _config_hash (void)
+{
+  char *buf = NULL;
+  size_t sz = 0;
+  FILE *fp;
+  unsigned long long h = 0;
+  char *s, *t;
+
+  fp = open_memstream (&buf, &sz);
+  if (!fp) {
+    fatal_error ("open_memstream() failed");
+  }
+  config_dump (fp);
+  fclose (fp);
+
+  for (s = buf; s && *s; s = t) {
+    t = strchr (s, '\n');
+    if (t) {
+      t++;
+    }
+    else {
+      t = s + strlen (s);
+    }
+    /* type key value */
+    char *k = strchr (s, ' ');
+    if (!k || k > t) continue;
+    k++;
+    if (strncmp (k, "net.", 4) == 0 || strncmp (k, "lefdef.", 7) == 0 ||
+	strncmp (k, "act.mangle", 10) == 0) {
+      h += _fnv_hash (FNV_INIT, s, t - s);
+    }
+  }
+  free (buf);
+  return h;
+}
+
+static char *_cache_file (const char *dir, unsigned long long key)
+{
+  char *s;
+  int len = strlen (dir) + 24;
+
+  MALLOC (s, char, len);
+  snprintf (s, len, "%s/%016llx.sp", dir, key);
+  return s;
+}
+
+void ActNetlistPass::setCacheDir (const char *dir)
+{
+  if (_cache_dir) {
+    FREE (_cache_dir);
+    _cache_dir = NULL;
+  }
+  if (dir) {
+    _cache_dir = Strdup (dir);
+  }
+}
+
+void ActNetlistPass::_cache_free ()
+{
+  phash_iter_t it;
+  phash_bucket_t *b;
+
+  if (!_cache) return;
+  phash_iter_init (_cache, &it);
+  while ((b = phash_iter_next (_cache, &it))) {
+    FREE (b->v);
+  }
+  phash_free (_cache);
+  _cache = NULL;
+}
+
+void ActNetlistPass::_cache_setup (Process *root)
+{
+  struct pHashtable *H;
+  list_t *l;
+  listitem_t *li;
+  phash_bucket_t *b;
+  unsigned long long cfg;
+  char buf[1024];
+
+  _cache_free ();
+  if (!_cache_dir) {
+    return;
+  }
+  if (mkdir (_cache_dir, 0777) != 0 && errno != EEXIST) {
+    fatal_error ("Could not create netlist cache directory `%s'",
+		 _cache_dir);
+  }
+
+  cfg = _config_hash ();
+  snprintf (buf, 1024, "%d %d", weak_share_min, weak_share_max);
+  cfg = _fnv_hash (cfg, buf, strlen (buf));
+
+  H = phash_new (32);
+  l = list_new ();
+  _collect_procs (root, H, l);
+  phash_free (H);
+
+  _cache = phash_new (32);
+
+  /* post-order, so the children already have their keys */
+  for (li = list_first (l); li; li = list_next (li)) {
+    Process *x = (Process *) list_value (li);
+    struct netgen_cache *ce;
+    char *text = NULL;
+    size_t sz = 0;
+    FILE *fp;
+    unsigned long long key;
+
+    fp = open_memstream (&text, &sz);
+    if (!fp) {
+      fatal_error ("open_memstream() failed");
+    }
+    if (x) {
+      fprintf (fp, "%s\n", a->mangledName (x));
+      x->Print (fp);
+    }
+    else {
+      fprintf (fp, "-toplevel-\n");
+      ActNamespace::Global()->CurScope()->Print (fp);
+      ActNamespace::Global()->getlang()->Print (fp);
+    }
+    if (x == root && top_level_only) {
+      fprintf (fp, "-root-\n");
+    }
+    fclose (fp);
+    key = _fnv_hash (cfg, text, sz);
+    free (text);
+
+    ActUniqProcInstiter i(x ? x->CurScope() :
+			  ActNamespace::Global()->CurScope());
+    for (i = i.begin(); i != i.end(); i++) {
+      ValueIdx *vx = *i;
+      b = phash_lookup (_cache, vx->t->BaseType());
+      Assert (b, "Child type missing from the netlist cache?");
+      unsigned long long ck = ((struct netgen_cache *)b->v)->key;
+      key = _fnv_hash (key, (char *)&ck, sizeof (ck));
+    }
+
+    NEW (ce, struct netgen_cache);
+    ce->key = key;
+    ce->hit = 0;
+
+    char *fname = _cache_file (_cache_dir, key);
+    fp = fopen (fname, "r");
+    if (fp) {
+      if (fgets (buf, 1024, fp) &&
+	  strncmp (buf, NETGEN_CACHE_MAGIC " ",
+		   strlen (NETGEN_CACHE_MAGIC) + 1) == 0 &&
+	  sscanf (buf + strlen (NETGEN_CACHE_MAGIC), "%d %d %d %d",
+		  &ce->weak_vdd, &ce->weak_gnd,
+		  &ce->vdd_len, &ce->gnd_len) == 4) {
+	ce->hit = 1;
+      }
+      fclose (fp);
+    }
+    FREE (fname);
+
+    b = phash_add (_cache, x);
+    b->v = ce;
+  }
+  list_free (l);
+}
+
+/*
+ * Generate a netlist, or return a placeholder with the weak supply
+ * information if the process has a valid cache entry.
+ */
+netlist_t *ActNetlistPass::_genNetlist (Process *p)
+{
+  phash_bucket_t *b;
+  
+  if (_cache && (b = phash_lookup (_cache, p))) {
+    struct netgen_cache *ce = (struct netgen_cache *) b->v;
+    if (ce->hit) {
+      netlist_t *n = _initialize_empty_netlist (bools->getBNL (p));
+      n->weak_supply_vdd = ce->weak_vdd;
+      n->weak_supply_gnd = ce->weak_gnd;
+      n->vdd_len = ce->vdd_len;
+      n->gnd_len = ce->gnd_len;
+      return n;
+    }
+  }
+  return genNetlist (p);
+}
+
+/*
+ * Emit a netlist, using (or updating) the cache file for the process.
+ */
+netlist_t *ActNetlistPass::_emitNetlist (Process *p, FILE *fp)
+{
+  phash_bucket_t *b;
+  struct netgen_cache *ce;
+  char *fname;
+  FILE *cfp;
+  char buf[8192];
+  size_t k;
+
+  if (!_cache || !(b = phash_lookup (_cache, p))) {
+    return emitNetlist (p, fp);
+  }
+  ce = (struct netgen_cache *) b->v;
+  fname = _cache_file (_cache_dir, ce->key);
+
+  if (ce->hit) {
+    cfp = fopen (fname, "r");
+    if (!cfp || !fgets (buf, 8192, cfp)) {
+      fatal_error ("Netlist cache file `%s' disappeared!", fname);
+    }
+    while ((k = fread (buf, 1, 8192, cfp)) > 0) {
+      fwrite (buf, 1, k, fp);
+    }
+    fclose (cfp);
+    FREE (fname);
+    return getNL (p);
+  }
+
+  char *text = NULL;
+  size_t sz = 0;
+  netlist_t *n;
+
+  cfp = open_memstream (&text, &sz);
+  if (!cfp) {
+    fatal_error ("open_memstream() failed");
+  }
+  n = emitNetlist (p, cfp);
+  fclose (cfp);
+  fwrite (text, 1, sz, fp);
+
+  /* write to a temporary file and rename, so that an interrupted run
+     never leaves a partial entry */
+  char *tmp;
+  MALLOC (tmp, char, strlen (fname) + 32);
+  sprintf (tmp, "%s.%d", fname, (int) getpid ());
+  cfp = fopen (tmp, "w");
+  if (cfp) {
+    fprintf (cfp, "%s %d %d %d %d\n", NETGEN_CACHE_MAGIC,
+	     n->weak_supply_vdd, n->weak_supply_gnd,
+	     n->vdd_len, n->gnd_len);
+    fwrite (text, 1, sz, cfp);
+    if (fclose (cfp) == 0) {
+      rename (tmp, fname);
+    }
+    else {
+      unlink (tmp);
+    }
+  }
+  else {
+    warning ("Could not write netlist cache file `%s'", tmp);
+  }
+  FREE (tmp);
+  free (text);
+  FREE (fname);
+  return n;
+}
+
+void ActNetlistPass::setThreads (int n)
+{
+  if (n == 0) {
+    n = workpool_ncpus ();
+  }
+  if (n < 1) {
+    n = 1;
+  }
+  _nthreads = n;
+}
+
 void ActNetlistPass::free_local (void *v)
 {
   netlist_t *n = (netlist_t *) v;
@@ -2372,6 +2828,11 @@ void ActNetlistPass::enableSharedStat ()
 ActNetlistPass::ActNetlistPass (Act *a) : ActPass (a, "prs2net")
 {
   current_act = a;
+  _nthreads = 1;
+  _pregen = NULL;
+  _outfp = NULL;
+  _cache_dir = NULL;
+  _cache = NULL;
   /*-- automatically add this pass if it doesn't exist --*/
   if (!a->pass_find ("booleanize")) {
     ActBooleanizePass *bp = new ActBooleanizePass (a);
@@ -2494,11 +2955,34 @@ ActNetlistPass::ActNetlistPass (Act *a) : ActPass (a, "prs2net")
 ActNetlistPass::~ActNetlistPass()
 {
   bools = NULL;
+  _cache_free ();
+  if (_cache_dir) {
+    FREE (_cache_dir);
+  }
 }
   
 int ActNetlistPass::run(Process *p)
 {
-  return ActPass::run (p);
+  int ret;
+  int prof = _prof_begin ();
+
+  if ((_nthreads > 1 || _cache_dir) && !completed()) {
+    if (!rundeps (p)) {
+      _prof_end (prof);
+      return 0;
+    }
+    _cache_setup (p);
+    if (_nthreads > 1) {
+      _parallel_gen (p);
+    }
+  }
+  ret = ActPass::run (p);
+  if (_pregen) {
+    phash_free (_pregen);
+    _pregen = NULL;
+  }
+  _prof_end (prof);
+  return ret;
 }
 
 netlist_t *ActNetlistPass::getNL (Process *p)
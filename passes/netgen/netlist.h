@@ -188,6 +188,18 @@ class ActNetlistPass : public ActPass {
 
   void enableSharedStat();
 
+  /* use n threads to generate and emit netlists for independent
+     process types; 0 = all processors, 1 = serial (default). The
+     output is identical to the serial output. */
+  void setThreads (int n);
+
+  /* incremental mode: the emitted text for each process type is saved
+     in directory dir, keyed by a hash of the type, the types it
+     instantiates, and the netlist configuration. Types with a saved
+     netlist are not regenerated; their netlist_t is an empty
+     placeholder, so this mode is only meant for Print(). */
+  void setCacheDir (const char *dir);
+
   void Print (FILE *fp, Process *p);
 
   static node_t *connection_to_node (netlist_t *n, act_connection *c);
@@ -279,7 +291,26 @@ class ActNetlistPass : public ActPass {
   FILE *_outfp;
 
   netlist_t *genNetlist (Process *p);
-  netlist_t *emitNetlist (Process *p);
+  netlist_t *emitNetlist (Process *p, FILE *fp);
+
+  /* parallel mode */
+  int _nthreads;
+  struct pHashtable *_pregen;	// netlists generated ahead of the
+				// serial pass traversal
+  netlist_t *_subNL (Process *p);
+  void _collect_procs (UserDef *p, struct pHashtable *H, list_t *l);
+  void _parallel_gen (Process *p);
+  void _parallel_emit (FILE *fp, Process *p);
+  static void _gen_job (void *cookie, int job, int tid);
+  static void _emit_job (void *cookie, int job, int tid);
+
+  /* incremental mode */
+  char *_cache_dir;
+  struct pHashtable *_cache;	// process -> struct netgen_cache
+  void _cache_setup (Process *p);
+  void _cache_free ();
+  netlist_t *_genNetlist (Process *p);
+  netlist_t *_emitNetlist (Process *p, FILE *fp);
 
   void fold_transistors (netlist_t *N);
   int  find_length_window (edge_t *e);
@@ -0,0 +1,478 @@
+/*************************************************************************
+ *
+ *  This file is part of the ACT library
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <act/passes/statepass.h>
+
+/*
+ *  Flattened state layout: see statepass.h for the file format.
+ */
+
+struct layout_info {
+  A_DECL (act_state_layout_inst_t, inst);
+  A_DECL (act_state_layout_type_t, types);
+  A_DECL (unsigned int, names);
+
+  char *str;			// string pool
+  unsigned int strsz, strmax;
+
+  char *path;			// current instance path
+  int pathmax;
+
+  struct pHashtable *tH;	// process -> type index
+};
+
+static unsigned int _add_str (struct layout_info *li, const char *s)
+{
+  unsigned int pos = li->strsz;
+  unsigned int len = strlen (s) + 1;
+
+  if (li->strsz + len > li->strmax) {
+    while (li->strsz + len > li->strmax) {
+      li->strmax = 2*li->strmax;
+    }
+    REALLOC (li->str, char, li->strmax);
+  }
+  memcpy (li->str + li->strsz, s, len);
+  li->strsz += len;
+  return pos;
+}
+
+static void _path_reserve (struct layout_info *li, int len)
+{
+  if (len >= li->pathmax) {
+    while (len >= li->pathmax) {
+      li->pathmax = 2*li->pathmax;
+    }
+    REALLOC (li->path, char, li->pathmax);
+  }
+}
+
+static void _add_conn_name (struct layout_info *li, act_connection *c,
+			    int *dyn, int idx)
+{
+  char buf[10240];
+
+  A_NEW (li->names, unsigned int);
+  if (!c) {
+    /* unused offset */
+    A_NEXT (li->names) = 0;
+  }
+  else {
+    ActId *id = c->toid();
+    id->sPrint (buf, 10240);
+    delete id;
+    if (dyn && dyn[idx] >= 0) {
+      /* element of a dynamic array */
+      int len = strlen (buf);
+      snprintf (buf + len, 10240 - len, "[%d]", idx - dyn[idx]);
+    }
+    A_NEXT (li->names) = _add_str (li, buf);
+  }
+  A_INC (li->names);
+}
+
+/*
+ * Return the type index for process p, adding the names of its local
+ * state the first time the process is encountered.
+ */
+static unsigned int _layout_type (struct layout_info *li, Process *p,
+				  stateinfo_t *si)
+{
+  phash_bucket_t *b;
+  act_state_layout_type_t *t;
+
+  b = phash_lookup (li->tH, p);
+  if (b) {
+    return b->i;
+  }
+  b = phash_add (li->tH, p);
+  b->i = A_LEN (li->types);
+
+  A_NEW (li->types, act_state_layout_type_t);
+  t = &A_NEXT (li->types);
+  A_INC (li->types);
+
+  t->name = _add_str (li, p ? p->getName() : "-toplevel-");
+  t->count[ACT_STATE_BOOL] = si->local.numBools();
+  t->count[ACT_STATE_CHPBOOL] = si->local.numCHPBools();
+  t->count[ACT_STATE_INT] = si->local.numInts();
+  t->count[ACT_STATE_CHAN] = si->local.numChans();
+  t->names = A_LEN (li->names);
+
+  for (int i=0; i < si->local.numBools(); i++) {
+    _add_conn_name (li, si->rev_bool[i], si->rev_dbool, i);
+  }
+  for (int i=0; i < si->local.numCHPBools(); i++) {
+    _add_conn_name (li, si->rev_chpbool[i], NULL, i);
+  }
+  for (int i=0; i < si->local.numInts(); i++) {
+    _add_conn_name (li, si->rev_int[i], si->rev_dint, i);
+  }
+  for (int i=0; i < si->local.numChans(); i++) {
+    _add_conn_name (li, si->rev_chan[i], NULL, i);
+  }
+  return b->i;
+}
+
+static void _set_base (int *base, state_counts *sc)
+{
+  base[ACT_STATE_BOOL] = sc->numBools();
+  base[ACT_STATE_CHPBOOL] = sc->numCHPBools();
+  base[ACT_STATE_INT] = sc->numInts();
+  base[ACT_STATE_CHAN] = sc->numChans();
+}
+
+/*
+ * Pre-order walk of the instance hierarchy, allocating state in the
+ * same order as countLocalState(). li->path[0..len-1] is the path to
+ * p.
+ */
+void ActStatePass::layoutWalk (Process *p, int len, state_counts *base,
+			       void *cookie)
+{
+  struct layout_info *li = (struct layout_info *) cookie;
+  stateinfo_t *si = getStateInfo (p);
+
+  if (!si) {
+    /* black box, no state */
+    return;
+  }
+
+  A_NEW (li->inst, act_state_layout_inst_t);
+  li->path[len] = '\0';
+  A_NEXT (li->inst).name = _add_str (li, li->path);
+  A_NEXT (li->inst).type = _layout_type (li, p, si);
+  _set_base (A_NEXT (li->inst).base, base);
+  A_INC (li->inst);
+
+  /* local state is allocated first; instance offsets are relative to
+     the start of this process */
+  state_counts cur = si->local;
+
+  ActUniqProcInstiter i(p ? p->CurScope() : ActNamespace::Global()->CurScope());
+
+  for (i = i.begin(); i != i.end(); i++) {
+    ValueIdx *vx = *i;
+    Process *x = dynamic_cast<Process *>(vx->t->BaseType());
+    if (!x->isExpanded()) {
+      continue;
+    }
+    stateinfo_t *ti = getStateInfo (x);
+    if (!ti) {
+      continue;
+    }
+
+    state_counts start;
+    if (si->inst) {
+      phash_bucket_t *ib = phash_lookup (si->inst, vx);
+      Assert (ib, "Missing instance offset?");
+      start = *((state_counts *)ib->v);
+    }
+    else {
+      start = cur;
+    }
+
+    int nlen = len + (len > 0 ? 1 : 0) + strlen (vx->getName());
+    _path_reserve (li, nlen);
+    if (len > 0) {
+      li->path[len] = '.';
+      strcpy (li->path + len + 1, vx->getName());
+    }
+    else {
+      strcpy (li->path, vx->getName());
+    }
+
+    if (vx->t->arrayInfo()) {
+      Arraystep *as = vx->t->arrayInfo()->stepper();
+      int count = 0;
+      while (!as->isend()) {
+	if (vx->isPrimary (as->index())) {
+	  /* same element offset as globalBoolOffset() */
+	  state_counts elem = *base;
+	  elem.addVar (start);
+	  elem.addVar (ti->all, as->index());
+
+	  char *str = as->string();
+	  int elen = nlen + strlen (str);
+	  _path_reserve (li, elen);
+	  strcpy (li->path + nlen, str);
+	  FREE (str);
+	  layoutWalk (x, elen, &elem, cookie);
+	  count++;
+	}
+	as->step();
+      }
+      delete as;
+      cur.addVar (ti->all, count);
+    }
+    else {
+      state_counts elem = *base;
+      elem.addVar (start);
+      layoutWalk (x, nlen, &elem, cookie);
+      cur.addVar (ti->all);
+    }
+  }
+}
+
+struct layout_sort {
+  const char *s;
+  unsigned int idx;
+};
+
+static int _sort_cmp (const void *a, const void *b)
+{
+  return strcmp (((struct layout_sort *)a)->s, ((struct layout_sort *)b)->s);
+}
+
+static int _write_all (FILE *fp, const void *v, size_t sz, size_t n)
+{
+  if (n == 0) return 1;
+  return fwrite (v, sz, n, fp) == n ? 1 : 0;
+}
+
+int ActStatePass::saveLayout (const char *file)
+{
+  struct layout_info li;
+  act_state_layout_hdr_t hdr;
+  struct layout_sort *srt;
+  unsigned int *byname;
+  state_counts zero;
+  FILE *fp;
+  int ok;
+
+  if (!_root_si) {
+    return 0;
+  }
+
+  A_INIT (li.inst);
+  A_INIT (li.types);
+  A_INIT (li.names);
+  li.strmax = 1024;
+  MALLOC (li.str, char, li.strmax);
+  li.strsz = 0;
+  _add_str (&li, "");		/* offset 0 is the empty string */
+  li.pathmax = 1024;
+  MALLOC (li.path, char, li.pathmax);
+  li.tH = phash_new (8);
+
+  layoutWalk (_root_si->bnl->p, 0, &zero, &li);
+
+  /* sort by name */
+  MALLOC (srt, struct layout_sort, A_LEN (li.inst));
+  MALLOC (byname, unsigned int, A_LEN (li.inst));
+  for (int i=0; i < A_LEN (li.inst); i++) {
+    srt[i].s = li.str + li.inst[i].name;
+    srt[i].idx = i;
+  }
+  qsort (srt, A_LEN (li.inst), sizeof (struct layout_sort), _sort_cmp);
+  for (int i=0; i < A_LEN (li.inst); i++) {
+    byname[i] = srt[i].idx;
+  }
+  FREE (srt);
+
+  hdr.magic = ACT_STATE_LAYOUT_MAGIC;
+  hdr.version = ACT_STATE_LAYOUT_VERSION;
+  hdr.ninst = A_LEN (li.inst);
+  hdr.ntypes = A_LEN (li.types);
+  hdr.nnames = A_LEN (li.names);
+  hdr.strsz = li.strsz;
+
+  ok = 0;
+  fp = fopen (file, "wb");
+  if (fp) {
+    ok = _write_all (fp, &hdr, sizeof (hdr), 1) &&
+      _write_all (fp, li.inst, sizeof (act_state_layout_inst_t), hdr.ninst) &&
+      _write_all (fp, byname, sizeof (unsigned int), hdr.ninst) &&
+      _write_all (fp, li.types, sizeof (act_state_layout_type_t), hdr.ntypes) &&
+      _write_all (fp, li.names, sizeof (unsigned int), hdr.nnames) &&
+      _write_all (fp, li.str, 1, hdr.strsz);
+    if (fclose (fp) != 0) {
+      ok = 0;
+    }
+  }
+
+  FREE (byname);
+  A_FREE (li.inst);
+  A_FREE (li.types);
+  A_FREE (li.names);
+  FREE (li.str);
+  FREE (li.path);
+  phash_free (li.tH);
+
+  return ok;
+}
+
+
+ActStateLayout *ActStateLayout::Open (const char *file)
+{
+  int fd;
+  struct stat st;
+  void *m;
+  act_state_layout_hdr_t *hdr;
+  size_t sz;
+  ActStateLayout *l;
+
+  fd = open (file, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat (fd, &st) != 0 || (size_t)st.st_size < sizeof (*hdr)) {
+    close (fd);
+    return NULL;
+  }
+  m = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (m == MAP_FAILED) {
+    return NULL;
+  }
+  hdr = (act_state_layout_hdr_t *) m;
+
+  /* validate the table sizes */
+  sz = sizeof (*hdr);
+  if (hdr->magic == ACT_STATE_LAYOUT_MAGIC &&
+      hdr->version == ACT_STATE_LAYOUT_VERSION) {
+    sz += (size_t)hdr->ninst * (sizeof (act_state_layout_inst_t) +
+				sizeof (unsigned int));
+    sz += (size_t)hdr->ntypes * sizeof (act_state_layout_type_t);
+    sz += (size_t)hdr->nnames * sizeof (unsigned int);
+    sz += hdr->strsz;
+  }
+  if (hdr->magic != ACT_STATE_LAYOUT_MAGIC ||
+      hdr->version != ACT_STATE_LAYOUT_VERSION ||
+      sz != (size_t)st.st_size || hdr->strsz == 0) {
+    munmap (m, st.st_size);
+    return NULL;
+  }
+
+  l = new ActStateLayout ();
+  l->_map = m;
+  l->_mapsz = st.st_size;
+  l->_hdr = hdr;
+  l->_inst = (act_state_layout_inst_t *) (hdr + 1);
+  l->_byname = (unsigned int *) (l->_inst + hdr->ninst);
+  l->_types = (act_state_layout_type_t *) (l->_byname + hdr->ninst);
+  l->_names = (unsigned int *) (l->_types + hdr->ntypes);
+  l->_str = (const char *) (l->_names + hdr->nnames);
+  return l;
+}
+
+ActStateLayout::~ActStateLayout ()
+{
+  munmap (_map, _mapsz);
+}
+
+int ActStateLayout::findInst (const char *path)
+{
+  int lo, hi, mid, c;
+
+  lo = 0;
+  hi = _hdr->ninst - 1;
+  while (lo <= hi) {
+    mid = (lo + hi)/2;
+    c = strcmp (path, _str + _inst[_byname[mid]].name);
+    if (c == 0) {
+      return _byname[mid];
+    }
+    if (c < 0) {
+      hi = mid - 1;
+    }
+    else {
+      lo = mid + 1;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Instances are in allocation order, so the owner of an offset is the
+ * last instance whose base is <= the offset (earlier instances with
+ * the same base have no local state of this kind).
+ */
+int ActStateLayout::findOwner (int offset, int kind, int *local)
+{
+  int lo, hi, mid;
+
+  if (offset < 0 || kind < 0 || kind >= ACT_STATE_NKINDS) {
+    return -1;
+  }
+  lo = 0;
+  hi = _hdr->ninst;
+  while (lo < hi) {
+    mid = (lo + hi)/2;
+    if (_inst[mid].base[kind] <= offset) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return -1;
+  }
+  lo--;
+  offset -= _inst[lo].base[kind];
+  if (offset >= _types[_inst[lo].type].count[kind]) {
+    return -1;
+  }
+  if (local) {
+    *local = offset;
+  }
+  return lo;
+}
+
+int ActStateLayout::offsetName (int offset, int kind, char *buf, int sz)
+{
+  int i, idx, len;
+  act_state_layout_type_t *t;
+  const char *path, *name;
+
+  i = findOwner (offset, kind, &idx);
+  if (i < 0) {
+    return 0;
+  }
+  t = &_types[_inst[i].type];
+  for (int k=0; k < kind; k++) {
+    idx += t->count[k];
+  }
+  name = _str + _names[t->names + idx];
+  if (!*name) {
+    /* unused offset */
+    return 0;
+  }
+  path = _str + _inst[i].name;
+  if (*path) {
+    len = snprintf (buf, sz, "%s.%s", path, name);
+  }
+  else {
+    len = snprintf (buf, sz, "%s", name);
+  }
+  return (len >= 0 && len < sz) ? 1 : 0;
+}
@@ -28,18 +28,65 @@
 #include <common/config.h>
 #include <act/passes/statepass.h>
 
-static act_connection *_inv_hash (struct pHashtable *H, int idx)
+/*
+ * Invert the hash table for values 0 .. n-1: the result maps each
+ * value to a key with that value, or NULL if there isn't one.
+ */
+static act_connection **_inv_hash (struct pHashtable *H, int n)
 {
+  act_connection **ret;
   phash_iter_t iter;
   phash_bucket_t *ib;
-  
+
+  if (n <= 0) {
+    return NULL;
+  }
+  MALLOC (ret, act_connection *, n);
+  for (int i=0; i < n; i++) {
+    ret[i] = NULL;
+  }
   phash_iter_init (H, &iter);
   while ((ib = phash_iter_next (H, &iter))) {
-    if (ib->i == idx) {
-      return (act_connection *)ib->key;
+    if (ib->i >= 0 && ib->i < n && !ret[ib->i]) {
+      ret[ib->i] = (act_connection *)ib->key;
+    }
+  }
+  return ret;
+}
+
+static act_connection **_rev_alloc (int n)
+{
+  act_connection **ret;
+
+  if (n <= 0) {
+    return NULL;
+  }
+  MALLOC (ret, act_connection *, n);
+  for (int i=0; i < n; i++) {
+    ret[i] = NULL;
+  }
+  return ret;
+}
+
+/* set rev[off] to c, ignoring out-of-range offsets */
+static void _rev_set (act_connection **rev, int n, int off,
+		      act_connection *c)
+{
+  if (off >= 0 && off < n && !rev[off]) {
+    rev[off] = c;
+  }
+}
+
+/* offsets off .. off+sz-1 are part of the dynamic array c */
+static void _rev_range (act_connection **rev, int *base, int n,
+			int off, int sz, act_connection *c)
+{
+  for (int i=0; i < sz; i++) {
+    if (off + i >= 0 && off + i < n) {
+      rev[off+i] = c;
+      base[off+i] = off;
     }
   }
-  return NULL;
 }
 
 void *ActStatePass::local_op (Process *p, int mode)
@@ -195,6 +242,17 @@ stateinfo_t *ActStatePass::countLocalState (Process *p)
   si->chp_ismulti = 0;
   si->inst = NULL;
 
+  si->rev_bool = NULL;
+  si->rev_chpbool = NULL;
+  si->rev_int = NULL;
+  si->rev_chan = NULL;
+  si->rev_dbool = NULL;
+  si->rev_dint = NULL;
+  si->rev_pbool = NULL;
+  si->rev_pchpbool = NULL;
+  si->rev_pint = NULL;
+  si->rev_pchan = NULL;
+
   int nportchptot = si->ports.numCHPVars();
   int localchp = chp_count - nportchptot;
 
@@ -729,12 +787,14 @@ stateinfo_t *ActStatePass::countLocalState (Process *p)
 
   if (Act::no_local_driver) {
     int err_ctxt = 0;
+    act_connection **inv;
     /* now check if there is some local state that is actually never
        driven! */
+    inv = _inv_hash (si->map, si->local.numBools());
     for (int i=0; i < si->local.numBools(); i++) {
       if (bitset_tst (inpbits, i + si->ports.numBools()) &&
 	  !bitset_tst (tmpbits, i + si->ports.numBools())) {
-	act_connection *tmpc = _inv_hash (si->map, i);
+	act_connection *tmpc = inv[i];
 	Assert (tmpc, "How did we get here?");
 	ActId *tmpid = tmpc->toid();
 	if (!err_ctxt) {
@@ -748,11 +808,15 @@ stateinfo_t *ActStatePass::countLocalState (Process *p)
 	delete tmpid;
       }
     }
+    if (inv) {
+      FREE (inv);
+    }
 
+    inv = _inv_hash (/*si->map*/ _cmap, localchp);
     for (int i=0; i < localchp; i++) {
       if (bitset_tst (inpchp, i + nportchptot) &&
 	  !bitset_tst (tmpchp, i + nportchptot)) {
-	act_connection *tmpc = _inv_hash (/*si->map*/ _cmap, i);
+	act_connection *tmpc = inv[i];
 	Assert (tmpc, "How did we get here?");
 	ActId *tmpid = tmpc->toid();
 	if (!err_ctxt) {
@@ -766,6 +830,9 @@ stateinfo_t *ActStatePass::countLocalState (Process *p)
 	delete tmpid;
       }
     }
+    if (inv) {
+      FREE (inv);
+    }
   }
   
   if (tmpbits) {
@@ -914,9 +981,152 @@ stateinfo_t *ActStatePass::countLocalState (Process *p)
   Assert (_cmap->n == 0, "Sanity check on chp state generation failed");
   phash_free (_cmap);
 
+  buildReverseMaps (si);
+
   return si;
 }
 
+
+/*
+ *------------------------------------------------------------------------
+ *
+ *  Build the offset -> connection maps for local state and ports, so
+ *  that getConnFromOffset() does not have to search the state map.
+ *
+ *------------------------------------------------------------------------
+ */
+void ActStatePass::buildReverseMaps (stateinfo_t *si)
+{
+  act_boolean_netlist_t *b = si->bnl;
+  phash_iter_t iter;
+  phash_bucket_t *pb, *xb;
+  int nbools, nints;
+
+  nbools = si->local.numBools();
+  nints = si->local.numInts();
+
+  si->rev_bool = _rev_alloc (nbools);
+  si->rev_chpbool = _rev_alloc (si->local.numCHPBools());
+  si->rev_int = _rev_alloc (nints);
+  si->rev_chan = _rev_alloc (si->local.numChans());
+
+  /*-- dynamic arrays occupy a range of offsets --*/
+  if (b->cdH->n > 0) {
+    if (nbools > 0) {
+      MALLOC (si->rev_dbool, int, nbools);
+      for (int i=0; i < nbools; i++) {
+	si->rev_dbool[i] = -1;
+      }
+    }
+    if (nints > 0) {
+      MALLOC (si->rev_dint, int, nints);
+      for (int i=0; i < nints; i++) {
+	si->rev_dint[i] = -1;
+      }
+    }
+    phash_iter_init (b->cdH, &iter);
+    while ((pb = phash_iter_next (b->cdH, &iter))) {
+      act_dynamic_var_t *dv = (act_dynamic_var_t *) pb->v;
+      act_connection *c = (act_connection *) pb->key;
+
+      xb = phash_lookup (si->map, c);
+      Assert (xb, "What?");
+      if (dv->isstruct) {
+	state_counts ts;
+	getStructCount (dv->isstruct, &ts);
+	_rev_range (si->rev_bool, si->rev_dbool, nbools, xb->i,
+		    ts.numBools()*dv->a->size(), c);
+	xb = phash_lookup (si->map,
+			   (act_connection *)(((unsigned long)c)|1));
+	if (xb) {
+	  _rev_range (si->rev_int, si->rev_dint, nints, xb->i,
+		      ts.numInts()*dv->a->size(), c);
+	}
+      }
+      else if (dv->isint) {
+	_rev_range (si->rev_int, si->rev_dint, nints, xb->i,
+		    dv->a->size(), c);
+      }
+      else {
+	_rev_range (si->rev_bool, si->rev_dbool, nbools, xb->i,
+		    dv->a->size(), c);
+      }
+    }
+  }
+
+  /*-- everything else has one offset --*/
+  phash_iter_init (si->map, &iter);
+  while ((pb = phash_iter_next (si->map, &iter))) {
+    act_booleanized_var_t *v;
+    act_connection *c;
+
+    if (pb->i < 0 || (pb->key & 1)) {
+      /* ports/globals, or the integer part of a dynamic struct */
+      continue;
+    }
+    c = (act_connection *) pb->key;
+    xb = phash_lookup (b->cH, c);
+    if (!xb) {
+      /* dynamic array, already handled */
+      continue;
+    }
+    v = (act_booleanized_var_t *) xb->v;
+    if (ActBooleanizePass::isDynamicRef (b, v->id)) {
+      continue;
+    }
+    if (v->used) {
+      _rev_set (si->rev_bool, nbools, pb->i, c);
+    }
+    else if (v->ischan) {
+      _rev_set (si->rev_chan, si->local.numChans(), pb->i, c);
+    }
+    else if (v->isint) {
+      _rev_set (si->rev_int, nints, pb->i, c);
+    }
+    else {
+      _rev_set (si->rev_chpbool, si->local.numCHPBools(),
+		pb->i - si->all.numBools(), c);
+    }
+  }
+
+  /*-- ports, in reverse order --*/
+  int k, kb, ki, kc;
+
+  si->rev_pbool = _rev_alloc (si->ports.numBools());
+  k = 0;
+  for (int i=A_LEN (b->ports)-1; i >= 0; i--) {
+    if (b->ports[i].omit) continue;
+    _rev_set (si->rev_pbool, si->ports.numBools(), k++, b->ports[i].c);
+  }
+
+  si->rev_pchpbool = _rev_alloc (si->ports.numCHPBools());
+  si->rev_pint = _rev_alloc (si->ports.numInts());
+  si->rev_pchan = _rev_alloc (si->ports.numChans());
+  kb = 0;
+  ki = 0;
+  kc = 0;
+  for (int i=A_LEN (b->chpports)-1; i >= 0; i--) {
+    act_booleanized_var_t *xv;
+    if (b->chpports[i].omit) continue;
+    xb = phash_lookup (b->cH, b->chpports[i].c);
+    if (!xb) continue;
+    xv = (act_booleanized_var_t *)xb->v;
+    if (xv->used) continue;
+    if (xv->ischan) {
+      _rev_set (si->rev_pchan, si->ports.numChans(), kc++,
+		b->chpports[i].c);
+    }
+    else if (xv->isint) {
+      _rev_set (si->rev_pint, si->ports.numInts(), ki++,
+		b->chpports[i].c);
+    }
+    else {
+      _rev_set (si->rev_pchpbool, si->ports.numCHPBools(), kb++,
+		b->chpports[i].c);
+    }
+  }
+}
+
 ActStatePass::ActStatePass (Act *a, int inst_offset) : ActPass (a, "collect_state", 1)
 {
   /*-- need the booleanize pass --*/
@@ -948,18 +1158,30 @@ void ActStatePass::free_local (void *v)
   if (s->inst) {
     phash_free (s->inst);
   }
+  if (s->rev_bool) { FREE (s->rev_bool); }
+  if (s->rev_chpbool) { FREE (s->rev_chpbool); }
+  if (s->rev_int) { FREE (s->rev_int); }
+  if (s->rev_chan) { FREE (s->rev_chan); }
+  if (s->rev_dbool) { FREE (s->rev_dbool); }
+  if (s->rev_dint) { FREE (s->rev_dint); }
+  if (s->rev_pbool) { FREE (s->rev_pbool); }
+  if (s->rev_pchpbool) { FREE (s->rev_pchpbool); }
+  if (s->rev_pint) { FREE (s->rev_pint); }
+  if (s->rev_pchan) { FREE (s->rev_pchan); }
   
   FREE (s);
 }
 
 int ActStatePass::run (Process *p)
 {
+  int prof = _prof_begin ();
   int res = ActPass::run (p);
 
   /*-- set root stateinfo for global variables --*/
   _root_si = getStateInfo (p);
 
   if (!_root_si) {
+    _prof_end (prof);
     return res;
   }
 
@@ -1041,6 +1263,7 @@ int ActStatePass::run (Process *p)
     }
   }
   
+  _prof_end (prof);
   return res;
 }
 
@@ -1288,117 +1511,53 @@ act_connection *ActStatePass::getConnFromOffset (stateinfo_t *si, int off, int t
   }
   else if (isPortOffset (off)) {
     off = portIdx (off);
-    if (type == 0 && off < si->ports.numBools()) {
-      /* -- booleanized ports -- */
-      for (int i=A_LEN (si->bnl->ports)-1; i >= 0; i--) {
-	if (si->bnl->ports[i].omit) continue;
-	if (off == 0) {
-	  return si->bnl->ports[i].c;
-	}
-	off--;
+    if (type == 0) {
+      /* -- booleanized ports, followed by chp bool ports -- */
+      if (off < si->ports.numBools()) {
+	return si->rev_pbool[off];
+      }
+      off -= si->ports.numBools();
+      if (off < si->ports.numCHPBools()) {
+	return si->rev_pchpbool[off];
+      }
+    }
+    else if (type == 1) {
+      if (off < si->ports.numInts()) {
+	return si->rev_pint[off];
       }
     }
     else {
-      off = off - si->ports.numBools();
-      /* -- chp ports: wrong -- */
-      for (int i=A_LEN (si->bnl->chpports)-1; i >= 0; i--) {
-	if (si->bnl->chpports[i].omit) continue;
-	phash_bucket_t *xb = phash_lookup (si->bnl->cH,
-					   si->bnl->chpports[i].c);
-	if (!xb) {
-	  continue;
-	}
-	act_booleanized_var_t *xv = (act_booleanized_var_t *)xb->v;
-	if (xv->used) {
-	  continue;
-	}
-	if ((type == 2 || type == 3) && xv->ischan) {
-	  if (off == 0) {
-	    return si->bnl->chpports[i].c;
-	  }
-	  off--;
-	}
-	else if (type == 1 && xv->isint) {
-	  if (off == 0) {
-	    return si->bnl->chpports[i].c;
-	  }
-	  off--;
-	}
-	else if (type == 0 && !(xv->isint || xv->ischan)) {
-	  if (off == 0) {
-	    return si->bnl->chpports[i].c;
-	  }
-	  off--;
-	}
+      if (off < si->ports.numChans()) {
+	return si->rev_pchan[off];
       }
     }
     /* something went wrong */
     return NULL;
   }
   else {
-    act_connection *c;
-    phash_bucket_t *b;
-    phash_iter_t bi;
-
-    phash_iter_init (si->map, &bi);
-
-    /* -- check variables -- */
-    while ((b = phash_iter_next (si->map, &bi))) {
-      if (b->i == off) {
-	c = (act_connection *)b->key;
-	
-	/* check if c has the right type! */
-	phash_bucket_t *xb;
-	act_booleanized_var_t *v;
-	xb = phash_lookup (si->bnl->cH, c);
-
-	if (xb) {
-	  v = (act_booleanized_var_t *)xb->v;
-	  if (v->isint && type == 1) {
-	    return c;
-	  }
-	  else if (v->ischan && (type == 2 || type == 3)) {
-	    return c;
-	  }
-	  else if (type == 0) {
-	    return c;
-	  }
-	  /*-- else continue searching --*/
-	}
-	else {
-	  act_dynamic_var_t *dv;
-	  xb = phash_lookup (si->bnl->cdH, c);
-	  Assert (xb, "What?!");
-	  dv = (act_dynamic_var_t *)xb->v;
-	  if (type == 1 && dv->isint) {
-	    *doff = 0;
-	    return c;
-	  }
-	  else if (type == 0) {
-	    *doff = 0;
-	    return c;
-	  }
-	  /* -- else continue searching -- */
+    if (type == 0) {
+      if (off < si->local.numBools()) {
+	if (si->rev_dbool && si->rev_dbool[off] >= 0) {
+	  *doff = off - si->rev_dbool[off];
 	}
+	return si->rev_bool[off];
+      }
+      off -= si->all.numBools();
+      if (off >= 0 && off < si->local.numCHPBools()) {
+	return si->rev_chpbool[off];
       }
     }
-
-    /* -- search dynamic info -- */
-    phash_iter_init (si->bnl->cdH, &bi);
-    while ((b = phash_iter_next (si->bnl->cdH, &bi))) {
-      act_dynamic_var_t *dv = (act_dynamic_var_t *)b->v;
-      act_connection *c = (act_connection *)b->key;
-      phash_bucket_t *xb = phash_lookup (si->map, c);
-      Assert (xb, "What?");
-      if (xb->i < off && off < xb->i + dv->a->size()) {
-	if (type == 1 && dv->isint) {
-	  *doff = off - xb->i;
-	  return c;
-	}
-	else if (type == 0) {
-	  *doff = off - xb->i;
-	  return c;
+    else if (type == 1) {
+      if (off < si->local.numInts()) {
+	if (si->rev_dint && si->rev_dint[off] >= 0) {
+	  *doff = off - si->rev_dint[off];
 	}
+	return si->rev_int[off];
+      }
+    }
+    else {
+      if (off < si->local.numChans()) {
+	return si->rev_chan[off];
       }
     }
     return NULL;
@@ -125,9 +125,121 @@ typedef struct {
   int chp_ismulti;		// multidriver through CHP
 
   struct pHashtable *inst;	// used for instance offsets
+
+  /*
+    Reverse maps, from offset to connection pointer; these are built
+    from map, and are used by getConnFromOffset().
+
+    Local state: one entry per offset. CHP-only bools are numbered
+    starting at all.numBools(), so rev_chpbool[i] corresponds to
+    offset all.numBools() + i. For offsets that are part of a
+    dynamic array, the connection is the array itself and
+    rev_dbool/rev_dint have the offset of the first element; these
+    are -1 otherwise (and the arrays are NULL if there are no
+    dynamic arrays).
+
+    Ports: indexed by the reversed port index (see the offset methods
+    in ActStatePass).
+  */
+  act_connection **rev_bool;	 // local.numBools()
+  act_connection **rev_chpbool;	 // local.numCHPBools()
+  act_connection **rev_int;	 // local.numInts()
+  act_connection **rev_chan;	 // local.numChans()
+  int *rev_dbool, *rev_dint;
+  
+  act_connection **rev_pbool;	 // ports.numBools()
+  act_connection **rev_pchpbool; // ports.numCHPBools()
+  act_connection **rev_pint;	 // ports.numInts()
+  act_connection **rev_pchan;	 // ports.numChans()
   
 } stateinfo_t;
 
+/*
+ * Flattened global state layout, written by ActStatePass::saveLayout()
+ * and read using ActStateLayout. The file is a header followed by
+ * fixed-size tables and a string pool, so it can be mmap'd and used
+ * directly.
+ *
+ *   - one entry per process instance in the hierarchy (including the
+ *     top-level), in depth-first pre-order. This is the order in which
+ *     state is allocated, so the base offsets of the entries are
+ *     non-decreasing for each kind of state.
+ *   - a permutation of the instances sorted by hierarchical name, for
+ *     name -> offset lookups.
+ *   - one entry per process type, with the local state counts and the
+ *     index of the names of the local state in the name table.
+ *
+ * The global offset of local variable i of kind k in an instance is
+ * the base offset of kind k for the instance + i. Globals and
+ * top-level ports are not part of the layout.
+ */
+#define ACT_STATE_LAYOUT_MAGIC   0x594c5341 /* "ASLY" */
+#define ACT_STATE_LAYOUT_VERSION 1
+
+/* kinds of state */
+#define ACT_STATE_BOOL    0
+#define ACT_STATE_CHPBOOL 1
+#define ACT_STATE_INT     2
+#define ACT_STATE_CHAN    3
+#define ACT_STATE_NKINDS  4
+
+typedef struct {
+  unsigned int magic, version;
+  unsigned int ninst;		// # of instances
+  unsigned int ntypes;		// # of process types
+  unsigned int nnames;		// # of local names
+  unsigned int strsz;		// size of the string pool
+} act_state_layout_hdr_t;
+
+typedef struct {
+  unsigned int name;		// string pool offset for the type name
+  int count[ACT_STATE_NKINDS];	// local state
+  unsigned int names;		// index of the first local name; names
+				// for all the kinds are stored
+				// contiguously in kind order
+} act_state_layout_type_t;
+
+typedef struct {
+  unsigned int name;		// string pool offset for the instance path
+  unsigned int type;		// index into the type table
+  int base[ACT_STATE_NKINDS];	// base offsets
+} act_state_layout_inst_t;
+
+class ActStateLayout {
+public:
+  ~ActStateLayout ();
+
+  /* returns NULL on error */
+  static ActStateLayout *Open (const char *file);
+
+  int numInst () { return _hdr->ninst; }
+  const char *instName (int i) { return _str + _inst[i].name; }
+  const char *instType (int i) { return _str + _types[_inst[i].type].name; }
+  int instBase (int i, int kind) { return _inst[i].base[kind]; }
+
+  /* returns the instance index, or -1 if not found */
+  int findInst (const char *path);
+
+  /* returns the instance that owns the offset, or -1 */
+  int findOwner (int offset, int kind, int *local = NULL);
+
+  /* print hierarchical name of an offset into buf; returns 1 on
+     success, 0 on error */
+  int offsetName (int offset, int kind, char *buf, int sz);
+
+private:
+  ActStateLayout () { }
+  
+  void *_map;
+  size_t _mapsz;
+  act_state_layout_hdr_t *_hdr;
+  act_state_layout_inst_t *_inst;
+  unsigned int *_byname;
+  act_state_layout_type_t *_types;
+  unsigned int *_names;
+  const char *_str;
+};
+
 class ActStatePass : public ActPass {
 public:
   ActStatePass (Act *a, int inst_offset = 0);
@@ -198,6 +310,10 @@ public:
 				    valid */
   int globalBoolOffset (ActId *id);
 
+  /* save the flattened layout of the state for the process last used
+     in run(); returns 1 on success, 0 on error. */
+  int saveLayout (const char *file);
+
   static void getStructCount (Data *d, state_counts *sc);
 
 private:
@@ -205,7 +321,9 @@ private:
   void free_local (void *);
 
   stateinfo_t *countLocalState (Process *p);
+  void buildReverseMaps (stateinfo_t *si);
   void printLocal (FILE *fp, Process *p);
+  void layoutWalk (Process *p, int len, state_counts *base, void *cookie);
   int _black_box_mode;
   int _inst_offsets;
 
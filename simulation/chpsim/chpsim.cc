@@ -0,0 +1,1651 @@
+/*************************************************************************
+ *
+ *  This file is part of the ACT library
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <string.h>
+#include <act/iter.h>
+#include "chpsim.h"
+
+/* threads blocked on a change to a variable */
+struct chpsim_watch {
+  ChpSimThread *th;
+  unsigned long key;
+  struct chpsim_watch *prev, *next; // other threads waiting on key
+  struct chpsim_watch *tnext;	    // other variables for th
+};
+
+/* # of backward jumps without a timed action before a thread yields */
+#define CHPSIM_MAXSPIN 1000
+
+static inline unsigned long _mask (int w)
+{
+  return w >= 64 ? ~0UL : ((1UL << w) - 1);
+}
+
+static inline unsigned long _wkey (int kind, int idx)
+{
+  return ((unsigned long)idx << 2) | kind;
+}
+
+static int _bitwidth (unsigned long v)
+{
+  int w = 1;
+  while (w < 64 && (v >> w)) {
+    w++;
+  }
+  return w;
+}
+
+static int _maxw (int a, int b)
+{
+  return a > b ? a : b;
+}
+
+static int _capw (int w)
+{
+  return w > 64 ? 64 : w;
+}
+
+
+/*------------------------------------------------------------------------
+ *
+ *  Threads
+ *
+ *------------------------------------------------------------------------
+ */
+ChpSimThread::ChpSimThread (ChpSim *sim, chpsim_inst_t *inst, int pc)
+{
+  _sim = sim;
+  _inst = inst;
+  _pc = pc;
+  _pending = 0;
+  _done = 0;
+  _watch = NULL;
+  _next = NULL;
+}
+
+int ChpSimThread::Step (Event *ev)
+{
+  return _sim->_exec (this);
+}
+
+
+/*------------------------------------------------------------------------
+ *
+ *  Compilation
+ *
+ *------------------------------------------------------------------------
+ */
+int ChpSim::_emit (chpsim_type_t *t, int op, int a, int b, int c, int d)
+{
+  A_NEW (t->code, chpsim_insn_t);
+  A_NEXT (t->code).op = op;
+  A_NEXT (t->code).flags = 0;
+  A_NEXT (t->code).w = 0;
+  A_NEXT (t->code).a = a;
+  A_NEXT (t->code).b = b;
+  A_NEXT (t->code).c = c;
+  A_NEXT (t->code).d = d;
+  A_INC (t->code);
+  return A_LEN (t->code) - 1;
+}
+
+void ChpSim::_exemit (chpsim_type_t *t, int op, int w, int a, unsigned long v)
+{
+  A_NEW (t->ex, chpsim_exop_t);
+  A_NEXT (t->ex).op = op;
+  A_NEXT (t->ex).w = w;
+  A_NEXT (t->ex).a = a;
+  A_NEXT (t->ex).v = v;
+  A_INC (t->ex);
+}
+
+/*
+ * Return the index of the variable in the variable table for t,
+ * adding it if necessary.
+ */
+int ChpSim::_varref (chpsim_type_t *t, ActId *id)
+{
+  act_connection *c;
+  int off, type, w, kind;
+  ihash_bucket_t *b;
+
+  if (id->isDynamicDeref ()) {
+    fprintf (stderr, "Variable: ");
+    id->Print (stderr);
+    fprintf (stderr, "\n");
+    fatal_error ("%s: dynamic array references are not supported",
+		 t->p->getName());
+  }
+  c = id->Canonical (t->p->CurScope());
+  if (!c || !_sp->getTypeOffset (t->si, c, &off, &type, &w)) {
+    fprintf (stderr, "Variable: ");
+    id->Print (stderr);
+    fprintf (stderr, "\n");
+    fatal_error ("%s: no state allocated for variable", t->p->getName());
+  }
+  if (type == 0) {
+    kind = CHPSIM_BOOL;
+    w = 1;
+  }
+  else if (type == 1) {
+    kind = CHPSIM_INT;
+  }
+  else {
+    kind = CHPSIM_CHAN;
+  }
+  if (w > 64) {
+    fprintf (stderr, "Variable: ");
+    id->Print (stderr);
+    fprintf (stderr, "\n");
+    fatal_error ("%s: values wider than 64 bits are not supported",
+		 t->p->getName());
+  }
+  if (w < 1) {
+    w = 1;
+  }
+
+  b = ihash_lookup (t->varH, _wkey (kind, off));
+  if (b) {
+    return b->i;
+  }
+  b = ihash_add (t->varH, _wkey (kind, off));
+  b->i = A_LEN (t->var);
+
+  A_NEW (t->var, chpsim_var_t);
+  A_NEXT (t->var).kind = kind;
+  A_NEXT (t->var).off = off;
+  A_NEXT (t->var).w = w;
+  A_INC (t->var);
+  return b->i;
+}
+
+int ChpSim::_tmpvar (chpsim_type_t *t, int w)
+{
+  A_NEW (t->var, chpsim_var_t);
+  A_NEXT (t->var).kind = CHPSIM_TMP;
+  A_NEXT (t->var).off = t->ntmp++;
+  A_NEXT (t->var).w = w;
+  A_INC (t->var);
+  return A_LEN (t->var) - 1;
+}
+
+static int _loadop (int kind)
+{
+  switch (kind) {
+  case CHPSIM_BOOL:
+    return CHPSIM_EX_BOOL;
+  case CHPSIM_INT:
+    return CHPSIM_EX_INT;
+  case CHPSIM_TMP:
+    return CHPSIM_EX_TMP;
+  default:
+    return CHPSIM_EX_PROBE;
+  }
+}
+
+/* postfix code for e; returns the width of the result */
+int ChpSim::_cexpr_rec (chpsim_type_t *t, Expr *e)
+{
+  int lw, rw, v, lo, hi;
+  ihash_bucket_t *b;
+
+  switch (e->type) {
+  case E_TRUE:
+    _exemit (t, CHPSIM_EX_CONST, 1, 0, 1);
+    return 1;
+
+  case E_FALSE:
+    _exemit (t, CHPSIM_EX_CONST, 1, 0, 0);
+    return 1;
+
+  case E_INT:
+    if (e->u.v_extra) {
+      fatal_error ("%s: constants wider than 64 bits are not supported",
+		   t->p->getName());
+    }
+    _exemit (t, CHPSIM_EX_CONST, 64, 0, e->u.v);
+    return _bitwidth (e->u.v);
+
+  case E_VAR:
+    v = _varref (t, (ActId *)e->u.e.l);
+    if (t->var[v].kind == CHPSIM_CHAN) {
+      /* dataflow: the value received from the channel */
+      b = _dfmap ? ihash_lookup (_dfmap, v) : NULL;
+      if (!b) {
+	fatal_error ("%s: channel used in an expression", t->p->getName());
+      }
+      v = b->i;
+    }
+    _exemit (t, _loadop (t->var[v].kind), t->var[v].w, v);
+    return t->var[v].w;
+
+  case E_PROBE:
+    v = _varref (t, (ActId *)e->u.e.l);
+    if (t->var[v].kind != CHPSIM_CHAN) {
+      fatal_error ("%s: probe of a non-channel", t->p->getName());
+    }
+    _exemit (t, CHPSIM_EX_PROBE, 1, v);
+    return 1;
+
+  case E_BITFIELD:
+    v = _varref (t, (ActId *)e->u.e.l);
+    if (t->var[v].kind == CHPSIM_CHAN) {
+      b = _dfmap ? ihash_lookup (_dfmap, v) : NULL;
+      if (!b) {
+	fatal_error ("%s: channel used in an expression", t->p->getName());
+      }
+      v = b->i;
+    }
+    hi = e->u.e.r->u.e.r->u.v;
+    lo = e->u.e.r->u.e.l ? e->u.e.r->u.e.l->u.v : hi;
+    if (lo > hi || hi >= 64) {
+      fatal_error ("%s: invalid bitfield {%d..%d}", t->p->getName(), hi, lo);
+    }
+    _exemit (t, _loadop (t->var[v].kind), t->var[v].w, v);
+    _exemit (t, CHPSIM_EX_BITS, hi - lo + 1, lo);
+    return hi - lo + 1;
+
+#define BINARY(eop,op,width)			\
+  case eop:					\
+    lw = _cexpr_rec (t, e->u.e.l);		\
+    rw = _cexpr_rec (t, e->u.e.r);		\
+    _exemit (t, op, lw);			\
+    return _capw (width)
+
+    BINARY (E_AND, CHPSIM_EX_AND, _maxw (lw, rw));
+    BINARY (E_OR, CHPSIM_EX_OR, _maxw (lw, rw));
+    BINARY (E_XOR, CHPSIM_EX_XOR, _maxw (lw, rw));
+    BINARY (E_PLUS, CHPSIM_EX_ADD, _maxw (lw, rw) + 1);
+    BINARY (E_MINUS, CHPSIM_EX_SUB, _maxw (lw, rw) + 1);
+    BINARY (E_MULT, CHPSIM_EX_MUL, lw + rw);
+    BINARY (E_DIV, CHPSIM_EX_DIV, lw);
+    BINARY (E_MOD, CHPSIM_EX_MOD, rw);
+    BINARY (E_LSL, CHPSIM_EX_LSL, rw >= 7 ? 64 : lw + (1 << rw) - 1);
+    BINARY (E_LSR, CHPSIM_EX_LSR, lw);
+    BINARY (E_ASR, CHPSIM_EX_ASR, lw);
+    BINARY (E_LT, CHPSIM_EX_LT, 1);
+    BINARY (E_GT, CHPSIM_EX_GT, 1);
+    BINARY (E_LE, CHPSIM_EX_LE, 1);
+    BINARY (E_GE, CHPSIM_EX_GE, 1);
+    BINARY (E_EQ, CHPSIM_EX_EQ, 1);
+    BINARY (E_NE, CHPSIM_EX_NE, 1);
+#undef BINARY
+
+  case E_NOT:
+  case E_COMPLEMENT:
+    lw = _cexpr_rec (t, e->u.e.l);
+    _exemit (t, CHPSIM_EX_NOT, lw);
+    return lw;
+
+  case E_UMINUS:
+    lw = _cexpr_rec (t, e->u.e.l);
+    _exemit (t, CHPSIM_EX_NEG, lw);
+    return lw;
+
+  case E_QUERY:
+    _cexpr_rec (t, e->u.e.l);
+    lw = _cexpr_rec (t, e->u.e.r->u.e.l);
+    rw = _cexpr_rec (t, e->u.e.r->u.e.r);
+    _exemit (t, CHPSIM_EX_QUERY);
+    return _maxw (lw, rw);
+
+  case E_CONCAT:
+    lw = _cexpr_rec (t, e->u.e.l);
+    for (e = e->u.e.r; e; e = e->u.e.r) {
+      rw = _cexpr_rec (t, e->u.e.l);
+      _exemit (t, CHPSIM_EX_CONCAT, rw);
+      lw += rw;
+    }
+    return _capw (lw);
+
+  case E_BUILTIN_BOOL:
+    _cexpr_rec (t, e->u.e.l);
+    _exemit (t, CHPSIM_EX_MASK, 1);
+    return 1;
+
+  case E_BUILTIN_INT:
+    lw = _cexpr_rec (t, e->u.e.l);
+    if (e->u.e.r) {
+      lw = _capw (e->u.e.r->u.v);
+      _exemit (t, CHPSIM_EX_MASK, lw);
+    }
+    return lw;
+
+  case E_FUNCTION:
+    fatal_error ("%s: function calls should have been inlined",
+		 t->p->getName());
+    break;
+
+  case E_REAL:
+    fatal_error ("%s: real values are not supported", t->p->getName());
+    break;
+
+  default:
+    fatal_error ("%s: unsupported expression type %d", t->p->getName(),
+		 e->type);
+    break;
+  }
+  return 0;
+}
+
+/*
+ * Compile e, returning the start of its code. A NULL expression is
+ * true.
+ */
+int ChpSim::_cexpr (chpsim_type_t *t, Expr *e)
+{
+  int start = A_LEN (t->ex);
+  int depth, max;
+
+  if (e) {
+    _cexpr_rec (t, e);
+  }
+  else {
+    _exemit (t, CHPSIM_EX_CONST, 1, 0, 1);
+  }
+  _exemit (t, CHPSIM_EX_END);
+
+  depth = 0;
+  max = 0;
+  for (int i=start; t->ex[i].op != CHPSIM_EX_END; i++) {
+    switch (t->ex[i].op) {
+    case CHPSIM_EX_CONST:
+    case CHPSIM_EX_BOOL:
+    case CHPSIM_EX_INT:
+    case CHPSIM_EX_TMP:
+    case CHPSIM_EX_PROBE:
+      depth++;
+      break;
+    case CHPSIM_EX_NOT:
+    case CHPSIM_EX_NEG:
+    case CHPSIM_EX_MASK:
+    case CHPSIM_EX_BITS:
+      break;
+    case CHPSIM_EX_QUERY:
+      depth -= 2;
+      break;
+    default:
+      depth--;
+      break;
+    }
+    if (depth > max) {
+      max = depth;
+    }
+  }
+  if (max > CHPSIM_STACK) {
+    fatal_error ("%s: expression too complex (depth %d > %d)",
+		 t->p->getName(), max, CHPSIM_STACK);
+  }
+  return start;
+}
+
+/* v == c, or #v if c < 0 */
+int ChpSim::_guard_expr (chpsim_type_t *t, int v, int cmp, unsigned long c)
+{
+  int start = A_LEN (t->ex);
+
+  if (cmp) {
+    _exemit (t, _loadop (t->var[v].kind), t->var[v].w, v);
+    _exemit (t, CHPSIM_EX_CONST, 64, 0, c);
+    _exemit (t, CHPSIM_EX_EQ);
+  }
+  else {
+    _exemit (t, _loadop (t->var[v].kind), t->var[v].w, v);
+  }
+  _exemit (t, CHPSIM_EX_END);
+  return start;
+}
+
+/* add variables in the expression to the current watch list */
+void ChpSim::_addwatch (chpsim_type_t *t, int ex)
+{
+  int start, i;
+
+  /* the current list starts after the last terminator */
+  for (start = A_LEN (t->watch); start > 0 && t->watch[start-1] != -1;
+       start--)
+    ;
+  for (; t->ex[ex].op != CHPSIM_EX_END; ex++) {
+    if (t->ex[ex].op == CHPSIM_EX_BOOL || t->ex[ex].op == CHPSIM_EX_INT ||
+	t->ex[ex].op == CHPSIM_EX_PROBE) {
+      for (i=start; i < A_LEN (t->watch); i++) {
+	if (t->watch[i] == t->ex[ex].a) break;
+      }
+      if (i == A_LEN (t->watch)) {
+	A_APPEND (t->watch, int, t->ex[ex].a);
+      }
+    }
+  }
+}
+
+void ChpSim::_compile (chpsim_type_t *t, act_chp_lang_t *c)
+{
+  listitem_t *li;
+  act_chp_gc_t *gc;
+  int pc, i, n, v, ex;
+  A_DECL (int, fix);
+
+  if (!c) return;
+
+  switch (c->type) {
+  case ACT_CHP_SKIP:
+    break;
+
+  case ACT_CHP_SEMI:
+    for (li = list_first (c->u.semi_comma.cmd); li; li = list_next (li)) {
+      _compile (t, (act_chp_lang_t *) list_value (li));
+    }
+    break;
+
+  case ACT_CHP_COMMA:
+    n = list_length (c->u.semi_comma.cmd);
+    if (n == 0) {
+      break;
+    }
+    if (n == 1) {
+      _compile (t, (act_chp_lang_t *)
+		list_value (list_first (c->u.semi_comma.cmd)));
+      break;
+    }
+    /* the thread runs the first branch, and the last thread to
+       finish continues after the join */
+    v = A_LEN (t->branch);
+    for (i=0; i < n; i++) {
+      A_APPEND (t->branch, int, -1);
+    }
+    _emit (t, CHPSIM_OP_FORK, t->njoin, n, v);
+    A_INIT (fix);
+    i = 0;
+    for (li = list_first (c->u.semi_comma.cmd); li; li = list_next (li)) {
+      t->branch[v + i] = A_LEN (t->code);
+      _compile (t, (act_chp_lang_t *) list_value (li));
+      A_APPEND (fix, int, _emit (t, CHPSIM_OP_JOIN, t->njoin, -1));
+      i++;
+    }
+    for (i=0; i < A_LEN (fix); i++) {
+      t->code[fix[i]].b = A_LEN (t->code);
+    }
+    A_FREE (fix);
+    t->njoin++;
+    break;
+
+  case ACT_CHP_ASSIGN:
+  case ACT_CHP_ASSIGNSELF:
+    v = _varref (t, c->u.assign.id);
+    if (t->var[v].kind == CHPSIM_CHAN) {
+      fatal_error ("%s: assignment to a channel", t->p->getName());
+    }
+    ex = _cexpr (t, c->u.assign.e);
+    pc = _emit (t, CHPSIM_OP_ASSIGN, v, ex);
+    t->code[pc].w = t->var[v].w;
+    break;
+
+  case ACT_CHP_SEND:
+  case ACT_CHP_RECV:
+    if (c->u.comm.flavor != 0) {
+      fatal_error ("%s: half-handshake channel actions are not supported",
+		   t->p->getName());
+    }
+    v = _varref (t, c->u.comm.chan);
+    if (t->var[v].kind != CHPSIM_CHAN) {
+      fatal_error ("%s: communication action on a non-channel",
+		   t->p->getName());
+    }
+    if (c->type == ACT_CHP_SEND) {
+      if (c->u.comm.var) {
+	fatal_error ("%s: bidirectional channels are not supported",
+		     t->p->getName());
+      }
+      ex = c->u.comm.e ? _cexpr (t, c->u.comm.e) : -1;
+      pc = _emit (t, CHPSIM_OP_SEND, v, ex);
+      t->code[pc].w = t->var[v].w;
+    }
+    else {
+      if (c->u.comm.e) {
+	fatal_error ("%s: bidirectional channels are not supported",
+		     t->p->getName());
+      }
+      n = c->u.comm.var ? _varref (t, c->u.comm.var) : -1;
+      if (n >= 0 && t->var[n].kind == CHPSIM_CHAN) {
+	fatal_error ("%s: receive into a channel", t->p->getName());
+      }
+      pc = _emit (t, CHPSIM_OP_RECV, v, n);
+      t->code[pc].w = (n >= 0 ? t->var[n].w : 0);
+    }
+    break;
+
+  case ACT_CHP_SELECT:
+  case ACT_CHP_SELECT_NONDET:
+  case ACT_CHP_LOOP:
+    pc = _emit (t, CHPSIM_OP_SEL, A_LEN (t->guard), 0, -1, -1);
+    if (c->type == ACT_CHP_SELECT_NONDET) {
+      t->code[pc].flags = CHPSIM_SEL_NONDET;
+    }
+    n = 0;
+    for (gc = c->u.gc; gc; gc = gc->next) {
+      if (gc->id) {
+	fatal_error ("%s: unexpanded guard replication", t->p->getName());
+      }
+      if (!gc->g && c->type != ACT_CHP_LOOP) {
+	/* else clause */
+	continue;
+      }
+      ex = _cexpr (t, gc->g);
+      A_NEW (t->guard, chpsim_guard_t);
+      A_NEXT (t->guard).ex = ex;
+      A_NEXT (t->guard).pc = -1;
+      A_INC (t->guard);
+      n++;
+    }
+    t->code[pc].b = n;
+    if (c->type != ACT_CHP_LOOP) {
+      t->code[pc].d = A_LEN (t->watch);
+      for (i=0; i < n; i++) {
+	_addwatch (t, t->guard[t->code[pc].a + i].ex);
+      }
+      A_APPEND (t->watch, int, -1);
+    }
+
+    A_INIT (fix);
+    i = t->code[pc].a;
+    for (gc = c->u.gc; gc; gc = gc->next) {
+      if (!gc->g && c->type != ACT_CHP_LOOP) {
+	t->code[pc].c = A_LEN (t->code);
+      }
+      else {
+	t->guard[i++].pc = A_LEN (t->code);
+      }
+      _compile (t, gc->s);
+      if (c->type == ACT_CHP_LOOP) {
+	_emit (t, CHPSIM_OP_JMP, pc);
+      }
+      else {
+	A_APPEND (fix, int, _emit (t, CHPSIM_OP_JMP, -1));
+      }
+    }
+    if (c->type == ACT_CHP_LOOP) {
+      /* all guards false: exit the loop */
+      t->code[pc].c = A_LEN (t->code);
+    }
+    for (i=0; i < A_LEN (fix); i++) {
+      t->code[fix[i]].a = A_LEN (t->code);
+    }
+    A_FREE (fix);
+    break;
+
+  case ACT_CHP_DOLOOP:
+    v = A_LEN (t->code);
+    _compile (t, c->u.gc->s);
+    ex = _cexpr (t, c->u.gc->g);
+    pc = _emit (t, CHPSIM_OP_SEL, A_LEN (t->guard), 1, -1, -1);
+    t->code[pc].c = pc + 1;
+    A_NEW (t->guard, chpsim_guard_t);
+    A_NEXT (t->guard).ex = ex;
+    A_NEXT (t->guard).pc = v;
+    A_INC (t->guard);
+    break;
+
+  case ACT_CHP_FUNC:
+    if (strcmp (string_char (c->u.func.name), "log") != 0) {
+      warning ("%s: built-in function `%s' ignored", t->p->getName(),
+	       string_char (c->u.func.name));
+      break;
+    }
+    _emit (t, CHPSIM_OP_LOG, A_LEN (t->logarg),
+	   list_length (c->u.func.rhs));
+    for (li = list_first (c->u.func.rhs); li; li = list_next (li)) {
+      act_func_arguments_t *arg = (act_func_arguments_t *) list_value (li);
+      ex = arg->isstring ? -1 : _cexpr (t, arg->u.e);
+      A_NEW (t->logarg, chpsim_logarg_t);
+      A_NEXT (t->logarg).s = arg->isstring ? string_char (arg->u.s) : NULL;
+      A_NEXT (t->logarg).ex = ex;
+      A_INC (t->logarg);
+    }
+    break;
+
+  default:
+    fatal_error ("%s: unsupported CHP construct (type %d)",
+		 t->p->getName(), c->type);
+    break;
+  }
+}
+
+/* receive every channel in the dataflow expression e into a temporary */
+void ChpSim::_recv_inputs (chpsim_type_t *t, Expr *e)
+{
+  int v, x, pc;
+  ihash_bucket_t *b;
+
+  if (!e) return;
+
+  switch (e->type) {
+  case E_TRUE:
+  case E_FALSE:
+  case E_INT:
+  case E_REAL:
+    break;
+
+  case E_VAR:
+  case E_BITFIELD:
+    v = _varref (t, (ActId *)e->u.e.l);
+    if (t->var[v].kind != CHPSIM_CHAN) {
+      fatal_error ("%s: dataflow expression uses a non-channel",
+		   t->p->getName());
+    }
+    if (!ihash_lookup (_dfmap, v)) {
+      x = _tmpvar (t, t->var[v].w);
+      b = ihash_add (_dfmap, v);
+      b->i = x;
+      pc = _emit (t, CHPSIM_OP_RECV, v, x);
+      t->code[pc].w = t->var[x].w;
+    }
+    break;
+
+  case E_BUILTIN_BOOL:
+  case E_BUILTIN_INT:
+    _recv_inputs (t, e->u.e.l);
+    break;
+
+  case E_FUNCTION:
+    fatal_error ("%s: function calls should have been inlined",
+		 t->p->getName());
+    break;
+
+  default:
+    _recv_inputs (t, e->u.e.l);
+    _recv_inputs (t, e->u.e.r);
+    break;
+  }
+}
+
+/*
+ * Dataflow elements become CHP loops:
+ *
+ *   func    : *[ in1?x1, ..., inN?xN; out!f(x1..xN) ]
+ *   split   : *[ c?g; in?x; [ g=0 -> out0!x [] ... ] ]
+ *   merge   : *[ c?g; [ g=0 -> in0?x [] ... ]; out!x ]
+ *   mixer,
+ *   arbiter : *[ [| #in0 -> in0?x; ctrl!0 [] ... |]; out!x ]
+ *   sink    : *[ in? ]
+ */
+void ChpSim::_compile_dflow (chpsim_type_t *t, act_dataflow_element *e)
+{
+  int top, pc, out, in, g, x, n, i, v, ex;
+  A_DECL (int, fix);
+
+  if (e->t == ACT_DFLOW_CLUSTER) {
+    for (listitem_t *li = list_first (e->u.dflow_cluster); li;
+	 li = list_next (li)) {
+      _compile_dflow (t, (act_dataflow_element *) list_value (li));
+    }
+    return;
+  }
+
+  A_APPEND (t->start, int, A_LEN (t->code));
+
+  switch (e->t) {
+  case ACT_DFLOW_FUNC:
+    out = _varref (t, e->u.func.rhs);
+    if (e->u.func.init) {
+      pc = _emit (t, CHPSIM_OP_SEND, out, _cexpr (t, e->u.func.init));
+      t->code[pc].w = t->var[out].w;
+    }
+    top = A_LEN (t->code);
+    _dfmap = ihash_new (4);
+    _recv_inputs (t, e->u.func.lhs);
+    ex = _cexpr (t, e->u.func.lhs);
+    ihash_free (_dfmap);
+    _dfmap = NULL;
+    pc = _emit (t, CHPSIM_OP_SEND, out, ex);
+    t->code[pc].w = t->var[out].w;
+    _emit (t, CHPSIM_OP_JMP, top);
+    break;
+
+  case ACT_DFLOW_SPLIT:
+  case ACT_DFLOW_MERGE:
+  case ACT_DFLOW_MIXER:
+  case ACT_DFLOW_ARBITER:
+    n = e->u.splitmerge.nmulti;
+    top = A_LEN (t->code);
+    in = _varref (t, e->u.splitmerge.single);
+    x = _tmpvar (t, t->var[in].w);
+    g = -1;
+    if (e->t == ACT_DFLOW_SPLIT || e->t == ACT_DFLOW_MERGE) {
+      i = _varref (t, e->u.splitmerge.guard);
+      g = _tmpvar (t, t->var[i].w);
+      pc = _emit (t, CHPSIM_OP_RECV, i, g);
+      t->code[pc].w = t->var[g].w;
+    }
+    if (e->t == ACT_DFLOW_SPLIT) {
+      pc = _emit (t, CHPSIM_OP_RECV, in, x);
+      t->code[pc].w = t->var[x].w;
+    }
+
+    pc = _emit (t, CHPSIM_OP_SEL, A_LEN (t->guard), n, -1, -1);
+    for (i=0; i < n; i++) {
+      if (g >= 0) {
+	ex = _guard_expr (t, g, 1, i);
+      }
+      else {
+	ex = _guard_expr (t, _varref (t, e->u.splitmerge.multi[i]), 0, 0);
+      }
+      A_NEW (t->guard, chpsim_guard_t);
+      A_NEXT (t->guard).ex = ex;
+      A_NEXT (t->guard).pc = -1;
+      A_INC (t->guard);
+    }
+    if (g < 0) {
+      /* wait on the probes of the inputs */
+      t->code[pc].flags = CHPSIM_SEL_NONDET;
+      t->code[pc].d = A_LEN (t->watch);
+      for (i=0; i < n; i++) {
+	_addwatch (t, t->guard[t->code[pc].a + i].ex);
+      }
+      A_APPEND (t->watch, int, -1);
+    }
+
+    A_INIT (fix);
+    for (i=0; i < n; i++) {
+      t->guard[t->code[pc].a + i].pc = A_LEN (t->code);
+      if (!e->u.splitmerge.multi[i]) {
+	/* split to nowhere: drop the value */
+	A_APPEND (fix, int, _emit (t, CHPSIM_OP_JMP, -1));
+	continue;
+      }
+      v = _varref (t, e->u.splitmerge.multi[i]);
+      if (e->t == ACT_DFLOW_SPLIT) {
+	int y = _emit (t, CHPSIM_OP_SEND, v, _guard_expr (t, x, 0, 0));
+	t->code[y].w = t->var[v].w;
+      }
+      else {
+	int y = _emit (t, CHPSIM_OP_RECV, v, x);
+	t->code[y].w = t->var[x].w;
+	if (e->u.splitmerge.nondetctrl) {
+	  int z = _varref (t, e->u.splitmerge.nondetctrl);
+	  _exemit (t, CHPSIM_EX_CONST, 64, 0, i);
+	  _exemit (t, CHPSIM_EX_END);
+	  y = _emit (t, CHPSIM_OP_SEND, z, A_LEN (t->ex) - 2);
+	  t->code[y].w = t->var[z].w;
+	}
+      }
+      A_APPEND (fix, int, _emit (t, CHPSIM_OP_JMP, -1));
+    }
+    for (i=0; i < A_LEN (fix); i++) {
+      t->code[fix[i]].a = A_LEN (t->code);
+    }
+    A_FREE (fix);
+
+    if (e->t != ACT_DFLOW_SPLIT) {
+      pc = _emit (t, CHPSIM_OP_SEND, in, _guard_expr (t, x, 0, 0));
+      t->code[pc].w = t->var[in].w;
+    }
+    _emit (t, CHPSIM_OP_JMP, top);
+    break;
+
+  case ACT_DFLOW_SINK:
+    top = A_LEN (t->code);
+    _emit (t, CHPSIM_OP_RECV, _varref (t, e->u.sink.chan), -1);
+    _emit (t, CHPSIM_OP_JMP, top);
+    break;
+
+  default:
+    fatal_error ("%s: unsupported dataflow element %d", t->p->getName(),
+		 e->t);
+    break;
+  }
+}
+
+/*
+ * Compiled code for process p, shared by all its instances; NULL if
+ * there is nothing to simulate.
+ */
+chpsim_type_t *ChpSim::_gettype (Process *p, stateinfo_t *si)
+{
+  phash_bucket_t *b;
+  chpsim_type_t *t;
+  act_chp *chp;
+  act_dataflow *df;
+
+  b = phash_lookup (_typeH, p);
+  if (b) {
+    return (chpsim_type_t *) b->v;
+  }
+  b = phash_add (_typeH, p);
+  b->v = NULL;
+
+  if (!p->getlang()) {
+    return NULL;
+  }
+  chp = p->getlang()->getchp();
+  df = p->getlang()->getdflow();
+  if ((!chp || !chp->c) && (!df || !df->dflow || list_isempty (df->dflow))) {
+    return NULL;
+  }
+
+  NEW (t, chpsim_type_t);
+  t->p = p;
+  t->si = si;
+  A_INIT (t->code);
+  A_INIT (t->ex);
+  A_INIT (t->var);
+  A_INIT (t->guard);
+  A_INIT (t->branch);
+  A_INIT (t->watch);
+  A_INIT (t->logarg);
+  A_INIT (t->start);
+  t->ntmp = 0;
+  t->njoin = 0;
+  t->varH = ihash_new (8);
+
+  if (chp && chp->c) {
+    A_APPEND (t->start, int, A_LEN (t->code));
+    _compile (t, chp->c);
+    _emit (t, CHPSIM_OP_DONE);
+  }
+  if (df && df->dflow) {
+    for (listitem_t *li = list_first (df->dflow); li; li = list_next (li)) {
+      _compile_dflow (t, (act_dataflow_element *) list_value (li));
+    }
+  }
+
+  ihash_free (t->varH);
+  t->varH = NULL;
+
+  b->v = t;
+  _ntypes++;
+  return t;
+}
+
+
+/*------------------------------------------------------------------------
+ *
+ *  Instances
+ *
+ *------------------------------------------------------------------------
+ */
+
+/*
+ * Global offset of an ActStatePass offset in an instance with state
+ * starting at base, and port table ports.
+ */
+int ChpSim::_resolve (stateinfo_t *si, state_counts *base, int **ports,
+		      int kind, int off)
+{
+  if (_sp->isGlobalOffset (off)) {
+    return _gbase[kind] + _sp->globalIdx (off);
+  }
+  if (_sp->isPortOffset (off)) {
+    return ports[kind][_sp->portIdx (off)];
+  }
+  switch (kind) {
+  case CHPSIM_BOOL:
+    if (off < si->local.numBools()) {
+      return base->numBools() + off;
+    }
+    /* chp bools follow all the booleanized bools */
+    return _nb + base->numCHPBools() + (off - si->all.numBools());
+
+  case CHPSIM_INT:
+    return base->numInts() + off;
+
+  default:
+    return base->numChans() + off;
+  }
+}
+
+/* global offset for port c of instance <vx><arr> of a sub-process */
+static int _portmap (ActStatePass *sp, Process *p,
+		     stateinfo_t *si, ActId *inst, act_connection *c,
+		     int *off)
+{
+  ActId *tmp = inst->Clone ();
+  act_connection *pc;
+  int ret;
+
+  tmp->Append (c->toid());
+  pc = tmp->Canonical (p->CurScope());
+  ret = pc ? sp->getTypeOffset (si, pc, off, NULL, NULL) : 0;
+  if (!ret) {
+    fprintf (stderr, "Port: ");
+    tmp->Print (stderr);
+    fprintf (stderr, "\n");
+    fatal_error ("%s: no state allocated for port", p->getName());
+  }
+  delete tmp;
+  return ret;
+}
+
+void ChpSim::_build (Process *p, const char *name, state_counts *base,
+		     int **ports)
+{
+  stateinfo_t *si = _sp->getStateInfo (p);
+  chpsim_type_t *t;
+  chpsim_inst_t *inst;
+  phash_bucket_t *ib;
+
+  if (!si) {
+    /* black box */
+    return;
+  }
+
+  t = _gettype (p, si);
+  if (t) {
+    NEW (inst, chpsim_inst_t);
+    inst->t = t;
+    inst->name = Strdup (*name ? name : p->getName());
+    MALLOC (inst->vmap, int, A_LEN (t->var) + 1);
+    for (int i=0; i < A_LEN (t->var); i++) {
+      if (t->var[i].kind == CHPSIM_TMP) {
+	inst->vmap[i] = t->var[i].off;
+      }
+      else {
+	inst->vmap[i] = _resolve (si, base, ports, t->var[i].kind,
+				  t->var[i].off);
+      }
+    }
+    MALLOC (inst->tmp, unsigned long, t->ntmp + 1);
+    for (int i=0; i < t->ntmp; i++) {
+      inst->tmp[i] = 0;
+    }
+    MALLOC (inst->join, int, t->njoin + 1);
+    inst->idle = NULL;
+    A_APPEND (_inst, chpsim_inst_t *, inst);
+  }
+
+  /* sub-processes: same allocation order as ActStatePass::layoutWalk() */
+  state_counts cur = si->local;
+  ActUniqProcInstiter i(p->CurScope());
+
+  for (i = i.begin(); i != i.end(); i++) {
+    ValueIdx *vx = *i;
+    Process *x = dynamic_cast<Process *>(vx->t->BaseType());
+    if (!x->isExpanded()) {
+      continue;
+    }
+    stateinfo_t *ti = _sp->getStateInfo (x);
+    if (!ti) {
+      continue;
+    }
+
+    state_counts start;
+    if (si->inst) {
+      ib = phash_lookup (si->inst, vx);
+      Assert (ib, "Missing instance offset?");
+      start = *((state_counts *)ib->v);
+    }
+    else {
+      start = cur;
+    }
+
+    Arraystep *as = vx->t->arrayInfo() ? vx->t->arrayInfo()->stepper() : NULL;
+    int count = 0;
+    while (!as || !as->isend()) {
+      if (!as || vx->isPrimary (as->index())) {
+	state_counts elem = *base;
+	elem.addVar (start);
+	if (as) {
+	  elem.addVar (ti->all, as->index());
+	}
+
+	char *str = as ? as->string() : Strdup ("");
+	char *cname;
+	MALLOC (cname, char, strlen (name) + strlen (vx->getName()) +
+		strlen (str) + 2);
+	sprintf (cname, "%s%s%s%s", name, *name ? "." : "", vx->getName(),
+		 str);
+	FREE (str);
+
+	/* port tables for the instance */
+	ActId *iid = new ActId (vx->getName(), as ? as->toArray() : NULL);
+	int *cports[CHPSIM_NKINDS];
+	int nb = ti->ports.numBools();
+	int off;
+
+	MALLOC (cports[CHPSIM_BOOL], int, nb + ti->ports.numCHPBools() + 1);
+	MALLOC (cports[CHPSIM_INT], int, ti->ports.numInts() + 1);
+	MALLOC (cports[CHPSIM_CHAN], int, ti->ports.numChans() + 1);
+	for (int j=0; j < nb; j++) {
+	  _portmap (_sp, p, si, iid, ti->rev_pbool[j], &off);
+	  cports[CHPSIM_BOOL][j] = _resolve (si, base, ports, CHPSIM_BOOL, off);
+	}
+	for (int j=0; j < ti->ports.numCHPBools(); j++) {
+	  _portmap (_sp, p, si, iid, ti->rev_pchpbool[j], &off);
+	  cports[CHPSIM_BOOL][nb+j] =
+	    _resolve (si, base, ports, CHPSIM_BOOL, off);
+	}
+	for (int j=0; j < ti->ports.numInts(); j++) {
+	  _portmap (_sp, p, si, iid, ti->rev_pint[j], &off);
+	  cports[CHPSIM_INT][j] = _resolve (si, base, ports, CHPSIM_INT, off);
+	}
+	for (int j=0; j < ti->ports.numChans(); j++) {
+	  _portmap (_sp, p, si, iid, ti->rev_pchan[j], &off);
+	  cports[CHPSIM_CHAN][j] = _resolve (si, base, ports, CHPSIM_CHAN, off);
+	}
+	delete iid;
+
+	_build (x, cname, &elem, cports);
+
+	for (int j=0; j < CHPSIM_NKINDS; j++) {
+	  FREE (cports[j]);
+	}
+	FREE (cname);
+	count++;
+      }
+      if (!as) break;
+      as->step();
+    }
+    if (as) {
+      delete as;
+    }
+    cur.addVar (ti->all, count);
+  }
+}
+
+ChpSim::ChpSim (ActStatePass *sp, Process *p)
+{
+  stateinfo_t *si;
+  state_counts zero;
+  int *ports[CHPSIM_NKINDS];
+  int n[CHPSIM_NKINDS];
+  int nglob, np;
+
+  _sp = sp;
+  _top = p;
+  _delay = 10;
+  _steps = 0;
+  _rr = 0;
+  _dfmap = NULL;
+  _typeH = phash_new (8);
+  _ntypes = 0;
+  A_INIT (_inst);
+  A_INIT (_threads);
+  _watchH = ihash_new (32);
+  _wfree = NULL;
+
+  si = sp->getStateInfo (p);
+  if (!si) {
+    fatal_error ("Process `%s': no state information", p->getName());
+  }
+  nglob = A_LEN (si->bnl->used_globals);
+  _nb = si->all.numBools();
+  _nxb = si->all.numCHPBools();
+
+  /* top-level ports follow the state of the hierarchy, followed by
+     the globals */
+  np = si->ports.numBools() + si->ports.numCHPBools();
+  MALLOC (ports[CHPSIM_BOOL], int, np + 1);
+  for (int i=0; i < np; i++) {
+    ports[CHPSIM_BOOL][i] = _nb + _nxb + i;
+  }
+  _gbase[CHPSIM_BOOL] = _nb + _nxb + np;
+
+  np = si->ports.numInts();
+  MALLOC (ports[CHPSIM_INT], int, np + 1);
+  for (int i=0; i < np; i++) {
+    ports[CHPSIM_INT][i] = si->all.numInts() + i;
+  }
+  _gbase[CHPSIM_INT] = si->all.numInts() + np;
+
+  np = si->ports.numChans();
+  MALLOC (ports[CHPSIM_CHAN], int, np + 1);
+  for (int i=0; i < np; i++) {
+    ports[CHPSIM_CHAN][i] = si->all.numChans() + i;
+  }
+  _gbase[CHPSIM_CHAN] = si->all.numChans() + np;
+
+  for (int i=0; i < CHPSIM_NKINDS; i++) {
+    n[i] = _gbase[i] + nglob + 1;
+  }
+  MALLOC (_bools, unsigned char, n[CHPSIM_BOOL]);
+  memset (_bools, 0, n[CHPSIM_BOOL]);
+  MALLOC (_ints, unsigned long, n[CHPSIM_INT]);
+  memset (_ints, 0, sizeof (unsigned long)*n[CHPSIM_INT]);
+  MALLOC (_chans, chpsim_chan_t, n[CHPSIM_CHAN]);
+  memset (_chans, 0, sizeof (chpsim_chan_t)*n[CHPSIM_CHAN]);
+
+  _build (p, "", &zero, ports);
+
+  for (int i=0; i < CHPSIM_NKINDS; i++) {
+    FREE (ports[i]);
+  }
+}
+
+ChpSim::~ChpSim ()
+{
+  phash_iter_t it;
+  phash_bucket_t *b;
+  struct chpsim_watch *w;
+
+  for (int i=0; i < A_LEN (_threads); i++) {
+    delete _threads[i];
+  }
+  A_FREE (_threads);
+
+  for (int i=0; i < A_LEN (_inst); i++) {
+    FREE (_inst[i]->name);
+    FREE (_inst[i]->vmap);
+    FREE (_inst[i]->tmp);
+    FREE (_inst[i]->join);
+    FREE (_inst[i]);
+  }
+  A_FREE (_inst);
+
+  phash_iter_init (_typeH, &it);
+  while ((b = phash_iter_next (_typeH, &it))) {
+    chpsim_type_t *t = (chpsim_type_t *) b->v;
+    if (t) {
+      A_FREE (t->code);
+      A_FREE (t->ex);
+      A_FREE (t->var);
+      A_FREE (t->guard);
+      A_FREE (t->branch);
+      A_FREE (t->watch);
+      A_FREE (t->logarg);
+      A_FREE (t->start);
+      FREE (t);
+    }
+  }
+  phash_free (_typeH);
+
+  /* threads were deleted, so any remaining watches are stale */
+  ihash_iter_t iit;
+  ihash_bucket_t *ib;
+  ihash_iter_init (_watchH, &iit);
+  while ((ib = ihash_iter_next (_watchH, &iit))) {
+    while (ib->v) {
+      w = (struct chpsim_watch *) ib->v;
+      ib->v = w->next;
+      FREE (w);
+    }
+  }
+  ihash_free (_watchH);
+  while (_wfree) {
+    w = _wfree;
+    _wfree = w->next;
+    FREE (w);
+  }
+
+  FREE (_bools);
+  FREE (_ints);
+  FREE (_chans);
+}
+
+void ChpSim::Start ()
+{
+  for (int i=0; i < A_LEN (_inst); i++) {
+    for (int j=0; j < A_LEN (_inst[i]->t->start); j++) {
+      _spawn (_inst[i], _inst[i]->t->start[j]);
+    }
+  }
+}
+
+int ChpSim::numBlocked ()
+{
+  int n = 0;
+  for (int i=0; i < A_LEN (_threads); i++) {
+    if (!_threads[i]->_done) {
+      n++;
+    }
+  }
+  return n;
+}
+
+void ChpSim::printBlocked (FILE *fp)
+{
+  for (int i=0; i < A_LEN (_threads); i++) {
+    ChpSimThread *th = _threads[i];
+    if (th->_done) continue;
+
+    chpsim_insn_t *x = &th->_inst->t->code[th->_pc];
+    fprintf (fp, "  %s [%s]: ", th->_inst->name,
+	     th->_inst->t->p->getName());
+    switch (x->op) {
+    case CHPSIM_OP_SEND:
+      fprintf (fp, "send\n");
+      break;
+    case CHPSIM_OP_RECV:
+      fprintf (fp, "receive\n");
+      break;
+    case CHPSIM_OP_SEL:
+      fprintf (fp, "selection, all guards false\n");
+      break;
+    default:
+      fprintf (fp, "pc %d\n", th->_pc);
+      break;
+    }
+  }
+}
+
+
+/*------------------------------------------------------------------------
+ *
+ *  Execution
+ *
+ *------------------------------------------------------------------------
+ */
+void ChpSim::_spawn (chpsim_inst_t *inst, int pc)
+{
+  ChpSimThread *th;
+
+  if (inst->idle) {
+    th = inst->idle;
+    inst->idle = th->_next;
+    th->_done = 0;
+    th->_pc = pc;
+  }
+  else {
+    th = new ChpSimThread (this, inst, pc);
+    A_APPEND (_threads, ChpSimThread *, th);
+  }
+  th->Pause (0);
+}
+
+void ChpSim::_retire (ChpSimThread *th)
+{
+  th->_done = 1;
+  th->_next = th->_inst->idle;
+  th->_inst->idle = th;
+}
+
+/* wait for a change to any variable in the watch list w */
+void ChpSim::_wait (ChpSimThread *th, int w)
+{
+  chpsim_type_t *t = th->_inst->t;
+  struct chpsim_watch *x;
+  ihash_bucket_t *b;
+
+  if (w < 0) return;
+
+  for (; t->watch[w] != -1; w++) {
+    int v = t->watch[w];
+    unsigned long key = _wkey (t->var[v].kind, th->_inst->vmap[v]);
+
+    if (_wfree) {
+      x = _wfree;
+      _wfree = x->next;
+    }
+    else {
+      NEW (x, struct chpsim_watch);
+    }
+    x->th = th;
+    x->key = key;
+    x->prev = NULL;
+
+    b = ihash_lookup (_watchH, key);
+    if (!b) {
+      b = ihash_add (_watchH, key);
+      b->v = NULL;
+    }
+    x->next = (struct chpsim_watch *) b->v;
+    if (x->next) {
+      x->next->prev = x;
+    }
+    b->v = x;
+
+    x->tnext = th->_watch;
+    th->_watch = x;
+  }
+}
+
+void ChpSim::_unwait (ChpSimThread *th)
+{
+  struct chpsim_watch *x, *nx;
+  ihash_bucket_t *b;
+
+  for (x = th->_watch; x; x = nx) {
+    nx = x->tnext;
+    if (x->prev) {
+      x->prev->next = x->next;
+    }
+    else {
+      b = ihash_lookup (_watchH, x->key);
+      Assert (b, "Watch list missing?");
+      if (x->next) {
+	b->v = x->next;
+      }
+      else {
+	ihash_delete (_watchH, x->key);
+      }
+    }
+    if (x->next) {
+      x->next->prev = x->prev;
+    }
+    x->next = _wfree;
+    _wfree = x;
+  }
+  th->_watch = NULL;
+}
+
+/* wake up threads waiting on a variable */
+void ChpSim::_fire (int kind, int idx)
+{
+  ihash_bucket_t *b;
+  unsigned long key = _wkey (kind, idx);
+
+  while ((b = ihash_lookup (_watchH, key))) {
+    ChpSimThread *th = ((struct chpsim_watch *) b->v)->th;
+    _unwait (th);
+    th->Pause (0);
+  }
+}
+
+void ChpSim::_write (chpsim_inst_t *inst, int v, unsigned long val)
+{
+  int idx = inst->vmap[v];
+
+  switch (inst->t->var[v].kind) {
+  case CHPSIM_BOOL:
+    if (_bools[idx] != val) {
+      _bools[idx] = val;
+      if (_watchH->n > 0) {
+	_fire (CHPSIM_BOOL, idx);
+      }
+    }
+    break;
+
+  case CHPSIM_INT:
+    if (_ints[idx] != val) {
+      _ints[idx] = val;
+      if (_watchH->n > 0) {
+	_fire (CHPSIM_INT, idx);
+      }
+    }
+    break;
+
+  case CHPSIM_TMP:
+    inst->tmp[idx] = val;
+    break;
+
+  default:
+    Assert (0, "Write to a channel?");
+    break;
+  }
+}
+
+unsigned long ChpSim::_eval (chpsim_inst_t *inst, int ex)
+{
+  chpsim_exop_t *op = &inst->t->ex[ex];
+  unsigned long stk[CHPSIM_STACK];
+  unsigned long x;
+  chpsim_chan_t *c;
+  int sp = 0;
+
+#define BINOP(expr)  sp--; stk[sp-1] = (expr); break
+#define L stk[sp-1]
+#define R stk[sp]
+
+  for (;; op++) {
+    switch (op->op) {
+    case CHPSIM_EX_END:
+      return stk[0];
+
+    case CHPSIM_EX_CONST:
+      stk[sp++] = op->v;
+      break;
+    case CHPSIM_EX_BOOL:
+      stk[sp++] = _bools[inst->vmap[op->a]];
+      break;
+    case CHPSIM_EX_INT:
+      stk[sp++] = _ints[inst->vmap[op->a]];
+      break;
+    case CHPSIM_EX_TMP:
+      stk[sp++] = inst->tmp[inst->vmap[op->a]];
+      break;
+    case CHPSIM_EX_PROBE:
+      c = &_chans[inst->vmap[op->a]];
+      stk[sp++] = (c->s || c->r) ? 1 : 0;
+      break;
+
+    case CHPSIM_EX_AND: BINOP (L & R);
+    case CHPSIM_EX_OR:  BINOP (L | R);
+    case CHPSIM_EX_XOR: BINOP (L ^ R);
+    case CHPSIM_EX_ADD: BINOP (L + R);
+    case CHPSIM_EX_SUB: BINOP (L - R);
+    case CHPSIM_EX_MUL: BINOP (L * R);
+    case CHPSIM_EX_DIV: BINOP (R ? L / R : 0);
+    case CHPSIM_EX_MOD: BINOP (R ? L % R : 0);
+    case CHPSIM_EX_LSL: BINOP (R >= 64 ? 0 : L << R);
+    case CHPSIM_EX_LSR: BINOP (R >= 64 ? 0 : L >> R);
+    case CHPSIM_EX_LT:  BINOP (L < R);
+    case CHPSIM_EX_GT:  BINOP (L > R);
+    case CHPSIM_EX_LE:  BINOP (L <= R);
+    case CHPSIM_EX_GE:  BINOP (L >= R);
+    case CHPSIM_EX_EQ:  BINOP (L == R);
+    case CHPSIM_EX_NE:  BINOP (L != R);
+
+    case CHPSIM_EX_ASR:
+      sp--;
+      x = L;
+      if (op->w < 64 && ((x >> (op->w - 1)) & 1)) {
+	x |= ~_mask (op->w);
+      }
+      x = (unsigned long) (((signed long)x) >> (R >= 64 ? 63 : R));
+      L = x & _mask (op->w);
+      break;
+
+    case CHPSIM_EX_NOT:
+      L = ~L & _mask (op->w);
+      break;
+    case CHPSIM_EX_NEG:
+      L = (0 - L) & _mask (op->w);
+      break;
+    case CHPSIM_EX_MASK:
+      L &= _mask (op->w);
+      break;
+    case CHPSIM_EX_BITS:
+      L = (L >> op->a) & _mask (op->w);
+      break;
+
+    case CHPSIM_EX_QUERY:
+      sp -= 2;
+      stk[sp-1] = stk[sp-1] ? stk[sp] : stk[sp+1];
+      break;
+    case CHPSIM_EX_CONCAT:
+      BINOP ((op->w >= 64 ? 0 : (L << op->w)) | R);
+
+    default:
+      fatal_error ("Unknown expression op %d", op->op);
+      break;
+    }
+  }
+#undef BINOP
+#undef L
+#undef R
+  return 0;
+}
+
+void ChpSim::_log (chpsim_inst_t *inst, chpsim_insn_t *x)
+{
+  chpsim_logarg_t *arg = &inst->t->logarg[x->a];
+
+  printf ("[%lu] %s: ", SimDES::CurTimeLo(), inst->name);
+  for (int i=0; i < x->b; i++) {
+    if (arg[i].s) {
+      printf ("%s", arg[i].s);
+    }
+    else {
+      printf ("%lu", _eval (inst, arg[i].ex));
+    }
+  }
+  printf ("\n");
+}
+
+/*
+ * Run a thread until it blocks, finishes, or executes an action
+ * that takes time.
+ */
+int ChpSim::_exec (ChpSimThread *th)
+{
+  chpsim_inst_t *inst = th->_inst;
+  chpsim_type_t *t = inst->t;
+  chpsim_insn_t *x, *rx;
+  chpsim_chan_t *c;
+  unsigned long val;
+  int i, k, n, spin = 0;
+
+  _steps++;
+
+  while (1) {
+    x = &t->code[th->_pc];
+    switch (x->op) {
+    case CHPSIM_OP_DONE:
+      _retire (th);
+      return 1;
+
+    case CHPSIM_OP_ASSIGN:
+      _write (inst, x->a, _eval (inst, x->b) & _mask (x->w));
+      th->_pc++;
+      th->Pause (_delay);
+      return 1;
+
+    case CHPSIM_OP_SEND:
+      c = &_chans[inst->vmap[x->a]];
+      if (th->_pending) {
+	/* the receiver has taken the value */
+	th->_pending = 0;
+	th->_pc++;
+	th->Pause (_delay);
+	return 1;
+      }
+      val = (x->b >= 0 ? _eval (inst, x->b) & _mask (x->w) : 0);
+      if (c->r) {
+	/* complete the receive on behalf of the waiting receiver */
+	rx = &c->r->_inst->t->code[c->r->_pc];
+	if (rx->b >= 0) {
+	  _write (c->r->_inst, rx->b, val & _mask (rx->w));
+	}
+	c->r->Pause (0);
+	c->r = NULL;
+	th->_pc++;
+	th->Pause (_delay);
+	return 1;
+      }
+      if (c->s) {
+	fatal_error ("%s: multiple concurrent senders on a channel",
+		     inst->name);
+      }
+      c->v = val;
+      c->s = th;
+      th->_pending = 1;
+      if (_watchH->n > 0) {
+	_fire (CHPSIM_CHAN, inst->vmap[x->a]);
+      }
+      return 1;
+
+    case CHPSIM_OP_RECV:
+      c = &_chans[inst->vmap[x->a]];
+      if (th->_pending) {
+	/* the sender has written the value */
+	th->_pending = 0;
+      }
+      else if (c->s) {
+	if (x->b >= 0) {
+	  _write (inst, x->b, c->v & _mask (x->w));
+	}
+	c->s->Pause (0);
+	c->s = NULL;
+      }
+      else {
+	if (c->r) {
+	  fatal_error ("%s: multiple concurrent receivers on a channel",
+		       inst->name);
+	}
+	c->r = th;
+	th->_pending = 1;
+	if (_watchH->n > 0) {
+	  _fire (CHPSIM_CHAN, inst->vmap[x->a]);
+	}
+	return 1;
+      }
+      th->_pc++;
+      th->Pause (_delay);
+      return 1;
+
+    case CHPSIM_OP_JMP:
+      if (x->a <= th->_pc && ++spin > CHPSIM_MAXSPIN) {
+	/* let time advance */
+	th->_pc = x->a;
+	th->Pause (_delay);
+	return 1;
+      }
+      th->_pc = x->a;
+      break;
+
+    case CHPSIM_OP_SEL:
+      n = x->b;
+      i = (x->flags & CHPSIM_SEL_NONDET) && n > 1 ? (_rr++ % n) : 0;
+      k = -1;
+      for (int j=0; j < n; j++) {
+	if (_eval (inst, t->guard[x->a + i].ex)) {
+	  k = i;
+	  break;
+	}
+	i = (i + 1 == n ? 0 : i + 1);
+      }
+      if (k >= 0) {
+	th->_pc = t->guard[x->a + k].pc;
+      }
+      else if (x->c >= 0) {
+	th->_pc = x->c;
+      }
+      else {
+	/* wait for a change to the variables in the guards; with
+	   nothing to wait on, this would be reported as a deadlock */
+	if (x->d < 0 || t->watch[x->d] == -1) {
+	  fatal_error ("%s: selection with all guards false has no "
+		       "variables to wait on", inst->name);
+	}
+	_wait (th, x->d);
+	return 1;
+      }
+      break;
+
+    case CHPSIM_OP_FORK:
+      inst->join[x->a] = x->b;
+      for (i=1; i < x->b; i++) {
+	_spawn (inst, t->branch[x->c + i]);
+      }
+      th->_pc = t->branch[x->c];
+      break;
+
+    case CHPSIM_OP_JOIN:
+      if (--inst->join[x->a] == 0) {
+	th->_pc = x->b;
+	break;
+      }
+      _retire (th);
+      return 1;
+
+    case CHPSIM_OP_LOG:
+      _log (inst, x);
+      th->_pc++;
+      break;
+
+    default:
+      fatal_error ("Unknown instruction %d", x->op);
+      break;
+    }
+  }
+  return 1;
+}
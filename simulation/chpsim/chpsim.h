@@ -0,0 +1,260 @@
+/*************************************************************************
+ *
+ *  This file is part of the ACT library
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#ifndef __CHPSIM_H__
+#define __CHPSIM_H__
+
+#include <act/act.h>
+#include <act/passes/statepass.h>
+#include <common/simdes.h>
+#include <common/array.h>
+#include <common/hash.h>
+
+/*
+ *  CHP/dataflow simulator.
+ *
+ *  The expanded CHP body of each process type is compiled once into a
+ *  small instruction array with postfix expressions; dataflow
+ *  elements are compiled into equivalent CHP loops. Variables in the
+ *  code are referenced through a per-type variable table, and each
+ *  instance maps that table to offsets in the global state arrays
+ *  laid out exactly as in ActStatePass (local state of the hierarchy,
+ *  then top-level ports, then globals).
+ *
+ *  Each thread of control is a SimDES object. Assignments and
+ *  communication actions take "delay" time units; control flow is
+ *  free. Channels are rendezvous objects. A selection with no true
+ *  guard waits for a change to a variable (or probe) in its guards;
+ *  it is an error if the guards do not use any variables.
+ *
+ *  Limitations: integers are at most 64 bits wide, and arithmetic is
+ *  done in 64 bits and truncated on assignment; dynamic arrays,
+ *  bidirectional channels, half-handshake channel actions, and
+ *  production rules are not simulated. Dataflow buffers are treated
+ *  as unbuffered.
+ */
+
+/* kinds of variables */
+#define CHPSIM_BOOL  0
+#define CHPSIM_INT   1
+#define CHPSIM_CHAN  2
+#define CHPSIM_TMP   3		// per-instance temporary (dataflow)
+#define CHPSIM_NKINDS 3		// kinds with global state
+
+enum chpsim_op {
+  CHPSIM_OP_DONE,		// thread exits
+  CHPSIM_OP_ASSIGN,		// var a := expr b
+  CHPSIM_OP_SEND,		// chan a ! expr b (b = -1: no data)
+  CHPSIM_OP_RECV,		// chan a ? var b (b = -1: no data)
+  CHPSIM_OP_JMP,		// goto a
+  CHPSIM_OP_SEL,		// guards a .. a+b-1, c = pc if no guard is
+				// true (-1: wait), d = watch list
+  CHPSIM_OP_FORK,		// join slot a, b branches at branch[c..]
+  CHPSIM_OP_JOIN,		// join slot a, continue at b
+  CHPSIM_OP_LOG			// log arguments a .. a+b-1
+};
+
+#define CHPSIM_SEL_NONDET  0x1	// flags for SEL
+
+typedef struct {
+  unsigned char op;
+  unsigned char flags;
+  unsigned char w;		// width of assigned value
+  int a, b, c, d;
+} chpsim_insn_t;
+
+enum chpsim_exop {
+  CHPSIM_EX_END,
+  CHPSIM_EX_CONST,
+  CHPSIM_EX_BOOL, CHPSIM_EX_INT, CHPSIM_EX_TMP, CHPSIM_EX_PROBE,
+  CHPSIM_EX_AND, CHPSIM_EX_OR, CHPSIM_EX_XOR,
+  CHPSIM_EX_ADD, CHPSIM_EX_SUB, CHPSIM_EX_MUL, CHPSIM_EX_DIV, CHPSIM_EX_MOD,
+  CHPSIM_EX_LSL, CHPSIM_EX_LSR, CHPSIM_EX_ASR,
+  CHPSIM_EX_LT, CHPSIM_EX_GT, CHPSIM_EX_LE, CHPSIM_EX_GE,
+  CHPSIM_EX_EQ, CHPSIM_EX_NE,
+  CHPSIM_EX_NOT, CHPSIM_EX_NEG, CHPSIM_EX_MASK, CHPSIM_EX_BITS,
+  CHPSIM_EX_QUERY, CHPSIM_EX_CONCAT
+};
+
+/* maximum expression stack depth */
+#define CHPSIM_STACK 64
+
+typedef struct {
+  unsigned char op;
+  unsigned char w;		// operand/result width
+  int a;			// variable, or low bit for EX_BITS
+  unsigned long v;		// constant
+} chpsim_exop_t;
+
+typedef struct {
+  int kind;
+  int off;			// ActStatePass offset, or temporary #
+  int w;			// width
+} chpsim_var_t;
+
+typedef struct {
+  int ex;			// guard expression
+  int pc;			// target
+} chpsim_guard_t;
+
+typedef struct {
+  const char *s;		// string, or NULL
+  int ex;			// expression otherwise
+} chpsim_logarg_t;
+
+/* compiled process type */
+typedef struct {
+  Process *p;
+  stateinfo_t *si;
+
+  A_DECL (chpsim_insn_t, code);
+  A_DECL (chpsim_exop_t, ex);
+  A_DECL (chpsim_var_t, var);
+  A_DECL (chpsim_guard_t, guard);
+  A_DECL (int, branch);		// FORK targets
+  A_DECL (int, watch);		// -1 terminated variable lists
+  A_DECL (chpsim_logarg_t, logarg);
+  A_DECL (int, start);		// entry point per thread
+
+  int ntmp;			// # of temporaries
+  int njoin;			// # of join counters
+
+  struct iHashtable *varH;	// used during compilation
+} chpsim_type_t;
+
+class ChpSimThread;
+
+typedef struct {
+  ChpSimThread *s, *r;		// blocked sender/receiver
+  unsigned long v;		// value from a blocked sender
+} chpsim_chan_t;
+
+typedef struct {
+  chpsim_type_t *t;
+  char *name;
+  int *vmap;			// variable table -> global offset
+  unsigned long *tmp;
+  int *join;
+  ChpSimThread *idle;		// finished threads, for re-use
+} chpsim_inst_t;
+
+struct chpsim_watch;
+class ChpSim;
+
+class ChpSimThread : public SimDES {
+public:
+  ChpSimThread (ChpSim *sim, chpsim_inst_t *inst, int pc);
+
+  int Step (Event *ev);
+  const char *Name () { return _inst->name; }
+
+private:
+  ChpSim *_sim;
+  chpsim_inst_t *_inst;
+  int _pc;
+  unsigned int _pending:1;	// blocked on a channel action
+  unsigned int _done:1;		// on the idle list
+  struct chpsim_watch *_watch;	// variables being waited on
+  ChpSimThread *_next;		// idle list
+
+  friend class ChpSim;
+};
+
+class ChpSim {
+public:
+  ChpSim (ActStatePass *sp, Process *p);
+  ~ChpSim ();
+
+  void setDelay (int d) { _delay = d; }
+
+  void Start ();		// create the initial threads
+
+  unsigned long numSteps () { return _steps; }
+  int numInst () { return A_LEN (_inst); }
+  int numTypes () { return _ntypes; }
+
+  int numBlocked ();
+  void printBlocked (FILE *fp);
+
+private:
+  ActStatePass *_sp;
+  Process *_top;
+  int _delay;
+  unsigned long _steps;
+  unsigned int _rr;		// rotation for non-deterministic choice
+
+  /* global state */
+  unsigned char *_bools;
+  unsigned long *_ints;
+  chpsim_chan_t *_chans;
+  int _nb, _nxb;		// hierarchy bools and chp bools
+  int _gbase[CHPSIM_NKINDS];	// globals
+
+  struct pHashtable *_typeH;	// Process -> chpsim_type_t
+  int _ntypes;
+  A_DECL (chpsim_inst_t *, _inst);
+  A_DECL (ChpSimThread *, _threads);
+
+  struct iHashtable *_watchH;	// variable -> waiting threads
+  struct chpsim_watch *_wfree;
+
+  /*-- compilation --*/
+  chpsim_type_t *_gettype (Process *p, stateinfo_t *si);
+  int _varref (chpsim_type_t *t, ActId *id);
+  int _tmpvar (chpsim_type_t *t, int w);
+  int _emit (chpsim_type_t *t, int op, int a = 0, int b = 0, int c = 0,
+	     int d = 0);
+  void _exemit (chpsim_type_t *t, int op, int w = 0, int a = 0,
+		unsigned long v = 0);
+  int _cexpr (chpsim_type_t *t, Expr *e);
+  int _cexpr_rec (chpsim_type_t *t, Expr *e);
+  int _guard_expr (chpsim_type_t *t, int v, int cmp, unsigned long c);
+  void _addwatch (chpsim_type_t *t, int ex);
+  void _compile (chpsim_type_t *t, act_chp_lang_t *c);
+  void _compile_dflow (chpsim_type_t *t, act_dataflow_element *e);
+  void _recv_inputs (chpsim_type_t *t, Expr *e);
+
+  struct iHashtable *_dfmap;	// channel -> temporary, dataflow mode
+
+  /*-- instances --*/
+  void _build (Process *p, const char *name, state_counts *base,
+	       int **ports);
+  int _resolve (stateinfo_t *si, state_counts *base, int **ports,
+		int kind, int off);
+
+  /*-- execution --*/
+  int _exec (ChpSimThread *th);
+  unsigned long _eval (chpsim_inst_t *inst, int ex);
+  void _write (chpsim_inst_t *inst, int v, unsigned long val);
+  void _spawn (chpsim_inst_t *inst, int pc);
+  void _retire (ChpSimThread *th);
+  void _log (chpsim_inst_t *inst, chpsim_insn_t *x);
+
+  void _wait (ChpSimThread *th, int w);
+  void _unwait (ChpSimThread *th);
+  void _fire (int kind, int idx);
+
+  friend class ChpSimThread;
+};
+
+#endif /* __CHPSIM_H__ */
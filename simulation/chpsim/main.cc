@@ -0,0 +1,125 @@
+/*************************************************************************
+ *
+ *  This file is part of the ACT library
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <act/act.h>
+#include <act/passes.h>
+#include <common/mytime.h>
+#include "chpsim.h"
+
+static void usage (char *name)
+{
+  fprintf (stderr, "Usage: %s [act-options] [-d delay] [-T time] [-v] <actfile> <process>\n", name);
+  fprintf (stderr, "  -d : delay for each assignment and communication action (default: 10)\n");
+  fprintf (stderr, "  -T : stop the simulation at the specified time\n");
+  fprintf (stderr, "  -v : list blocked threads on deadlock\n");
+  exit (1);
+}
+
+int main (int argc, char **argv)
+{
+  Act *a;
+  Process *p;
+  int ch, delay, verbose;
+  long tmax;
+  double tm;
+
+  Act::Init (&argc, &argv);
+
+  delay = 10;
+  tmax = -1;
+  verbose = 0;
+  while ((ch = getopt (argc, argv, "d:T:v")) != -1) {
+    switch (ch) {
+    case 'd':
+      delay = atoi (optarg);
+      break;
+    case 'T':
+      tmax = atol (optarg);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+  if (optind + 2 != argc || delay < 0) {
+    usage (argv[0]);
+  }
+
+  a = new Act (argv[optind]);
+  a->Expand ();
+  p = a->findProcess (argv[optind+1]);
+  if (!p) {
+    fatal_error ("Could not find process `%s' in file `%s'", argv[optind+1],
+		 argv[optind]);
+  }
+  if (!p->isExpanded()) {
+    fatal_error ("Process `%s' is not expanded.", argv[optind+1]);
+  }
+
+  /* functions are inlined before state is allocated, since inlining
+     can introduce new variables */
+  ActCHPFuncInline *fp = new ActCHPFuncInline (a);
+  fp->run (p);
+
+  ActStatePass *sp = new ActStatePass (a);
+  sp->run (p);
+
+  realtime_msec ();
+  ChpSim *sim = new ChpSim (sp, p);
+  sim->setDelay (delay);
+  tm = realtime_msec ();
+  printf ("chpsim: %d process types, %d instances (%.1f ms)\n",
+	  sim->numTypes(), sim->numInst(), tm);
+
+  sim->Start ();
+  if (tmax >= 0) {
+    SimDES::AdvanceTime (tmax);
+  }
+  else {
+    SimDES::Run ();
+  }
+  tm = realtime_msec ();
+
+  printf ("chpsim: time %lu, %lu steps in %.1f ms", SimDES::CurTimeLo(),
+	  sim->numSteps(), tm);
+  if (tm > 0) {
+    printf (" (%.0f steps/s)", sim->numSteps()*1000.0/tm);
+  }
+  printf ("\n");
+
+  if (!SimDES::hasPendingEvent() && sim->numBlocked() > 0) {
+    printf ("chpsim: deadlock, %d blocked thread(s)\n", sim->numBlocked());
+    if (verbose) {
+      sim->printBlocked (stdout);
+    }
+  }
+
+  delete sim;
+  return 0;
+}
@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Throughput of chpsim and prsim on the same token ring (ring.act).
+#
+#   ./run.sh [stages] [time]
+#
+# chpsim runs the CHP ring for <time> units with the default delay of
+# 10 per communication, so the token makes time/10 hops. prsim runs
+# the ring as C-elements for the same time; every hop is two
+# transitions, counted with dumptc. Both report hops per second of
+# wall-clock time, excluding start-up.
+#
+
+ARCH=`$VLSI_TOOLS_SRC/scripts/getarch`
+OS=`$VLSI_TOOLS_SRC/scripts/getos`
+EXT=${ARCH}_${OS}
+CHPSIM=../../chpsim.$EXT
+PRSIM=../../../prsim/prsim.$EXT
+
+N=${1:-16}
+T=${2:-10000000}
+
+if [ ! -x $CHPSIM -o ! -x $PRSIM ]
+then
+	echo "Build chpsim and prsim first."
+	exit 1
+fi
+
+#
+# chpsim: the last line is "chpsim: time <t>, <n> steps in <ms> ms ..."
+#
+$CHPSIM -T $T ring.act "ring<$N>" > ring.chp.out 2>&1
+awk -v d=10 '/^chpsim: time/ {
+	t = $3; sub (",", "", t); ms = $7;
+	printf "chpsim: %d hops in %.1f ms", t/d, ms;
+	if (ms > 0) printf " (%.0f hops/s)", t/d*1000.0/ms;
+	printf "\n"
+}' ring.chp.out
+
+#
+# prsim: the same ring with an active-high reset that puts the token
+# in stage 0
+#
+awk -v n=$N 'BEGIN {
+  for (i=0; i < n; i++) {
+    p = (i+n-1) % n; q = (i+1) % n;
+    if (i == 0) {
+      printf "Reset | \"c[%d]\" & ~\"c[%d]\" -> \"c[%d]\"+\n", p, q, i;
+      printf "~Reset & ~\"c[%d]\" & \"c[%d]\" -> \"c[%d]\"-\n", p, q, i;
+    }
+    else {
+      printf "~Reset & \"c[%d]\" & ~\"c[%d]\" -> \"c[%d]\"+\n", p, q, i;
+      printf "Reset | ~\"c[%d]\" & \"c[%d]\" -> \"c[%d]\"-\n", p, q, i;
+    }
+  }
+}' > ring.prs
+
+printf 'norandom\ninitialize\nset Reset 1\ncycle\nset Reset 0\n' > ring.0.cmd
+printf 'norandom\ninitialize\nset Reset 1\ncycle\nset Reset 0\nadvance %s\ndumptc ring.tc\n' $T > ring.1.cmd
+
+t0=`date +%s%N`
+$PRSIM -r ring.prs < ring.0.cmd > /dev/null 2>&1
+t1=`date +%s%N`
+$PRSIM -r ring.prs < ring.1.cmd > /dev/null 2>&1
+t2=`date +%s%N`
+
+awk -v t0=$t0 -v t1=$t1 -v t2=$t2 '$1 != "Reset" { n += $2 }
+END {
+	ms = ((t2 - t1) - (t1 - t0))/1e6;
+	printf "prsim:  %d hops in %.1f ms", n/2, ms;
+	if (ms > 0) printf " (%.0f hops/s)", n/2*1000.0/ms;
+	printf "\n"
+}' ring.tc
+
+rm -f ring.chp.out ring.prs ring.0.cmd ring.1.cmd ring.tc
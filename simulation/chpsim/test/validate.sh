@@ -0,0 +1,25 @@
+#!/bin/sh
+
+ARCH=`$VLSI_TOOLS_SRC/scripts/getarch`
+OS=`$VLSI_TOOLS_SRC/scripts/getos`
+EXT=${ARCH}_${OS}
+ACTTOOL=../chpsim.$EXT 
+
+if [ $# -eq 0 ]
+then
+	list=*.act
+else
+	list="$@"
+fi
+
+if [ ! -d runs ]
+then
+	mkdir runs
+fi
+
+for i in $list
+do
+	$ACTTOOL -v $i 'test<>' 2> runs/$i.stderr | \
+	  sed -e 's/ ([0-9.]* ms)$//' \
+	      -e 's/^\(chpsim: time [0-9]*\),.*$/\1/' > runs/$i.stdout
+done
@@ -64,6 +64,7 @@ static int TOK_AND, TOK_OR, TOK_NOT, TOK_LPAR, TOK_RPAR,
 
 static void random_init (void);
 static Prs *prs_lex_internal (LEX_T *L, char *names);
+static Prs *prs_bin_internal (FILE *fp, char *names);
 static void process_names_conns (Prs *p);
 
 #define UNSTAB_NODE(p,n) ((n)->unstab || ((p)->flags & PRS_UNSTAB))
@@ -255,6 +256,32 @@ Prs *prs_packfopen (char *s, char *names)
   return p;
 }
 
+/*
+ *
+ *   Read prs from binary netlist "s".prsb with names database "s", as
+ *   written by aflat -b
+ *
+ */
+Prs *prs_binfopen (char *s)
+{
+  Prs *p;
+  FILE *fp;
+  char *t;
+
+  random_init ();
+  MALLOC (t, char, strlen (s) + 6);
+  sprintf (t, "%s.prsb", s);
+  fp = fopen (t, "r");
+  if (!fp) {
+    fatal_error ("Could not open file `%s' for reading", t);
+  }
+  FREE (t);
+  p = prs_bin_internal (fp, s);
+  fclose (fp);
+
+  return p;
+}
+
 /*
  *  1 if it is an identifier token, 0 otherwise
  */
@@ -305,6 +332,34 @@ static char *lex_mustbe_id (Prs *p, LEX_T *l)
   }
 }
 
+/*
+ *  Allocate an empty simulation data structure
+ */
+static Prs *prs_alloc (char *names)
+{
+  Prs *p;
+
+  NEW (p, Prs);
+  p->H = hash_new (128);
+  p->seed = 0;
+  p->flags = 0;
+  if (names) {
+    p->N = names_open (names);
+  }
+  else {
+    p->N = NULL;
+  }
+  p->eventQueue = heap_new (128);
+  p->time = 0;
+  p->ev_list = NULL;
+  p->energy = 0;
+  A_INIT (p->exhi);
+  A_INIT (p->exlo);
+  p->timing = phash_new (4);
+
+  return p;
+}
+
 /*
  *  Parse prs file and return simulation data structure
  */
@@ -335,23 +390,7 @@ static Prs *prs_lex_internal (LEX_T *L, char *names)
 
 #undef __addtok
 
-  NEW (p, Prs);
-  p->H = hash_new (128);
-  p->seed = 0;
-  p->flags = 0;
-  if (names) {
-    p->N = names_open (names);
-  }
-  else {
-    p->N = NULL;
-  }
-  p->eventQueue = heap_new (128);
-  p->time = 0;
-  p->ev_list = NULL;
-  p->energy = 0;
-  A_INIT (p->exhi);
-  A_INIT (p->exlo);
-  p->timing = phash_new (4);
+  p = prs_alloc (names);
 
   lex_getsym (L);
 
@@ -2955,6 +2994,8 @@ static void process_names_conns (Prs *p)
 
 
 static PrsExpr *expr (Prs *p, LEX_T *l);
+static void add_rule (PrsNode *n, PrsExpr *e, int v, int weak, int delay,
+		      int unstab);
 
 
 /*
@@ -2981,34 +3022,31 @@ static void mk_out_link (PrsExpr *e, PrsNode *n)
 
 
 /*
- * Parse excl directives
+ * Add node to an excl ring; the ring points to buckets until it is
+ * canonicalized
  */
-static void parse_excl (LEX_T *l, int ishi, Prs *p)
+static PrsExclRing *excl_ring_add (PrsExclRing *r, PrsNode *n, int ishi)
 {
-  PrsNode *n;
-  PrsExclRing *r, *s;
-
-  lex_mustbe (l, TOK_LPAR);
-
-  r = NULL;
+  PrsExclRing *s;
 
-  do {
-    n = lookup (lex_mustbe_id (p,l), p->H);
-    NEW (s, PrsExclRing);
-    s->n = (PrsNode *)n->b;
-    if (!r) {
-      r = s;
-    }
-    else {
-      s->next = r->next;
-    }
-    r->next = s;
-    if (ishi)
-      n->exclhi = 1;
-    else
-      n->excllo = 1;
-  } while (lex_have (l, TOK_COMMA));
+  NEW (s, PrsExclRing);
+  s->n = (PrsNode *)n->b;
+  if (!r) {
+    r = s;
+  }
+  else {
+    s->next = r->next;
+  }
+  r->next = s;
+  if (ishi)
+    n->exclhi = 1;
+  else
+    n->excllo = 1;
+  return r;
+}
 
+static void excl_ring_done (Prs *p, PrsExclRing *r, int ishi)
+{
   if (ishi) {
     A_NEW (p->exhi, PrsExclRing *);
     A_NEXT (p->exhi) = r;
@@ -3019,6 +3057,26 @@ static void parse_excl (LEX_T *l, int ishi, Prs *p)
     A_NEXT (p->exlo) = r;
     A_INC (p->exlo);
   }
+}
+
+/*
+ * Parse excl directives
+ */
+static void parse_excl (LEX_T *l, int ishi, Prs *p)
+{
+  PrsNode *n;
+  PrsExclRing *r;
+
+  lex_mustbe (l, TOK_LPAR);
+
+  r = NULL;
+
+  do {
+    n = lookup (lex_mustbe_id (p,l), p->H);
+    r = excl_ring_add (r, n, ishi);
+  } while (lex_have (l, TOK_COMMA));
+
+  excl_ring_done (p, r, ishi);
   lex_mustbe (l, TOK_RPAR);
 }
 
@@ -3038,17 +3096,11 @@ static void parse_rand_init (LEX_T *l, Prs *p)
   lex_mustbe (l, TOK_RPAR);
 }
 
-/*
- * Parse timing directives
- */
-static void parse_timing (Prs *p, LEX_T *l)
+static PrsTiming *timing_new (void)
 {
-  PrsNode *n;
   PrsTiming *constraint;
   int i;
 
-  lex_mustbe (l, TOK_LPAR);
-
   NEW (constraint, PrsTiming);
   for (i=0; i < 3; i++) {
     constraint->n[i] = NULL;
@@ -3056,26 +3108,51 @@ static void parse_timing (Prs *p, LEX_T *l)
     constraint->margin = 0;
     constraint->state = PRS_TIMING_INACTIVE;
   }
+  return constraint;
+}
+
+/*
+ * Set node i of a timing constraint, and link the constraint into the
+ * per-node timing list
+ */
+static void timing_add_node (Prs *p, PrsTiming *constraint, int i, PrsNode *n)
+{
+  phash_bucket_t *b;
+
+  constraint->n[i] = n;
+  if ((i < 1 || n != constraint->n[i-1]) &&
+      (i < 2 || n != constraint->n[i-2])) {
+    if (!n->intiming) {
+      n->intiming = 1;
+      b = phash_lookup (p->timing, n);
+      Assert (!b, "intiming flag error");
+      b = phash_add (p->timing, n);
+    }
+    else {
+      b = phash_lookup (p->timing, n);
+      Assert (b, "intiming flag error");
+      constraint->next[i] = (PrsTiming *)b->v;
+    } 
+    b->v = constraint;
+  }
+}
+
+/*
+ * Parse timing directives
+ */
+static void parse_timing (Prs *p, LEX_T *l)
+{
+  PrsNode *n;
+  PrsTiming *constraint;
+  int i;
+
+  lex_mustbe (l, TOK_LPAR);
+
+  constraint = timing_new ();
 
   for (i=0; i < 3; i++) {
-    phash_bucket_t *b;
     n = lookup (lex_mustbe_id (p,l), p->H);
-    constraint->n[i] = n;
-    if ((i < 1 || n != constraint->n[i-1]) &&
-	(i < 2 || n != constraint->n[i-2])) {
-      if (!n->intiming) {
-	n->intiming = 1;
-	b = phash_lookup (p->timing, n);
-	Assert (!b, "intiming flag error");
-	b = phash_add (p->timing, n);
-      }
-      else {
-	b = phash_lookup (p->timing, n);
-	Assert (b, "intiming flag error");
-	constraint->next[i] = (PrsTiming *)b->v;
-      } 
-      b->v = constraint;
-    }
+    timing_add_node (p, constraint, i, n);
     if (lex_have (l, TOK_UP)) {
       constraint->f[i].up = 1;
       constraint->f[i].dn = 0;
@@ -3331,7 +3408,7 @@ static int lex_have_unstab (Prs *p, LEX_T *l)
  */
 static void parse_prs (Prs *p,LEX_T *l)
 {
-  PrsExpr *e, *ne;
+  PrsExpr *e;
   PrsNode *n;
   int v, delay, unstab;
   int weak = G_NORM;
@@ -3356,20 +3433,35 @@ static void parse_prs (Prs *p,LEX_T *l)
   if (!e) return;
   lex_mustbe (l, TOK_ARROW);
   n = lookup(lex_mustbe_id (p,l), p->H);
-  if (unstab) {
-    n->unstab = 1;
-  }
   if (lex_have (l, TOK_UP)) {
-    n->delay_up[weak] = delay;
     v = 1;
   }
   else if (lex_have (l, TOK_DN)) {
-    n->delay_dn[weak] = delay;
     v = 0;
   }
   else {
     fatal_error ("Expected `+' or `-'\n\t%s", lex_errstring (l));
   }
+  add_rule (n, e, v, weak, delay, unstab);
+}
+
+/*
+ *  Add rule e -> n+ (v = 1) or e -> n- (v = 0)
+ */
+static void add_rule (PrsNode *n, PrsExpr *e, int v, int weak, int delay,
+		      int unstab)
+{
+  PrsExpr *ne;
+
+  if (unstab) {
+    n->unstab = 1;
+  }
+  if (v) {
+    n->delay_up[weak] = delay;
+  }
+  else {
+    n->delay_dn[weak] = delay;
+  }
 
   if (v) {
     if (n->up[weak]) {
@@ -3399,6 +3491,235 @@ static void parse_prs (Prs *p,LEX_T *l)
 }
 
 
+/*
+ *
+ *  Binary netlist. The file starts with "PRSB" and a version byte,
+ *  followed by a sequence of records. Node names are indices into the
+ *  names database, and all integers are LEB128-encoded.
+ *
+ *    R <flags> [<after>] <node> <expr>   production rule
+ *    H <n> <node>*n                      exclhi
+ *    L <n> <node>*n                      excllo
+ *    I <n> <node>*n                      rand_init
+ *    T <flags> (<node> <dir>)*3 [<margin>]  timing constraint
+ *
+ *  where <dir> is `+', `-', or `*' for both transitions.
+ *  Expressions are in prefix form: `v' <node>, `~' <expr>, or
+ *  `&'/`|' <n> <expr>*n. Connections are stored as aliases in the
+ *  names database.
+ *
+ */
+#define PRSB_VERSION 1
+
+#define PRSB_RULE_UP     0x01
+#define PRSB_RULE_WEAK   0x02
+#define PRSB_RULE_UNSTAB 0x04
+#define PRSB_RULE_AFTER  0x08
+
+#define PRSB_TIMING_MARGIN 0x01
+
+static unsigned long bin_uint (FILE *fp)
+{
+  unsigned long x;
+  int c, offset;
+
+  x = 0;
+  offset = 0;
+  do {
+    c = getc (fp);
+    if (c == EOF) {
+      fatal_error ("Unexpected end of file in binary netlist");
+    }
+    x |= (unsigned long)(c & 0x7f) << offset;
+    offset += 7;
+  } while (c & 0x80);
+  return x;
+}
+
+static PrsNode *bin_node (Prs *p, FILE *fp, hash_bucket_t **nodes)
+{
+  unsigned long idx;
+
+  idx = bin_uint (fp);
+  if (idx == 0 || idx > p->N->unique_names) {
+    fatal_error ("Invalid node index %lu in binary netlist", idx);
+  }
+  return canonical_name ((PrsNode *)nodes[idx]->v);
+}
+
+/*
+ *  Same expression trees as the ones built by expr()
+ */
+static PrsExpr *bin_expr (Prs *p, FILE *fp, hash_bucket_t **nodes)
+{
+  PrsExpr *e, *ret;
+  unsigned long i, k;
+  int c;
+
+  c = getc (fp);
+  switch (c) {
+  case 'v':
+    ret = newexpr ();
+    ret->type = PRS_VAR;
+    ret->val = PRS_VAL_X;
+    ret->valx = 1;
+    mk_out_link (ret, bin_node (p, fp, nodes));
+    break;
+
+  case '~':
+    ret = newexpr ();
+    ret->type = PRS_NOT;
+    ret->val = PRS_VAL_X;
+    ret->valx = 1;
+    ret->l = bin_expr (p, fp, nodes);
+    ret->l->u = ret;
+    break;
+
+  case '&':
+  case '|':
+    k = bin_uint (fp);
+    if (k < 2) {
+      fatal_error ("Invalid expression in binary netlist");
+    }
+    ret = newexpr ();
+    ret->type = (c == '&' ? PRS_AND : PRS_OR);
+    ret->val = 0;
+    ret->valx = k;
+    ret->l = bin_expr (p, fp, nodes);
+    ret->l->u = ret;
+    e = ret->l;
+    for (i=1; i < k; i++) {
+      e->r = bin_expr (p, fp, nodes);
+      e = e->r;
+      e->u = ret;
+    }
+    break;
+
+  default:
+    fatal_error ("Invalid expression in binary netlist");
+    ret = NULL;
+    break;
+  }
+  return ret;
+}
+
+static Prs *prs_bin_internal (FILE *fp, char *names)
+{
+  Prs *p;
+  PrsNode *n;
+  PrsExpr *e;
+  PrsExclRing *r;
+  PrsTiming *constraint;
+  hash_bucket_t **nodes;
+  char buf[5];
+  IDX_TYPE idx, idx2;
+  unsigned long i, k;
+  int c, flags, delay, weak;
+
+  init_tables ();
+
+  p = prs_alloc (names);
+
+  if (fread (buf, 1, 5, fp) != 5 || strncmp (buf, "PRSB", 4) != 0) {
+    fatal_error ("Binary netlist for `%s': bad header", names);
+  }
+  if (buf[4] != PRSB_VERSION) {
+    fatal_error ("Binary netlist for `%s': version %d, expected %d", names,
+		 buf[4], PRSB_VERSION);
+  }
+
+  /* create all nodes up front; names are unique in the database */
+  MALLOC (nodes, hash_bucket_t *, p->N->unique_names + 1);
+  nodes[0] = NULL;
+  for (idx=1; idx <= p->N->unique_names; idx++) {
+    nodes[idx] = lookup (names_num2name (p->N, idx), p->H)->b;
+  }
+
+  /* connections; same order as process_names_conns() */
+  for (idx=1; idx <= p->N->unique_names; idx++) {
+    idx2 = names_parent (p->N, idx);
+    if (idx2 != 0) {
+      do_connection (p, canonical_name ((PrsNode *)nodes[idx]->v),
+		     canonical_name ((PrsNode *)nodes[idx2]->v));
+    }
+  }
+
+  while ((c = getc (fp)) != EOF) {
+    switch (c) {
+    case 'R':
+      flags = bin_uint (fp);
+      if (flags & PRSB_RULE_WEAK) {
+	weak = G_WEAK;
+	delay = 20;
+      }
+      else {
+	weak = G_NORM;
+	delay = 10;
+      }
+      if (flags & PRSB_RULE_AFTER) {
+	delay = bin_uint (fp);
+      }
+      n = bin_node (p, fp, nodes);
+      e = bin_expr (p, fp, nodes);
+      add_rule (n, e, (flags & PRSB_RULE_UP) ? 1 : 0, weak, delay,
+		(flags & PRSB_RULE_UNSTAB) ? 1 : 0);
+      break;
+
+    case 'H':
+    case 'L':
+      k = bin_uint (fp);
+      r = NULL;
+      for (i=0; i < k; i++) {
+	r = excl_ring_add (r, bin_node (p, fp, nodes), c == 'H');
+      }
+      if (r) {
+	excl_ring_done (p, r, c == 'H');
+      }
+      break;
+
+    case 'I':
+      k = bin_uint (fp);
+      for (i=0; i < k; i++) {
+	bin_node (p, fp, nodes)->rand_init = 1;
+      }
+      break;
+
+    case 'T':
+      flags = bin_uint (fp);
+      constraint = timing_new ();
+      for (i=0; i < 3; i++) {
+	timing_add_node (p, constraint, i, bin_node (p, fp, nodes));
+	c = getc (fp);
+	constraint->f[i].up = (c != '-');
+	constraint->f[i].dn = (c != '+');
+      }
+      if (flags & PRSB_TIMING_MARGIN) {
+	constraint->margin = bin_uint (fp);
+      }
+      if (constraint->n[1] == constraint->n[2]) {
+	fatal_error ("Timing constraint cannot repeat the signal name on the RHS!");
+      }
+      break;
+
+    default:
+      fatal_error ("Binary netlist for `%s': unknown record type 0x%x",
+		   names, c);
+      break;
+    }
+  }
+  FREE (nodes);
+
+  /* sanity check delays */
+  prs_apply (p, p, _check_delays);
+
+  canonicalize_hashtable (p);
+  canonicalize_excllist (p);
+  canonicalize_timing (p);
+
+  return p;
+}
+
+
 /*
  *
  *  Debugging
@@ -255,6 +255,9 @@ Prs *prs_fopen (char *filename);
 Prs *prs_packfopen (char *file, char *names);
 Prs *prs_packfile (FILE *fp, char *names);
 
+/* binary netlist <base>.prsb with names database <base> (aflat -b) */
+Prs *prs_binfopen (char *base);
+
 /* get node corresponding to node name */
 PrsNode *prs_node (Prs *, char *s);
 
@@ -2238,7 +2238,7 @@ int main (int argc, char **argv)
   FILE *fp;
   extern int opterr, optind;
   extern char *optarg;
-  char *names;
+  char *names, *binary;
   int ch;
   char buf[10240];
 
@@ -2248,10 +2248,11 @@ int main (int argc, char **argv)
   LispInit ();
 
   names = NULL;
+  binary = NULL;
   opterr = 0;
   no_readline = 0;
   profile_cmd = 0;
-  while ((ch = getopt (argc, argv, "prn:")) != -1) {
+  while ((ch = getopt (argc, argv, "prn:b:")) != -1) {
     switch (ch) {
     case 'r':
       no_readline = 1;
@@ -2262,12 +2263,19 @@ int main (int argc, char **argv)
     case 'p':
       profile_cmd = 1;
       break;
+    case 'b':
+      binary = Strdup (optarg);
+      break;
     default:
       fatal_error ("getopt() is broken");
       break;
     }
   }
-  if (optind == argc-1) {
+  if (binary && !names && optind == argc) {
+    P = prs_binfopen (binary);
+    fp = stdin;
+  }
+  else if (!binary && optind == argc-1) {
     if (names) {
       P = prs_packfopen (argv[optind],names);
     }
@@ -2276,7 +2284,7 @@ int main (int argc, char **argv)
     }
     fp = stdin;
   }
-  else if (optind == argc) {
+  else if (!binary && optind == argc) {
     if (names) {
       P = prs_packfile (stdin, names);
     }
@@ -2289,6 +2297,7 @@ int main (int argc, char **argv)
     fprintf (stderr, "Usage: %s [options] [prsfile]\n", argv[0]);
     fprintf (stderr, "  -r : no readline\n");
     fprintf (stderr, "  -n names: packed file with names file\n");
+    fprintf (stderr, "  -b base: binary netlist <base>.prsb from aflat -b\n");
     fprintf (stderr, "  -p : profile each prsim command\n");
     exit (1);
   }
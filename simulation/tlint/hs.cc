@@ -26,12 +26,19 @@
 
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <common/misc.h>
 #include <common/array.h>
 #include <common/atrace.h>
+#include <common/mytime.h>
+#include <common/workpool.h>
 
 #define BLOCKHEADERSIZE					4
 
@@ -77,32 +84,105 @@ static void do_swap(char *block, int size, int itemSize)
 }
 
 
+/*
+  The input trace file is mapped into memory; pos is the read
+  position used by the block and line readers below.
+*/
+typedef struct {
+  const char *name;
+  const char *m;
+  size_t sz;
+  size_t pos;
+} hs_input_t;
+
+/*
+  Parsed data: a window of nrows x ncols floats in row-major order,
+  starting at row row0 of the trace. Signal i has its time in column
+  sig[i].tcol and its value in column sig[i].vcol.
+*/
+typedef struct {
+  char *name;
+  int tcol, vcol;
+  name_t *n;
+} hs_sig_t;
+
+/* how the delta-format writer records values */
+#define HS_EMIT_CHANGES  0	/* changes only, skip the first row */
+#define HS_EMIT_CSV      1	/* first row, then changes only */
+#define HS_EMIT_ALL      2	/* everything, with the atrace filter */
+
+typedef struct hs_table {
+  float *v;
+  long vmax;			/* # of floats allocated for v */
+  long row0;			/* first row in the window */
+  long nrows;			/* # of rows in the window */
+  int ncols;
+  int emit;
+  A_DECL (hs_sig_t, sig);
+
+  /*
+    Streamed input: next() parses the rows that follow the current
+    window from position pos of the input into v, and returns the
+    number of rows (0 at the end). When next is NULL, v holds all
+    ntotal rows of the trace and is the only window.
+  */
+  long (*next) (struct hs_table *);
+  void *src;			/* parser state for next() */
+  hs_input_t *f;
+  size_t data;			/* start of the data rows in f */
+  size_t wpos;			/* start of the current window in f */
+  size_t pos;
+  long ntotal;
+} hs_table_t;
+
+static int nthreads = 1;	/* threads for parsing */
+static float node_dt = 0;	/* > 0: node order output with this dt */
+
+/* input bytes parsed by one job in a window of streamed input */
+#define HS_CHUNK_BYTES   (1 << 20)
+
+/* memory for node order blocks per pass over streamed input */
+#define HS_NODE_BYTES    (1 << 26)
+
+/* fgets() on the mapped input */
+static char *mgets (char *buf, int sz, hs_input_t *f)
+{
+  int i;
+
+  if (f->pos >= f->sz) {
+    return NULL;
+  }
+  for (i=0; i < sz-1 && f->pos < f->sz; ) {
+    buf[i++] = f->m[f->pos++];
+    if (buf[i-1] == '\n') break;
+  }
+  buf[i] = '\0';
+  return buf;
+}
+
 /*
 // Read block header. Returns:
 //   -1 ... block header corrupted
 //    0 ... endian swap not performed
 //    1 ... endian swap performed
 // Arguments:
-//   f           ... pointer to file for reading
-//   fileName    ... name of the file
+//   f           ... mapped input file
 //   blockHeader ... array of four integers consisting block header
 //   size        ... size of items in block
 */
-static int readBlockHeader(FILE *f, const char *fileName, int *blockHeader, 
-			   int size)
+static int readBlockHeader(hs_input_t *f, int *blockHeader, int size)
 {
   int swap;
-  int num;
 
   Assert (sizeof (int) == 4, "Fix this please");
 
   /* read the header */
-  num = fread(blockHeader, sizeof(int), BLOCKHEADERSIZE, f);
-
-  if(num != BLOCKHEADERSIZE)  {
+  if (f->pos + BLOCKHEADERSIZE*sizeof (int) > f->sz) {
     /* did not read the header */
     return -1;
   }
+  memcpy (blockHeader, f->m + f->pos, BLOCKHEADERSIZE*sizeof (int));
+  f->pos += BLOCKHEADERSIZE*sizeof (int);
 
   /* Block header check and swap */
   if (blockHeader[0] == 0x00000004 && blockHeader[2] == 0x00000004) {
@@ -128,8 +208,7 @@ static int readBlockHeader(FILE *f, const char *fileName, int *blockHeader,
 //   0 ... reading performed normally
 //   1 ... reading failed
 // Arguments:
-//   f           ... pointer to file for reading
-//   fileName    ... name of the file
+//   f           ... mapped input file
 //   ptr         ... pointer to reserved space for data
 //   offset      ... pointer to reserved space size,
 //                   increased for current block size
@@ -137,15 +216,15 @@ static int readBlockHeader(FILE *f, const char *fileName, int *blockHeader,
 //   numOfItems  ... number of items in block
 //   swap        ... perform endian swap flag
 */
-static int readBlockData(FILE *f, const char *fileName, void *ptr,
-		  int *offset, int itemSize, int numOfItems, int swap)
+static int readBlockData(hs_input_t *f, void *ptr,
+			 int *offset, int itemSize, int numOfItems, int swap)
 {
-  int num = fread(ptr, itemSize, numOfItems, f);
-
-  if(num != numOfItems) {
-    fatal_error ("reading trace file %s: could not read block data", fileName);
+  if (numOfItems < 0 || f->pos + (size_t)itemSize*numOfItems > f->sz) {
+    fatal_error ("reading trace file %s: could not read block data", f->name);
     return 1;
   }
+  memcpy (ptr, f->m + f->pos, (size_t)itemSize*numOfItems);
+  f->pos += (size_t)itemSize*numOfItems;
 
   *offset = *offset + numOfItems;
   if(swap > 0) do_swap((char *)ptr, numOfItems, itemSize); /* endianness */
@@ -158,24 +237,24 @@ static int readBlockData(FILE *f, const char *fileName, void *ptr,
 //   0 ... reading performed normally
 
 // Arguments:
-//   f           ... pointer to file for reading
-//   fileName    ... name of the file
+//   f           ... mapped input file
 //   swap        ... perform endian swap flag
 //   header      ... block size from header
 */
-static int readBlockTrailer(FILE *f, const char *fileName, int swap, int header)
+static int readBlockTrailer(hs_input_t *f, int swap, int header)
 {
-  int trailer, num;
-  num = fread(&trailer, sizeof(int), 1, f);
-  if(num != 1) {
-    fatal_error ("reading trace file %s: could not read trailer", fileName);
+  int trailer;
+  if (f->pos + sizeof (int) > f->sz) {
+    fatal_error ("reading trace file %s: could not read trailer", f->name);
   }
+  memcpy (&trailer, f->m + f->pos, sizeof (int));
+  f->pos += sizeof (int);
 
   if(swap > 0) do_swap((char *)(&trailer), 1, sizeof(int));
 
   /* Block header and trailer match check. */
   if(header != trailer) {
-    fatal_error ("reading trace file %s: inconsistent trailer");
+    fatal_error ("reading trace file %s: inconsistent trailer", f->name);
   }
   return 0;
 }
@@ -186,21 +265,18 @@ static int readBlockTrailer(FILE *f, const char *fileName, int swap, int header)
 //    0 ... there is at least one more block left
 //    1 ... error occured during reading the block
 // Arguments:
-//   f         ... pointer to file for reading
-//   debugMode ... debug messages flag
-//   fileName  ... name of the file
+//   f         ... mapped input file
 //   buf       ... pointer to header buffer,
 //                 enlarged (reallocated) for current block
 //   bufOffset ... pointer to buffer size, increased for current block
 // size
 */
-static int readHeaderBlock(FILE *f, const char *fileName, char **buf,
-					int *bufOffset)
+static int readHeaderBlock(hs_input_t *f, char **buf, int *bufOffset)
 {
   int error, blockHeader[BLOCKHEADERSIZE], swap;
 
   /* Get size of file header block */
-  swap = readBlockHeader(f, fileName, blockHeader, sizeof(char));
+  swap = readBlockHeader(f, blockHeader, sizeof(char));
   if(swap < 0) {
     /* error */
     return 1;
@@ -210,13 +286,13 @@ static int readHeaderBlock(FILE *f, const char *fileName, char **buf,
   REALLOC (*buf, char, (*bufOffset + blockHeader[0] + 1));
 
   /* read data */
-  error = readBlockData(f, fileName, *buf + *bufOffset, bufOffset,
+  error = readBlockData(f, *buf + *bufOffset, bufOffset,
 			sizeof(char), blockHeader[0], swap /* XXX: was 0 */);
   if(error == 1) return 1;	/* Error. */
   (*buf)[*bufOffset] = 0;
 
   /* Read trailer of file header block. */
-  error = readBlockTrailer(f, fileName, swap, blockHeader[BLOCKHEADERSIZE - 1]);
+  error = readBlockTrailer(f, swap, blockHeader[BLOCKHEADERSIZE - 1]);
   if(error == 1) return 1;	/* Error. */
 
   if(strstr(*buf, "$&%#")) return -1;	/* End of block. */
@@ -283,129 +359,366 @@ int getSweepInfo(int debugMode, PyObject **sweep, char *buf, int *sweepSize,
 
 
 /*
-// Read one data block. Returns:
-//   -1 ... this was the last block
-//    0 ... there is at least one more block left
-//    1 ... error occured during reading the block
-// Arguments:
-//   f             ... pointer to file for reading
-//   debugMode     ... debug messages flag
-//   fileName      ... name of the file
-//   rawData       ... pointer to data array,
-//                     enlarged (reallocated) for current block
-//   rawDataOffset ... pointer to data array size, increased for
-// current block size
+  A raw data block: n floats at file offset off, that go to position
+  pos in the table.
 */
-int readDataBlock(FILE *f, const char *fileName, float **rawData,
-		  int *rawDataOffset)
+typedef struct {
+  size_t off;
+  long pos;
+  int n;
+  int swap;
+} hs_block_t;
+
+struct blkcopy {
+  hs_input_t *f;
+  hs_block_t *blk;
+  int nblk;
+  int njobs;
+  float *v;
+};
+
+static void blkcopy_job (void *cookie, int job, int tid)
 {
-  int error, blockHeader[BLOCKHEADERSIZE], swap;
+  struct blkcopy *c = (struct blkcopy *) cookie;
+  int i, start, end;
 
-  /* Get size of raw data block. */
-  swap = readBlockHeader(f, fileName, blockHeader, sizeof(float));
-  if(swap < 0) return 1;	/* Error. */
+  start = (long)c->nblk*job/c->njobs;
+  end = (long)c->nblk*(job+1)/c->njobs;
 
-  /* Allocate space for raw data. */
-  if (!*rawData) {
-    MALLOC (*rawData, float, blockHeader[0]);
-  }
-  else {
-    REALLOC (*rawData, float, *rawDataOffset + blockHeader[0]);
+  for (i=start; i < end; i++) {
+    hs_block_t *b = &c->blk[i];
+    memcpy (c->v + b->pos, c->f->m + b->off, sizeof (float)*b->n);
+    if (b->swap) {
+      do_swap ((char *)(c->v + b->pos), b->n, sizeof (float));
+    }
   }
+}
 
-  /* Read raw data block. */
-  error = readBlockData(f, fileName, *rawData + *rawDataOffset,
-			rawDataOffset, sizeof(float), blockHeader[0], swap);
+/*
+// Read the raw data blocks into one array. The block structure is
+// scanned first, and the blocks are then copied (and endian swapped)
+// in parallel.
+// Arguments:
+//   f              ... mapped input file
+//   rawDataOffset  ... set to the total number of items read
+*/
+static float *readDataBlocks(hs_input_t *f, long *rawDataOffset)
+{
+  int blockHeader[BLOCKHEADERSIZE], swap;
+  A_DECL (hs_block_t, blk);
+  long total = 0;
+  float last = 0;
+  struct blkcopy c;
 
-  if(error == 1) return 1;	/* Error.*/
+  A_INIT (blk);
+  blk = NULL;
 
-  /* Read trailer of file header block. */
-  error = readBlockTrailer(f, fileName, swap, blockHeader[BLOCKHEADERSIZE - 1]);
-  if(error == 1) return 1;	/* Error.*/
+  do {
+    /* Get size of raw data block. */
+    swap = readBlockHeader(f, blockHeader, sizeof(float));
+    if (swap < 0) {
+      fatal_error ("Could not read data from trace file %s", f->name);
+    }
+    if (blockHeader[0] < 0 ||
+	f->pos + sizeof (float)*blockHeader[0] > f->sz) {
+      fatal_error ("reading trace file %s: could not read block data", f->name);
+    }
 
-  if((*rawData)[*rawDataOffset - 1] > 9e29) return -1;	/* End of
-							   block. */
+    A_NEW (blk, hs_block_t);
+    A_NEXT (blk).off = f->pos;
+    A_NEXT (blk).pos = total;
+    A_NEXT (blk).n = blockHeader[0];
+    A_NEXT (blk).swap = swap;
+    A_INC (blk);
+
+    if (blockHeader[0] > 0) {
+      memcpy (&last, f->m + f->pos + sizeof (float)*(blockHeader[0]-1),
+	      sizeof (float));
+      if (swap) do_swap ((char *)&last, 1, sizeof (float));
+    }
+    total += blockHeader[0];
+    f->pos += sizeof (float)*blockHeader[0];
+
+    /* Read trailer of data block. */
+    readBlockTrailer(f, swap, blockHeader[BLOCKHEADERSIZE - 1]);
+  } while (last <= 9e29 && f->pos < f->sz); /* End of block or file. */
+
+  MALLOC (c.v, float, total + 1);
+  c.f = f;
+  c.blk = blk;
+  c.nblk = A_LEN (blk);
+  c.njobs = (nthreads > 1) ? 16*nthreads : 1;
+  if (c.njobs > c.nblk) {
+    c.njobs = c.nblk;
+  }
+  workpool_run (nthreads, c.njobs, blkcopy_job, &c);
 
-  error = getc (f);
-  ungetc(error, f);
+  A_FREE (blk);
+  *rawDataOffset = total;
+  return c.v;
+}
 
-  if (feof (f)) 
-    return -1;
 
-  return 0;	/* There is more. */
+/*
+  Row windows. table_rewind() goes back to the start of the trace,
+  and table_next() moves on to the next window; it returns the number
+  of rows in it, 0 at the end of the trace.
+*/
+static void table_rewind (hs_table_t *T)
+{
+  T->row0 = 0;
+  T->nrows = 0;
+  T->pos = T->data;
+  T->wpos = T->data;
+}
+
+static long table_next (hs_table_t *T)
+{
+  T->row0 += T->nrows;
+  if (T->next) {
+    /* drop the input pages of the previous window from the mapping */
+    size_t pg = sysconf (_SC_PAGESIZE);
+    size_t lo = T->wpos & ~(pg-1);
+    size_t hi = T->pos & ~(pg-1);
+    if (hi > lo) {
+      madvise ((void *)(T->f->m + lo), hi - lo, MADV_DONTNEED);
+    }
+    T->wpos = T->pos;
+    T->nrows = (*T->next) (T);
+  }
+  else {
+    T->nrows = (T->row0 == 0) ? T->ntotal : 0;
+  }
+  return T->nrows;
+}
+
+/* make room for n rows in the window buffer */
+static void table_reserve (hs_table_t *T, long n)
+{
+  if (n*T->ncols + 1 > T->vmax) {
+    T->vmax = n*T->ncols + 1;
+    REALLOC (T->v, float, T->vmax);
+  }
 }
 
 /*
-// Convert one table to an atrace file
-// Arguments:
-//   A              ... atrace output file
-//   f              ... pointer to file for reading
-//   fileName       ... name of the file
-//   numOfVariables ... number of variables in table
-//   type           ... type of variables with exeption of scale 
-//   numOfVectors   ... number of variables and probes in table
-//   scale          ... scale name
-//   names           ... array of vector names
+  Create the atrace nodes for all signals
+*/
+static void create_nodes (atrace *A, hs_table_t *T)
+{
+  int i;
+  for (i=0; i < A_LEN (T->sig); i++) {
+    T->sig[i].n = atrace_create_node (A, T->sig[i].name);
+    atrace_mk_analog (T->sig[i].n);
+  }
+}
+
+/*
+  Write the trace out in delta format, one change at a time
 */
-void convTable(atrace *A, FILE *f, const char *fileName,
-	      int numOfVariables, int type, int numOfVectors,
-	       char *scale, name_t **names)
+static void write_delta (hs_table_t *T, const char *output)
 {
-  int i, j, num, offset = 0, numOfColumns = numOfVectors;
-  float *rawDataPos, *rawData = NULL;
+  atrace *A;
+  long i, step;
+  int j;
   float prevtm;
 
-  /* Read raw data blocks. */
+  A = atrace_create (output, ATRACE_DELTA, 1e-9 /* 10ns */ , 1e-12 /* dt */);
+  if (!A) {
+    fatal_error ("Could not create trace file `%s'", output);
+  }
+  if (T->emit == HS_EMIT_ALL) {
+    atrace_filter (A, 0.01, 0.01); /* 1% change, 10mV change */
+  }
+  create_nodes (A, T);
 
-  /*printf ("Raw data blocks begin at: %lu\n", ftell(f));*/
+  prevtm = -1;
+  table_rewind (T);
+  while (table_next (T) > 0) {
+    for (i=0; i < T->nrows; i++) {
+      float *row = T->v + i*T->ncols;
+
+      step = T->row0 + i;
+      if (T->emit == HS_EMIT_CHANGES) {
+	if ((step > 0) && (row[0] < prevtm)) {
+	  warning("[step=%ld] Current time: %g; previous time: %g; time moving backward?", step, (double)row[0], (double)prevtm);
+	}
+	prevtm = row[0];
+      }
+      for (j=0; j < A_LEN (T->sig); j++) {
+	hs_sig_t *s = &T->sig[j];
+	float t = row[s->tcol];
+	float v = row[s->vcol];
+
+	switch (T->emit) {
+	case HS_EMIT_CHANGES:
+	  if (step > 0 && (fabs(ATRACE_NODE_FLOATVAL (s->n) - v) >= 1e-6)) {
+	    atrace_signal_change (A, s->n, t, v);
+	  }
+	  break;
+	case HS_EMIT_CSV:
+	  if (step == 0 || (fabs(ATRACE_NODE_FLOATVAL (s->n) - v) >= 1e-6)) {
+	    atrace_signal_change (A, s->n, t, v);
+	  }
+	  break;
+	default:
+	  atrace_signal_change (A, s->n, t, v);
+	  break;
+	}
+      }
+    }
+  }
+  atrace_close (A);
+}
 
-  do {
-    num = readDataBlock(f, fileName, &rawData, &offset);
-  } while (num == 0);
+struct resample {
+  hs_table_t *T;
+  int *sigmap;			/* node index -> signal */
+  int first;			/* first node index in this batch */
+  int nsteps;
+  float dt;
+  float *buf;
+  float *cur;			/* per node in the batch: held value */
+  int *k;			/* ... and next step to fill */
+};
 
-  if(num > 0) {
-    fatal_error ("Could not read data from trace file %s", fileName);
+/*
+  Sample-and-hold the signal onto the time grid, using the same
+  rounding of times to steps as the atrace library. Called once per
+  window; the held value and step carry over to the next window.
+*/
+static void resample_job (void *cookie, int job, int tid)
+{
+  struct resample *r = (struct resample *) cookie;
+  hs_table_t *T = r->T;
+  hs_sig_t *s = &T->sig[r->sigmap[r->first + job]];
+  float *out = r->buf + (long)job*r->nsteps;
+  float cur;
+  long i;
+  int k, step;
+
+  if (T->row0 == 0) {
+    r->cur[job] = T->v[s->vcol];
   }
-
-  /* Increase number of columns if variables with exeption of scale
-     are complex. */
-  if(type == complex_var) {
-    fatal_error ("Can't handle complex variables");
+  cur = r->cur[job];
+  k = r->k[job];
+  for (i=0; i < T->nrows && k < r->nsteps; i++) {
+    float *row = T->v + i*T->ncols;
+    step = (int) ((row[s->tcol] + r->dt*0.01)/r->dt);
+    if (step > r->nsteps) {
+      step = r->nsteps;
+    }
+    while (k < step) {
+      out[k++] = cur;
+    }
+    cur = row[s->vcol];
   }
+  r->cur[job] = cur;
+  r->k[job] = k;
+}
 
-  rawDataPos = rawData;
-  num = (offset - 1) / numOfColumns;	/* Number of rows. */
+/*
+  Write the trace out in node order format: each node is resampled
+  onto the node_dt grid in parallel, and written out as one block.
+  Nodes are resampled in batches, with one pass over the trace per
+  batch; for streamed input the batch is as large as HS_NODE_BYTES
+  of output allows, to keep the number of passes down.
+*/
+static void write_nodeorder (hs_table_t *T, const char *output)
+{
+  atrace *A;
+  float tmax;
+  long i;
+  int j, k, nnodes;
+  size_t batch;
+  struct resample r;
+
+  tmax = 0;
+  table_rewind (T);
+  while (table_next (T) > 0) {
+    for (i=0; i < T->nrows; i++) {
+      for (j=0; j < A_LEN (T->sig); j++) {
+	float t = T->v[i*T->ncols + T->sig[j].tcol];
+	if (t > tmax) {
+	  tmax = t;
+	}
+      }
+    }
+  }
 
-#if 0
-  printf ("   steps: %d\n", num);
-#endif
+  A = atrace_create (output, ATRACE_NODE_ORDER, tmax, node_dt);
+  if (!A) {
+    fatal_error ("Could not create trace file `%s'", output);
+  }
+  create_nodes (A, T);
+  if (A->Nnodes < 2) {
+    fatal_error ("No signals in trace file");
+  }
+  if (sizeof (float)*(4 + (double)A->Nnodes*A->Nsteps) >
+      ATRACE_MAX_FILE_SIZE) {
+    fatal_error ("Node order trace with %d nodes x %d steps exceeds 2GB; use a larger time step", A->Nnodes, A->Nsteps);
+  }
 
-  prevtm = -1;
-  for(i = 0; i < num; i++) {
-    float tm;
+  nnodes = atrace_nodeorder_begin (A);
 
-    tm = *rawDataPos;
+  MALLOC (r.sigmap, int, nnodes);
+  for (j=0; j < nnodes; j++) {
+    r.sigmap[j] = -1;
+  }
+  for (j=A_LEN (T->sig)-1; j >= 0; j--) {
+    r.sigmap[T->sig[j].n->idx] = j;
+  }
 
-    if ((i > 0) && (tm < prevtm)) {
-      warning("[step=%d] Current time: %g; previous time: %g; time moving backward?", i, (double)tm, (double)prevtm);
+  batch = 8*nthreads;
+  if (T->next && batch < HS_NODE_BYTES/(sizeof (float)*A->Nsteps)) {
+    batch = HS_NODE_BYTES/(sizeof (float)*A->Nsteps);
+  }
+  if (batch > (size_t)(nnodes-1)) {
+    batch = nnodes-1;
+  }
+  r.T = T;
+  r.nsteps = A->Nsteps;
+  r.dt = node_dt;
+  MALLOC (r.buf, float, (long)batch*r.nsteps);
+  MALLOC (r.cur, float, batch);
+  MALLOC (r.k, int, batch);
+
+  for (r.first=1; r.first < nnodes; r.first += batch) {
+    int cnt = nnodes - r.first;
+    if ((size_t)cnt > batch) {
+      cnt = batch;
     }
-
-    rawDataPos++;
-    for(j = 0; j < numOfVectors-1; j++) {
-      if (names[j]) {
-	if (i > 0 && (fabs(ATRACE_NODE_FLOATVAL (names[j])-*rawDataPos) >= 1e-6)) {
-	  atrace_signal_change (A, names[j], tm, *rawDataPos);
-	}
+    for (j=0; j < cnt; j++) {
+      r.cur[j] = 0;
+      r.k[j] = 0;
+    }
+    table_rewind (T);
+    while (table_next (T) > 0) {
+      workpool_run (nthreads, cnt, resample_job, &r);
+    }
+    for (j=0; j < cnt; j++) {
+      float *out = r.buf + (long)j*r.nsteps;
+      for (k=r.k[j]; k < r.nsteps; k++) {
+	out[k] = r.cur[j];
       }
-      rawDataPos++;
+      atrace_nodeorder_block (A, r.first + j, out);
     }
-    prevtm = tm;
   }
-  //printf ("left = %d\n", (int) ((unsigned long
-  //long)sizeof(float)*offset - (unsigned long long)rawDataPos  +
-  //(unsigned long long)rawData));
-  free (rawData);
-  rawData = NULL;
+  FREE (r.buf);
+  FREE (r.cur);
+  FREE (r.k);
+  FREE (r.sigmap);
+  atrace_close (A);
+}
+
+static void write_table (hs_table_t *T, const char *output)
+{
+  if (node_dt > 0) {
+    write_nodeorder (T, output);
+  }
+  else {
+    write_delta (T, output);
+  }
 }
 
 /*
@@ -471,172 +784,308 @@ static char *name_convert (char *signal)
   return s;
 }
 
-void csv_convert (FILE *fp, const char *output)
+static void add_signal (hs_table_t *T, char *name, int tcol, int vcol)
 {
-  atrace *A;
-  char *buf;
-  int sz = 10;
-  int first = 1;
-  A_DECL (name_t *, names);
-  char *tok;
-
-  MALLOC (buf, char, sz);
-  buf[sz-1] = '\0';
-
-  A_INIT (names);
+  A_NEW (T->sig, hs_sig_t);
+  A_NEXT (T->sig).name = name;
+  A_NEXT (T->sig).tcol = tcol;
+  A_NEXT (T->sig).vcol = vcol;
+  A_NEXT (T->sig).n = NULL;
+  A_INC (T->sig);
+}
 
-  while (fgets (buf, sz, fp)) {
-    /* resize buffer if we didn't get the entire line */
-    while (buf[strlen(buf)-1] != '\n') {
-      int newsz = sz*2;
+/*
+  Next value on a CSV line, in the same way as strtok() + atof() on
+  ",\n" separated tokens. Returns 0 at the end of the line.
+*/
+static int csv_next (const char **s, float *v)
+{
+  const char *p = *s;
+  char *e;
 
-      REALLOC (buf, char, newsz);
-      buf[newsz-1] = '\0';
-      Assert (fgets (buf+sz-1, sz+1, fp), "EOF without end of line?");
-      sz = newsz;
+  while (*p == ',') p++;
+  if (*p == '\n') {
+    *s = p;
+    return 0;
+  }
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p == ',' || *p == '\n') {
+    /* blank token */
+    *v = 0;
+  }
+  else {
+    *v = strtod (p, &e);
+    if (e == p) {
+      *v = 0;
     }
-    if (first == 1) {
-      /* get names */
-
-      A = atrace_create (output, ATRACE_DELTA, 1e-9 /* 10ns */ , 1e-12 /* dt */);
+    else {
+      p = e;
+    }
+  }
+  while (*p != ',' && *p != '\n') p++;
+  *s = p;
+  return 1;
+}
 
-      tok = strtok (buf, ",\n");
+struct csvparse {
+  hs_input_t *f;
+  hs_table_t *T;
+  int njobs;
+  size_t *start;		/* chunk boundaries, njobs+1 */
+  long *rows;			/* first row of each chunk, njobs+1 */
+};
 
-      while (tok) {
-	char *nm, *tmp;
-	int l;
-	nm = Strdup (tok);
-	
-	l = strlen (nm);
-	
-	tok = strtok (NULL, ",\n");
+static void csv_count_job (void *cookie, int job, int tid)
+{
+  struct csvparse *c = (struct csvparse *) cookie;
+  const char *p = c->f->m + c->start[job];
+  const char *end = c->f->m + c->start[job+1];
+  long n = 0;
+
+  while (p < end && (p = (const char *) memchr (p, '\n', end - p))) {
+    n++;
+    p++;
+  }
+  c->rows[job+1] = n;
+}
 
-	if (strlen (tok) != l) {
-	  printf ("[%s] [%s]\n", nm, tok);
-	  fatal_error ("Assumed that names were `name X' `name Y' pairs\n");
-	}
-	
-	if (l < 2 || nm[l-2] != ' ' || nm[l-1] != 'X' || tok[l-2] != ' ' || tok[l-1] != 'Y') {
-	  printf ("[%s] [%s]\n", nm, tok);
-	  fatal_error ("Names must be [<foo> X] and [<foo> Y]\n");
-	}
-	nm[l-2] = '\0';
-	tmp = name_convert (nm);
-	free (nm);
-	nm = tmp;
+static void csv_parse_job (void *cookie, int job, int tid)
+{
+  struct csvparse *c = (struct csvparse *) cookie;
+  hs_table_t *T = c->T;
+  const char *p = c->f->m + c->start[job];
+  long r;
+  int i;
+  float v;
+
+  for (r = c->rows[job]; r < c->rows[job+1]; r++) {
+    float *row = T->v + r*T->ncols;
+    i = 0;
+    while (csv_next (&p, &v)) {
+      if (i >= T->ncols) {
+	fatal_error ("Too much data on line %ld\n", T->row0+r+2);
+      }
+      row[i++] = v;
+      if (!csv_next (&p, &v)) {
+	fatal_error ("Missing data on line %ld\n", T->row0+r+2);
+      }
+      row[i++] = v;
+    }
+    if (i != T->ncols) {
+      fatal_error ("Missing data from line %ld\n", T->row0+r+2);
+    }
+    p++;
+  }
+}
 
-	A_NEW (names, name_t *);
-	A_NEXT (names) = atrace_create_node (A, nm);
-	A_INC (names);
+/*
+  Parse the next window of CSV lines: njobs chunks of about
+  HS_CHUNK_BYTES each, split at line boundaries. Lines are counted
+  per chunk, and the chunks are then parsed in parallel.
+*/
+static long csv_window (hs_table_t *T)
+{
+  struct csvparse *c = (struct csvparse *) T->src;
+  hs_input_t *f = T->f;
+  const char *nl;
+  int i;
 
-	free (nm);
-	tok = strtok (NULL, ",\n");
-      }
+  if (T->pos >= f->sz) {
+    return 0;
+  }
+  c->start[0] = T->pos;
+  for (i=1; i <= c->njobs; i++) {
+    size_t pos = c->start[i-1] + HS_CHUNK_BYTES;
+    if (pos >= f->sz) {
+      pos = f->sz;
     }
     else {
-      int i;
+      nl = (const char *) memchr (f->m + pos, '\n', f->sz - pos);
+      pos = nl - f->m + 1;
+    }
+    c->start[i] = pos;
+  }
+  T->pos = c->start[c->njobs];
 
-      tok = strtok (buf, ",\n");
+  c->rows[0] = 0;
+  workpool_run (nthreads, c->njobs, csv_count_job, c);
+  for (i=0; i < c->njobs; i++) {
+    c->rows[i+1] += c->rows[i];
+  }
+  table_reserve (T, c->rows[c->njobs]);
+  workpool_run (nthreads, c->njobs, csv_parse_job, c);
+  return c->rows[c->njobs];
+}
 
-      i = 0;
-      while (tok) {
-	float t, v; 
-	/* t,v pair */
+/*
+  CSV file with a header line of "<name> X,<name> Y" pairs, followed
+  by one line of time,value pairs per step. The data lines are parsed
+  and written out one window at a time.
+*/
+static void csv_convert (hs_input_t *f, hs_table_t *T, const char *output)
+{
+  const char *nl;
+  char *buf, *tok;
+  size_t len;
+  struct csvparse c;
 
-	if (i >= A_LEN (names)) {
-	  fatal_error ("Too much data on line %d\n", first);
-	}
+  if (f->m[f->sz-1] != '\n') {
+    fatal_error ("EOF without end of line?");
+  }
+  nl = (const char *) memchr (f->m, '\n', f->sz);
+  len = nl - f->m + 1;
+  MALLOC (buf, char, len + 1);
+  memcpy (buf, f->m, len);
+  buf[len] = '\0';
+
+  /* get names */
+  tok = strtok (buf, ",\n");
+  while (tok) {
+    char *nm, *tmp;
+    int l;
+    nm = Strdup (tok);
+
+    l = strlen (nm);
+
+    tok = strtok (NULL, ",\n");
+
+    if (!tok || strlen (tok) != (size_t)l) {
+      printf ("[%s] [%s]\n", nm, tok ? tok : "");
+      fatal_error ("Assumed that names were `name X' `name Y' pairs\n");
+    }
 
-	t = atof (tok);
-	tok = strtok (NULL, ",\n");
-	if (!tok) {
-	  fatal_error ("Missing data on line %d\n", first);
-	}
-	v = atof (tok);
+    if (l < 2 || nm[l-2] != ' ' || nm[l-1] != 'X' || tok[l-2] != ' ' || tok[l-1] != 'Y') {
+      printf ("[%s] [%s]\n", nm, tok);
+      fatal_error ("Names must be [<foo> X] and [<foo> Y]\n");
+    }
+    nm[l-2] = '\0';
+    tmp = name_convert (nm);
+    free (nm);
 
-	if (first < 2 || (fabs(ATRACE_NODE_FLOATVAL (names[i]) - v) >= 1e-6)) {
-	  atrace_signal_change (A, names[i], t, v);
-	}
-	tok = strtok (NULL, ",\n");
-	i++;
-      }
-      if (i != A_LEN (names)) {
-	fatal_error ("Missing data from line %d\n", first);
+    add_signal (T, tmp, 2*A_LEN (T->sig), 2*A_LEN (T->sig)+1);
+    tok = strtok (NULL, ",\n");
+  }
+  FREE (buf);
+  T->ncols = 2*A_LEN (T->sig);
+  T->emit = HS_EMIT_CSV;
+
+  c.f = f;
+  c.T = T;
+  c.njobs = (nthreads > 1) ? 4*nthreads : 1;
+  MALLOC (c.start, size_t, c.njobs+1);
+  MALLOC (c.rows, long, c.njobs+1);
+
+  T->f = f;
+  T->data = len;
+  T->next = csv_window;
+  T->src = &c;
+  write_table (T, output);
+
+  FREE (c.start);
+  FREE (c.rows);
+}
+
+struct rawconv {
+  const char *data;
+  hs_table_t *T;
+  int nvars;
+  int *col;			/* input variable -> column, or -1 */
+  long nrows;			/* rows in the input */
+  long wrows;			/* rows per window */
+  long n;			/* rows in the current window */
+  int njobs;
+};
+
+static void raw_conv_job (void *cookie, int job, int tid)
+{
+  struct rawconv *c = (struct rawconv *) cookie;
+  hs_table_t *T = c->T;
+  long r, start, end;
+  int i;
+  double d;
+
+  start = c->n*job/c->njobs;
+  end = c->n*(job+1)/c->njobs;
+
+  for (r=start; r < end; r++) {
+    const char *src = c->data + r*c->nvars*sizeof (double);
+    float *row = T->v + r*T->ncols;
+    for (i=0; i < c->nvars; i++) {
+      if (c->col[i] >= 0) {
+	memcpy (&d, src + i*sizeof (double), sizeof (double));
+	row[c->col[i]] = d;
       }
     }
-    first++;
   }
+}
 
-  free (buf);
+/*
+  Convert the next window of binary rows from double in parallel
+*/
+static long raw_window (hs_table_t *T)
+{
+  struct rawconv *c = (struct rawconv *) T->src;
 
-  if (first > 1) {
-    atrace_close (A);
+  c->n = c->nrows - T->row0;
+  if (c->n > c->wrows) {
+    c->n = c->wrows;
   }
-  exit (0);
+  if (c->n <= 0) {
+    return 0;
+  }
+  table_reserve (T, c->n);
+  c->data = T->f->m + T->pos;
+  c->njobs = (nthreads > 1) ? 4*nthreads : 1;
+  if (c->njobs > c->n) {
+    c->njobs = c->n;
+  }
+  workpool_run (nthreads, c->njobs, raw_conv_job, c);
+  T->pos += c->n*c->nvars*sizeof (double);
+  return c->n;
 }
 
-void raw_convert (FILE *fp, const char *output)
+/*
+  Spice raw file with binary data
+*/
+static void raw_convert (hs_input_t *f, hs_table_t *T, const char *output)
 {
-  atrace *A;
   char *buf;
   int sz = 10240;
-  int lineno = 0;
-  A_DECL (name_t *, names);
   char *tok;
   int nvars;
-  int i;
-  double *vals;
-  A_DECL (int, skipvars);
+  int i, line;
+  size_t rest;
+  struct rawconv c;
 
   MALLOC (buf, char, sz);
   buf[sz-1] = '\0';
-
-  A_INIT (names);
-  A_INIT (skipvars);
-
   buf[0] = '\0';
-  buf[sz-1] = '\0';
 
-  /* line 1 */
-  fgets (buf, sz, fp);
-  Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
-  /* line 2 */
-  fgets (buf, sz, fp);
-  Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
-  /* line 3 */
-  fgets (buf, sz, fp);
-  Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
-  /* line 4 */
-  fgets (buf, sz, fp);
-  Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
-  /* line 5 */
-  fgets (buf, sz, fp);
-  Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
-  tok = strtok (buf, " ");
-  tok = strtok (NULL, " ");
-  tok = strtok (NULL, " ");
-  Assert (tok, "Hmm");
-  nvars = atoi (tok);
-
-  /* line 6 */
-  fgets (buf, sz, fp);
-  Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
-  /* line 7 */
-  fgets (buf, sz, fp);
-  Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
+  /* lines 1 .. 7; the # of variables is on line 5 */
+  nvars = 0;
+  for (line=1; line <= 7; line++) {
+    Assert (mgets (buf, sz, f), "Hmm");
+    Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
+    if (line == 5) {
+      tok = strtok (buf, " ");
+      tok = strtok (NULL, " ");
+      tok = strtok (NULL, " ");
+      Assert (tok, "Hmm");
+      nvars = atoi (tok);
+    }
+  }
+  Assert (nvars > 0, "Hmm");
 
   /* now read the variables */
-  A = atrace_create (output, ATRACE_DELTA, 1e-9 /* 10ns */ , 1e-12 /* dt */);
-
-  atrace_filter (A, 0.01, 0.01); /* 1% change, 10mV change */
-  
+  MALLOC (c.col, int, nvars);
+  T->ncols = 1;
   for (i=0; i < nvars; i++) {
     /* first line must be time */
-    Assert (fgets (buf, sz, fp), "Hmm...");
+    Assert (mgets (buf, sz, f), "Hmm...");
     Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
 
     tok = strtok (buf, " \t");
- 
+
     Assert (atoi(tok) == i, "Hmm");
     tok = strtok (NULL, " \t");
 
@@ -644,65 +1093,55 @@ void raw_convert (FILE *fp, const char *output)
       if (strcasecmp (tok, "time") != 0) {
 	fatal_error ("Variable 0 should be time!\n");
       }
-      A_NEW (skipvars, int);
-      A_NEXT (skipvars) = 0;
+      c.col[i] = 0;
     }
     else {
-      char *nm, *tmp;
+      char *nm;
       nm = Strdup (tok);
 
-      A_NEW (skipvars, int);
-
       tok = strtok (NULL, " \t\n");
       if (strcmp (tok, "voltage") != 0) {
-	A_NEXT (skipvars) = 1;
 	/* skipping non-voltage variable */
+	c.col[i] = -1;
       }
       else {
-	A_NEXT (skipvars) = 0;
-      }
-      
-      if (A_NEXT (skipvars) == 0) {
-	tmp = name_convert (nm);
-	A_NEW (names, name_t *);
-	A_NEXT (names) = atrace_create_node (A, tmp);
-	A_INC (names);
-	FREE (nm);
+	c.col[i] = T->ncols++;
+	add_signal (T, name_convert (nm), 0, c.col[i]);
       }
+      FREE (nm);
     }
-    A_INC (skipvars);
   }
 
-  fgets (buf, sz, fp);
+  Assert (mgets (buf, sz, f), "Hmm");
   Assert (buf[sz-1] == '\0' && buf[strlen (buf)-1] == '\n', "Hmm");
   if (strcmp (buf, "Binary:\n") != 0) {
     fatal_error ("Expecting `Binary:'");
   }
-  /* now read the file! */
+  FREE (buf);
 
-  MALLOC (vals, double, nvars);
-
-  while (!feof (fp)) {
-    int x;
-    int j;
+  /* now read the file, one window at a time */
+  rest = f->sz - f->pos;
+  if (rest % (nvars*sizeof (double)) != 0) {
+    fatal_error ("File format error");
+  }
+  T->emit = HS_EMIT_ALL;
+
+  c.T = T;
+  c.nvars = nvars;
+  c.nrows = rest/(nvars*sizeof (double));
+  c.wrows = (long)((nthreads > 1) ? 4*nthreads : 1)*HS_CHUNK_BYTES/
+    (nvars*sizeof (double));
+  if (c.wrows < 1) {
+    c.wrows = 1;
+  }
 
-    x = fread (vals, sizeof (double), nvars, fp);
-    if (x == 0) break;
-    if (x != nvars) {
-      fatal_error ("File format error");
-    }
+  T->f = f;
+  T->data = f->pos;
+  T->next = raw_window;
+  T->src = &c;
+  write_table (T, output);
 
-    j = 0;
-    for (i=1; i < nvars; i++) {
-      if (skipvars[i]) {
-	continue;
-      }
-      atrace_signal_change (A, names[j], vals[0], vals[i]);
-      j++;
-    }
-  }
-  atrace_close (A);
-  exit (0);
+  FREE (c.col);
 }
 
 #ifdef HAVE_ZLIB
@@ -798,7 +1237,7 @@ void zcsv_convert (const char *input, const char *output)
 	}
 	v = atof (tok);
 
-	if (first < 2 || (fabs(names[i]->v - v) >= 1e-6)) {
+	if (first < 2 || (fabs(ATRACE_NODE_FLOATVAL (names[i]) - v) >= 1e-6)) {
 	  atrace_signal_change (A, names[i], t, v);
 	}
 	tok = strtok (NULL, ",\n");
@@ -822,82 +1261,22 @@ void zcsv_convert (const char *input, const char *output)
 #endif
 
 
-int main (int argc, char **argv) 
+/*
+  HSPICE binary trace file
+*/
+static void hspice_convert (hs_input_t *f, hs_table_t *T, const char *output)
 {
-  const char *fileName;
-  const char *outfile;
-  FILE *f;
-  
-  name_t **names;
-
   char *buf = NULL;
   int offset = 0;
-  
   int i, num;
   int numOfVectors, numOfVariables;
-
   char *token;
   int type;
-
-  char *scale;
-
-  atrace *A;
-
-  int raw_fmt = 0;
-
-  if (argc != 3 && argc != 4) {
-    fatal_error ("Usage: %s [-r] <tracefile> <atrace file>\n", argv[0]);
-  }
-  if (argc == 4) {
-    if (strcmp (argv[1], "-r") != 0) {
-      fatal_error ("Usage: %s [-r] <tracefile> <atrace file>\n", argv[0]);
-    }
-    raw_fmt = 1;
-    fileName = argv[2];
-    outfile = argv[3];
-  }
-  else {
-    fileName = argv[1];
-    outfile = argv[2];
-  }
-  
-  f = fopen(fileName, "rb");	/* open file */
-  if(f == NULL) {
-    fatal_error ("Could not open file %s for reading", fileName);
-  }
-  num = getc(f);
-  ungetc(num, f);
-  if(num == EOF) {
-    fatal_error ("Trace file %s is empty", fileName);
-  }
-
-  if (raw_fmt == 1) {
-    raw_convert (f, outfile);
-  }
-  else {
-    if((num & 0xff) >= ' ') {
-      /* ASCII file, try CSV conversion */
-      csv_convert (f, outfile);
-      fatal_error ("Trace file %s looks like an ASCII file", fileName);
-    }
-#ifdef HAVE_ZLIB
-    else if ((num & 0xff) == 0x1f) {
-      /* might be gzipped */
-      num = getc (f);
-      num = getc (f);
-      if ((num & 0xff) == 0x8b) {
-	fclose (f);
-	zcsv_convert (fileName, outfile);
-	exit (0);
-      }
-      fseek (f, 0, SEEK_SET);
-    }
-#endif
-  }
+  long total;
 
   /* Read file */
   do {
-    num = readHeaderBlock(f, fileName, &buf, &offset);
+    num = readHeaderBlock(f, &buf, &offset);
   } while(num == 0);
 
   if(num > 0) {
@@ -914,13 +1293,11 @@ int main (int argc, char **argv)
 
   /* file contains creation date */
   buf[dateEndPosition] = 0;
-  /*date = PyUnicode_FromString(&buf[dateStartPosition]);*/
 
   i = dateStartPosition - 1;
   while(buf[i] == ' ') i--;
   buf[i + 1] = 0;
 
-  /*title = PyUnicode_FromString(&buf[titleStartPosition]);*/
 #if 0
   printf ("HSPICE trace file information\n");
   printf ("   Title: %s\n", &buf[titleStartPosition]);
@@ -937,18 +1314,10 @@ int main (int argc, char **argv)
 				   and probes) */
   numOfVectors = atoi(&buf[numOfProbesPosition]);
 
-#if 0
-  printf ("    #vec: %d\n", numOfVectors);
-#endif
-  
   buf[numOfProbesPosition] = 0;
   numOfVariables = atoi(&buf[numOfVariablesPosition]);	/* Scale included. */
   numOfVectors = numOfVectors + numOfVariables;
 
-#if 0
-  printf ("    #var: %d\n", numOfVariables);
-#endif
-
   /* Get type of variables. Scale is always real. */
   token = strtok(&buf[vectorDescriptionStartPosition], " \t\n");
   type = atoi(token);
@@ -979,18 +1348,6 @@ int main (int argc, char **argv)
     if (!token) {
       fatal_error ("Could not find location of TIME in the trace file");
     }
-#if 0
-    printf (" new #var: %d\n", numOfVariables);
-#endif
-  }
-
-  scale = Strdup (token);
-
-  A = atrace_create (outfile, ATRACE_DELTA, 1e-9 /* 10ns */ , 1e-12 /* dt */);
-  
-  MALLOC (names, name_t *, numOfVectors-1);
-  for (i=0; i < numOfVectors-1; i++) {
-    names[i] = NULL;
   }
 
   for(i = 0; i < numOfVectors - 1; i++)	{
@@ -1003,22 +1360,151 @@ int main (int argc, char **argv)
 
     if (strlen (tmp) > 2 && tmp[0] == 'i' && tmp[1] == '(') {
       /* skip currents */
-      names[i] = NULL;
+      free (tmp);
     }
     else {
-      names[i] = atrace_create_node (A, tmp);
-      atrace_mk_analog (names[i]);
+      add_signal (T, tmp, 0, i+1);
     }
-    free (tmp);
   }
+  FREE (buf);
 
-  // Process vector names: make name lowercase, remove v( in front of name
   if(num == 1)	fatal_error ("Handle sweeps!");
 
-  convTable(A, f, fileName, numOfVariables, type,
-	    numOfVectors, scale, names);
+  /* Read raw data blocks. */
+  T->v = readDataBlocks (f, &total);
 
-  fclose(f);
-  atrace_close (A);
+  /* Increase number of columns if variables with exeption of scale
+     are complex. */
+  if(type == complex_var) {
+    fatal_error ("Can't handle complex variables");
+  }
+
+  /* the whole table is one window */
+  T->ncols = numOfVectors;
+  T->ntotal = (total - 1) / numOfVectors;	/* Number of rows. */
+  T->emit = HS_EMIT_CHANGES;
+  write_table (T, output);
+}
+
+static void usage (char *name)
+{
+  fprintf (stderr, "Usage: %s [-r] [-j <num>] [-n <dt>] <tracefile> <atrace file>\n", name);
+  fprintf (stderr, "  -r : input is a spice raw file\n");
+  fprintf (stderr, "  -j : number of threads for parsing (0 = all cpus; default: 1)\n");
+  fprintf (stderr, "  -n : write a node order trace with time step <dt>\n");
+  exit (1);
+}
+
+int main (int argc, char **argv) 
+{
+  const char *fileName;
+  const char *outfile;
+  hs_input_t in;
+  hs_table_t T;
+  struct stat st;
+  int fd, ch, i;
+  int raw_fmt = 0;
+  double tm;
+
+  while ((ch = getopt (argc, argv, "rj:n:")) != -1) {
+    switch (ch) {
+    case 'r':
+      raw_fmt = 1;
+      break;
+    case 'j':
+      nthreads = atoi (optarg);
+      if (nthreads == 0) {
+	nthreads = workpool_ncpus ();
+      }
+      break;
+    case 'n':
+      node_dt = atof (optarg);
+      if (node_dt <= 0) {
+	usage (argv[0]);
+      }
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+  if (optind + 2 != argc || nthreads < 0) {
+    usage (argv[0]);
+  }
+  fileName = argv[optind];
+  outfile = argv[optind+1];
+
+  realtime_msec ();
+
+  fd = open (fileName, O_RDONLY);
+  if (fd < 0) {
+    fatal_error ("Could not open file %s for reading", fileName);
+  }
+  if (fstat (fd, &st) != 0) {
+    fatal_error ("Could not stat file %s", fileName);
+  }
+  if (st.st_size == 0) {
+    fatal_error ("Trace file %s is empty", fileName);
+  }
+  in.name = fileName;
+  in.sz = st.st_size;
+  in.pos = 0;
+  in.m = (const char *) mmap (NULL, in.sz, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (in.m == (const char *) MAP_FAILED) {
+    fatal_error ("Could not map file %s", fileName);
+  }
+
+  T.v = NULL;
+  T.vmax = 0;
+  T.row0 = 0;
+  T.nrows = 0;
+  T.ncols = 0;
+  A_INIT (T.sig);
+  T.next = NULL;
+  T.src = NULL;
+  T.f = &in;
+  T.data = 0;
+  T.wpos = 0;
+  T.pos = 0;
+  T.ntotal = 0;
+
+  if (raw_fmt == 1) {
+    raw_convert (&in, &T, outfile);
+  }
+  else if ((in.m[0] & 0xff) >= ' ') {
+    /* ASCII file, try CSV conversion */
+    csv_convert (&in, &T, outfile);
+  }
+#ifdef HAVE_ZLIB
+  else if (in.sz > 1 && (in.m[0] & 0xff) == 0x1f && (in.m[1] & 0xff) == 0x8b) {
+    /* gzipped */
+    munmap ((void *)in.m, in.sz);
+    if (node_dt > 0) {
+      warning ("Node order output is not supported for gzipped files");
+    }
+    zcsv_convert (fileName, outfile);
+    exit (0);
+  }
+#endif
+  else {
+    hspice_convert (&in, &T, outfile);
+  }
+
+  tm = realtime_msec ();
+  printf ("%s: %.1f MB in %.1f ms", fileName, in.sz/1e6, tm);
+  if (tm > 0) {
+    printf (" (%.1f MB/s)", in.sz/1e3/tm);
+  }
+  printf ("\n");
+
+  for (i=0; i < A_LEN (T.sig); i++) {
+    free (T.sig[i].name);
+  }
+  A_FREE (T.sig);
+  if (T.v) {
+    FREE (T.v);
+  }
+  munmap ((void *)in.m, in.sz);
   return 0;
 }
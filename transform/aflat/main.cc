@@ -25,6 +25,7 @@
 #include <string.h>
 #include <act/passes/aflat.h>
 #include <act/passes/cells.h>
+#include <common/names.h>
 
 static enum output_formats {
   PRSIM_FMT,
@@ -35,11 +36,39 @@ static enum output_formats {
 #define EXTRA_ARGS  NULL, (export_format == LVS_FMT ? 1 : 0)
 
 /* hash table for labels */
-static struct Hashtable *labels;
+static thread_local struct Hashtable *labels;
+
+/*
+  With -j, instances are flattened in parallel and each thread writes
+  to its own buffer; the pass merges the buffers in order.
+*/
+ActApplyPass *gpass;
+#define AFLAT_OUT gpass->out()
+
+/*
+  Binary netlist output (-b): <base>.prsb has the rules and specs,
+  <base> is the names database with connections as aliases. The
+  format is described in prsim's prs.c.
+*/
+static FILE *bin_fp = NULL;
+static NAMES_T *bin_names = NULL;
+static struct Hashtable *bin_idx = NULL;   /* name -> names index */
+L_A_DECL (IDX_TYPE, bin_list);
+
+#define PRSB_VERSION 1
+
+#define PRSB_RULE_UP     0x01
+#define PRSB_RULE_WEAK   0x02
+#define PRSB_RULE_UNSTAB 0x04
+#define PRSB_RULE_AFTER  0x08
+
+#define PRSB_TIMING_MARGIN 0x01
 
 void usage (char *s)
 {
-  fprintf (stderr, "Usage: %s [act-options] [-c] [-prsim|-lvs] <file.act>\n", s);
+  fprintf (stderr, "Usage: %s [act-options] [-c] [-b <base>] [-j <n>] [-prsim|-lvs] <file.act>\n", s);
+  fprintf (stderr, "  -b <base> : binary prsim netlist in <base>.prsb and names database <base>\n");
+  fprintf (stderr, "  -j <n>    : flatten using <n> threads (0 = # of cpus)\n");
   exit (1);
 }
 
@@ -47,26 +76,30 @@ void usage (char *s)
 static void print_connect()
 {
   if (export_format == LVS_FMT) {
-    printf ("connect ");
+    fprintf (AFLAT_OUT, "connect ");
   }
   else {
-    printf ("= ");
+    fprintf (AFLAT_OUT, "= ");
   }
 }
 
 #define ARRAY_STYLE (export_format == LVS_FMT ? 1 : 0)
 #define EXTRA_ARGS  NULL, (export_format == LVS_FMT ? 1 : 0)
 
-static ActId *current_prefix = NULL;
+static thread_local ActApplyPath *current_prefix = NULL;
 
-static void prefix_id_print (Scope *s, ActId *id, const char *str = "")
+static void prefix_id_string (Scope *s, ActId *id, const char *str,
+			      char *buf, int sz)
 {
-  printf ("\"");
+  int len;
+
+  buf[0] = '\0';
   if (s->Lookup (id, 0)) {
     if (current_prefix) {
       if (id->getName()[0] != ':') {
-	current_prefix->Print (stdout);
-	printf (".");
+	current_prefix->sPrint (buf, sz);
+	len = strlen (buf);
+	snprintf (buf+len, sz-len, ".");
       }
     }
   }
@@ -81,26 +114,65 @@ static void prefix_id_print (Scope *s, ActId *id, const char *str = "")
     }
     else {
       char *tmp = vx->global->Name ();
-      printf ("%s::", tmp);
+      snprintf (buf, sz, "%s::", tmp);
       FREE (tmp);
     }
   }
-  id->Print (stdout, EXTRA_ARGS);
-  printf ("%s\"", str);
+  len = strlen (buf);
+  id->sPrint (buf+len, sz-len, EXTRA_ARGS);
+  len = strlen (buf);
+  snprintf (buf+len, sz-len, "%s", str);
+}
+
+static void prefix_id_print (Scope *s, ActId *id, const char *str = "")
+{
+  char buf[10240];
+
+  prefix_id_string (s, id, str, buf, sizeof (buf));
+  fprintf (AFLAT_OUT, "\"%s\"", buf);
+}
+
+static void bin_uint (unsigned long x)
+{
+  while (x >= 0x80) {
+    putc ((x & 0x7f) | 0x80, bin_fp);
+    x >>= 7;
+  }
+  putc (x, bin_fp);
+}
+
+static IDX_TYPE bin_name (const char *s)
+{
+  hash_bucket_t *b;
+
+  b = hash_lookup (bin_idx, s);
+  if (!b) {
+    b = hash_add (bin_idx, s);
+    b->i = names_newname (bin_names, (char *)s);
+  }
+  return b->i;
+}
+
+static IDX_TYPE bin_id (Scope *s, ActId *id, const char *str = "")
+{
+  char buf[10240];
+
+  prefix_id_string (s, id, str, buf, sizeof (buf));
+  return bin_name (buf);
 }
 
 
 #define PREC_BEGIN(myprec)			\
   do {						\
     if ((myprec) < prec) {			\
-      printf ("(");				\
+      fprintf (AFLAT_OUT, "(");				\
     }						\
   } while (0)
 
 #define PREC_END(myprec)			\
   do {						\
     if ((myprec) < prec) {			\
-      printf (")");				\
+      fprintf (AFLAT_OUT, ")");				\
     }						\
   } while (0)
 
@@ -108,7 +180,7 @@ static void prefix_id_print (Scope *s, ActId *id, const char *str = "")
   do {						\
     PREC_BEGIN(myprec);				\
     _print_prs_expr (s, e->u.e.l, (myprec), flip);	\
-    printf ("%s", (sym));			\
+    fprintf (AFLAT_OUT, "%s", (sym));			\
     _print_prs_expr (s, e->u.e.r, (myprec), flip);	\
     PREC_END (myprec);				\
   } while (0)
@@ -116,7 +188,7 @@ static void prefix_id_print (Scope *s, ActId *id, const char *str = "")
 #define EMIT_UNOP(myprec,sym)			\
   do {						\
     PREC_BEGIN(myprec);				\
-    printf ("%s", sym);				\
+    fprintf (AFLAT_OUT, "%s", sym);				\
     _print_prs_expr (s, e->u.e.l, (myprec), flip);	\
     PREC_END (myprec);				\
   } while (0)
@@ -143,7 +215,7 @@ static void _print_prs_expr (Scope *s, act_prs_expr_t *e, int prec, int flip)
     
   case ACT_PRS_EXPR_VAR:
     if (flip) {
-      printf ("~");
+      fprintf (AFLAT_OUT, "~");
     }
     prefix_id_print (s, e->u.v.id);
     break;
@@ -162,19 +234,19 @@ static void _print_prs_expr (Scope *s, act_prs_expr_t *e, int prec, int flip)
     }
     pl = (act_prs_lang_t *) b->v;
     if (pl->u.one.dir == 0) {
-      printf ("~");
+      fprintf (AFLAT_OUT, "~");
     }
-    printf ("(");
+    fprintf (AFLAT_OUT, "(");
     _print_prs_expr (s, pl->u.one.e, 0, flip);
-    printf (")");
+    fprintf (AFLAT_OUT, ")");
     break;
 
   case ACT_PRS_EXPR_TRUE:
-    printf ("true");
+    fprintf (AFLAT_OUT, "true");
     break;
     
   case ACT_PRS_EXPR_FALSE:
-    printf ("false");
+    fprintf (AFLAT_OUT, "false");
     break;
 
   default:
@@ -183,46 +255,220 @@ static void _print_prs_expr (Scope *s, act_prs_expr_t *e, int prec, int flip)
   }
 }
 
-static void print_attr_prefix (act_attr_t *attr, int force_after)
+/*
+  Binary expressions: chains of the same operator are flattened into
+  one n-ary node, exactly the way prsim parses the printed expression.
+*/
+static void _bin_prs_expr (Scope *s, act_prs_expr_t *e, int flip);
+
+static int _bin_nops (act_prs_expr_t *e, int type)
+{
+  if (e->type == type) {
+    return _bin_nops (e->u.e.l, type) + _bin_nops (e->u.e.r, type);
+  }
+  return 1;
+}
+
+static void _bin_ops (Scope *s, act_prs_expr_t *e, int type, int flip)
+{
+  if (e->type == type) {
+    _bin_ops (s, e->u.e.l, type, flip);
+    _bin_ops (s, e->u.e.r, type, flip);
+  }
+  else {
+    _bin_prs_expr (s, e, flip);
+  }
+}
+
+static void _bin_prs_expr (Scope *s, act_prs_expr_t *e, int flip)
 {
-  /* examine attributes:
+  hash_bucket_t *b;
+  act_prs_lang_t *pl;
+
+  if (!e) {
+    fatal_error ("Empty production rule guard");
+  }
+  switch (e->type) {
+  case ACT_PRS_EXPR_AND:
+  case ACT_PRS_EXPR_OR:
+    putc (e->type == ACT_PRS_EXPR_AND ? '&' : '|', bin_fp);
+    bin_uint (_bin_nops (e, e->type));
+    _bin_ops (s, e, e->type, flip);
+    break;
+
+  case ACT_PRS_EXPR_VAR:
+    if (flip) {
+      putc ('~', bin_fp);
+    }
+    putc ('v', bin_fp);
+    bin_uint (bin_id (s, e->u.v.id));
+    break;
+
+  case ACT_PRS_EXPR_NOT:
+    putc ('~', bin_fp);
+    _bin_prs_expr (s, e->u.e.l, flip);
+    break;
+
+  case ACT_PRS_EXPR_LABEL:
+    if (!labels) {
+      fatal_error ("No labels defined!");
+    }
+    b = hash_lookup (labels, e->u.l.label);
+    if (!b) {
+      fatal_error ("Missing label `%s'", e->u.l.label);
+    }
+    pl = (act_prs_lang_t *) b->v;
+    if (pl->u.one.dir == 0) {
+      putc ('~', bin_fp);
+    }
+    _bin_prs_expr (s, pl->u.one.e, flip);
+    break;
+
+  case ACT_PRS_EXPR_TRUE:
+    putc ('v', bin_fp);
+    bin_uint (bin_name ("true"));
+    break;
+
+  case ACT_PRS_EXPR_FALSE:
+    putc ('v', bin_fp);
+    bin_uint (bin_name ("false"));
+    break;
+
+  default:
+    fatal_error ("What?");
+    break;
+  }
+}
+
+/*
+  examine attributes:
      after
      weak
      unstab
-  */
-  int weak = 0;
-  int unstab = 0;
-  int after = 0;
+  returns 1 if there is an after delay
+*/
+static int prs_attr_values (act_attr_t *attr, int force_after,
+			    int *weak, int *unstab, int *after)
+{
   int have_after = 0;
   act_attr_t *x;
 
-  if (export_format == LVS_FMT) return;
+  *weak = 0;
+  *unstab = 0;
+  *after = 0;
 
   for (x = attr; x; x = x->next) {
     if (strcmp (x->attr, "weak") == 0) {
-      weak = 1;
+      *weak = 1;
     }
     else if (strcmp (x->attr, "unstab") == 0) {
-      unstab = 1;
+      *unstab = 1;
     }
     else if (strcmp (x->attr, "after") == 0) {
-      after = x->e->u.v;
+      *after = x->e->u.v;
       have_after = 1;
     }
   }
   if (!have_after && force_after) {
-    after = 0;
+    *after = 0;
     have_after = 1;
   }
+  return have_after;
+}
+
+/* start of a binary rule; the guard follows */
+static void bin_rule_prefix (Scope *s, act_attr_t *attr, int force_after,
+			     ActId *id, int dir)
+{
+  int weak, unstab, after, have_after;
+  int flags;
+
+  have_after = prs_attr_values (attr, force_after, &weak, &unstab, &after);
+  flags = (dir ? PRSB_RULE_UP : 0) | (weak ? PRSB_RULE_WEAK : 0) |
+    (unstab ? PRSB_RULE_UNSTAB : 0) | (have_after ? PRSB_RULE_AFTER : 0);
+  putc ('R', bin_fp);
+  bin_uint (flags);
+  if (have_after) {
+    if (after < 0) {
+      fatal_error ("Negative delay (%d) in production rule", after);
+    }
+    bin_uint (after);
+  }
+  bin_uint (bin_id (s, id));
+}
+
+static void print_attr_prefix (act_attr_t *attr, int force_after)
+{
+  int weak, unstab, after, have_after;
+
+  if (export_format == LVS_FMT) return;
+
+  have_after = prs_attr_values (attr, force_after, &weak, &unstab, &after);
   if (weak) {
-    printf ("weak ");
+    fprintf (AFLAT_OUT, "weak ");
   }
   if (unstab) {
-    printf ("unstab ");
+    fprintf (AFLAT_OUT, "unstab ");
   }
   if (have_after) {
-    printf ("after %d ", after);
+    fprintf (AFLAT_OUT, "after %d ", after);
+  }
+}
+
+static void print_timing (Scope *s, act_spec *spec, const char *s1,
+			  const char *s2, int *delay)
+{
+  const char *sfx[3] = { "", s1, s2 };
+  int dir;
+
+  if (bin_fp) {
+    putc ('T', bin_fp);
+    bin_uint (delay ? PRSB_TIMING_MARGIN : 0);
+    for (int i=0; i < 3; i++) {
+      bin_uint (bin_id (s, spec->ids[i], sfx[i]));
+      dir = spec->extra[i] & 0x03;
+      putc (dir == 0 ? '*' : (dir == 1 ? '+' : '-'), bin_fp);
+    }
+    if (delay) {
+      if (*delay < 0) {
+	fatal_error ("Timing margin must be positive (not %d)", *delay);
+      }
+      bin_uint (*delay);
+    }
+    return;
+  }
+
+  fprintf (AFLAT_OUT, "timing(");
+  for (int i=0; i < 3; i++) {
+    if (i != 0) {
+      fprintf (AFLAT_OUT, ",");
+    }
+    prefix_id_print (s, spec->ids[i], sfx[i]);
+    dir = spec->extra[i] & 0x03;
+    if (dir) {
+      fprintf (AFLAT_OUT, dir == 1 ? "+" : "-");
+    }
+  }
+  if (delay) {
+    fprintf (AFLAT_OUT, ",%d", *delay);
+  }
+  fprintf (AFLAT_OUT, ")\n");
+}
+
+static void print_spec_item (Scope *s, ActId *id, const char *str,
+			     int *comma)
+{
+  if (bin_fp) {
+    A_NEW (bin_list, IDX_TYPE);
+    A_NEXT (bin_list) = bin_id (s, id, str);
+    A_INC (bin_list);
+    return;
+  }
+  if (*comma != 0) {
+    fprintf (AFLAT_OUT, ",");
   }
+  prefix_id_print (s, id, str);
+  *comma = 1;
 }
 
 static void aflat_print_spec (Scope *s, act_spec *spec)
@@ -274,32 +520,7 @@ static void aflat_print_spec (Scope *s, act_spec *spec)
 	}
 
 	if (!as[0] && !as[1]) {
-	  printf ("timing(");
-	  prefix_id_print (s, spec->ids[0]);
-
-#define PRINT_EXTRA(x)					\
-	  do {						\
-	    if (spec->extra[x] & 0x03) {		\
-	      if ((spec->extra[x] & 0x03) == 1) {	\
-		printf ("+");				\
-	      }						\
-	      else {					\
-		printf ("-");				\
-	      }						\
-	    }						\
-	  } while (0)
-
-	  PRINT_EXTRA (0);
-	  printf (",");
-	  prefix_id_print (s, spec->ids[1]);
-	  PRINT_EXTRA (1);
-	  printf (",");
-	  prefix_id_print (s, spec->ids[2]);
-	  PRINT_EXTRA (2);
-	  if (e) {
-	    printf (",%d", delay);
-	  }
-	  printf (")\n");
+	  print_timing (s, spec, "", "", e ? &delay : NULL);
 	}
 	else {
 	  if (aref[1]) {
@@ -321,31 +542,14 @@ static void aflat_print_spec (Scope *s, act_spec *spec)
 	      }
 	    }
 	    
-	    printf ("timing(");
-	    prefix_id_print (s, spec->ids[0]);
-	    PRINT_EXTRA (0);
-	    printf (",");
+	    print_timing (s, spec, tmp[0] ? tmp[0] : "", tmp[1] ? tmp[1] : "",
+			  e ? &delay : NULL);
 	    if (tmp[0]) {
-	      prefix_id_print (s, spec->ids[1], tmp[0]);
 	      FREE (tmp[0]);
 	    }
-	    else {
-	      prefix_id_print (s, spec->ids[1]);
-	    }
-	    PRINT_EXTRA (1);
-	    printf (",");
 	    if (tmp[1]) {
-	      prefix_id_print (s, spec->ids[2], tmp[1]);
 	      FREE (tmp[1]);
 	    }
-	    else {
-	      prefix_id_print (s, spec->ids[2]);
-	    }
-	    PRINT_EXTRA (2);
-	    if (e) {
-	      printf (",%d", delay);
-	    }
-	    printf (")\n");
 
 	    if (as[1]) {
 	      as[1]->step();
@@ -404,7 +608,12 @@ static void aflat_print_spec (Scope *s, act_spec *spec)
 	 (strcmp (tmp, "exclhi") == 0 || strcmp (tmp, "excllo") == 0))) {
       if (spec->count > 0) {
 	int comma = 0;
-	printf ("%s(", tmp);
+	if (bin_fp) {
+	  A_LEN_RAW (bin_list) = 0;
+	}
+	else {
+	  fprintf (AFLAT_OUT, "%s(", tmp);
+	}
 	for (int i=0; i < spec->count; i++) {
 	  Array *aref;
 	  id = spec->ids[i];
@@ -432,11 +641,7 @@ static void aflat_print_spec (Scope *s, act_spec *spec)
 	    }
 	    while (!astep->isend()) {
 	      char *tmp = astep->string();
-	      if (comma != 0) {
-		printf (",");
-	      }
-	      prefix_id_print (s, spec->ids[i], tmp);
-	      comma = 1;
+	      print_spec_item (s, spec->ids[i], tmp, &comma);
 	      FREE (tmp);
 	      astep->step();
 	    }
@@ -446,14 +651,27 @@ static void aflat_print_spec (Scope *s, act_spec *spec)
 	    }
 	  }
 	  else {
-	    if (comma != 0) {
-	      printf (",");
-	    }
-	    prefix_id_print (s, spec->ids[i]);
-	    comma = 1;
+	    print_spec_item (s, spec->ids[i], "", &comma);
+	  }
+	}
+	if (bin_fp) {
+	  if (strcmp (tmp, "mk_exclhi") == 0) {
+	    putc ('H', bin_fp);
+	  }
+	  else if (strcmp (tmp, "mk_excllo") == 0) {
+	    putc ('L', bin_fp);
+	  }
+	  else {
+	    putc ('I', bin_fp);
+	  }
+	  bin_uint (A_LEN (bin_list));
+	  for (int i=0; i < A_LEN (bin_list); i++) {
+	    bin_uint (bin_list[i]);
 	  }
 	}
-	printf (")\n");
+	else {
+	  fprintf (AFLAT_OUT, ")\n");
+	}
       }
     }
     spec = spec->next;
@@ -479,41 +697,57 @@ static void aflat_print_prs (Scope *s, act_prs_lang_t *p)
 	b = hash_add (labels, (char *)p->u.one.id);
 	b->v = p;
       }
+      else if (bin_fp) {
+	bin_rule_prefix (s, p->u.one.attr, 0, p->u.one.id, p->u.one.dir);
+	_bin_prs_expr (s, p->u.one.e, 0);
+	if (p->u.one.arrow_type == 1) {
+	  bin_rule_prefix (s, p->u.one.attr, 0, p->u.one.id, !p->u.one.dir);
+	  putc ('~', bin_fp);
+	  _bin_prs_expr (s, p->u.one.e, 0);
+	}
+	else if (p->u.one.arrow_type == 2) {
+	  bin_rule_prefix (s, p->u.one.attr, 0, p->u.one.id, !p->u.one.dir);
+	  _bin_prs_expr (s, p->u.one.e, 1);
+	}
+	else if (p->u.one.arrow_type != 0) {
+	  fatal_error ("Eh?");
+	}
+      }
       else {
 	print_attr_prefix (p->u.one.attr, 0);
 	_print_prs_expr (s, p->u.one.e, 0, 0);
-	printf ("->");
+	fprintf (AFLAT_OUT, "->");
 	prefix_id_print (s, p->u.one.id);
 	if (p->u.one.dir) {
-	  printf ("+\n");
+	  fprintf (AFLAT_OUT, "+\n");
 	}
 	else {
-	  printf ("-\n");
+	  fprintf (AFLAT_OUT, "-\n");
 	}
 	if (p->u.one.arrow_type == 1) {
 	  print_attr_prefix (p->u.one.attr, 0);
-	  printf ("~(");
+	  fprintf (AFLAT_OUT, "~(");
 	  _print_prs_expr (s, p->u.one.e, 0, 0);
-	  printf (")");
-	  printf ("->");
+	  fprintf (AFLAT_OUT, ")");
+	  fprintf (AFLAT_OUT, "->");
 	  prefix_id_print (s, p->u.one.id);
 	  if (p->u.one.dir) {
-	    printf ("-\n");
+	    fprintf (AFLAT_OUT, "-\n");
 	  }
 	  else {
-	    printf ("+\n");
+	    fprintf (AFLAT_OUT, "+\n");
 	  }
 	}
 	else if (p->u.one.arrow_type == 2) {
 	  print_attr_prefix (p->u.one.attr, 0);
 	  _print_prs_expr (s, p->u.one.e, 0, 1);
-	  printf ("->");
+	  fprintf (AFLAT_OUT, "->");
 	  prefix_id_print (s, p->u.one.id);
 	  if (p->u.one.dir) {
-	    printf ("-\n");
+	    fprintf (AFLAT_OUT, "-\n");
 	  }
 	  else {
-	    printf ("+\n");
+	    fprintf (AFLAT_OUT, "+\n");
 	  }
 	}
 	else if (p->u.one.arrow_type != 0) {
@@ -522,24 +756,47 @@ static void aflat_print_prs (Scope *s, act_prs_lang_t *p)
       }
       break;
     case ACT_PRS_GATE:
+      if (bin_fp) {
+	if (p->u.p.g) {
+	  bin_rule_prefix (s, p->u.p.attr, 1, p->u.p.d, 0);
+	  putc ('&', bin_fp);
+	  bin_uint (2);
+	  putc ('v', bin_fp);
+	  bin_uint (bin_id (s, p->u.p.g));
+	  putc ('~', bin_fp);
+	  putc ('v', bin_fp);
+	  bin_uint (bin_id (s, p->u.p.s));
+	}
+	if (p->u.p._g) {
+	  bin_rule_prefix (s, p->u.p.attr, 1, p->u.p.d, 1);
+	  putc ('&', bin_fp);
+	  bin_uint (2);
+	  putc ('~', bin_fp);
+	  putc ('v', bin_fp);
+	  bin_uint (bin_id (s, p->u.p._g));
+	  putc ('v', bin_fp);
+	  bin_uint (bin_id (s, p->u.p.s));
+	}
+	break;
+      }
       print_attr_prefix (p->u.p.attr, 1);
       if (p->u.p.g) {
 	/* passn */
 	prefix_id_print (s, p->u.p.g);
-	printf (" & ~");
+	fprintf (AFLAT_OUT, " & ~");
 	prefix_id_print (s, p->u.p.s);
-	printf (" -> ");
+	fprintf (AFLAT_OUT, " -> ");
 	prefix_id_print (s, p->u.p.d);
-	printf ("-\n");
+	fprintf (AFLAT_OUT, "-\n");
       }
       if (p->u.p._g) {
-	printf ("~");
+	fprintf (AFLAT_OUT, "~");
 	prefix_id_print (s, p->u.p._g);
-	printf (" & ");
+	fprintf (AFLAT_OUT, " & ");
 	prefix_id_print (s, p->u.p.s);
-	printf (" -> ");
+	fprintf (AFLAT_OUT, " -> ");
 	prefix_id_print (s, p->u.p.d);
-	printf ("+\n");
+	fprintf (AFLAT_OUT, "+\n");
       }
       break;
     case ACT_PRS_TREE:
@@ -572,7 +829,7 @@ static void aflat_ns (ActNamespace *ns)
   aflat_dump (ns->CurScope(), ns->getprs(), ns->getspec());
 }
 		     
-void aflat_body (void *cookie, ActId *prefix, UserDef *u)
+void aflat_body (void *cookie, ActApplyPath *prefix, UserDef *u)
 {
   Assert (u->isExpanded(), "What?");
   current_prefix = prefix;
@@ -583,17 +840,16 @@ void aflat_body (void *cookie, ActId *prefix, UserDef *u)
   current_prefix = NULL;
 }
 
-ActApplyPass *gpass;
-
-void aflat_conns (void *cookie, ActId *id1, ActId *id2)
+void aflat_conns (void *cookie, ActApplyPath *id1, ActApplyPath *id2)
 {
+  if (bin_fp) {
+    IDX_TYPE idx1 = bin_name (id1->string());
+    names_addalias (bin_names, idx1, bin_name (id2->string()));
+    return;
+  }
   print_connect ();
 
-  printf ("\"");
-  id1->Print (stdout);
-  printf ("\" \"");
-  id2->Print (stdout);
-  printf ("\"\n");
+  fprintf (AFLAT_OUT, "\"%s\" \"%s\"\n", id1->string(), id2->string());
 }
 
 
@@ -603,12 +859,14 @@ int main (int argc, char **argv)
   char *file;
   int do_cells = 0;
   char *cells = NULL;
+  char *binary = NULL;
+  int nthreads = 1;
 
   Act::Init (&argc, &argv);
   
   export_format = PRSIM_FMT;
 
-  if (argc < 2 || argc > 4) usage (argv[0]);
+  if (argc < 2 || argc > 8) usage (argv[0]);
 
   int idx = 1;
 
@@ -622,6 +880,15 @@ int main (int argc, char **argv)
      }
      idx++;
   }
+  if (idx < argc-1 && strcmp (argv[idx], "-b") == 0) {
+    binary = argv[idx+1];
+    idx += 2;
+  }
+  if (idx < argc-1 && strcmp (argv[idx], "-j") == 0) {
+    nthreads = atoi (argv[idx+1]);
+    if (nthreads < 0) usage (argv[0]);
+    idx += 2;
+  }
   if (idx >= argc) usage (argv[0]);
   if (strcmp (argv[idx], "-prsim") == 0) {
      export_format = PRSIM_FMT;
@@ -637,6 +904,7 @@ int main (int argc, char **argv)
     }
   }
   if (idx != argc-1) usage (argv[0]);
+  if (binary && export_format != PRSIM_FMT) usage (argv[0]);
   file = argv[idx];
 
   a = new Act (file);
@@ -649,15 +917,42 @@ int main (int argc, char **argv)
      cp->run ();
   }
 
+  if (binary) {
+    char *tmp;
+    MALLOC (tmp, char, strlen (binary) + 6);
+    sprintf (tmp, "%s.prsb", binary);
+    bin_fp = fopen (tmp, "w");
+    if (!bin_fp) {
+      fatal_error ("Could not open file `%s' for writing", tmp);
+    }
+    FREE (tmp);
+    fprintf (bin_fp, "PRSB%c", PRSB_VERSION);
+    bin_names = names_create (binary, 1e7);
+    bin_idx = hash_new (1024);
+    A_INIT (bin_list);
+  }
+
   ActApplyPass *ap = new ActApplyPass (a);
 
   gpass = ap;
 
-  ap->setInstFn (aflat_body);
-  ap->setConnPairFn (aflat_conns);
+  /* the names database is built in walk order, so -b is serial */
+  if (!binary && nthreads != 1) {
+    ap->setThreads (nthreads, stdout);
+  }
+
+  ap->setInstPathFn (aflat_body);
+  ap->setConnPathFn (aflat_conns);
   ap->run();
   aflat_ns (a->Global());
 
+  if (bin_fp) {
+    fclose (bin_fp);
+    names_close (bin_names);
+    hash_free (bin_idx);
+    A_FREE (bin_list);
+  }
+
   //aflat_prs (a, export_format);
 
   return 0;
@@ -97,6 +97,105 @@ then
 	echo
 fi
 
+#
+# Parallel flattening must produce byte-identical output
+#
+myecho " "
+num=0
+count=0
+while [ -f ${count}.act ]
+do
+	i=${count}.act
+	count=`expr $count + 1`
+	bname=`expr $i : '\(.*\).act'`
+	num=`expr $num + 1`
+	myecho ".[j:$bname]"
+	ok=1
+	for mode in "" -prsim
+	do
+		$ACTTOOL -j 1 $mode $i > runs/$i.j1.stdout 2>/dev/null
+		$ACTTOOL -j 4 $mode $i > runs/$i.j4.stdout 2>/dev/null
+		if ! cmp runs/$i.j1.stdout runs/$i.j4.stdout >/dev/null 2>/dev/null
+		then
+			ok=0
+		fi
+	done
+	if [ $ok -eq 0 ]
+	then
+		echo
+		echo "** FAILED TEST $i: -j 4 output differs from -j 1 **"
+		myecho " "
+		fail=`expr $fail + 1`
+		num=0
+	elif [ $num -eq $lim ]
+	then
+		echo
+		myecho " "
+		num=0
+	fi
+done
+
+if [ $num -ne 0 ]
+then
+	echo
+fi
+
+#
+# Binary netlist (-b): prsim must simulate the same circuit from the
+# text and the binary netlist. Every node is driven (alternately to 0
+# and 1), the circuit is run until it settles, and the node values are
+# compared.
+#
+PRSIM=$VLSI_TOOLS_SRC/simulation/prsim/prsim.$EXT
+if [ -x $PRSIM ]
+then
+	myecho " "
+	num=0
+	count=0
+	while [ -f ${count}.act ]
+	do
+		i=${count}.act
+		count=`expr $count + 1`
+		bname=`expr $i : '\(.*\).act'`
+		$ACTTOOL -prsim $i > runs/$i.b.prs 2>/dev/null
+		if ! grep -e '->' runs/$i.b.prs >/dev/null 2>&1
+		then
+			rm -f runs/$i.b.prs
+			continue
+		fi
+		num=`expr $num + 1`
+		myecho ".[b:$bname]"
+		$ACTTOOL -b runs/$i.b -prsim $i > /dev/null 2>/dev/null
+		printf 'initialize\nstatus X\n' | $PRSIM -r runs/$i.b.prs > runs/$i.b.nodes 2>/dev/null
+		(echo norandom; echo initialize; \
+		 tr ' ' '\n' < runs/$i.b.nodes | awk 'NF > 0 { print "set", $1, NR%2 }'; \
+		 echo cycle; echo status 0; echo status 1; echo status X) > runs/$i.b.cmd
+		$PRSIM -r runs/$i.b.prs < runs/$i.b.cmd 2>&1 | tr ' ' '\n' | sort > runs/$i.b.t.out
+		$PRSIM -r -b runs/$i.b < runs/$i.b.cmd 2>&1 | tr ' ' '\n' | sort > runs/$i.b.b.out
+		if [ ! -s runs/$i.b.prsb ] || \
+		   ! cmp runs/$i.b.t.out runs/$i.b.b.out >/dev/null 2>/dev/null
+		then
+			echo
+			echo "** FAILED TEST $i: prsim -b differs from the text netlist **"
+			myecho " "
+			fail=`expr $fail + 1`
+			num=0
+		elif [ $num -eq $lim ]
+		then
+			echo
+			myecho " "
+			num=0
+		fi
+		rm -f runs/$i.b runs/$i.b.* runs/$i.b_*
+	done
+	if [ $num -ne 0 ]
+	then
+		echo
+	fi
+else
+	echo "   (skipping -b checks: $PRSIM not built)"
+fi
+
 
 if [ $fail -ne 0 ]
 then
@@ -20,6 +20,7 @@
  **************************************************************************
  */
 #include <stdio.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -96,65 +97,216 @@ char *name_munge (const char *name)
 
 static void usage (char *name)
 {
-  fprintf (stderr, "Usage: %s [act-options] [-c <mincap>] [-s <scale>] <file.ext>\n", name);
+  fprintf (stderr, "Usage: %s [act-options] [-c <mincap>] [-s <scale>] [-j <num>] [-C] <file.ext>\n", name);
   fprintf (stderr, " -c <mincap> : filter caps at or below this threshold\n");
   fprintf (stderr, " -s <scale>  : scale all units by <scale>\n");
+  fprintf (stderr, " -j <num>    : read extract files with <num> threads (0 = all cpus)\n");
+  fprintf (stderr, " -C          : cache parsed extract files in binary .extb files\n");
   exit (1);
 }
 
-static struct Hashtable *seen = NULL;
+/*
+  Output goes through a large buffer instead of many small stdio
+  calls; it is flushed when full and at the end of main().
+*/
+#define OUTBUF_SIZE (1 << 20)
 
-struct alias_tree {
-  struct alias_tree *up;
-  struct alias_tree *noglob;
-  hash_bucket_t *b;
-  char *name;
-  int global;
+static char *outbuf = NULL;
+static int outlen = 0;
+
+static void out_flush (void)
+{
+  if (outlen > 0) {
+    fwrite (outbuf, 1, outlen, stdout);
+    outlen = 0;
+  }
+  fflush (stdout);
+}
+
+static void out_write (const char *s, int len)
+{
+  if (outlen + len > OUTBUF_SIZE) {
+    out_flush ();
+    if (len > OUTBUF_SIZE) {
+      fwrite (s, 1, len, stdout);
+      return;
+    }
+  }
+  memcpy (outbuf + outlen, s, len);
+  outlen += len;
+}
+
+static void out_str (const char *s)
+{
+  out_write (s, strlen (s));
+}
+
+static void out_chr (char c)
+{
+  if (outlen == OUTBUF_SIZE) {
+    out_flush ();
+  }
+  outbuf[outlen++] = c;
+}
+
+static void out_int (int x)
+{
+  char buf[16];
+  int i = sizeof (buf);
+  unsigned int u = (x < 0) ? -(unsigned int)x : x;
+
+  do {
+    buf[--i] = '0' + (u % 10);
+    u /= 10;
+  } while (u);
+  if (x < 0) {
+    buf[--i] = '-';
+  }
+  out_write (buf + i, sizeof (buf) - i);
+}
+
+static void out_printf (const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  if (outlen + 256 > OUTBUF_SIZE) {
+    out_flush ();
+  }
+  va_start (ap, fmt);
+  n = vsnprintf (outbuf + outlen, OUTBUF_SIZE - outlen, fmt, ap);
+  va_end (ap);
+  if (n >= OUTBUF_SIZE - outlen) {
+    out_flush ();
+    va_start (ap, fmt);
+    vfprintf (stdout, fmt, ap);
+    va_end (ap);
+  }
+  else {
+    outlen += n;
+  }
+}
+
+/* same as name_munge(), but written directly to the output */
+static void out_munged (const char *name)
+{
+  int count = 0;
+
+  for (int i=0; name[i]; i++) {
+    if (name[i] == '/') {
+      count++;
+    }
+  }
+  if (count > 0) {
+    out_chr ('x');
+  }
+  for (int i=0; name[i]; i++) {
+    if (name[i] == '/') {
+      out_chr (SEP_CHAR);
+      count--;
+      if (count > 0) {
+	out_chr ('x');
+      }
+    }
+    else {
+      out_chr (name[i]);
+    }
+  }
+}
+
+/* print a cell name without its .ext suffix */
+static void out_cellname (const char *name)
+{
+  int l = strlen (name);
+  if (l >= 4 && (strcmp (name + l - 4, ".ext") == 0)) {
+    l -= 4;
+  }
+  out_write (name, l);
+}
+
+/*
+  Per-cell node table. Every name used in a cell gets a small integer
+  index (stored in the name table), and connections are tracked with
+  union-find over the indices rather than with individually allocated
+  tree nodes.
+*/
+struct ext_node {
+  int up;			/* union-find parent, -1 for a root */
+  int noglob;			/* alias chain without globals, -1 if none */
+  int global;			/* 1 = name has a "!", 2 = the global itself */
   double cap_gnd;
-  double *perim, *area;
+  hash_bucket_t *b;		/* name table entry */
+  char *name;			/* SPICE name, computed on demand */
 };
 
+struct ext_cell {
+  struct Hashtable *H;		/* name -> node index */
+  A_DECL (struct ext_node, n);
+  double *ap;			/* area, perim per device type and node;
+				   allocated on demand */
+  int apmax;			/* # of nodes with space in ap */
+};
+
+static struct Hashtable *seen = NULL;
 
-struct alias_tree *getroot (struct alias_tree *a)
+static const char *node_name (struct ext_cell *C, int x)
 {
-  while (a->up) {
-    a = a->up;
+  struct ext_node *n = &C->n[x];
+  if (!n->name) {
+    if (n->global == 2) {
+      n->name = n->b->key;
+    }
+    else {
+      n->name = name_munge (n->b->key);
+    }
   }
-  return a;
+  return n->name;
 }
 
-struct alias_tree *getroot_noglob (struct alias_tree *a)
+/* area/perim of node x; NULL if none was ever recorded for it */
+static double *node_ap (struct ext_cell *C, int x, int alloc)
 {
-  struct alias_tree *tmp;
-
-  tmp = a;
-  while (a->up) {
-    a = a->up;
+  if (x >= C->apmax) {
+    if (!alloc) {
+      return NULL;
+    }
+    int old = C->apmax;
+    C->apmax = A_LEN (C->n) + 1024;
+    REALLOC (C->ap, double, 2*num_devices*C->apmax);
+    for (int i=2*num_devices*old; i < 2*num_devices*C->apmax; i++) {
+      C->ap[i] = 0;
+    }
   }
+  return C->ap + 2*num_devices*x;
+}
+#define AP_AREA(ap,type) ((ap)[2*(type)])
+#define AP_PERIM(ap,type) ((ap)[2*(type)+1])
 
-  while (tmp->up) {
-    struct alias_tree *x;
-    x = tmp->up;
-    tmp->up = a;
-    tmp = x;
+static int getroot (struct ext_cell *C, int a)
+{
+  while (C->n[a].up >= 0) {
+    a = C->n[a].up;
   }
-  
   return a;
 }
 
-struct alias_tree *getalias (struct alias_tree *a)
+static int getroot_noglob (struct ext_cell *C, int a)
 {
-  struct alias_tree *root, *tmp;
+  int root = getroot (C, a);
 
-  root = getroot (a);
-  while (a->up) {
-    tmp = a->up;
-    a->up = root;
-    a = tmp;
+  while (C->n[a].up >= 0) {
+    int x = C->n[a].up;
+    C->n[a].up = root;
+    a = x;
   }
   return root;
 }
 
+static int getalias (struct ext_cell *C, int a)
+{
+  return getroot_noglob (C, a);
+}
+
 void global_name (const char *name, int *start, int *end)
 {
   int s, e;
@@ -174,34 +326,35 @@ void global_name (const char *name, int *start, int *end)
   *end = e;
 }
 
-void print_substr (const char *name, int s, int e)
+static int newnode (struct ext_cell *C, hash_bucket_t *b)
 {
-  while (s <= e) {
-    putchar (name[s++]);
-  }
+  struct ext_node *n;
+
+  A_NEW (C->n, struct ext_node);
+  n = &A_NEXT (C->n);
+  n->up = -1;
+  n->noglob = -1;
+  n->global = 0;
+  n->cap_gnd = 0;
+  n->b = b;
+  n->name = NULL;
+  b->i = A_LEN (C->n);
+  A_INC (C->n);
+  return b->i;
 }
 
-static struct alias_tree *newnode ()
+static struct ext_cell *newcell (void)
 {
-  struct alias_tree *a;
-  
-  NEW (a, struct alias_tree);
-  a->b = NULL;
-  a->global = 0;
-  a->up = NULL;
-  a->noglob = NULL;
-  a->name = NULL;
-  a->cap_gnd = 0;
-  MALLOC (a->area, double, num_devices);
-  MALLOC (a->perim, double, num_devices);
-  for (int i=0; i < num_devices; i++) {
-    a->area[i] = 0;
-    a->perim[i] = 0;
-  }
-  return a;
+  struct ext_cell *C;
+
+  NEW (C, struct ext_cell);
+  C->H = hash_new (32);
+  A_INIT (C->n);
+  C->ap = NULL;
+  C->apmax = 0;
+  return C;
 }
 
-
 static int islocal (char *s)
 {
   int i = 0;
@@ -215,25 +368,22 @@ static int islocal (char *s)
 /*
   name is in the EXT file namespace 
 */
-struct alias_tree *getname (struct Hashtable *N, const char *name)
+static int getname (struct ext_cell *C, const char *name)
 {
   hash_bucket_t *b;
-  struct alias_tree *a;
+  int a;
   int l;
 
-  b = hash_lookup (N, name);
+  b = hash_lookup (C->H, name);
   if (!b) {
-    b = hash_add (N, name);
-    a = newnode ();
-    a->name = name_munge (b->key);
-    b->v = a;
-    a->b = b;
+    b = hash_add (C->H, name);
+    a = newnode (C, b);
     l = strlen (b->key);
 
     /* if the name has a "!" in it, it is a global signal */
     while (l > 0) {
       if (b->key[l] == '!') {
-	a->global = 1;
+	C->n[a].global = 1;
 	break;
       }
       if (b->key[l] == '/') {
@@ -241,12 +391,11 @@ struct alias_tree *getname (struct Hashtable *N, const char *name)
       }
       l--;
     }
-    if (a->global) {
-      /* a->global = 1 => the signal has a ! */
+    if (C->n[a].global) {
+      /* global = 1 => the signal has a ! */
       int s, e;
       char *tmp;
       hash_bucket_t *g;
-      struct alias_tree *x;
 
       global_name (b->key, &s, &e);
       /* s, e correspond to start and end indices in b->key that
@@ -261,140 +410,100 @@ struct alias_tree *getname (struct Hashtable *N, const char *name)
 	e--;
       }
       /* tmp is the name of the global, without the ! */
-      g = hash_lookup (N, tmp);
+      g = hash_lookup (C->H, tmp);
       if (!g) {
-	g = hash_add (N, tmp);
-	x = newnode ();
-	x->global = 2;
-	x->name = g->key;
-	addglobal (x->name);
-	g->v = x;
-	x->b = g;
+	g = hash_add (C->H, tmp);
+	newnode (C, g);
+	C->n[g->i].global = 2;
+	addglobal (g->key);
       }
-      x = (struct alias_tree *)g->v;
-      a->up = x;
+      C->n[a].up = g->i;
       FREE (tmp);
     }
   }
-  return getalias ((struct alias_tree *)b->v);
+  return getalias (C, b->i);
 }
 
-void mergealias (struct alias_tree *a1, struct alias_tree *a2)
+static void mergealias (struct ext_cell *C, int a1, int a2)
 {
-  struct alias_tree *t1, *t2;
+  int t1, t2;
+  struct ext_node *n1, *n2;
 
   /* noglob merge trees */
-  t1 = getroot_noglob (a1);
-  t2 = getroot_noglob (a2);
+  t1 = getroot_noglob (C, a1);
+  t2 = getroot_noglob (C, a2);
   if (t1 != t2) {
-    t1->noglob = t2;
+    C->n[t1].noglob = t2;
   }
   
-  a1 = getalias (a1);
-  a2 = getalias (a2);
+  a1 = getalias (C, a1);
+  a2 = getalias (C, a2);
   if (a1 != a2) {
-    if (!a2->global) {
-      a2->up = a1;
-      a2->cap_gnd += a1->cap_gnd;
-      a1->cap_gnd = 0;
-    }
-    else if (!a1->global) {
-      a1->up = a2;
-      a1->cap_gnd += a2->cap_gnd;
-      a2->cap_gnd = 0;
-    }
-    else if (a2->global == 1) {
-      a2->up = a1;
-      a2->cap_gnd += a1->cap_gnd;
-      a1->cap_gnd = 0;
-    }
-    else if (a1->global == 1) {
-      a1->up = a2;
-      a1->cap_gnd += a2->cap_gnd;
-      a2->cap_gnd = 0;
+    n1 = &C->n[a1];
+    n2 = &C->n[a2];
+    if (!n2->global) {
+      n2->up = a1;
+      n2->cap_gnd += n1->cap_gnd;
+      n1->cap_gnd = 0;
+    }
+    else if (!n1->global) {
+      n1->up = a2;
+      n1->cap_gnd += n2->cap_gnd;
+      n2->cap_gnd = 0;
+    }
+    else if (n2->global == 1) {
+      n2->up = a1;
+      n2->cap_gnd += n1->cap_gnd;
+      n1->cap_gnd = 0;
+    }
+    else if (n1->global == 1) {
+      n1->up = a2;
+      n1->cap_gnd += n2->cap_gnd;
+      n2->cap_gnd = 0;
     }
     else {
-      warning ("Connecting `%s' and `%s': two globals?", a1->name, a2->name);
-      a1->up = a2;
-      a1->cap_gnd += a2->cap_gnd;
-      a2->cap_gnd = 0;
+      warning ("Connecting `%s' and `%s': two globals?",
+	       node_name (C, a1), node_name (C, a2));
+      n1->up = a2;
+      n1->cap_gnd += n2->cap_gnd;
+      n2->cap_gnd = 0;
     }
   }
 }
 
-static struct alias_tree *get_cur_node (hash_bucket_t *b, struct Hashtable *cur,
-					char *buf, int l)
-{
-  struct alias_tree *x = (struct alias_tree *)b->v;
-  hash_bucket_t *newb;
-  struct alias_tree *newx;
-  
-  if (x->global == 2) {
-    newb = hash_lookup (cur, b->key);
-    if (!newb) {
-      return NULL;
-    }
-    else {
-      return (struct alias_tree *)newb->v;
-    }
-  }
-  else {
-    sprintf (buf+l+1, "%s", b->key);
-    newb = hash_lookup (cur, buf);
-    if (!newb) {
-      return NULL;
-    }
-    else {
-      return (struct alias_tree *)newb->v;
-    }
-  }
-}
-
-static void import_base_node (hash_bucket_t *b, struct Hashtable *cur,
-			      char *buf, int l)
+/*
+  Node in the current cell corresponding to subcell node x; the
+  instance prefix is in buf[0..l].
+*/
+static int import_node (struct ext_cell *sub, int x, struct ext_cell *C,
+			char *buf, int l)
 {
-  struct alias_tree *x = (struct alias_tree *)b->v;
-  int new_node;
+  hash_bucket_t *b = sub->n[x].b;
   hash_bucket_t *newb;
-  struct alias_tree *newx;
-
-  sprintf (buf+l+1, "%s", b->key);
+  const char *key;
 
-  new_node = 1;
-
-  if (x->global == 2) {
-    newb = hash_lookup (cur, b->key);
-    if (!newb) {
-      newb = hash_add (cur, b->key);
-    }
-    else {
-      new_node = 0;
-    }
+  if (sub->n[x].global == 2) {
+    key = b->key;
   }
   else {
-    newb = hash_lookup (cur, buf);
-    if (newb) {
-      new_node = 0;
-    }
-    else {
-      newb = hash_add (cur, buf);
-    }
+    strcpy (buf+l+1, b->key);
+    key = buf;
   }
-  if (new_node) {
-    newx = newnode();
-    newx->name = name_munge (newb->key);
-    newx->global = x->global;
-    newb->v = newx;
-    newx->b = newb;
+  newb = hash_lookup (C->H, key);
+  if (!newb) {
+    newb = hash_add (C->H, key);
+    newnode (C, newb);
+    C->n[newb->i].global = sub->n[x].global;
   }
+  return newb->i;
 }
 
-static void import_subcell_conns (struct Hashtable *N,
+static void import_subcell_conns (struct ext_cell *C,
 				  const char *instname, const char *tname,
 				  int xl, int xh, int yl, int yh)
 {
-  struct Hashtable *sub;
-  hash_bucket_t *b, *tb;
+  struct ext_cell *sub;
+  hash_bucket_t *b;
   char *strbuf;
   int l, t;
 
@@ -402,15 +511,13 @@ static void import_subcell_conns (struct Hashtable *N,
 
   b = hash_lookup (seen, tname);
   Assert (b, "What?");
-  sub = (struct Hashtable *) b->v;
+  sub = (struct ext_cell *) b->v;
 
   t = 0;
-  for (int i=0; i < sub->size; i++) {
-    for (b = sub->head[i]; b; b = b->next) {
-      int x = strlen (b->key);
-      if (x > t) {
-	t = x;
-      }
+  for (int i=0; i < A_LEN (sub->n); i++) {
+    int x = strlen (sub->n[i].b->key);
+    if (x > t) {
+      t = x;
     }
   }
 
@@ -443,29 +550,24 @@ static void import_subcell_conns (struct Hashtable *N,
       sprintf (strbuf, "%s[%d,%d]/", instname, xval, yval);
     }
 
-    for (int i=0; i < sub->size; i++) {
-      for (b = sub->head[i]; b; b = b->next) {
-	struct alias_tree *base;
-	struct alias_tree *x, *x1;
-
-	base = (struct alias_tree *)b->v;
-	import_base_node (b, N, strbuf, l);
+    /* walk the subcell names in table order, so that the names in
+       the current cell are created in a deterministic order */
+    for (int i=0; i < sub->H->size; i++) {
+      for (b = sub->H->head[i]; b; b = b->next) {
+	struct ext_node *base = &sub->n[b->i];
+	int x, x1;
 
 	/* x is the current node */
-	x = get_cur_node (b, N, strbuf, l);
+	x = import_node (sub, b->i, C, strbuf, l);
 
 	/* now import connections */
-	if (base->up) {
-	  import_base_node (base->up->b, N, strbuf, l);
-	  x1 = get_cur_node (base->up->b, N, strbuf, l);
-	  Assert (x1, "What?");
-	  x->up = x1;
+	if (base->up >= 0) {
+	  x1 = import_node (sub, base->up, C, strbuf, l);
+	  C->n[x].up = x1;
 	}
-	if (base->noglob) {
-	  import_base_node (base->noglob->b, N, strbuf, l);
-	  x1 = get_cur_node (base->noglob->b, N, strbuf, l);
-	  Assert (x1, "What?");
-	  x->noglob = x1;
+	if (base->noglob >= 0) {
+	  x1 = import_node (sub, base->noglob, C, strbuf, l);
+	  C->n[x].noglob = x1;
 	}
       }
     }
@@ -494,19 +596,19 @@ static void import_subcell_conns (struct Hashtable *N,
   FREE (strbuf);
 }
 
-static void print_number (FILE *fp, double x)
+static void print_number (double x)
 {
   if (x > 1e3) {
-    fprintf (fp, "%gK", x*1e-3);
+    out_printf ("%gK", x*1e-3);
   }
   if (x > 1e-3) {
-    fprintf (fp, "%g", x);
+    out_printf ("%g", x);
   }
   else if (x > 1e-9) {
-    fprintf (fp, "%gU", x*1e6);
+    out_printf ("%gU", x*1e6);
   }
   else {
-    fprintf (fp, "%gP", x*1e12);
+    out_printf ("%gP", x*1e12);
   }
 }
 
@@ -514,8 +616,7 @@ static void print_number (FILE *fp, double x)
 void ext2spice (const char *name, struct ext_file *E, int toplevel)
 {
   hash_bucket_t *b;
-  int l;
-  struct Hashtable *N;
+  struct ext_cell *C;
   int devcount = 1;
   const char *extra_fet_string;
   
@@ -526,8 +627,8 @@ void ext2spice (const char *name, struct ext_file *E, int toplevel)
   b = hash_add (seen, name);
 
   /*-- create names table --*/
-  N = hash_new (32);
-  b->v = N;
+  C = newcell ();
+  b->v = C;
 
   if (config_exists ("net.extra_fet_string")) {
     extra_fet_string = config_get_string ("net.extra_fet_string");
@@ -556,211 +657,199 @@ void ext2spice (const char *name, struct ext_file *E, int toplevel)
       yl = lst->ylo;
       yh = lst->yhi;
     }
-    import_subcell_conns (N, lst->id, lst->file, xl, xh, yl, yh);
+    import_subcell_conns (C, lst->id, lst->file, xl, xh, yl, yh);
   }
 
   if (!toplevel) {
-    l = strlen (name);
-    if (l >= 4 && (strcmp (name + l - 4, ".ext") == 0)) {
-      l -= 4;
-    }
-    printf ("*---------------------------------------------------\n");
-    printf ("* Subcircuit from %s\n", name);
-    printf ("*---------------------------------------------------\n");
-    printf (".subckt ");
-    while (l) {
-      putchar (*name);
-      name++;
-      l--;
-    }
-    printf (" _\n");
+    out_str ("*---------------------------------------------------\n");
+    out_str ("* Subcircuit from ");
+    out_str (name);
+    out_str ("\n*---------------------------------------------------\n");
+    out_str (".subckt ");
+    out_cellname (name);
+    out_str (" _\n");
   }
   else {
-    printf ("*\n");
-    printf ("*---------------------------------------------------\n");
-    printf ("*  Main extract file %s [scale=%g]\n", name, scale);
-    printf ("*---------------------------------------------------\n");
-    printf ("*\n");
+    out_str ("*\n");
+    out_str ("*---------------------------------------------------\n");
+    out_printf ("*  Main extract file %s [scale=%g]\n", name, scale);
+    out_str ("*---------------------------------------------------\n");
+    out_str ("*\n");
   }
 
   if (E->subcells) {
-    printf ("*--- subcircuits ---\n");
+    out_str ("*--- subcircuits ---\n");
     for (struct ext_list *lst = E->subcells; lst; lst = lst->next) {
-      int p = 0;
-      printf ("x%s %s ", lst->id, gnd_node);
-      l = strlen (lst->file);
-      if (l >= 4 && (strcmp (lst->file + l - 4, ".ext") == 0)) {
-	l -= 4;
-      }
-      while (l) {
-	putchar (lst->file[p++]);
-	l--;
-      }
-      putchar ('\n');
+      out_chr ('x');
+      out_str (lst->id);
+      out_chr (' ');
+      out_str (gnd_node);
+      out_chr (' ');
+      out_cellname (lst->file);
+      out_chr ('\n');
     }
   }
   
   /*-- process aliases --*/
-  printf ("* -- connections ---\n");
+  out_str ("* -- connections ---\n");
   for (struct ext_alias *a = E->aliases; a; a = a->next) {
-    struct alias_tree *t1, *t2;
-    t1 = getname (N, a->n1);
-    t2 = getname (N, a->n2);
+    int t1, t2;
+    t1 = getname (C, a->n1);
+    t2 = getname (C, a->n2);
     if (t1 != t2) {
-      char *s1, *s2;
-      s1 = name_munge (a->n1);
-      s2 = name_munge (a->n2);
-      printf ("V%d %s %s\n", devcount++, s2, s1);
-      FREE (s1);
-      FREE (s2);
+      out_chr ('V');
+      out_int (devcount++);
+      out_chr (' ');
+      out_munged (a->n2);
+      out_chr (' ');
+      out_munged (a->n1);
+      out_chr ('\n');
     }
     if (islocal (a->n1)) {
-      mergealias (t1, t2);
+      mergealias (C, t1, t2);
     }
     else {
-      mergealias (t2, t1);
+      mergealias (C, t2, t1);
     }      
   }
 
   /*-- process area/perim --*/
   for (struct ext_ap *a = E->ap; a; a = a->next) {
-    struct alias_tree *t = getname (N, a->node);
+    int t = getname (C, a->node);
+    double *ap = node_ap (C, t, 1);
     for (int i=0; i < num_devices; i++) {
-      t->area[i] += a->area[i];
-      t->perim[i] += a->perim[i];
+      AP_AREA (ap, i) += a->area[i];
+      AP_PERIM (ap, i) += a->perim[i];
     }
   }
 
   /*--- now print out fets ---*/
   if (E->fet) {
-    printf ("* -- fets ---\n");
+    out_str ("* -- fets ---\n");
     for (struct ext_fets *fl = E->fet; fl; fl = fl->next) {
-      struct alias_tree *tsrc, *tdrain, *t;
+      int tsrc, tdrain, t;
+      double *ap;
       if (use_subckt_models) {
-	printf ("x");
+	out_chr ('x');
       }
-      printf ("M%d ", devcount++);
-      tdrain = getname (N, fl->t2); /* drain */
-      printf ("%s ", tdrain->name); /* gate */
-      t = getname (N, fl->g);  /* src */
-      printf ("%s ", t->name);
-      tsrc = getname (N, fl->t1);
-      printf ("%s ", tsrc->name);
-      t = getname (N, fl->sub);
-      printf ("%s ", t->name);
+      out_chr ('M');
+      out_int (devcount++);
+      out_chr (' ');
+      tdrain = getname (C, fl->t2); /* drain */
+      out_str (node_name (C, tdrain));
+      out_chr (' ');
+      t = getname (C, fl->g);  /* gate */
+      out_str (node_name (C, t));
+      out_chr (' ');
+      tsrc = getname (C, fl->t1); /* src */
+      out_str (node_name (C, tsrc));
+      out_chr (' ');
+      t = getname (C, fl->sub);
+      out_str (node_name (C, t));
+      out_chr (' ');
       if (devnames) {
-	printf ("%s ", config_get_string (devnames[fl->type]));
+	out_str (config_get_string (devnames[fl->type]));
+	out_chr (' ');
       }
       else {
 	if (fl->type == EXT_FET_PTYPE) {
-	  printf ("pfet ");
+	  out_str ("pfet ");
 	}
 	else {
-	  printf ("nfet ");
+	  out_str ("nfet ");
 	}
       }
-      printf ("W=");
-      print_number (stdout, fl->width*scale);
-      printf (" L=");
-      print_number (stdout, fl->length*scale);
-      printf ("\n+ AS=");
-      print_number (stdout, tsrc->area[fl->type]*scale*scale);
-      printf (" PS=");
-      print_number (stdout, tsrc->perim[fl->type]*scale);
-      tsrc->area[fl->type] = 0;
-      tsrc->perim[fl->type] = 0;
-      printf (" AD=");
-      print_number (stdout, tdrain->area[fl->type]*scale*scale);
-      printf (" PD=");
-      print_number (stdout, tdrain->perim[fl->type]*scale);
-      tdrain->area[fl->type] = 0;
-      tdrain->perim[fl->type] = 0;
+      out_str ("W=");
+      print_number (fl->width*scale);
+      out_str (" L=");
+      print_number (fl->length*scale);
+      ap = node_ap (C, tsrc, 0);
+      out_str ("\n+ AS=");
+      print_number (ap ? AP_AREA (ap, fl->type)*scale*scale : 0);
+      out_str (" PS=");
+      print_number (ap ? AP_PERIM (ap, fl->type)*scale : 0);
+      if (ap) {
+	AP_AREA (ap, fl->type) = 0;
+	AP_PERIM (ap, fl->type) = 0;
+      }
+      ap = node_ap (C, tdrain, 0);
+      out_str (" AD=");
+      print_number (ap ? AP_AREA (ap, fl->type)*scale*scale : 0);
+      out_str (" PD=");
+      print_number (ap ? AP_PERIM (ap, fl->type)*scale : 0);
+      if (ap) {
+	AP_AREA (ap, fl->type) = 0;
+	AP_PERIM (ap, fl->type) = 0;
+      }
 
       if (extra_fet_string) {
-	printf (" %s", extra_fet_string);
+	out_chr (' ');
+	out_str (extra_fet_string);
       }
-      printf ("\n");
+      out_chr ('\n');
     }
   }
 
   /*-- caps --*/
   if (E->cap) {
-    printf ("* -- caps ---\n");
+    out_str ("* -- caps ---\n");
 
-    /*--- collect cap to GND ---*/
+    /*--- single pass: collect cap to GND, and print the rest ---*/
     for (struct ext_cap *l = E->cap; l; l = l->next) {
-      struct alias_tree *t, *u;
+      int t, u;
 
-      t = getname (N, l->n1);
+      t = getname (C, l->n1);
       if (l->type == CAP_GND || l->type == CAP_SUBSTRATE) {
 	if (l->type == CAP_GND) {
-	  t->cap_gnd += l->cap;
+	  C->n[t].cap_gnd += l->cap;
 	}
+	continue;
       }
-      else {
-	u = getname (N, l->n2);
-	if (strcmp (t->name, gnd_node) == 0) {
-	  u->cap_gnd += l->cap;
-	}
-	else if (strcmp (u->name, gnd_node) == 0) {
-	  t->cap_gnd += l->cap;
-	}
+      u = getname (C, l->n2);
+      if (strcmp (node_name (C, t), gnd_node) == 0) {
+	C->n[u].cap_gnd += l->cap;
       }
-    }
-      
-    for (struct ext_cap *l = E->cap; l; l = l->next) {
-      struct alias_tree *t, *u;
-
-      if (l->type == CAP_GND || l->type == CAP_SUBSTRATE) continue;
-    
-      t = getname (N, l->n1);
-      u = getname (N, l->n2);
-      if (strcmp (t->name, gnd_node) == 0) {
-	continue;
+      else if (strcmp (node_name (C, u), gnd_node) == 0) {
+	C->n[t].cap_gnd += l->cap;
       }
-      else if (strcmp (u->name, gnd_node) == 0) {
-	continue;
+      else if (l->cap >= mincap) {
+	out_printf ("C%d %s %s %gF\n", devcount++, node_name (C, t),
+		    node_name (C, u), l->cap*1.0e15);
       }
-
-      if (l->cap < mincap) continue;
-    
-      printf ("C%d %s %s %gF\n", devcount++, t->name, u->name, l->cap*1.0e15);
     }
 
     /* print caps to GND */
-    for (int i=0; i < N->size; i++) {
-      for (hash_bucket_t *b = N->head[i]; b; b = b->next) {
-	struct alias_tree *t = (struct alias_tree *)b->v;
+    for (int i=0; i < C->H->size; i++) {
+      for (hash_bucket_t *b = C->H->head[i]; b; b = b->next) {
+	struct ext_node *t = &C->n[b->i];
 	if (t->cap_gnd > 0 && t->cap_gnd >= mincap) {
-	  if (strcmp (t->name, gnd_node) == 0) continue;
-	  printf ("C%d %s %s %gF\n", devcount++, t->name,
-		  gnd_node, t->cap_gnd*1.0e15);
+	  if (strcmp (node_name (C, b->i), gnd_node) == 0) continue;
+	  out_printf ("C%d %s %s %gF\n", devcount++, node_name (C, b->i),
+		      gnd_node, t->cap_gnd*1.0e15);
 	}
       }
     }
   }
 
   if (!toplevel) {
-    printf (".ends\n");
+    out_str (".ends\n");
   }
   else {
     /* print globals! */
-    printf ("*--- inferred globals\n");
+    out_str ("*--- inferred globals\n");
     for (int i=0; i < A_LEN (globals); i++) {
-      printf (".global %s\n", globals[i]);
+      out_str (".global ");
+      out_str (globals[i]);
+      out_chr ('\n');
     }
   }
 
-#if 0  
-  /*--- delete hashtable ---*/
-  for (int i=0; i < N->size; i++) {
-    for (hash_bucket_t *b = N->head[i]; b; b = b->next) {
-      FREE (b->v);
-    }
+  /* the area/perim values are not needed by parent cells */
+  if (C->ap) {
+    FREE (C->ap);
+    C->ap = NULL;
+    C->apmax = 0;
   }
-  hash_free (N);
-#endif  
-  N = NULL;
 }
 
 
@@ -775,7 +864,7 @@ int main (int argc, char **argv)
 
   Act::Init (&argc, &argv);
 
-  while ((ch = getopt (argc, argv, "c:s:")) != -1) {
+  while ((ch = getopt (argc, argv, "c:s:j:C")) != -1) {
     switch (ch) {
     case 'c':
       mincap = atof (optarg);
@@ -783,6 +872,15 @@ int main (int argc, char **argv)
     case 's':
       scale = atof (optarg);
       break;
+    case 'j':
+      if (atoi (optarg) < 0) {
+	usage (argv[0]);
+      }
+      ext_set_threads (atoi (optarg));
+      break;
+    case 'C':
+      ext_set_cache (1);
+      break;
     default:
       usage(argv[0]);
       break;
@@ -827,7 +925,9 @@ int main (int argc, char **argv)
     use_subckt_models = config_get_int ("net.use_subckt_models");
   }
 
+  MALLOC (outbuf, char, OUTBUF_SIZE);
   ext2spice (argv[optind], E, 1);
+  out_flush ();
 
   return 0;
 }
@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# Generate a large flat extract file for measuring ext2sp throughput
+# and peak memory, e.g.
+#
+#   ./genbig.sh 200000 2000000 > /tmp/big.ext
+#   ../ext2sp.$EXT /tmp/big.ext > /dev/null
+#
+# Arguments: number of nodes, number of coupling caps [200000 2000000]
+#
+nodes=${1:-200000}
+caps=${2:-2000000}
+
+awk -v N=$nodes -v C=$caps 'function nm(i) { return "\"a/b" int(i/1000) "/n" i "\"" }
+BEGIN {
+  srand(1);
+  print "timestamp 100"; print "version 8.2"; print "tech scmos";
+  print "scale 1000 1 5";
+  for (i=0; i < N; i++) {
+    print "node " nm(i) " 10 20.5 0 0 ndiff 100 40 0 0";
+  }
+  for (i=0; i < N; i++) {
+    print "fet nfet 0 0 1 1 24 12 \"GND!\" " nm(i) " 4 0 " nm((i+1)%N) " 6 0 " nm((i+7)%N) " 6 0";
+  }
+  for (i=0; i < C; i++) {
+    print "cap " nm(int(rand()*N)) " " nm(int(rand()*N)) " " 1+int(rand()*500);
+  }
+  for (i=0; i+1 < N; i += 97) {
+    print "merge " nm(i) " " nm(i+1) " -3";
+  }
+}'
@@ -28,11 +28,14 @@
 #include <act/passes.h>
 #include <act/passes/cells.h>
 #include <common/config.h>
+#include <common/mytime.h>
 
 
 static void usage (char *name)
 {
-  fprintf (stderr, "Usage: %s [act-options] <actfile> <cellin> <cellout>\n", name);
+  fprintf (stderr, "Usage: %s [act-options] [-s] [-j <num>] <actfile> <cellin> <cellout>\n", name);
+  fprintf (stderr, " -s : print cell matching statistics and run time to stderr\n");
+  fprintf (stderr, " -j <num> : extract gates using <num> threads (0 = all cpus)\n");
   exit (1);
 }
 
@@ -43,14 +46,36 @@ int main (int argc, char **argv)
   char *proc;
   FILE *fp;
 
+  int ch;
+  int stats = 0;
+  int num_threads = 1;
+  double tm;
+
   Act::Init (&argc, &argv);
 
-  if (argc != 4) {
+  while ((ch = getopt (argc, argv, "sj:")) != -1) {
+    switch (ch) {
+    case 's':
+      stats = 1;
+      break;
+    case 'j':
+      num_threads = atoi (optarg);
+      if (num_threads < 0) {
+	usage (argv[0]);
+      }
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+
+  if (argc - optind != 3) {
     usage (argv[0]);
   }
 
-  a = new Act (argv[1]);
-  a->Merge (argv[2]);
+  a = new Act (argv[optind]);
+  a->Merge (argv[optind+1]);
   a->Expand ();
   /* for each expanded ACT process, read in cells */
 
@@ -58,12 +83,20 @@ int main (int argc, char **argv)
      to cells */
 
   ActCellPass *cp = new ActCellPass (a);
+  cp->setThreads (num_threads);
+  realtime_msec ();
   cp->run();
+  tm = realtime_msec ();
+
+  if (stats) {
+    cp->printStats (stderr);
+    fprintf (stderr, "prs2cells: run time %.1f ms\n", tm);
+  }
 
   /* now emit new cells file */
-  fp = fopen (argv[3], "w");
+  fp = fopen (argv[optind+2], "w");
   if (!fp) {
-    fatal_error ("Could not open file `%s' for writing", argv[3]);
+    fatal_error ("Could not open file `%s' for writing", argv[optind+2]);
   }
   cp->Print (fp);
   fclose (fp);
@@ -109,6 +109,39 @@ then
 	echo
 fi
 
+#
+# Parallel gate extraction must produce byte-identical output
+#
+myecho " "
+num=0
+for i in [0-9]*.act par_*.act
+do
+	num=`expr $num + 1`
+	bname=`expr $i : '\(.*\).act'`
+	myecho ".[j:$bname]"
+	$ACTTOOL -j 1 $i cells.act runs/$i.j1.cellout > runs/$i.j1.stdout 2>/dev/null
+	$ACTTOOL -j 4 $i cells.act runs/$i.j4.cellout > runs/$i.j4.stdout 2>/dev/null
+	if ! cmp runs/$i.j1.stdout runs/$i.j4.stdout >/dev/null 2>/dev/null || \
+	   ! cmp runs/$i.j1.cellout runs/$i.j4.cellout >/dev/null 2>/dev/null
+	then
+		echo
+		echo "** FAILED TEST $i: -j 4 output differs from -j 1 **"
+		myecho " "
+		fail=`expr $fail + 1`
+		num=0
+	elif [ $num -eq $lim ]
+	then
+		echo
+		myecho " "
+		num=0
+	fi
+done
+
+if [ $num -ne 0 ]
+then
+	echo
+fi
+
 
 if [ $fail -ne 0 ]
 then
@@ -60,11 +60,15 @@ static void usage (char *name)
   fprintf (stderr, " -l	       LVS netlist; ignore all load capacitances\n");
   fprintf (stderr, " -S        Enable shared long-channel devices in staticizers\n");
   fprintf (stderr, " -s <scale> Scale all transistor parameters by <scale>\n");
+  fprintf (stderr, " -j <num>  Use <num> threads for netlist generation (0 = all processors)\n");
+  fprintf (stderr, " -C <dir>  Incremental mode: cache per-process netlists in <dir>\n");
   exit (1);
 }
 
 
 static int enable_shared_stat = 0;
+static int num_threads = 1;
+static char *cache_dir;
 static char *cell_file;
 
 /*
@@ -86,6 +90,7 @@ static char *initialize_parameters (int *argc, char ***argv, FILE **fpout)
   top_level_only = 0;
   proc_name = NULL;
   cell_file = NULL;
+  cache_dir = NULL;
 
   config_set_default_string ("net.global_vdd", "Vdd");
   config_set_default_string ("net.global_gnd", "GND");
@@ -94,7 +99,7 @@ static char *initialize_parameters (int *argc, char ***argv, FILE **fpout)
 
   Act::Init (argc, argv);
 
-  while ((ch = getopt (*argc, *argv, "SBdtp:o:lc:s:")) != -1) {
+  while ((ch = getopt (*argc, *argv, "SBdtp:o:lc:s:j:C:")) != -1) {
     switch (ch) {
     case 's':
       scale_factor = atof (optarg);
@@ -104,6 +109,20 @@ static char *initialize_parameters (int *argc, char ***argv, FILE **fpout)
     case 'S':
       enable_shared_stat = 1;
       break;
+
+    case 'C':
+      if (cache_dir) {
+	FREE (cache_dir);
+      }
+      cache_dir = Strdup (optarg);
+      break;
+
+    case 'j':
+      num_threads = atoi (optarg);
+      if (num_threads < 0) {
+	usage ((*argv)[0]);
+      }
+      break;
       
     case 'l':
       ignore_loadcap = 1;
@@ -234,6 +253,10 @@ int main (int argc, char **argv)
   if (enable_shared_stat) {
     np->enableSharedStat();
   }
+  np->setThreads (num_threads);
+  if (cache_dir) {
+    np->setCacheDir (cache_dir);
+  }
   np->run (p);
   np->Print (fpout, p);
   if (fpout != stdin) {
@@ -101,6 +101,127 @@ then
 	echo
 fi
 
+#
+# Parallel netlist generation must produce byte-identical output
+#
+myecho " "
+num=0
+for i in [0-9]*.act par_*.act
+do
+	num=`expr $num + 1`
+	bname=`expr $i : '\(.*\).act'`
+	myecho ".[j:$bname]"
+	if [ -f conf_$i ]
+	then
+		cnf=-cnf=conf_$i
+	else
+		cnf=
+	fi
+	$ACTTOOL $cnf -j 1 -l -p 'foo<>' $i > runs/$i.j1.stdout 2>/dev/null
+	$ACTTOOL $cnf -j 4 -l -p 'foo<>' $i > runs/$i.j4.stdout 2>/dev/null
+	if ! cmp runs/$i.j1.stdout runs/$i.j4.stdout >/dev/null 2>/dev/null
+	then
+		echo
+		echo "** FAILED TEST $i: -j 4 output differs from -j 1 **"
+		myecho " "
+		fail=`expr $fail + 1`
+		num=0
+	elif [ $num -eq $lim ]
+	then
+		echo
+		myecho " "
+		num=0
+	fi
+done
+
+if [ $num -ne 0 ]
+then
+	echo
+fi
+
+#
+# Incremental mode (-C): a cold and a warm run must match the
+# non-incremental output, and so must a run after an edit that
+# invalidates part of the cache
+#
+myecho " "
+num=0
+for i in [0-9]*.act par_*.act
+do
+	num=`expr $num + 1`
+	bname=`expr $i : '\(.*\).act'`
+	myecho ".[C:$bname]"
+	if [ -f conf_$i ]
+	then
+		cnf=-cnf=conf_$i
+	else
+		cnf=
+	fi
+	rm -rf runs/cache
+	$ACTTOOL $cnf -l -p 'foo<>' $i > runs/$i.C0.stdout 2>/dev/null
+	$ACTTOOL $cnf -C runs/cache -l -p 'foo<>' $i > runs/$i.C1.stdout 2>/dev/null
+	$ACTTOOL $cnf -C runs/cache -l -p 'foo<>' $i > runs/$i.C2.stdout 2>/dev/null
+	if ! cmp runs/$i.C0.stdout runs/$i.C1.stdout >/dev/null 2>/dev/null || \
+	   ! cmp runs/$i.C0.stdout runs/$i.C2.stdout >/dev/null 2>/dev/null
+	then
+		echo
+		echo "** FAILED TEST $i: -C output differs **"
+		myecho " "
+		fail=`expr $fail + 1`
+		num=0
+	elif [ $num -eq $lim ]
+	then
+		echo
+		myecho " "
+		num=0
+	fi
+done
+
+# edit a leaf type and one instance count, re-using the warm cache
+sed -e 's/a | b #> c-/a \& b #> c-/' -e 's/chain<3>/chain<4>/' par_0.act > runs/par_edit.act
+$ACTTOOL -l -p 'foo<>' runs/par_edit.act > runs/par_edit.C0.stdout 2>/dev/null
+$ACTTOOL -C runs/cache -l -p 'foo<>' runs/par_edit.act > runs/par_edit.C1.stdout 2>/dev/null
+myecho ".[C:edit]"
+if ! cmp runs/par_edit.C0.stdout runs/par_edit.C1.stdout >/dev/null 2>/dev/null
+then
+	echo
+	echo "** FAILED TEST par_edit: -C output after edit differs **"
+	fail=`expr $fail + 1`
+fi
+echo
+rm -rf runs/cache runs/par_edit.act
+
+#
+# Pass profiling (-prof=): the netlist must be unchanged, and both
+# the JSON and the folded-stack profiles must name the netlist pass
+# and its booleanize dependency
+#
+myecho " .[prof]"
+$ACTTOOL -prof=runs/prof.json -l -p 'foo<>' par_0.act > runs/prof.stdout 2>/dev/null
+$ACTTOOL -prof=runs/prof.folded -l -p 'foo<>' par_0.act > /dev/null 2>/dev/null
+$ACTTOOL -l -p 'foo<>' par_0.act > runs/prof.0.stdout 2>/dev/null
+if ! cmp runs/prof.0.stdout runs/prof.stdout >/dev/null 2>/dev/null
+then
+	echo
+	echo "** FAILED TEST prof: output differs with -prof **"
+	fail=`expr $fail + 1`
+elif ! grep '"name": "prs2net"' runs/prof.json >/dev/null 2>&1 || \
+     ! grep '"name": "booleanize"' runs/prof.json >/dev/null 2>&1 || \
+     ! grep '"cpu_ms"' runs/prof.json >/dev/null 2>&1
+then
+	echo
+	echo "** FAILED TEST prof: JSON profile incomplete **"
+	fail=`expr $fail + 1`
+elif ! grep '^prs2net;booleanize' runs/prof.folded >/dev/null 2>&1 || \
+     grep -v '^[^ ]* [0-9][0-9]*$' runs/prof.folded >/dev/null 2>&1
+then
+	echo
+	echo "** FAILED TEST prof: folded profile malformed **"
+	fail=`expr $fail + 1`
+fi
+echo
+rm -f runs/prof.json runs/prof.folded runs/prof.stdout runs/prof.0.stdout
+
 
 if [ $fail -ne 0 ]
 then
@@ -0,0 +1,206 @@
+/*************************************************************************
+ *
+ *  This file is part of the ACT library
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ *  Synthetic design generator for benchmarking.
+ *
+ *  The design is a tree of "lvl<d>" processes: each level has
+ *  <fanout> instances of the level below it, chained together
+ *  through a bool array and a channel. The leaves are PRS cells
+ *  (leaf<W,K>) and CHP processes (cleaf<W,K>); the K parameter is
+ *  varied so that there are up to <unique> distinct leaf types. The
+ *  top-level process is "top<>".
+ *
+ *  The scale presets correspond to the sizes used by run.sh.
+ */
+
+static int depth = 3;		/* levels of hierarchy */
+static int fanout = 4;		/* instances per level */
+static int width = 8;		/* bool array width */
+static int unique = 8;		/* # of distinct template instances */
+static int chp_every = 4;	/* every n-th leaf is a CHP process */
+
+static void usage (char *name)
+{
+  fprintf (stderr, "Usage: %s [-s small|medium|large] [-d depth] [-f fanout] [-w width] [-u unique] [-c n]\n", name);
+  fprintf (stderr, "  -s : scale preset (default: small)\n");
+  fprintf (stderr, "  -d : levels of hierarchy (default: %d)\n", depth);
+  fprintf (stderr, "  -f : instances per level (default: %d)\n", fanout);
+  fprintf (stderr, "  -w : width of bool arrays (default: %d)\n", width);
+  fprintf (stderr, "  -u : number of distinct leaf template instances (default: %d)\n", unique);
+  fprintf (stderr, "  -c : every n-th leaf is a CHP process, 0 = none (default: %d)\n", chp_every);
+  exit (1);
+}
+
+static void set_scale (char *name, char *s)
+{
+  if (strcmp (s, "small") == 0) {
+    depth = 3; fanout = 4; width = 8; unique = 8; chp_every = 4;
+  }
+  else if (strcmp (s, "medium") == 0) {
+    depth = 4; fanout = 6; width = 8; unique = 32; chp_every = 4;
+  }
+  else if (strcmp (s, "large") == 0) {
+    depth = 5; fanout = 8; width = 16; unique = 128; chp_every = 8;
+  }
+  else {
+    usage (name);
+  }
+}
+
+static void emit_leaves (FILE *fp)
+{
+  /* PRS-heavy leaf */
+  fprintf (fp, "template<pint W, K>\n");
+  fprintf (fp, "defproc leaf (bool? in[W]; bool! out[W])\n");
+  fprintf (fp, "{\n");
+  fprintf (fp, "  bool x[W], y[W];\n");
+  fprintf (fp, "  prs {\n");
+  fprintf (fp, "    (i:W: in[i] & in[(i+K)%%W] -> x[i]-\n");
+  fprintf (fp, "         ~in[i] | ~in[(i+K)%%W] -> x[i]+\n");
+  fprintf (fp, "          x[i] & y[(i+1)%%W] -> out[i]-\n");
+  fprintf (fp, "         ~x[i] & ~y[(i+1)%%W] -> out[i]+\n");
+  fprintf (fp, "          x[i] => y[i]-\n");
+  fprintf (fp, "    )\n");
+  fprintf (fp, "  }\n");
+  fprintf (fp, "}\n\n");
+
+  /* CHP leaf */
+  fprintf (fp, "template<pint W, K>\n");
+  fprintf (fp, "defproc cleaf (bool? in[W]; bool! out[W]; chan?(int<8>) l; chan!(int<8>) r)\n");
+  fprintf (fp, "{\n");
+  fprintf (fp, "  int<8> x, acc;\n");
+  fprintf (fp, "  chp {\n");
+  fprintf (fp, "    acc := 0;\n");
+  fprintf (fp, "    *[ l?x; acc := acc + x + K;\n");
+  fprintf (fp, "       [ acc > W -> r!acc; acc := 0 [] else -> skip ];\n");
+  fprintf (fp, "       (;i:W: [in[i] -> out[i]+ [] else -> out[i]-])\n");
+  fprintf (fp, "     ]\n");
+  fprintf (fp, "  }\n");
+  fprintf (fp, "}\n\n");
+}
+
+static int is_chp (int i)
+{
+  return chp_every > 0 && (i % chp_every) == chp_every - 1;
+}
+
+/*
+ *  Every level is parameterized by V, the index of the instance among
+ *  all instances at that level; leaf i of lvl1<V> gets K = (V*f+i) %
+ *  unique. So all the non-leaf instances are distinct types as well.
+ */
+static void emit_level (FILE *fp, int d)
+{
+  int i, k;
+
+  fprintf (fp, "template<pint V>\n");
+  fprintf (fp, "defproc lvl%d (bool? in[%d]; bool! out[%d]; chan?(int<8>) l; chan!(int<8>) r)\n", d, width, width);
+  fprintf (fp, "{\n");
+  for (i=0; i < fanout; i++) {
+    if (d > 1) {
+      fprintf (fp, "  lvl%d<V*%d+%d> c%d;\n", d-1, fanout, i, i);
+    }
+    else if (is_chp (i)) {
+      fprintf (fp, "  cleaf<%d,(V*%d+%d)%%%d> c%d;\n", width, fanout, i, unique, i);
+    }
+    else {
+      fprintf (fp, "  leaf<%d,(V*%d+%d)%%%d> c%d;\n", width, fanout, i, unique, i);
+    }
+  }
+  fprintf (fp, "  c0.in = in;\n");
+  for (i=1; i < fanout; i++) {
+    fprintf (fp, "  c%d.in = c%d.out;\n", i, i-1);
+  }
+  fprintf (fp, "  c%d.out = out;\n", fanout-1);
+
+  /* thread the channel through everything that has one */
+  k = -1;
+  for (i=0; i < fanout; i++) {
+    if (d > 1 || is_chp (i)) {
+      if (k == -1) {
+	fprintf (fp, "  c%d.l = l;\n", i);
+      }
+      else {
+	fprintf (fp, "  c%d.l = c%d.r;\n", i, k);
+      }
+      k = i;
+    }
+  }
+  if (k == -1) {
+    fprintf (fp, "  l = r;\n");
+  }
+  else {
+    fprintf (fp, "  c%d.r = r;\n", k);
+  }
+  fprintf (fp, "}\n\n");
+}
+
+int main (int argc, char **argv)
+{
+  int ch;
+
+  while ((ch = getopt (argc, argv, "s:d:f:w:u:c:")) != -1) {
+    switch (ch) {
+    case 's':
+      set_scale (argv[0], optarg);
+      break;
+    case 'd':
+      depth = atoi (optarg);
+      break;
+    case 'f':
+      fanout = atoi (optarg);
+      break;
+    case 'w':
+      width = atoi (optarg);
+      break;
+    case 'u':
+      unique = atoi (optarg);
+      break;
+    case 'c':
+      chp_every = atoi (optarg);
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+  if (optind != argc || depth < 1 || fanout < 2 || width < 1 ||
+      unique < 1 || chp_every < 0) {
+    usage (argv[0]);
+  }
+
+  printf ("/* actgen -d %d -f %d -w %d -u %d -c %d */\n\n",
+	  depth, fanout, width, unique, chp_every);
+  emit_leaves (stdout);
+  for (int d=1; d <= depth; d++) {
+    emit_level (stdout, d);
+  }
+  printf ("defproc top ()\n{\n  lvl%d<0> t;\n}\n", depth);
+  return 0;
+}
@@ -0,0 +1,186 @@
+/*************************************************************************
+ *
+ *  This file is part of the ACT library
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <act/act.h>
+#include <act/passes.h>
+#include <common/config.h>
+#include <common/mytime.h>
+
+/*
+ *  Time each stage of the standard flow separately on one design:
+ *
+ *     parse, expand, booleanize, cells, state, netlist, flatten
+ *
+ *  One line is printed per stage, of the form
+ *
+ *     tag=<tag> phase=<name> time_ms=<wall> cpu_ms=<cpu> maxrss_kb=<peak>
+ *
+ *  where maxrss_kb is the peak RSS of the process at the end of the
+ *  stage. Stages after the one specified with -l are skipped. The
+ *  sizing pass is a dependency of the cell pass, and is included in
+ *  the time for "cells".
+ *
+ *  Example: passbench -t small design.act 'top<>'
+ */
+
+static const char *phases[] = {
+  "parse", "expand", "booleanize", "cells", "state", "netlist", "flatten",
+  NULL
+};
+
+static const char *tag = "-";
+
+static void usage (char *name)
+{
+  fprintf (stderr, "Usage: %s [act-options] [-t tag] [-j threads] [-l lastphase] <actfile> <process>\n", name);
+  fprintf (stderr, "  -t : tag printed on every line (default: -)\n");
+  fprintf (stderr, "  -j : threads for the cells and netlist passes (default: 1)\n");
+  fprintf (stderr, "  -l : last phase to run; one of");
+  for (int i=0; phases[i]; i++) {
+    fprintf (stderr, " %s", phases[i]);
+  }
+  fprintf (stderr, "\n");
+  exit (1);
+}
+
+static void phase_begin (void)
+{
+  realtime_msec ();
+  cputime_msec ();
+}
+
+/* returns 1 if this was the last phase */
+static int phase_end (int idx, int last)
+{
+  double tm, ctm;
+  struct rusage ru;
+
+  tm = realtime_msec ();
+  ctm = cputime_msec ();
+  getrusage (RUSAGE_SELF, &ru);
+  printf ("tag=%s phase=%s time_ms=%.1f cpu_ms=%.1f maxrss_kb=%ld\n",
+	  tag, phases[idx], tm, ctm, ru.ru_maxrss);
+  fflush (stdout);
+  return idx == last;
+}
+
+static long ninst, nconn;
+
+static void count_inst (void *cookie, ActApplyPath *p, UserDef *u)
+{
+  ninst++;
+}
+
+static void count_conn (void *cookie, ActApplyPath *p1, ActApplyPath *p2)
+{
+  nconn++;
+}
+
+int main (int argc, char **argv)
+{
+  Act *a;
+  Process *p;
+  int ch, last, nthreads;
+
+  Act::Init (&argc, &argv);
+
+  last = -1;
+  nthreads = 1;
+  while ((ch = getopt (argc, argv, "t:j:l:")) != -1) {
+    switch (ch) {
+    case 't':
+      tag = optarg;
+      break;
+    case 'j':
+      nthreads = atoi (optarg);
+      break;
+    case 'l':
+      for (last=0; phases[last]; last++) {
+	if (strcmp (phases[last], optarg) == 0) break;
+      }
+      if (!phases[last]) {
+	usage (argv[0]);
+      }
+      break;
+    default:
+      usage (argv[0]);
+      break;
+    }
+  }
+  if (optind + 2 != argc || nthreads < 0) {
+    usage (argv[0]);
+  }
+
+  phase_begin ();
+  a = new Act (argv[optind]);
+  if (phase_end (0, last)) return 0;
+
+  phase_begin ();
+  a->Expand ();
+  p = a->findProcess (argv[optind+1]);
+  if (!p) {
+    fatal_error ("Could not find process `%s' in file `%s'", argv[optind+1],
+		 argv[optind]);
+  }
+  if (!p->isExpanded()) {
+    fatal_error ("Process `%s' is not expanded.", argv[optind+1]);
+  }
+  if (phase_end (1, last)) return 0;
+
+  phase_begin ();
+  ActBooleanizePass *bp = new ActBooleanizePass (a);
+  bp->run (p);
+  if (phase_end (2, last)) return 0;
+
+  phase_begin ();
+  ActCellPass *cp = new ActCellPass (a);
+  cp->setThreads (nthreads);
+  cp->run ();
+  if (phase_end (3, last)) return 0;
+
+  phase_begin ();
+  ActStatePass *sp = new ActStatePass (a);
+  sp->run (p);
+  if (phase_end (4, last)) return 0;
+
+  phase_begin ();
+  ActNetlistPass *np = new ActNetlistPass (a);
+  np->setThreads (nthreads);
+  np->run (p);
+  if (phase_end (5, last)) return 0;
+
+  phase_begin ();
+  ActApplyPass *ap = new ActApplyPass (a);
+  ap->setInstPathFn (count_inst);
+  ap->setConnPathFn (count_conn);
+  ap->run (p);
+  phase_end (6, last);
+  printf ("tag=%s instances=%ld connections=%ld\n", tag, ninst, nconn);
+
+  return 0;
+}
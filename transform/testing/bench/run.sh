@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Generate the synthetic designs at each scale and time every stage of
+# the flow on them. Results are printed as tag=<scale> key=value lines
+# (see passbench.cc), one line per stage.
+#
+# Usage: run.sh [scale ...]     (default: small medium large)
+#
+# Any options in $PASSBENCH_OPTS (e.g. -j 8) are passed to passbench.
+#
+
+ARCH=`$VLSI_TOOLS_SRC/scripts/getarch`
+OS=`$VLSI_TOOLS_SRC/scripts/getos`
+EXT=${ARCH}_${OS}
+
+if [ $# -eq 0 ]
+then
+	set small medium large
+fi
+
+tmp=${TMPDIR:-/tmp}/actbench.$$
+mkdir -p $tmp || exit 1
+trap "rm -rf $tmp" 0 1 2 15
+
+fail=0
+for scale in "$@"
+do
+	if ./actgen.$EXT -s $scale > $tmp/$scale.act
+	then
+		if ./passbench.$EXT $PASSBENCH_OPTS -t $scale $tmp/$scale.act 'top<>'
+		then
+			:
+		else
+			echo "tag=$scale failed=1"
+			fail=1
+		fi
+	else
+		fail=1
+	fi
+done
+exit $fail
@@ -0,0 +1,219 @@
+/*************************************************************************
+ *
+ *  This file is part of the ACT library
+ *
+ *  Copyright (c) 2024 Rajit Manohar
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <act/act.h>
+#include <act/passes.h>
+#include <common/config.h>
+#include <common/mytime.h>
+
+/*
+ *  Resolve every local and port offset of a process back to its
+ *  connection using getConnFromOffset(), and check that getTypeOffset()
+ *  maps the connection back to the same offset.
+ *
+ *  If a layout file is specified, the flattened state layout is saved
+ *  to it and then read back, and every global bool offset is mapped
+ *  to its hierarchical name and back using globalBoolOffset().
+ *
+ *  Example: bench_statepass test/bench.act 'foo<>'
+ */
+
+static void usage (char *name)
+{
+  fprintf (stderr, "Usage: %s [act-options] <actfile> <process> [reps [layoutfile]]\n", name);
+  exit (1);
+}
+
+static ActStatePass *sp;
+static stateinfo_t *si;
+static long nlookups, nresolved, nerrors;
+
+static void check (int off, int type)
+{
+  act_connection *c;
+  int doff, roff, rtype, rwidth;
+
+  nlookups++;
+  c = sp->getConnFromOffset (si, off, type, &doff);
+  if (!c) {
+    return;
+  }
+  nresolved++;
+  if (doff >= 0) {
+    /* element of a dynamic array; the offset is of the array */
+    return;
+  }
+  if (!sp->getTypeOffset (si, c, &roff, &rtype, &rwidth)) {
+    nerrors++;
+    return;
+  }
+  if (roff != off || (rtype == 0) != (type == 0)) {
+    nerrors++;
+  }
+}
+
+static int check_layout (const char *file, int reps)
+{
+  ActStateLayout *l;
+  char buf[10240];
+  double tm;
+  long nnames, nerr;
+  int nb;
+
+  realtime_msec ();
+  if (!sp->saveLayout (file)) {
+    fatal_error ("Could not save layout to `%s'", file);
+  }
+  tm = realtime_msec ();
+  printf ("layout_save_ms=%.1f\n", tm);
+
+  realtime_msec ();
+  l = ActStateLayout::Open (file);
+  tm = realtime_msec ();
+  if (!l) {
+    fatal_error ("Could not read layout from `%s'", file);
+  }
+
+  /* offset -> name -> offset */
+  nb = si->all.numBools();
+  nnames = 0;
+  nerr = 0;
+  for (int i=0; i < nb; i++) {
+    if (!l->offsetName (i, ACT_STATE_BOOL, buf, 10240)) {
+      continue;
+    }
+    nnames++;
+    ActId *id = ActId::parseId (buf);
+    if (!id || !sp->checkIdExists (id) || sp->globalBoolOffset (id) != i) {
+      nerr++;
+    }
+    if (id) {
+      delete id;
+    }
+  }
+
+  /* time reverse lookups alone */
+  realtime_msec ();
+  for (int r=0; r < reps; r++) {
+    for (int i=0; i < nb; i++) {
+      l->offsetName (i, ACT_STATE_BOOL, buf, 10240);
+    }
+  }
+  double rtm = realtime_msec ();
+
+  printf ("layout_open_ms=%.3f instances=%d allbools=%d named=%ld errors=%ld ns_per_name=%.1f\n",
+	  tm, l->numInst(), nb, nnames, nerr,
+	  nb > 0 ? rtm*1e6/(nb*(double)reps) : 0.0);
+  delete l;
+  return nerr > 0 ? 1 : 0;
+}
+
+int main (int argc, char **argv)
+{
+  Act *a;
+  int reps;
+  double tm;
+
+  Act::Init (&argc, &argv);
+
+  if (argc < 3 || argc > 5) {
+    usage (argv[0]);
+  }
+  reps = 1;
+  if (argc >= 4) {
+    reps = atoi (argv[3]);
+    if (reps < 1) {
+      usage (argv[0]);
+    }
+  }
+
+  a = new Act (argv[1]);
+  a->Expand ();
+ 
+  Process *p = a->findProcess (argv[2]);
+
+  if (!p) {
+    fatal_error ("Could not find process `%s' in file `%s'", argv[2], argv[1]);
+  }
+
+  if (!p->isExpanded()) {
+    fatal_error ("Process `%s' is not expanded.", argv[2]);
+  }
+
+  sp = new ActStatePass (a, argc == 5 ? 1 : 0);
+  realtime_msec ();
+  sp->run (p);
+  tm = realtime_msec ();
+  printf ("pass_ms=%.1f\n", tm);
+
+  si = sp->getStateInfo (p);
+  if (!si) {
+    fatal_error ("Process `%s' is a black box.", argv[2]);
+  }
+
+  realtime_msec ();
+  for (int r=0; r < reps; r++) {
+    nlookups = 0;
+    nresolved = 0;
+    nerrors = 0;
+    /* local state */
+    for (int i=0; i < si->local.numBools(); i++) {
+      check (i, 0);
+    }
+    for (int i=0; i < si->local.numCHPBools(); i++) {
+      check (si->all.numBools() + i, 0);
+    }
+    for (int i=0; i < si->local.numInts(); i++) {
+      check (i, 1);
+    }
+    for (int i=0; i < si->local.numChans(); i++) {
+      check (i, 2);
+    }
+    /* ports: odd negative offsets */
+    for (int i=0; i < si->ports.numBools() + si->ports.numCHPBools(); i++) {
+      check (-(2*i+1), 0);
+    }
+    for (int i=0; i < si->ports.numInts(); i++) {
+      check (-(2*i+1), 1);
+    }
+    for (int i=0; i < si->ports.numChans(); i++) {
+      check (-(2*i+1), 2);
+    }
+  }
+  tm = realtime_msec ();
+
+  printf ("bools=%d chpbools=%d ints=%d chans=%d ports=%d lookups=%ld resolved=%ld errors=%ld time_ms=%.1f ns_per_lookup=%.1f\n",
+	  si->local.numBools(), si->local.numCHPBools(), si->local.numInts(),
+	  si->local.numChans(), si->ports.numAllVars(),
+	  nlookups, nresolved, nerrors, tm,
+	  nlookups > 0 ? tm*1e6/(nlookups*(double)reps) : 0.0);
+
+  if (argc == 5 && check_layout (argv[4], reps)) {
+    nerrors++;
+  }
+
+  return nerrors > 0 ? 1 : 0;
+}
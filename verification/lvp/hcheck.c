@@ -0,0 +1,319 @@
+/*************************************************************************
+ *
+ *  (c) 2024 Rajit Manohar
+ *
+ *************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <common/ext.h>
+#include <common/misc.h>
+#include "lvs.h"
+
+/*
+ *  Hierarchical checking.
+ *
+ *  Every unique subcell that has a <cell>.prs file next to its
+ *  <cell>.ext file is checked once, bottom-up, before the top-level
+ *  cell. A successful check leaves a <cell>.hxt summary with the
+ *  exported interface of the cell; ext_read() then uses the summary
+ *  instead of flattening the cell when it is instantiated in a parent.
+ *
+ *  The .hxt file also serves as the result cache: a cell is only
+ *  re-checked if its .ext timestamp is newer than the one recorded in
+ *  the .hxt file, the contents of its .prs file differ from the ones
+ *  that were checked (a hash of the .prs file is recorded in the .hxt
+ *  header, since file times are too coarse), or one of its subcells
+ *  was re-checked. Subcells without a .prs file are flattened into the
+ *  cell, so the hash in the header also covers the contents of their
+ *  .ext files (and those of the cells flattened into them).
+ */
+
+struct hcell {
+  int state;			/* 0 = unvisited, 1 = in progress, 2 = done */
+  int dirty;			/* 1 if the summary was regenerated */
+  unsigned long flat;		/* hash of the .ext files flattened into
+				   the parent; 0 if the cell has a
+				   summary */
+};
+
+static int hcheck_cached;	/* # of cells with a valid summary */
+static int hcheck_checked;	/* # of cells checked */
+static int hcheck_failed;	/* # of cells with errors */
+
+static char *_replace_suffix (const char *file, const char *suffix)
+{
+  char *s, *t;
+
+  MALLOC (s, char, strlen (file) + strlen (suffix) + 2);
+  strcpy (s, file);
+  t = s + strlen (s) - 1;
+  while (t != s && *t != '.' && *t != '/')
+    t--;
+  if (*t != '.')
+    t = s + strlen (s);
+  strcpy (t, suffix);
+  return s;
+}
+
+/*
+ *  Read the timestamp from the first line of a .ext/.hxt file;
+ *  returns 0 if the file doesn't exist or has no timestamp. If prshash
+ *  is non-NULL, it is set to the .prs hash recorded in a .hxt file
+ *  (0 if there isn't one).
+ */
+static unsigned long _read_timestamp (const char *file,
+				      unsigned long *prshash)
+{
+  FILE *fp;
+  char buf[MAXLINE];
+  unsigned long tm;
+
+  if (prshash) *prshash = 0;
+  fp = fopen (file, "r");
+  if (!fp) return 0;
+  tm = 0;
+  if (fgets (buf, MAXLINE, fp)) {
+    if (strncmp (buf, "timestamp ", 10) == 0 ||
+	strncmp (buf, "timestampF ", 11) == 0) {
+      if (prshash) {
+	if (sscanf (buf+10+(buf[9] == 'F'), "%lu prs %lx", &tm, prshash) != 2)
+	  *prshash = 0;
+      }
+      else {
+	sscanf (buf+10+(buf[9] == 'F'), "%lu", &tm);
+      }
+    }
+  }
+  fclose (fp);
+  return tm;
+}
+
+/*
+ *  64-bit FNV-1a hash of the contents of a file, never 0; returns 0
+ *  if the file can't be read.
+ */
+static unsigned long _file_hash (const char *file)
+{
+  FILE *fp;
+  unsigned char buf[8192];
+  unsigned long h;
+  size_t i, n;
+
+  fp = fopen (file, "r");
+  if (!fp) return 0;
+  h = 0xcbf29ce484222325UL;
+  while ((n = fread (buf, 1, sizeof (buf), fp)) > 0) {
+    for (i=0; i < n; i++) {
+      h ^= buf[i];
+      h *= 0x100000001b3UL;
+    }
+  }
+  fclose (fp);
+  return h ? h : 1;
+}
+
+/* fold x into the running hash h */
+static unsigned long _hash_mix (unsigned long h, unsigned long x)
+{
+  int i;
+  for (i=0; i < 8; i++) {
+    h ^= (x >> (8*i)) & 0xff;
+    h *= 0x100000001b3UL;
+  }
+  return h ? h : 1;
+}
+
+static time_t _mtime (const char *file)
+{
+  struct stat st;
+  if (stat (file, &st) != 0) return 0;
+  return st.st_mtime;
+}
+
+/*
+ *  Run the check for one cell in a child process, since the checker
+ *  keeps its state in globals. Returns 0 on success.
+ */
+static int _check_cell (const char *cell, const char *extfile,
+			const char *prsfile, const char *hxtfile)
+{
+  pid_t pid;
+  int status;
+  FILE *prs, *dmp;
+
+  pp_flush (PPout);
+  fflush (stdout);
+  fflush (stderr);
+
+  pid = fork ();
+  if (pid < 0) {
+    fatal_error ("fork() failed while checking `%s'", cell);
+  }
+  if (pid == 0) {
+    if (!(prs = fopen (prsfile, "r")))
+      fatal_error ("Unable to open file %s for reading.\n", prsfile);
+    if (!(dmp = fopen (hxtfile, "w")))
+      fatal_error ("Unable to open dump file %s for writing.\n", hxtfile);
+    dump_hier_file = 1;
+    exit_status = 0;
+    lvs ((char *)extfile, NULL, prs, NULL, dmp);
+    fclose (dmp);
+    pp_flush (PPout);
+    fflush (stdout);
+    _exit (exit_status);
+  }
+  if (waitpid (pid, &status, 0) < 0) {
+    fatal_error ("waitpid() failed while checking `%s'", cell);
+  }
+  if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+    /* never cache a failed check; the cell is flattened in its
+       parents instead */
+    unlink (hxtfile);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ *  Post-order walk of the subcell hierarchy. Returns 1 if the summary
+ *  for this cell (or any cell below it) was regenerated. *flat is set
+ *  to the hash of the .ext files that are flattened into the parent
+ *  when this cell is instantiated (0 if the cell has a summary).
+ */
+static int _hier_check (const char *file, struct Hashtable *H, int top,
+			unsigned long *flat)
+{
+  FILE *fp;
+  char buf[MAXLINE];
+  char *s, *extfile, *prsfile, *hxtfile;
+  hash_bucket_t *b;
+  struct hcell *hc;
+  int dirty;
+  unsigned long tm, hash, oldhash, subflat, cflat;
+
+  b = hash_lookup (H, file);
+  if (b) {
+    hc = (struct hcell *) b->v;
+    if (hc->state == 1)
+      fatal_error ("Cell `%s' instantiates itself!", file);
+    *flat = hc->flat;
+    return hc->dirty;
+  }
+  b = hash_add (H, file);
+  NEW (hc, struct hcell);
+  hc->state = 1;
+  hc->dirty = 0;
+  hc->flat = 0;
+  b->v = hc;
+
+  extfile = ext_find_file (file);
+  if (!extfile)
+    fatal_error ("Could not find cell %s", file);
+
+  /* check all subcells first */
+  dirty = 0;
+  subflat = 0xcbf29ce484222325UL;
+  fp = fopen (extfile, "r");
+  if (!fp)
+    fatal_error ("Unable to open file %s for reading.\n", extfile);
+  buf[MAXLINE-1] = '\n';
+  while (fgets (buf, MAXLINE, fp)) {
+    if (buf[MAXLINE-1] == '\0')
+      fatal_error ("This needs to be fixed!");      /* FIXME */
+    if (strncmp (buf, "use ", 4) == 0) {
+      s = buf+4;
+      while (*s && *s != ' ' && *s != '\n') s++;
+      *s = '\0';
+      strcat (buf, ".ext");
+      dirty |= _hier_check (buf+4, H, 0, &cflat);
+      subflat = _hash_mix (subflat, cflat);
+    }
+  }
+  fclose (fp);
+
+  if (!top) {
+    prsfile = _replace_suffix (extfile, ".prs");
+    hxtfile = _replace_suffix (extfile, ".hxt");
+    if (_mtime (prsfile) == 0) {
+      /* no production rules; the cell is flattened into its parent */
+      hc->flat = _hash_mix (_file_hash (extfile), subflat);
+      if (verbose) {
+	pp_printf (PPout, "No prs file for `%s', flattened", file);
+	pp_forced (PPout, 0);
+      }
+    }
+    else {
+      tm = _read_timestamp (hxtfile, &oldhash);
+      hash = _hash_mix (_file_hash (prsfile), subflat);
+      if (!dirty && tm != 0 && tm >= _read_timestamp (extfile, NULL) &&
+	  oldhash == hash) {
+	hcheck_cached++;
+	if (verbose) {
+	  pp_printf (PPout, "Using summary for `%s'", file);
+	  pp_forced (PPout, 0);
+	}
+      }
+      else {
+	pp_printf (PPout, "Checking cell `%s'...", file);
+	pp_forced (PPout, 0);
+	hcheck_checked++;
+	dirty = 1;
+	dump_hier_prshash = hash;
+	if (_check_cell (file, extfile, prsfile, hxtfile) != 0) {
+	  hcheck_failed++;
+	  exit_status = 1;
+	  pp_printf (PPout, "Cell `%s' has errors", file);
+	  pp_forced (PPout, 0);
+	}
+	dump_hier_prshash = 0;
+      }
+    }
+    FREE (prsfile);
+    FREE (hxtfile);
+  }
+  FREE (extfile);
+
+  hc->state = 2;
+  hc->dirty = dirty;
+  *flat = hc->flat;
+  return dirty;
+}
+
+/*------------------------------------------------------------------------
+ *
+ *  hier_check_subcells --
+ *
+ *     Check all subcells of "name" that have production rules, and
+ *     generate their summary files.
+ *
+ *------------------------------------------------------------------------
+ */
+void hier_check_subcells (char *name)
+{
+  struct Hashtable *H;
+  hash_bucket_t *b;
+  unsigned long flat;
+  int i;
+
+  hcheck_cached = 0;
+  hcheck_checked = 0;
+  hcheck_failed = 0;
+
+  H = hash_new (16);
+  _hier_check (name, H, 1, &flat);
+  for (i=0; i < H->size; i++)
+    for (b = H->head[i]; b; b = b->next)
+      FREE (b->v);
+  hash_free (H);
+
+  pp_printf (PPout, "Hierarchical check: %d cell%s checked, %d cached, %d with errors",
+	     hcheck_checked, hcheck_checked == 1 ? "" : "s", hcheck_cached,
+	     hcheck_failed);
+  pp_forced (PPout, 0);
+  pp_flush (PPout);
+}
@@ -500,6 +500,8 @@ lvs (char *name, FILE *sim, FILE *prs, FILE *aliases, FILE *dump)
   if (extract_file) {
     ext_validate_timestamp (name);
     //ext = parse_ext_file (sim, NULL, NULL);
+    ext_set_threads (lvp_threads);
+    ext_set_cache (cache_ext_files);
     ext = ext_read (name);
     flatten_ext_file (ext, V);
   }
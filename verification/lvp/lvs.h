@@ -87,6 +87,14 @@ extern int no_sneak_path_check;	        /* don't check sneak paths */
 
 extern int dump_hier_file;	        /* create output dump */
 extern int dump_hier_force;
+extern unsigned long dump_hier_prshash; /* .prs (and flattened .ext) hash
+					  for the dump, or 0 */
+
+extern int hier_check_cells;	        /* check subcells hierarchically */
+
+extern int lvp_threads;		        /* # of threads for sneak paths */
+
+extern int cache_ext_files;	        /* cache parsed extract files */
 
 extern int connect_globals_in_prs;      /* connect globals in prs file only */
 
@@ -149,6 +157,7 @@ extern void inc_naming_violations (void);
 extern void inc_sneak_paths (void);
 
 void flatten_ext_file (struct ext_file *ext, VAR_T *V);
+void hier_check_subcells (char *name);
 void initialize (int *argc, char ***argv);
 
 
@@ -79,6 +79,14 @@ int no_sneak_path_check;	/* don't check sneak paths */
 
 int dump_hier_file;		/* create output dump */
 int dump_hier_force;
+unsigned long dump_hier_prshash; /* .prs (and flattened .ext) hash
+				   for the dump, or 0 */
+
+int hier_check_cells;		/* check subcells hierarchically */
+
+int lvp_threads;		/* # of threads for sneak path checks */
+
+int cache_ext_files;		/* cache parsed extract files */
 
 int connect_globals_in_prs;     /* connect global names in prs file only */
 
@@ -188,6 +196,8 @@ void usage (void)
     " -g         keep trailing \"!\" for globals; don't strip it [off]",
     " -h         nodes ending in \"&\" are not output nodes [off]",
     " -i         print gate list from Vdd/GND to precharged node [off]",
+    " -j num     use \"num\" threads for reading extract files and sneak",
+    "            path checks; 0 = all cpus [1]",
     " -n         treat named nodes as output nodes [off]",
     " -o ratio   fraction of coupling to take into account [0.25]",
     " -p         print production rules from layout [off]",
@@ -203,10 +213,14 @@ void usage (void)
     " -G name    use \"name\" as GND [GND]",
     " -H         hierarchical analysis (requires -sE) [off]",
     " -K         overkill mode for charge-sharing analysis [off]",
+    " -M         check subcells with a .prs file once, bottom-up, and",
+    "            use their .hxt summaries; unchanged cells are not",
+    "            re-checked (requires -sE) [off]",
     " -P         generate pass transistors (n passes GND, p passes Vdd) [off]",
     " -R         merge _xResety signals with _Reset [off]",
     " -S         don't look for sneak paths [off]",
     " -V name    use \"name\" as Vdd [Vdd]",
+    " -X         cache parsed extract files in binary .extb files [off]",
 #if 0
     " -W         return non-zero exit status on any warnings [off]",
 #endif
@@ -327,6 +341,9 @@ void parse_arguments (int argc, char **eargv, char **file1, char **file2)
   no_sneak_path_check = 0;
   dump_hier_file = 0;
   dump_hier_force = 0;
+  hier_check_cells = 0;
+  lvp_threads = 1;
+  cache_ext_files = 0;
   connect_globals_in_prs = 1;
   wizard = 0;
   N_P_Ratio = 0.5;
@@ -354,7 +371,7 @@ void parse_arguments (int argc, char **eargv, char **file1, char **file2)
   prefix_reset = 0;
 
   opterr = 0;
-  while ((ch=getopt (argc,argv,"bHcCEfnBapgRPDz:hvr:w:sV:G:SZo:deKi"))!=-1){
+  while ((ch=getopt (argc,argv,"bHMcCEfnBapgRPDz:hvr:w:sV:G:SXZo:deKij:"))!=-1){
     switch (ch) {
     case 'R':
       prefix_reset = 1;
@@ -362,6 +379,11 @@ void parse_arguments (int argc, char **eargv, char **file1, char **file2)
     case 'i':
       dump_pchg_paths = 1;
       break;
+    case 'j':
+      sscanf (optarg, "%d", &lvp_threads);
+      if (lvp_threads < 0)
+	fatal_error ("-j: number of threads must be non-negative");
+      break;
     case 'K':
       display_all_bumps = overkill_mode;
       overkill_mode = 1;
@@ -382,9 +404,15 @@ void parse_arguments (int argc, char **eargv, char **file1, char **file2)
       if (dump_hier_file) dump_hier_force = 1;
       dump_hier_file = 1;
       break;
+    case 'M':
+      hier_check_cells = 1;
+      break;
     case 'S':
       no_sneak_path_check = 1;
       break;
+    case 'X':
+      cache_ext_files = 1;
+      break;
     case 'c':
       connect_warn_only = 1;
       break;
@@ -523,14 +551,14 @@ void parse_arguments (int argc, char **eargv, char **file1, char **file2)
     *file2 = argv[optind+1];
   }
   
-  if (dump_hier_file && 
+  if ((dump_hier_file || hier_check_cells) && 
       (!extract_file || no_sneak_path_check 
        ||  (!dump_hier_force && connect_globals)
        || !check_staticizers || connect_warn_only || print_only )) {
     usage ();
-    pp_printf (PPout, "-H requires: -sE");
+    pp_printf (PPout, "-H/-M requires: -sE");
     pp_forced (PPout, 0);
-    pp_printf (PPout, "-H excludes: -cBSp");
+    pp_printf (PPout, "-H/-M excludes: -cBSp");
     pp_forced (PPout, 0);
     fatal_error ("Hierarchical analysis incompatible with these options.");
   }
@@ -637,6 +665,8 @@ int main (int argc, char **argv)
     PPdump = pp_init (stdout, 72);
   else
     PPdump = NULL;
+  if (hier_check_cells)
+    hier_check_subcells (file1);
   lvs (file1, fp1, fp2, al, dmp);
   pp_close (PPout);
   if (print_only || pr_aliases) pp_close (PPdump);
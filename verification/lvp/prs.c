@@ -3789,7 +3789,12 @@ void save_io_nodes (VAR_T *V, FILE *fp, unsigned long stamp)
   int c;
   extern int exports_found;
 
-  fprintf (fp, "timestamp%c %lu\n", dump_hier_force ? 'F' : ' ', stamp);
+  fprintf (fp, "timestamp%c %lu", dump_hier_force ? 'F' : ' ', stamp);
+  if (dump_hier_prshash) {
+    /* content hash of the .prs file, used by the -M result cache */
+    fprintf (fp, " prs %lx", dump_hier_prshash);
+  }
+  fprintf (fp, "\n");
 
   vdd = var_locate (V, Vddnode);
   gnd = var_locate (V, GNDnode);
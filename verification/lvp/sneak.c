@@ -7,18 +7,50 @@
 #include "lvs.h"
 #include "parse.h"
 #include <common/misc.h>
+#include <common/array.h>
+#include <common/workpool.h>
 
 extern var_t *ResetVar, *_ResetVar;
 static var_t *vdd, *gnd;
 
-static var_t **output_scc_nodes;
-static int noutputs;
-    /* used to store list of output nodes when checking sneak paths */
+/*
+ *  The sneak path search is independent for each channel-connected
+ *  component of the n (or p) network. Components are collected
+ *  serially into a compact graph that only contains the edges the
+ *  search can traverse, and then searched on a pool of threads. The
+ *  search does not touch the var_t flags, so each thread only needs
+ *  its own visit marks and edge stack. Errors are saved with the
+ *  component, and reported in component order once all searches are
+ *  done, so the output does not depend on the number of threads.
+ */
+struct sneak_err {
+  int from, to;			/* output nodes shorted together */
+  int npath;
+  var_t **path;			/* gates on the path (if verbose) */
+};
+
+struct sneak_comp {
+  int type;			/* N_TYPE or P_TYPE */
+  int n;			/* # of nodes */
+  var_t **node;			/* nodes in the component */
+  int nout;
+  int *out;			/* output nodes, in discovery order */
+  int *adj;			/* edges from i: adj[i] .. adj[i+1]-1 */
+  int *to;			/* edge destination */
+  var_t **gate;			/* edge gate */
+  unsigned char *stop;		/* output node that ends the search */
+  unsigned char *skip;		/* don't start a search here */
+  A_DECL (struct sneak_err, err);
+};
+
+struct sneak_scratch {
+  int nvisited;
+  unsigned char *visited;	/* visit marks */
+  int edges, nedges;
+  var_t **edge_list;		/* gates on the current search path */
+};
 
-static var_t **edge_list;
-static int edges = 0;
-static int nedges;
-    /* used to store list of edges so far in the search tree */
+L_A_DECL (struct sneak_comp *, sneak_comps);
 
 
 /*------------------------------------------------------------------------
@@ -112,85 +144,80 @@ static void prune_paths (var_t *supply, int type)
   }
 }
 
+
 /*------------------------------------------------------------------------
  *
- *  dfs to check for sneak paths
+ *  1 if the search for sneak paths can traverse edge e of the
+ *  specified type
  *
  *------------------------------------------------------------------------
  */
-static var_t *run_dfs (var_t *v, int type)
+static int sneak_edge (edgelist_t *e, int type)
 {
-  var_t *tmp;
-  edgelist_t *e;
-  int i;
-  
-  v->flags |= VAR_VISITED;
-  for (e = v->edges; e ; e = e->next) {
-    if (e->isweak || (e->type != type) || (e->t1->flags & VAR_PRUNE(type))
-	/* no need to visit this edge */
-	|| (e->t1->flags & VAR_VISITED) 
-    	   /* back edge */
-	|| (e->t1 == vdd || e->t1 == gnd || (e->t1->flags & VAR_RESET_SUPPLY))
-	   /* to power supply */
-	|| ((e->gate == vdd || e->gate == _ResetVar) && type == P_TYPE) 
-	   /* thru cut-off transistor */
-	|| ((e->gate == gnd || e->gate == ResetVar) && type == N_TYPE)
-   	   /* to power supply, or thru cut-off transistor */
-	)
-      continue;
-    for (i=0; i < edges; i++)
-      if (exclusive_nodes (e->gate, edge_list[i],type)) break;
-    if (i != edges) continue;
-    /* traverse this edge */
-    if (edges == nedges) {
-      nedges *= 2;
-      REALLOC (edge_list, var_t *, nedges);
-    }
-    edge_list[edges++] = e->gate;
-    if ((e->t1->flags & VAR_OUTPUT) && 
-	!(e->t1->flags & (type == P_TYPE ? VAR_SKIPSNEAKP : VAR_SKIPSNEAKN))) {
-      /* short to another output node */
-      v->flags &= ~VAR_VISITED;
-      return e->t1;
-    }
-    if ((tmp = run_dfs (e->t1,type))) {
-      v->flags &= ~VAR_VISITED;
-      return tmp;
-    }
-    edges--;
-  }
-  v->flags &= ~VAR_VISITED;
-  return NULL;
+  if (e->isweak || (e->type != type) || (e->t1->flags & VAR_PRUNE(type))
+      /* no need to visit this edge */
+      || (e->t1 == vdd || e->t1 == gnd || (e->t1->flags & VAR_RESET_SUPPLY))
+      /* to power supply */
+      || ((e->gate == vdd || e->gate == _ResetVar) && type == P_TYPE) 
+      /* thru cut-off transistor */
+      || ((e->gate == gnd || e->gate == ResetVar) && type == N_TYPE)
+      /* to power supply, or thru cut-off transistor */
+      )
+    return 0;
+  return 1;
 }
 
-
-static void check_sneak_scc_p (var_t *v, var_t *gnd, var_t *vdd)
+/*------------------------------------------------------------------------
+ *
+ *  sneak_collect --
+ *
+ *    Collect the channel-connected component of the specified type
+ *    that contains output node v. Components with more than one
+ *    output node are saved for the sneak path search.
+ *
+ *------------------------------------------------------------------------
+ */
+static void sneak_collect (var_t *v, int type)
 {
-  var_t *hd, *tl, *t;
+  L_A_DECL (var_t *, nodes);
+  L_A_DECL (int, outs);
+  struct sneak_comp *c;
+  var_t *hd, *tl, *t, *other;
   edgelist_t *e;
-  int outputs = 0;
-  int i, j;
+  unsigned int mark;
+  int i, k;
+
+  if (type == P_TYPE) {
+    mark = VAR_SNEAKEDP;
+    other = gnd;
+  }
+  else {
+    mark = VAR_SNEAKEDN;
+    other = vdd;
+  }
+
+  A_LEN_RAW (nodes) = 0;
+  A_LEN_RAW (outs) = 0;
 
   hd = v;
   tl = v;
-  hd->flags |= VAR_SNEAKEDP;
+  hd->flags |= mark;
 
-  /*
-   * mark nodes in scc with VAR_SNEAKEDN, and clear their dn fields.
-   */
   while (hd) {
+    hd->idx = A_LEN (nodes);
+    A_NEW (nodes, var_t *);
+    A_NEXT (nodes) = hd;
+    A_INC (nodes);
     if (hd->flags & VAR_OUTPUT) {
-      if (outputs == noutputs) {
-	noutputs *= 2;
-	REALLOC (output_scc_nodes, var_t *, noutputs);
-      }
-      output_scc_nodes[outputs++] = hd;
+      A_NEW (outs, int);
+      A_NEXT (outs) = hd->idx;
+      A_INC (outs);
     }
     for (e = hd->edges; e; e = e->next) {
-      if (e->isweak || e->type == N_TYPE || e->t1 == gnd) continue;
-      if (e->t1->flags & VAR_PRUNEP) continue;
-      if (e->t1->flags & VAR_SNEAKEDP) continue;
-      e->t1->flags |= VAR_SNEAKEDP;
+      if (e->isweak || e->type != type || e->t1 == other) continue;
+      if (e->t1->flags & VAR_PRUNE(type)) continue;
+      if (e->t1->flags & mark) continue;
+      e->t1->flags |= mark;
       tl->worklist = e->t1;
       tl = e->t1;
       tl->worklist = NULL;
@@ -200,111 +227,195 @@ static void check_sneak_scc_p (var_t *v, var_t *gnd, var_t *vdd)
     t->worklist = NULL;
   }
 
-  if (outputs == 1) return;
-
-  for (i=0; i < outputs; i++) {
-    if (output_scc_nodes[i] == NULL) continue;
-    if (output_scc_nodes[i]->flags & VAR_SKIPSNEAKP) continue;
-    edges = 0;
-    if ((hd = run_dfs (output_scc_nodes[i],P_TYPE))) {
-      for (j=i+1; j < outputs; j++)
-	if (output_scc_nodes[j] == hd) output_scc_nodes[j] = NULL;
-      pp_printf (PPout, "Sneak path P: %s <-> %s", 
-		 var_name(output_scc_nodes[i]), var_name(hd));
-      pp_forced (PPout, 0);
-      inc_sneak_paths ();
-      if (verbose) {
-	pp_puts (PPout, "     ");
-	pp_setb (PPout);
-	for (j=0; j < edges; j++) {
-	  pp_puts (PPout, var_name (edge_list[j]));
-	  if (j != (edges-1)) {
-	    pp_puts (PPout, ", ");
-	    pp_lazy (PPout, 3);
-	  }
-	}
-	pp_endb (PPout);
-	pp_forced (PPout, 0);
-      }
+  if (A_LEN (outs) == 1) return;
+
+  NEW (c, struct sneak_comp);
+  c->type = type;
+  c->n = A_LEN (nodes);
+  MALLOC (c->node, var_t *, c->n);
+  MALLOC (c->stop, unsigned char, c->n);
+  MALLOC (c->skip, unsigned char, c->n);
+  MALLOC (c->adj, int, c->n+1);
+  for (i=0; i < c->n; i++) {
+    t = nodes[i];
+    c->node[i] = t;
+    c->stop[i] = (t->flags & VAR_OUTPUT) &&
+      !(t->flags & (type == P_TYPE ? VAR_SKIPSNEAKP : VAR_SKIPSNEAKN));
+    c->skip[i] = (t->flags & (type == P_TYPE ? VAR_SKIPSNEAKP : VAR_SKIPSNEAKN)) ? 1 : 0;
+  }
+  c->nout = A_LEN (outs);
+  MALLOC (c->out, int, c->nout);
+  for (i=0; i < c->nout; i++) {
+    c->out[i] = outs[i];
+  }
+
+  k = 0;
+  for (i=0; i < c->n; i++) {
+    for (e = c->node[i]->edges; e; e = e->next) {
+      if (sneak_edge (e, type)) k++;
     }
   }
+  if (k == 0) k = 1;
+  MALLOC (c->to, int, k);
+  MALLOC (c->gate, var_t *, k);
+  k = 0;
+  for (i=0; i < c->n; i++) {
+    c->adj[i] = k;
+    for (e = c->node[i]->edges; e; e = e->next) {
+      if (!sneak_edge (e, type)) continue;
+      Assert (e->t1->idx >= 0 && e->t1->idx < c->n &&
+	      c->node[e->t1->idx] == e->t1, "Sneak path component?");
+      c->to[k] = e->t1->idx;
+      /* canonical gates, so the search does not update alias pointers */
+      c->gate[k] = canonical_name (e->gate);
+      k++;
+    }
+  }
+  c->adj[c->n] = k;
+  A_INIT (c->err);
 
+  A_NEW (sneak_comps, struct sneak_comp *);
+  A_NEXT (sneak_comps) = c;
+  A_INC (sneak_comps);
 }
 
 /*------------------------------------------------------------------------
  *
- *  check_sneak_scc_n --
+ *  dfs to check for sneak paths
  *
- *    Look for sneak paths in a strongly connected component of the graph.
+ *------------------------------------------------------------------------
+ */
+static int run_dfs (struct sneak_comp *c, struct sneak_scratch *s, int v)
+{
+  int k, i, t, tmp;
+
+  s->visited[v] = 1;
+  for (k = c->adj[v]; k < c->adj[v+1]; k++) {
+    t = c->to[k];
+    if (s->visited[t])
+      /* back edge */
+      continue;
+    for (i=0; i < s->edges; i++)
+      if (exclusive_nodes (c->gate[k], s->edge_list[i], c->type)) break;
+    if (i != s->edges) continue;
+    /* traverse this edge */
+    if (s->edges == s->nedges) {
+      s->nedges *= 2;
+      REALLOC (s->edge_list, var_t *, s->nedges);
+    }
+    s->edge_list[s->edges++] = c->gate[k];
+    if (c->stop[t]) {
+      /* short to another output node */
+      s->visited[v] = 0;
+      return t;
+    }
+    if ((tmp = run_dfs (c, s, t)) >= 0) {
+      s->visited[v] = 0;
+      return tmp;
+    }
+    s->edges--;
+  }
+  s->visited[v] = 0;
+  return -1;
+}
+
+/*------------------------------------------------------------------------
+ *
+ *  check_sneak_comp --
+ *
+ *    Look for sneak paths in one channel-connected component; this is
+ *    run by the thread pool.
  *
  *------------------------------------------------------------------------
  */
-static void check_sneak_scc_n (var_t *v, var_t *gnd, var_t *vdd)
+static void check_sneak_comp (void *cookie, int job, int tid)
 {
-  var_t *hd, *tl, *t;
-  edgelist_t *e;
-  int outputs = 0;
-  int i, j;
+  struct sneak_scratch *s = ((struct sneak_scratch *)cookie) + tid;
+  struct sneak_comp *c = sneak_comps[job];
+  struct sneak_err *err;
+  int i, j, hd;
 
-  hd = v;
-  tl = v;
-  hd->flags |= VAR_SNEAKEDN;
+  if (s->nvisited < c->n) {
+    if (s->nvisited == 0) {
+      MALLOC (s->visited, unsigned char, c->n);
+    }
+    else {
+      REALLOC (s->visited, unsigned char, c->n);
+    }
+    for (i=s->nvisited; i < c->n; i++) {
+      s->visited[i] = 0;
+    }
+    s->nvisited = c->n;
+  }
 
-  /*
-   * mark nodes in scc with VAR_SNEAKEDN, and clear their dn fields.
-   */
-  while (hd) {
-    if (hd->flags & VAR_OUTPUT) {
-      if (outputs == noutputs) {
-	noutputs *= 2;
-	REALLOC (output_scc_nodes, var_t *, noutputs);
+  for (i=0; i < c->nout; i++) {
+    if (c->out[i] < 0) continue;
+    if (c->skip[c->out[i]]) continue;
+    s->edges = 0;
+    if ((hd = run_dfs (c, s, c->out[i])) >= 0) {
+      for (j=i+1; j < c->nout; j++)
+	if (c->out[j] == hd) c->out[j] = -1;
+      A_NEW (c->err, struct sneak_err);
+      err = &A_NEXT (c->err);
+      err->from = c->out[i];
+      err->to = hd;
+      err->npath = 0;
+      err->path = NULL;
+      if (verbose && s->edges > 0) {
+	err->npath = s->edges;
+	MALLOC (err->path, var_t *, s->edges);
+	for (j=0; j < s->edges; j++) {
+	  err->path[j] = s->edge_list[j];
+	}
       }
-      output_scc_nodes[outputs++] = hd;
-    }
-    for (e = hd->edges; e; e = e->next) {
-      if (e->isweak || e->type == P_TYPE || e->t1 == vdd) continue;
-      if (e->t1->flags & VAR_PRUNEN) continue;
-      if (e->t1->flags & VAR_SNEAKEDN) continue;
-      e->t1->flags |= VAR_SNEAKEDN;
-      tl->worklist = e->t1;
-      tl = e->t1;
-      tl->worklist = NULL;
+      A_INC (c->err);
     }
-    t = hd;
-    hd = hd->worklist;
-    t->worklist = NULL;
   }
+}
 
-  if (outputs == 1) return;
-
-  for (i=0; i < outputs; i++) {
-    if (output_scc_nodes[i] == NULL) continue;
-    if (output_scc_nodes[i]->flags & VAR_SKIPSNEAKN) continue;
-    edges = 0;
-    if ((hd = run_dfs (output_scc_nodes[i],N_TYPE))) {
-      for (j=i+1; j < outputs; j++)
-	if (output_scc_nodes[j] == hd) output_scc_nodes[j] = NULL;
-      pp_printf (PPout, "Sneak path N: %s <-> %s", 
-		 var_name(output_scc_nodes[i]), var_name(hd));
-      pp_forced (PPout, 0);
-      inc_sneak_paths ();
-      if (verbose) {
-	pp_puts (PPout, "     ");
-	pp_setb (PPout);
-	for (j=0; j < edges; j++) {
-	  pp_puts (PPout, var_name (edge_list[j]));
-	  if (j != (edges-1)) {
-	    pp_puts (PPout, ", ");
-	    pp_lazy (PPout, 3);
-	  }
+static void report_sneak_comp (struct sneak_comp *c)
+{
+  struct sneak_err *err;
+  int i, j;
+
+  for (i=0; i < A_LEN (c->err); i++) {
+    err = &c->err[i];
+    pp_printf (PPout, "Sneak path %c: %s <-> %s", c->type == P_TYPE ? 'P' : 'N',
+	       var_name(c->node[err->from]), var_name(c->node[err->to]));
+    pp_forced (PPout, 0);
+    inc_sneak_paths ();
+    if (verbose) {
+      pp_puts (PPout, "     ");
+      pp_setb (PPout);
+      for (j=0; j < err->npath; j++) {
+	pp_puts (PPout, var_name (err->path[j]));
+	if (j != (err->npath-1)) {
+	  pp_puts (PPout, ", ");
+	  pp_lazy (PPout, 3);
 	}
-	pp_endb (PPout);
-	pp_forced (PPout, 0);
       }
+      pp_endb (PPout);
+      pp_forced (PPout, 0);
+    }
+    if (err->path) {
+      FREE (err->path);
     }
   }
 }
 
+static void free_sneak_comp (struct sneak_comp *c)
+{
+  FREE (c->node);
+  FREE (c->out);
+  FREE (c->adj);
+  FREE (c->to);
+  FREE (c->gate);
+  FREE (c->stop);
+  FREE (c->skip);
+  A_FREE (c->err);
+  FREE (c);
+}
+
 
 /*------------------------------------------------------------------------
  *
@@ -318,33 +429,57 @@ static void check_sneak_scc_n (var_t *v, var_t *gnd, var_t *vdd)
 void check_sneak_paths (VAR_T *V)
 {
   var_t *v;
-  edgelist_t *e;
+  struct sneak_scratch *s;
+  int i, nth;
 
   vdd = var_locate (V, Vddnode);
   gnd = var_locate (V, GNDnode);
   
-  MALLOC (output_scc_nodes, var_t *, 10);
-  noutputs = 10;
-  MALLOC (edge_list, var_t *, 100);
-  nedges = 100;
-
   if (vdd) vdd->flags |= VAR_PRUNEN|VAR_PRUNEP;
   if (gnd) gnd->flags |= VAR_PRUNEN|VAR_PRUNEP;
 
   if (vdd) prune_paths (vdd, P_TYPE);
   if (gnd) prune_paths (gnd, N_TYPE);
 
+  A_LEN_RAW (sneak_comps) = 0;
   for (v = var_step_first (V); v; v = var_step_next (V)) {
     if (!(v->flags & VAR_OUTPUT)) continue;
     if (!(v->flags & VAR_PRUNEP) && !(v->flags & VAR_SNEAKEDP) 
 	&& !(v->flags & VAR_SKIPSNEAKP))
-      check_sneak_scc_p (v,gnd,vdd);
+      sneak_collect (v, P_TYPE);
     if (!(v->flags & VAR_PRUNEN) && !(v->flags & VAR_SNEAKEDN)
 	&& !(v->flags & VAR_SKIPSNEAKN))
-      check_sneak_scc_n (v,gnd,vdd);
+      sneak_collect (v, N_TYPE);
+  }
+
+  /* compress alias paths, so canonical_name() is read-only during the
+     parallel search */
+  for (v = var_step_first (V); v; v = var_step_next (V))
+    (void) canonical_name (v);
+
+  nth = lvp_threads > 0 ? lvp_threads : workpool_ncpus ();
+  MALLOC (s, struct sneak_scratch, nth);
+  for (i=0; i < nth; i++) {
+    s[i].nvisited = 0;
+    s[i].visited = NULL;
+    s[i].edges = 0;
+    s[i].nedges = 100;
+    MALLOC (s[i].edge_list, var_t *, s[i].nedges);
+  }
+
+  workpool_run (nth, A_LEN (sneak_comps), check_sneak_comp, s);
+
+  for (i=0; i < A_LEN (sneak_comps); i++) {
+    report_sneak_comp (sneak_comps[i]);
+    free_sneak_comp (sneak_comps[i]);
+  }
+  A_LEN_RAW (sneak_comps) = 0;
+
+  for (i=0; i < nth; i++) {
+    if (s[i].visited) {
+      FREE (s[i].visited);
+    }
+    FREE (s[i].edge_list);
   }
-  FREE (output_scc_nodes);
-  FREE (edge_list);
-  output_scc_nodes = NULL;
-  edge_list = NULL;
+  FREE (s);
 }
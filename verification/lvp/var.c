@@ -144,6 +144,7 @@ var_t *var_enter (VAR_T *V, char *s)
     v->hcell = 0;
     v->hname = 0;
     v->hc = NULL;
+    v->idx = -1;
 #ifndef DIGITAL_ONLY
     v->c.goodcap = 0.0;
     v->c.p_area = v->c.p_perim = 0;
@@ -277,7 +278,8 @@ var_t *canonical_name (var_t *v)
   if (root != o) {
     while (o->alias) {
       v = o->alias;
-      o->alias = root;
+      if (v != root)
+	o->alias = root;
       o = v;
     }
   }
@@ -195,6 +195,9 @@ typedef struct var {
   dots_t name_convert;		/* info about position of dots */
 
   hash_bucket_t *hc;		/* hash cell */
+
+  int idx;			/* index within a channel-connected */
+				/* component, for sneak path checks */
   
 #ifndef DIGITAL_ONLY
   struct capacitance c;		/* capacitance */